@@ -460,6 +460,22 @@ static int __kprobes do_page_fault(unsigned long addr, unsigned int esr,
 			die("Accessing user space memory outside uaccess.h routines", regs, esr);
 	}
 
+	/*
+	 * Try to handle user faults without the mmap_sem first. Speculative
+	 * faults never do I/O, so they are always minor.
+	 */
+	if (user_mode(regs)) {
+		fault = handle_speculative_fault(mm, addr & PAGE_MASK,
+						 mm_flags, vm_flags);
+		if (fault != VM_FAULT_RETRY) {
+			perf_sw_event(PERF_COUNT_SW_PAGE_FAULTS, 1, regs, addr);
+			tsk->min_flt++;
+			perf_sw_event(PERF_COUNT_SW_PAGE_FAULTS_MIN, 1, regs,
+				      addr);
+			goto return0;
+		}
+	}
+
 	/*
 	 * As per x86, we may deadlock here. However, since the kernel only
 	 * validly references user space from well defined areas of the code,
@@ -1316,6 +1316,20 @@ __do_page_fault(struct pt_regs *regs, unsigned long error_code,
 	if (error_code & PF_INSTR)
 		flags |= FAULT_FLAG_INSTRUCTION;
 
+	/*
+	 * Try to handle user faults without the mmap_sem first. Protection
+	 * key faults and reads from a present page always end up in
+	 * access_error(), leave them to the regular path.
+	 */
+	if ((error_code & PF_USER) && !(error_code & PF_PK) &&
+	    (error_code & (PF_WRITE | PF_PROT)) != PF_PROT) {
+		fault = handle_speculative_fault(mm, address, flags,
+				(error_code & PF_WRITE) ? VM_WRITE :
+				VM_READ | VM_EXEC | VM_WRITE);
+		if (fault != VM_FAULT_RETRY)
+			goto done;
+	}
+
 	/*
 	 * When running in the kernel we expect faults to occur only to
 	 * addresses in user space.  All other faults represent errors in
@@ -1435,6 +1449,7 @@ __do_page_fault(struct pt_regs *regs, unsigned long error_code,
 		return;
 	}
 
+done:
 	/*
 	 * Major/minor page fault accounting. If any of the events
 	 * returned VM_FAULT_MAJOR, we account it as a major fault.
@@ -0,0 +1,223 @@
+/*
+ * Same content page deduplication for zram
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/vmalloc.h>
+#include <linux/highmem.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
+
+#include "zram_drv.h"
+
+/* One hash bucket for every 1 << ZRAM_HASH_SHIFT pages of disksize */
+#define ZRAM_HASH_SHIFT		4
+#define ZRAM_HASH_SIZE_MIN	(1 << 10)
+
+/*
+ * Every object stored while dedup is enabled gets an entry. Slots that
+ * share the object hold a reference each, the object is freed along
+ * with the last one.
+ */
+struct zram_dedup_entry {
+	struct hlist_node node;
+	unsigned long handle;
+	unsigned int len;
+	u32 checksum;
+	unsigned long refcount;
+};
+
+static struct zram_hash *zram_dedup_bucket(struct zram_meta *meta,
+					u32 checksum)
+{
+	return &meta->hash[checksum & (meta->hash_size - 1)];
+}
+
+u32 zram_dedup_checksum(struct page *page)
+{
+	void *mem;
+	u32 checksum;
+
+	mem = kmap_atomic(page);
+	checksum = jhash2(mem, PAGE_SIZE / sizeof(u32), 0);
+	kunmap_atomic(mem);
+
+	return checksum;
+}
+
+/*
+ * Objects in the dedup table are always compressed by the primary
+ * algorithm, recompression skips them.
+ */
+static bool zram_dedup_match(struct zram *zram,
+			struct zram_dedup_entry *entry, struct page *page)
+{
+	struct zram_meta *meta = zram->meta;
+	void *cmem, *mem;
+	bool match;
+
+	cmem = zs_map_object(meta->mem_pool, entry->handle, ZS_MM_RO);
+	mem = kmap_atomic(page);
+	if (entry->len == PAGE_SIZE) {
+		match = !memcmp(mem, cmem, PAGE_SIZE);
+	} else {
+		struct zcomp *comp = zram->comps[ZRAM_PRIMARY_COMP];
+		struct zcomp_strm *zstrm = zcomp_stream_get(comp);
+
+		match = !zcomp_decompress(zstrm, cmem, entry->len,
+					zstrm->buffer) &&
+			!memcmp(mem, zstrm->buffer, PAGE_SIZE);
+		zcomp_stream_put(comp);
+	}
+	kunmap_atomic(mem);
+	zs_unmap_object(meta->mem_pool, entry->handle);
+
+	return match;
+}
+
+/*
+ * Look for an object with the same content as @page. On success a
+ * reference is taken on it and its handle returned, 0 otherwise.
+ */
+unsigned long zram_dedup_find(struct zram *zram, struct page *page,
+				u32 checksum, unsigned int *len)
+{
+	struct zram_hash *hash = zram_dedup_bucket(zram->meta, checksum);
+	struct zram_dedup_entry *entry;
+	unsigned long handle = 0;
+
+	spin_lock(&hash->lock);
+	hlist_for_each_entry(entry, &hash->head, node) {
+		if (entry->checksum != checksum)
+			continue;
+
+		if (!zram_dedup_match(zram, entry, page))
+			continue;
+
+		entry->refcount++;
+		handle = entry->handle;
+		*len = entry->len;
+		break;
+	}
+	spin_unlock(&hash->lock);
+
+	if (handle)
+		atomic64_add(*len, &zram->stats.dup_data_size);
+
+	return handle;
+}
+
+/*
+ * Index a newly stored object. Returns false if there was no memory
+ * for the entry, the object then stays private to its slot.
+ */
+bool zram_dedup_insert(struct zram *zram, unsigned long handle,
+				unsigned int len, u32 checksum)
+{
+	struct zram_hash *hash = zram_dedup_bucket(zram->meta, checksum);
+	struct zram_dedup_entry *entry;
+
+	entry = kmalloc(sizeof(*entry), GFP_NOIO | __GFP_NOWARN);
+	if (!entry)
+		return false;
+
+	entry->handle = handle;
+	entry->len = len;
+	entry->checksum = checksum;
+	entry->refcount = 1;
+
+	spin_lock(&hash->lock);
+	hlist_add_head(&entry->node, &hash->head);
+	spin_unlock(&hash->lock);
+
+	atomic64_add(sizeof(*entry), &zram->stats.meta_data_size);
+
+	return true;
+}
+
+/*
+ * Drop a slot's reference to @handle. Returns true if that was the
+ * last one and the caller has to free the object.
+ */
+bool zram_dedup_put(struct zram *zram, unsigned long handle, u32 checksum)
+{
+	struct zram_hash *hash = zram_dedup_bucket(zram->meta, checksum);
+	struct zram_dedup_entry *entry;
+	bool found = false;
+
+	spin_lock(&hash->lock);
+	hlist_for_each_entry(entry, &hash->head, node) {
+		if (entry->handle == handle) {
+			found = true;
+			break;
+		}
+	}
+
+	if (WARN_ON_ONCE(!found)) {
+		spin_unlock(&hash->lock);
+		return true;
+	}
+
+	if (--entry->refcount) {
+		spin_unlock(&hash->lock);
+		atomic64_sub(entry->len, &zram->stats.dup_data_size);
+		return false;
+	}
+
+	hlist_del(&entry->node);
+	spin_unlock(&hash->lock);
+
+	kfree(entry);
+	atomic64_sub(sizeof(*entry), &zram->stats.meta_data_size);
+
+	return true;
+}
+
+int zram_dedup_init(struct zram_meta *meta, size_t num_pages)
+{
+	size_t i;
+
+	meta->hash_size = max_t(size_t, num_pages >> ZRAM_HASH_SHIFT,
+				ZRAM_HASH_SIZE_MIN);
+	meta->hash_size = roundup_pow_of_two(meta->hash_size);
+	meta->hash = vzalloc(meta->hash_size * sizeof(struct zram_hash));
+	if (!meta->hash) {
+		pr_err("Error allocating zram entry hash\n");
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < meta->hash_size; i++) {
+		spin_lock_init(&meta->hash[i].lock);
+		INIT_HLIST_HEAD(&meta->hash[i].head);
+	}
+
+	return 0;
+}
+
+/* Free every indexed object, slots referencing them are already gone */
+void zram_dedup_fini(struct zram_meta *meta)
+{
+	struct zram_dedup_entry *entry;
+	struct hlist_node *tmp;
+	size_t i;
+
+	if (!meta->hash)
+		return;
+
+	for (i = 0; i < meta->hash_size; i++) {
+		hlist_for_each_entry_safe(entry, tmp, &meta->hash[i].head,
+					node) {
+			hlist_del(&entry->node);
+			zs_free(meta->mem_pool, entry->handle);
+			kfree(entry);
+		}
+	}
+
+	vfree(meta->hash);
+	meta->hash = NULL;
+	meta->hash_size = 0;
+}
@@ -31,6 +31,8 @@
 #include <linux/err.h>
 #include <linux/idr.h>
 #include <linux/sysfs.h>
+#include <linux/cpuhotplug.h>
+#include <linux/workqueue.h>
 
 #include "zram_drv.h"
 
@@ -75,7 +77,22 @@ static inline struct zram *dev_to_zram(struct device *dev)
 	return (struct zram *)dev_to_disk(dev)->private_data;
 }
 
-/* flag operations require table entry bit_spin_lock() being held */
+/*
+ * Each table entry carries its own lock in the ZRAM_ACCESS bit of ->value,
+ * so I/O to different slots never serialises on anything wider than the
+ * cache line holding the entry.
+ */
+static void zram_slot_lock(struct zram_meta *meta, u32 index)
+{
+	bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+}
+
+static void zram_slot_unlock(struct zram_meta *meta, u32 index)
+{
+	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+}
+
+/* flag operations require zram_slot_lock() being held */
 static int zram_test_flag(struct zram_meta *meta, u32 index,
 			enum zram_pageflags flag)
 {
@@ -94,6 +111,39 @@ static void zram_clear_flag(struct zram_meta *meta, u32 index,
 	meta->table[index].value &= ~BIT(flag);
 }
 
+#ifdef CONFIG_ZRAM_DEDUP
+static u32 zram_get_checksum(struct zram_meta *meta, u32 index)
+{
+	return meta->table[index].checksum;
+}
+
+static void zram_set_checksum(struct zram_meta *meta, u32 index,
+					u32 checksum)
+{
+	meta->table[index].checksum = checksum;
+}
+#else
+static u32 zram_get_checksum(struct zram_meta *meta, u32 index)
+{
+	return 0;
+}
+
+static void zram_set_checksum(struct zram_meta *meta, u32 index,
+					u32 checksum)
+{
+}
+#endif
+
+/*
+ * A slot holds data if it has a compressed object, a backing device
+ * block or a same-filled element.
+ */
+static bool zram_allocated(struct zram_meta *meta, u32 index)
+{
+	return meta->table[index].handle ||
+		zram_test_flag(meta, index, ZRAM_SAME);
+}
+
 static size_t zram_get_obj_size(struct zram_meta *meta, u32 index)
 {
 	return meta->table[index].value & (BIT(ZRAM_FLAG_SHIFT) - 1);
@@ -107,6 +157,26 @@ static void zram_set_obj_size(struct zram_meta *meta,
 	meta->table[index].value = (flags << ZRAM_FLAG_SHIFT) | size;
 }
 
+static void zram_set_priority(struct zram_meta *meta, u32 index, u32 prio)
+{
+	prio &= ZRAM_COMP_PRIORITY_MASK;
+	/*
+	 * Clear previous priority value first, in case if we recompress
+	 * further an already recompressed page
+	 */
+	meta->table[index].value &= ~((unsigned long)ZRAM_COMP_PRIORITY_MASK <<
+				      ZRAM_COMP_PRIORITY_BIT1);
+	meta->table[index].value |= ((unsigned long)prio <<
+				     ZRAM_COMP_PRIORITY_BIT1);
+}
+
+static u32 zram_get_priority(struct zram_meta *meta, u32 index)
+{
+	u32 prio = meta->table[index].value >> ZRAM_COMP_PRIORITY_BIT1;
+
+	return prio & ZRAM_COMP_PRIORITY_MASK;
+}
+
 static inline bool is_partial_io(struct bio_vec *bvec)
 {
 	return bvec->bv_len != PAGE_SIZE;
@@ -166,36 +236,629 @@ static inline void update_used_max(struct zram *zram,
 	} while (old_max != cur_max);
 }
 
-static bool page_zero_filled(void *ptr)
+static bool page_same_filled(void *ptr, unsigned long *element)
 {
 	unsigned int pos;
 	unsigned long *page;
+	unsigned long val;
 
 	page = (unsigned long *)ptr;
+	val = page[0];
 
-	for (pos = 0; pos != PAGE_SIZE / sizeof(*page); pos++) {
-		if (page[pos])
+	for (pos = 1; pos < PAGE_SIZE / sizeof(*page); pos++) {
+		if (val != page[pos])
 			return false;
 	}
 
+	*element = val;
+
 	return true;
 }
 
-static void handle_zero_page(struct bio_vec *bvec)
+static void zram_fill_page(char *ptr, unsigned long len,
+					unsigned long value)
 {
-	struct page *page = bvec->bv_page;
-	void *user_mem;
+	int i;
+	unsigned long *page = (unsigned long *)ptr;
 
-	user_mem = kmap_atomic(page);
-	if (is_partial_io(bvec))
-		memset(user_mem + bvec->bv_offset, 0, bvec->bv_len);
+	WARN_ON_ONCE(!IS_ALIGNED(len, sizeof(unsigned long)));
+
+	if (likely(value == 0)) {
+		memset(ptr, 0, len);
+	} else {
+		for (i = 0; i < len / sizeof(*page); i++)
+			page[i] = value;
+	}
+}
+
+static void zram_free_page(struct zram *zram, size_t index);
+static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
+				struct bio *bio, bool partial_io);
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+static bool zram_wb_enabled(struct zram *zram)
+{
+	return zram->backing_dev;
+}
+
+static void reset_bdev(struct zram *zram)
+{
+	struct block_device *bdev;
+
+	if (!zram_wb_enabled(zram))
+		return;
+
+	bdev = zram->bdev;
+	if (zram->old_block_size)
+		set_blocksize(bdev, zram->old_block_size);
+	blkdev_put(bdev, FMODE_READ|FMODE_WRITE|FMODE_EXCL);
+	/* hope filp_close flush all of IO */
+	filp_close(zram->backing_dev, NULL);
+	zram->backing_dev = NULL;
+	zram->old_block_size = 0;
+	zram->bdev = NULL;
+
+	vfree(zram->bitmap);
+	zram->bitmap = NULL;
+}
+
+static ssize_t backing_dev_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	struct file *file = zram->backing_dev;
+	char *p;
+	ssize_t ret;
+
+	down_read(&zram->init_lock);
+	if (!zram_wb_enabled(zram)) {
+		memcpy(buf, "none\n", 5);
+		up_read(&zram->init_lock);
+		return 5;
+	}
+
+	p = file_path(file, buf, PAGE_SIZE - 1);
+	if (IS_ERR(p)) {
+		ret = PTR_ERR(p);
+		goto out;
+	}
+
+	ret = strlen(p);
+	memmove(buf, p, ret);
+	buf[ret++] = '\n';
+out:
+	up_read(&zram->init_lock);
+	return ret;
+}
+
+static ssize_t backing_dev_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	char *file_name;
+	size_t sz;
+	struct file *backing_dev = NULL;
+	struct inode *inode;
+	struct address_space *mapping;
+	unsigned int bitmap_sz, old_block_size = 0;
+	unsigned long nr_pages, *bitmap = NULL;
+	struct block_device *bdev = NULL;
+	int err;
+	struct zram *zram = dev_to_zram(dev);
+
+	file_name = kmalloc(PATH_MAX, GFP_KERNEL);
+	if (!file_name)
+		return -ENOMEM;
+
+	down_write(&zram->init_lock);
+	if (init_done(zram)) {
+		pr_info("Can't setup backing device for initialized device\n");
+		err = -EBUSY;
+		goto out;
+	}
+
+	strlcpy(file_name, buf, PATH_MAX);
+	/* ignore trailing newline */
+	sz = strlen(file_name);
+	if (sz > 0 && file_name[sz - 1] == '\n')
+		file_name[sz - 1] = 0x00;
+
+	backing_dev = filp_open(file_name, O_RDWR|O_LARGEFILE, 0);
+	if (IS_ERR(backing_dev)) {
+		err = PTR_ERR(backing_dev);
+		backing_dev = NULL;
+		goto out;
+	}
+
+	mapping = backing_dev->f_mapping;
+	inode = mapping->host;
+
+	/*
+	 * Support only block device in this moment. A regular file
+	 * can be used through a loop device.
+	 */
+	if (!S_ISBLK(inode->i_mode)) {
+		err = -ENOTBLK;
+		goto out;
+	}
+
+	bdev = bdgrab(I_BDEV(inode));
+	err = blkdev_get(bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL, zram);
+	if (err < 0) {
+		bdev = NULL;
+		goto out;
+	}
+
+	nr_pages = i_size_read(inode) >> PAGE_SHIFT;
+	bitmap_sz = BITS_TO_LONGS(nr_pages) * sizeof(long);
+	bitmap = vzalloc(bitmap_sz);
+	if (!bitmap) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	old_block_size = block_size(bdev);
+	err = set_blocksize(bdev, PAGE_SIZE);
+	if (err)
+		goto out;
+
+	reset_bdev(zram);
+
+	zram->old_block_size = old_block_size;
+	zram->bdev = bdev;
+	zram->backing_dev = backing_dev;
+	zram->bitmap = bitmap;
+	zram->nr_pages = nr_pages;
+	up_write(&zram->init_lock);
+
+	pr_info("setup backing device %s\n", file_name);
+	kfree(file_name);
+
+	return len;
+out:
+	vfree(bitmap);
+
+	if (bdev)
+		blkdev_put(bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+
+	if (backing_dev)
+		filp_close(backing_dev, NULL);
+
+	up_write(&zram->init_lock);
+
+	kfree(file_name);
+
+	return err;
+}
+
+static unsigned long alloc_block_bdev(struct zram *zram)
+{
+	unsigned long blk_idx = 1;
+retry:
+	/* skip 0 bit to confuse zram.handle = 0 */
+	blk_idx = find_next_zero_bit(zram->bitmap, zram->nr_pages, blk_idx);
+	if (blk_idx == zram->nr_pages)
+		return 0;
+
+	if (test_and_set_bit(blk_idx, zram->bitmap))
+		goto retry;
+
+	atomic64_inc(&zram->stats.bd_count);
+	return blk_idx;
+}
+
+static void free_block_bdev(struct zram *zram, unsigned long blk_idx)
+{
+	int was_set;
+
+	was_set = test_and_clear_bit(blk_idx, zram->bitmap);
+	WARN_ON_ONCE(!was_set);
+	atomic64_dec(&zram->stats.bd_count);
+}
+
+static void zram_page_end_io(struct bio *bio)
+{
+	struct page *page = bio->bi_io_vec[0].bv_page;
+
+	page_endio(page, op_is_write(bio_op(bio)), bio->bi_error);
+	bio_put(bio);
+}
+
+/*
+ * Returns 1 if the submission is successful.
+ */
+static int read_from_bdev_async(struct zram *zram, struct bio_vec *bvec,
+			unsigned long entry, struct bio *parent)
+{
+	struct bio *bio;
+
+	bio = bio_alloc(GFP_ATOMIC, 1);
+	if (!bio)
+		return -ENOMEM;
+
+	bio->bi_iter.bi_sector = entry * (PAGE_SIZE >> 9);
+	bio->bi_bdev = zram->bdev;
+	if (!bio_add_page(bio, bvec->bv_page, bvec->bv_len, bvec->bv_offset)) {
+		bio_put(bio);
+		return -EIO;
+	}
+
+	bio_set_op_attrs(bio, REQ_OP_READ, 0);
+	if (!parent)
+		bio->bi_end_io = zram_page_end_io;
 	else
-		clear_page(user_mem);
-	kunmap_atomic(user_mem);
+		bio_chain(bio, parent);
 
-	flush_dcache_page(page);
+	submit_bio(bio);
+	atomic64_inc(&zram->stats.bd_reads);
+	return 1;
 }
 
+struct zram_work {
+	struct work_struct work;
+	struct zram *zram;
+	unsigned long entry;
+	struct page *page;
+	int error;
+};
+
+static void zram_sync_read(struct work_struct *work)
+{
+	struct zram_work *zw = container_of(work, struct zram_work, work);
+	struct zram *zram = zw->zram;
+	struct bio *bio;
+
+	bio = bio_alloc(GFP_NOIO, 1);
+	if (!bio) {
+		zw->error = -ENOMEM;
+		return;
+	}
+
+	bio->bi_iter.bi_sector = zw->entry * (PAGE_SIZE >> 9);
+	bio->bi_bdev = zram->bdev;
+	bio_add_page(bio, zw->page, PAGE_SIZE, 0);
+	bio_set_op_attrs(bio, REQ_OP_READ, READ_SYNC);
+
+	zw->error = submit_bio_wait(bio);
+	bio_put(bio);
+	if (!zw->error)
+		atomic64_inc(&zram->stats.bd_reads);
+}
+
+/*
+ * Block layer want one ->make_request_fn to be active at a time
+ * so if we wait for a bio submitted in the same context, it's a
+ * deadlock. To avoid it, the read is done in worker thread context.
+ */
+static int read_from_bdev_sync(struct zram *zram, struct bio_vec *bvec,
+				unsigned long entry)
+{
+	struct zram_work work;
+
+	work.zram = zram;
+	work.entry = entry;
+	work.page = bvec->bv_page;
+	work.error = 0;
+
+	INIT_WORK_ONSTACK(&work.work, zram_sync_read);
+	queue_work(system_unbound_wq, &work.work);
+	flush_work(&work.work);
+	destroy_work_on_stack(&work.work);
+
+	return work.error;
+}
+
+/*
+ * Returns 0 when the page has been read synchronously and 1 when the
+ * read was submitted and will complete along with @parent, or with
+ * page_endio() if there is no parent bio.
+ */
+static int read_from_bdev(struct zram *zram, struct bio_vec *bvec,
+			unsigned long entry, struct bio *parent, bool sync)
+{
+	if (sync)
+		return read_from_bdev_sync(zram, bvec, entry);
+	else
+		return read_from_bdev_async(zram, bvec, entry, parent);
+}
+
+static int write_to_bdev(struct zram *zram, struct bio_vec *bvec,
+					u32 index, struct bio *parent,
+					unsigned long *pentry)
+{
+	struct bio *bio;
+	unsigned long entry;
+
+	bio = bio_alloc(GFP_ATOMIC, 1);
+	if (!bio)
+		return -ENOMEM;
+
+	entry = alloc_block_bdev(zram);
+	if (!entry) {
+		bio_put(bio);
+		return -ENOSPC;
+	}
+
+	bio->bi_iter.bi_sector = entry * (PAGE_SIZE >> 9);
+	bio->bi_bdev = zram->bdev;
+	if (!bio_add_page(bio, bvec->bv_page, bvec->bv_len,
+					bvec->bv_offset)) {
+		bio_put(bio);
+		free_block_bdev(zram, entry);
+		return -EIO;
+	}
+
+	if (!parent) {
+		bio_set_op_attrs(bio, REQ_OP_WRITE, REQ_SYNC);
+		bio->bi_end_io = zram_page_end_io;
+	} else {
+		bio_set_op_attrs(bio, REQ_OP_WRITE, parent->bi_opf & REQ_SYNC);
+		bio_chain(bio, parent);
+	}
+
+	submit_bio(bio);
+	atomic64_inc(&zram->stats.bd_writes);
+	*pentry = entry;
+
+	return 0;
+}
+
+#define HUGE_WRITEBACK 0x1
+#define IDLE_WRITEBACK 0x2
+
+static ssize_t writeback_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	struct zram_meta *meta;
+	unsigned long nr_pages = zram->disksize >> PAGE_SHIFT;
+	unsigned long index;
+	struct bio *bio;
+	struct page *page;
+	ssize_t ret;
+	int mode;
+	unsigned long blk_idx = 0;
+
+	if (sysfs_streq(buf, "idle"))
+		mode = IDLE_WRITEBACK;
+	else if (sysfs_streq(buf, "huge"))
+		mode = HUGE_WRITEBACK;
+	else
+		return -EINVAL;
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram)) {
+		ret = -EINVAL;
+		goto release_init_lock;
+	}
+
+	if (!zram_wb_enabled(zram)) {
+		ret = -ENODEV;
+		goto release_init_lock;
+	}
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page) {
+		ret = -ENOMEM;
+		goto release_init_lock;
+	}
+
+	ret = len;
+	meta = zram->meta;
+	for (index = 0; index < nr_pages; index++) {
+		int err;
+
+		if (!blk_idx) {
+			blk_idx = alloc_block_bdev(zram);
+			if (!blk_idx) {
+				ret = -ENOSPC;
+				break;
+			}
+		}
+
+		zram_slot_lock(meta, index);
+		if (!zram_allocated(meta, index))
+			goto next;
+
+		if (zram_test_flag(meta, index, ZRAM_WB) ||
+				zram_test_flag(meta, index, ZRAM_SAME) ||
+				zram_test_flag(meta, index, ZRAM_UNDER_WB))
+			goto next;
+
+		if (mode == IDLE_WRITEBACK &&
+				!zram_test_flag(meta, index, ZRAM_IDLE))
+			goto next;
+		if (mode == HUGE_WRITEBACK &&
+				!zram_test_flag(meta, index, ZRAM_HUGE))
+			goto next;
+		/*
+		 * Clearing ZRAM_UNDER_WB is duty of caller.
+		 * IOW, zram_free_page never clear it.
+		 */
+		zram_set_flag(meta, index, ZRAM_UNDER_WB);
+		/* Need for hugepage writeback racing */
+		zram_set_flag(meta, index, ZRAM_IDLE);
+		zram_slot_unlock(meta, index);
+
+		if (__zram_bvec_read(zram, page, index, NULL, true))
+			goto clear_under_wb;
+
+		bio = bio_alloc(GFP_KERNEL, 1);
+		if (!bio)
+			goto clear_under_wb;
+
+		bio->bi_iter.bi_sector = blk_idx * (PAGE_SIZE >> 9);
+		bio->bi_bdev = zram->bdev;
+		bio_add_page(bio, page, PAGE_SIZE, 0);
+		bio_set_op_attrs(bio, REQ_OP_WRITE, REQ_SYNC);
+		/*
+		 * XXX: A single page IO would be inefficient for write
+		 * but it would be not bad as starter.
+		 */
+		err = submit_bio_wait(bio);
+		bio_put(bio);
+		if (err)
+			goto clear_under_wb;
+
+		atomic64_inc(&zram->stats.bd_writes);
+		/*
+		 * We released the slot lock so need to check if the slot was
+		 * changed. If there is freeing for the slot, we can catch it
+		 * easily by zram_allocated.
+		 * A subtle case is the slot is freed/reallocated/marked as
+		 * ZRAM_IDLE again. To close the race, idle_store doesn't
+		 * mark ZRAM_IDLE once it found the slot was ZRAM_UNDER_WB.
+		 * Thus, we could close the race by checking ZRAM_IDLE bit.
+		 */
+		zram_slot_lock(meta, index);
+		if (!zram_allocated(meta, index) ||
+				!zram_test_flag(meta, index, ZRAM_IDLE)) {
+			zram_clear_flag(meta, index, ZRAM_UNDER_WB);
+			zram_clear_flag(meta, index, ZRAM_IDLE);
+			goto next;
+		}
+
+		zram_free_page(zram, index);
+		zram_clear_flag(meta, index, ZRAM_UNDER_WB);
+		zram_set_flag(meta, index, ZRAM_WB);
+		meta->table[index].handle = blk_idx;
+		blk_idx = 0;
+		atomic64_inc(&zram->stats.pages_stored);
+next:
+		zram_slot_unlock(meta, index);
+		continue;
+
+clear_under_wb:
+		zram_slot_lock(meta, index);
+		zram_clear_flag(meta, index, ZRAM_UNDER_WB);
+		zram_clear_flag(meta, index, ZRAM_IDLE);
+		zram_slot_unlock(meta, index);
+	}
+
+	if (blk_idx)
+		free_block_bdev(zram, blk_idx);
+	__free_page(page);
+release_init_lock:
+	up_read(&zram->init_lock);
+
+	return ret;
+}
+
+static ssize_t bd_stat_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	ssize_t ret;
+
+	down_read(&zram->init_lock);
+	ret = scnprintf(buf, PAGE_SIZE,
+		"%8llu %8llu %8llu\n",
+		(u64)atomic64_read(&zram->stats.bd_count) << PAGE_SHIFT,
+		(u64)atomic64_read(&zram->stats.bd_reads) << PAGE_SHIFT,
+		(u64)atomic64_read(&zram->stats.bd_writes) << PAGE_SHIFT);
+	up_read(&zram->init_lock);
+
+	return ret;
+}
+#else
+static bool zram_wb_enabled(struct zram *zram) { return false; }
+static inline void reset_bdev(struct zram *zram) {};
+static int write_to_bdev(struct zram *zram, struct bio_vec *bvec,
+					u32 index, struct bio *parent,
+					unsigned long *pentry)
+
+{
+	return -EIO;
+}
+
+static int read_from_bdev(struct zram *zram, struct bio_vec *bvec,
+			unsigned long entry, struct bio *parent, bool sync)
+{
+	return -EIO;
+}
+static void free_block_bdev(struct zram *zram, unsigned long blk_idx) {};
+#endif
+
+static ssize_t idle_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	struct zram_meta *meta;
+	unsigned long nr_pages = zram->disksize >> PAGE_SHIFT;
+	unsigned long index;
+
+	if (!sysfs_streq(buf, "all"))
+		return -EINVAL;
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram)) {
+		up_read(&zram->init_lock);
+		return -EINVAL;
+	}
+
+	meta = zram->meta;
+	for (index = 0; index < nr_pages; index++) {
+		/*
+		 * Do not mark ZRAM_UNDER_WB slot as ZRAM_IDLE to close race.
+		 * See the comment in writeback_store.
+		 */
+		zram_slot_lock(meta, index);
+		if (zram_allocated(meta, index) &&
+				!zram_test_flag(meta, index, ZRAM_WB) &&
+				!zram_test_flag(meta, index, ZRAM_UNDER_WB))
+			zram_set_flag(meta, index, ZRAM_IDLE);
+		zram_slot_unlock(meta, index);
+	}
+
+	up_read(&zram->init_lock);
+
+	return len;
+}
+
+#ifdef CONFIG_ZRAM_DEDUP
+static bool zram_use_dedup(struct zram *zram)
+{
+	return zram->use_dedup;
+}
+
+static ssize_t use_dedup_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	bool val;
+	struct zram *zram = dev_to_zram(dev);
+
+	down_read(&zram->init_lock);
+	val = zram->use_dedup;
+	up_read(&zram->init_lock);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", (int)val);
+}
+
+static ssize_t use_dedup_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int val;
+	struct zram *zram = dev_to_zram(dev);
+
+	if (kstrtoint(buf, 10, &val) || (val != 0 && val != 1))
+		return -EINVAL;
+
+	down_write(&zram->init_lock);
+	if (init_done(zram)) {
+		up_write(&zram->init_lock);
+		pr_info("Can't change dedup usage for initialized device\n");
+		return -EBUSY;
+	}
+	zram->use_dedup = val;
+	up_write(&zram->init_lock);
+	return len;
+}
+#else
+static bool zram_use_dedup(struct zram *zram)
+{
+	return false;
+}
+#endif
+
 static ssize_t initstate_show(struct device *dev,
 		struct device_attribute *attr, char *buf)
 {
@@ -334,46 +997,178 @@ static ssize_t max_comp_streams_store(struct device *dev,
 	return len;
 }
 
-static ssize_t comp_algorithm_show(struct device *dev,
-		struct device_attribute *attr, char *buf)
+static void comp_algorithm_set(struct zram *zram, u32 prio, const char *alg)
 {
-	size_t sz;
-	struct zram *zram = dev_to_zram(dev);
+	/* Do not free statically defined compression algorithms */
+	if (zram->comp_algs[prio] != default_compressor)
+		kfree(zram->comp_algs[prio]);
+
+	zram->comp_algs[prio] = alg;
+}
+
+static ssize_t __comp_algorithm_show(struct zram *zram, u32 prio,
+				     char *buf, ssize_t at)
+{
+	ssize_t sz;
 
 	down_read(&zram->init_lock);
-	sz = zcomp_available_show(zram->compressor, buf);
+	sz = zcomp_available_show(zram->comp_algs[prio], buf, at);
 	up_read(&zram->init_lock);
 
 	return sz;
 }
 
-static ssize_t comp_algorithm_store(struct device *dev,
-		struct device_attribute *attr, const char *buf, size_t len)
+static int __comp_algorithm_store(struct zram *zram, u32 prio, const char *buf)
 {
-	struct zram *zram = dev_to_zram(dev);
-	char compressor[CRYPTO_MAX_ALG_NAME];
+	char *compressor;
 	size_t sz;
 
-	strlcpy(compressor, buf, sizeof(compressor));
+	sz = strlen(buf);
+	if (sz >= CRYPTO_MAX_ALG_NAME)
+		return -E2BIG;
+
+	compressor = kstrdup(buf, GFP_KERNEL);
+	if (!compressor)
+		return -ENOMEM;
+
 	/* ignore trailing newline */
-	sz = strlen(compressor);
 	if (sz > 0 && compressor[sz - 1] == '\n')
 		compressor[sz - 1] = 0x00;
 
-	if (!zcomp_available_algorithm(compressor))
+	if (!zcomp_available_algorithm(compressor)) {
+		kfree(compressor);
 		return -EINVAL;
+	}
 
 	down_write(&zram->init_lock);
 	if (init_done(zram)) {
 		up_write(&zram->init_lock);
+		kfree(compressor);
 		pr_info("Can't change algorithm for initialized device\n");
 		return -EBUSY;
 	}
 
-	strlcpy(zram->compressor, compressor, sizeof(compressor));
+	comp_algorithm_set(zram, prio, compressor);
 	up_write(&zram->init_lock);
-	return len;
+	return 0;
+}
+
+static ssize_t comp_algorithm_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return __comp_algorithm_show(zram, ZRAM_PRIMARY_COMP, buf, 0);
+}
+
+static ssize_t comp_algorithm_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	int ret;
+
+	ret = __comp_algorithm_store(zram, ZRAM_PRIMARY_COMP, buf);
+	return ret ? ret : len;
+}
+
+#ifdef CONFIG_ZRAM_MULTI_COMP
+/*
+ * Splits the next "param=value" token off @args, in place. Returns a
+ * pointer to the remaining arguments.
+ */
+static char *zram_next_arg(char *args, char **param, char **val)
+{
+	char *end, *next;
+
+	args = skip_spaces(args);
+	end = args + strlen(args);
+	next = strpbrk(args, " \t\n");
+	if (next)
+		*next++ = '\0';
+	else
+		next = end;
+
+	*param = args;
+	*val = strchr(args, '=');
+	if (*val)
+		*(*val)++ = '\0';
+
+	return next;
+}
+
+static ssize_t recomp_algorithm_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	ssize_t sz = 0;
+	u32 prio;
+
+	for (prio = ZRAM_SECONDARY_COMP; prio < ZRAM_MAX_COMPS; prio++) {
+		if (!zram->comp_algs[prio])
+			continue;
+
+		/* Each entry is bounded by what is left of the sysfs page */
+		if (sz >= PAGE_SIZE - 2)
+			break;
+
+		sz += scnprintf(buf + sz, PAGE_SIZE - sz - 2, "#%d: ", prio);
+		sz += __comp_algorithm_show(zram, prio, buf, sz);
+	}
+
+	return sz;
+}
+
+static ssize_t recomp_algorithm_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	int prio = ZRAM_SECONDARY_COMP;
+	char *args, *cur, *param, *val;
+	char *alg = NULL;
+	int ret;
+
+	args = kstrndup(buf, len, GFP_KERNEL);
+	if (!args)
+		return -ENOMEM;
+
+	cur = args;
+	while (*(cur = skip_spaces(cur))) {
+		cur = zram_next_arg(cur, &param, &val);
+
+		if (!val || !*val) {
+			ret = -EINVAL;
+			goto out;
+		}
+
+		if (!strcmp(param, "algo")) {
+			alg = val;
+			continue;
+		}
+
+		if (!strcmp(param, "priority")) {
+			ret = kstrtoint(val, 10, &prio);
+			if (ret)
+				goto out;
+			continue;
+		}
+
+		ret = -EINVAL;
+		goto out;
+	}
+
+	ret = -EINVAL;
+	if (!alg)
+		goto out;
+
+	if (prio < ZRAM_SECONDARY_COMP || prio >= ZRAM_MAX_COMPS)
+		goto out;
+
+	ret = __comp_algorithm_store(zram, prio, alg);
+out:
+	kfree(args);
+	return ret ? ret : len;
 }
+#endif
 
 static ssize_t compact_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t len)
@@ -420,6 +1215,7 @@ static ssize_t mm_stat_show(struct device *dev,
 	u64 orig_size, mem_used = 0;
 	long max_used;
 	ssize_t ret;
+	u32 prio;
 
 	memset(&pool_stats, 0x00, sizeof(struct zs_pool_stats));
 
@@ -433,14 +1229,21 @@ static ssize_t mm_stat_show(struct device *dev,
 	max_used = atomic_long_read(&zram->stats.max_used_pages);
 
 	ret = scnprintf(buf, PAGE_SIZE,
-			"%8llu %8llu %8llu %8lu %8ld %8llu %8lu\n",
+			"%8llu %8llu %8llu %8lu %8ld %8llu %8lu",
 			orig_size << PAGE_SHIFT,
 			(u64)atomic64_read(&zram->stats.compr_data_size),
 			mem_used << PAGE_SHIFT,
 			zram->limit_pages << PAGE_SHIFT,
 			max_used << PAGE_SHIFT,
-			(u64)atomic64_read(&zram->stats.zero_pages),
+			(u64)atomic64_read(&zram->stats.same_pages),
 			pool_stats.pages_compacted);
+	/* objects stored by each compression algorithm, by priority */
+	for (prio = ZRAM_PRIMARY_COMP; prio < ZRAM_MAX_COMPS; prio++)
+		ret += scnprintf(buf + ret, PAGE_SIZE - ret, " %8llu",
+			(u64)atomic64_read(&zram->stats.comp_objs[prio]));
+	ret += scnprintf(buf + ret, PAGE_SIZE - ret, " %8llu %8llu\n",
+			(u64)atomic64_read(&zram->stats.dup_data_size),
+			(u64)atomic64_read(&zram->stats.meta_data_size));
 	up_read(&zram->init_lock);
 
 	return ret;
@@ -472,7 +1275,18 @@ ZRAM_ATTR_RO(failed_reads);
 ZRAM_ATTR_RO(failed_writes);
 ZRAM_ATTR_RO(invalid_io);
 ZRAM_ATTR_RO(notify_free);
-ZRAM_ATTR_RO(zero_pages);
+
+/* same-filled pages are accounted where zero pages used to be */
+static ssize_t zero_pages_show(struct device *d,
+				struct device_attribute *attr, char *b)
+{
+	struct zram *zram = dev_to_zram(d);
+
+	deprecated_attr_warn("zero_pages");
+	return scnprintf(b, PAGE_SIZE, "%llu\n",
+		(u64)atomic64_read(&zram->stats.same_pages));
+}
+static DEVICE_ATTR_RO(zero_pages);
 ZRAM_ATTR_RO(compr_data_size);
 
 static inline bool zram_meta_get(struct zram *zram)
@@ -484,7 +1298,12 @@ static inline bool zram_meta_get(struct zram *zram)
 
 static inline void zram_meta_put(struct zram *zram)
 {
-	atomic_dec(&zram->refcount);
+	/*
+	 * Asynchronous bio workers can drop the last reference after
+	 * zram_reset_device() started waiting, so wake it up.
+	 */
+	if (atomic_dec_and_test(&zram->refcount))
+		wake_up(&zram->io_done);
 }
 
 static void zram_meta_free(struct zram_meta *meta, u64 disksize)
@@ -496,21 +1315,29 @@ static void zram_meta_free(struct zram_meta *meta, u64 disksize)
 	for (index = 0; index < num_pages; index++) {
 		unsigned long handle = meta->table[index].handle;
 
-		if (!handle)
+		/*
+		 * Backing device blocks go away with the bitmap and
+		 * shared objects with the dedup table.
+		 */
+		if (!handle || zram_test_flag(meta, index, ZRAM_WB) ||
+				zram_test_flag(meta, index, ZRAM_SAME) ||
+				zram_test_flag(meta, index, ZRAM_DEDUP))
 			continue;
 
 		zs_free(meta->mem_pool, handle);
 	}
 
+	zram_dedup_fini(meta);
 	zs_destroy_pool(meta->mem_pool);
 	vfree(meta->table);
 	kfree(meta);
 }
 
-static struct zram_meta *zram_meta_alloc(char *pool_name, u64 disksize)
+static struct zram_meta *zram_meta_alloc(char *pool_name, u64 disksize,
+					bool use_dedup)
 {
 	size_t num_pages;
-	struct zram_meta *meta = kmalloc(sizeof(*meta), GFP_KERNEL);
+	struct zram_meta *meta = kzalloc(sizeof(*meta), GFP_KERNEL);
 
 	if (!meta)
 		return NULL;
@@ -528,8 +1355,13 @@ static struct zram_meta *zram_meta_alloc(char *pool_name, u64 disksize)
 		goto out_error;
 	}
 
+	if (use_dedup && zram_dedup_init(meta, num_pages))
+		goto out_destroy_pool;
+
 	return meta;
 
+out_destroy_pool:
+	zs_destroy_pool(meta->mem_pool);
 out_error:
 	vfree(meta->table);
 	kfree(meta);
@@ -538,7 +1370,7 @@ static struct zram_meta *zram_meta_alloc(char *pool_name, u64 disksize)
 
 /*
  * To protect concurrent access to the same index entry,
- * caller should hold this table index entry's bit_spinlock to
+ * caller should hold this table index entry's slot lock to
  * indicate this index entry is accessing.
  */
 static void zram_free_page(struct zram *zram, size_t index)
@@ -546,188 +1378,243 @@ static void zram_free_page(struct zram *zram, size_t index)
 	struct zram_meta *meta = zram->meta;
 	unsigned long handle = meta->table[index].handle;
 
-	if (unlikely(!handle)) {
-		/*
-		 * No memory is allocated for zero filled pages.
-		 * Simply clear zero page flag.
-		 */
-		if (zram_test_flag(meta, index, ZRAM_ZERO)) {
-			zram_clear_flag(meta, index, ZRAM_ZERO);
-			atomic64_dec(&zram->stats.zero_pages);
-		}
+	if (zram_test_flag(meta, index, ZRAM_IDLE))
+		zram_clear_flag(meta, index, ZRAM_IDLE);
+
+	if (zram_test_flag(meta, index, ZRAM_HUGE)) {
+		zram_clear_flag(meta, index, ZRAM_HUGE);
+		atomic64_dec(&zram->stats.huge_pages);
+	}
+
+	if (zram_wb_enabled(zram) && zram_test_flag(meta, index, ZRAM_WB)) {
+		zram_clear_flag(meta, index, ZRAM_WB);
+		free_block_bdev(zram, handle);
+		atomic64_dec(&zram->stats.pages_stored);
+		meta->table[index].handle = 0;
+		return;
+	}
+
+	/*
+	 * No memory is allocated for same element filled pages.
+	 * Simply clear same page flag.
+	 */
+	if (zram_test_flag(meta, index, ZRAM_SAME)) {
+		zram_clear_flag(meta, index, ZRAM_SAME);
+		meta->table[index].element = 0;
+		atomic64_dec(&zram->stats.same_pages);
 		return;
 	}
 
+	if (unlikely(!handle))
+		return;
+
+	if (zram_test_flag(meta, index, ZRAM_DEDUP)) {
+		zram_clear_flag(meta, index, ZRAM_DEDUP);
+		/* Other slots still share the object, only drop our ref */
+		if (!zram_dedup_put(zram, handle,
+				zram_get_checksum(meta, index))) {
+			atomic64_dec(&zram->stats.pages_stored);
+			goto out;
+		}
+	}
+
 	zs_free(meta->mem_pool, handle);
 
 	atomic64_sub(zram_get_obj_size(meta, index),
 			&zram->stats.compr_data_size);
+	atomic64_dec(&zram->stats.comp_objs[zram_get_priority(meta, index)]);
 	atomic64_dec(&zram->stats.pages_stored);
-
+out:
 	meta->table[index].handle = 0;
 	zram_set_obj_size(meta, index, 0);
+	zram_set_priority(meta, index, 0);
+	zram_clear_flag(meta, index, ZRAM_INCOMPRESSIBLE);
 }
 
-static int zram_decompress_page(struct zram *zram, char *mem, u32 index)
+/*
+ * Reads the object stored in zsmalloc for @index into @page. The caller
+ * must hold the table index entry's slot lock.
+ */
+static int zram_read_from_zspool(struct zram *zram, struct page *page,
+				u32 index)
 {
 	int ret = 0;
-	unsigned char *cmem;
+	unsigned char *cmem, *dst;
 	struct zram_meta *meta = zram->meta;
 	unsigned long handle;
 	unsigned int size;
+	u32 prio;
+
+	if (zram_test_flag(meta, index, ZRAM_SAME)) {
+		dst = kmap_atomic(page);
+		zram_fill_page(dst, PAGE_SIZE, meta->table[index].element);
+		kunmap_atomic(dst);
+		return 0;
+	}
 
-	bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
 	handle = meta->table[index].handle;
 	size = zram_get_obj_size(meta, index);
 
-	if (!handle || zram_test_flag(meta, index, ZRAM_ZERO)) {
-		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
-		memset(mem, 0, PAGE_SIZE);
+	if (!handle) {
+		dst = kmap_atomic(page);
+		clear_page(dst);
+		kunmap_atomic(dst);
 		return 0;
 	}
 
 	cmem = zs_map_object(meta->mem_pool, handle, ZS_MM_RO);
 	if (size == PAGE_SIZE) {
-		memcpy(mem, cmem, PAGE_SIZE);
+		dst = kmap_atomic(page);
+		memcpy(dst, cmem, PAGE_SIZE);
+		kunmap_atomic(dst);
 	} else {
-		struct zcomp_strm *zstrm = zcomp_stream_get(zram->comp);
-
-		ret = zcomp_decompress(zstrm, cmem, size, mem);
-		zcomp_stream_put(zram->comp);
+		struct zcomp_strm *zstrm;
+
+		prio = zram_get_priority(meta, index);
+		zstrm = zcomp_stream_get(zram->comps[prio]);
+		dst = kmap_atomic(page);
+		ret = zcomp_decompress(zstrm, cmem, size, dst);
+		kunmap_atomic(dst);
+		zcomp_stream_put(zram->comps[prio]);
 	}
 	zs_unmap_object(meta->mem_pool, handle);
-	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
 
-	/* Should NEVER happen. Return bio error if it does. */
-	if (unlikely(ret)) {
-		pr_err("Decompression failed! err=%d, page=%u\n", ret, index);
-		return ret;
-	}
-
-	return 0;
+	return ret;
 }
 
-static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
-			  u32 index, int offset)
+static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
+				struct bio *bio, bool partial_io)
 {
 	int ret;
-	struct page *page;
-	unsigned char *user_mem, *uncmem = NULL;
 	struct zram_meta *meta = zram->meta;
-	page = bvec->bv_page;
 
-	bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
-	if (unlikely(!meta->table[index].handle) ||
-			zram_test_flag(meta, index, ZRAM_ZERO)) {
-		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
-		handle_zero_page(bvec);
-		return 0;
-	}
-	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+	zram_slot_lock(meta, index);
+	if (zram_wb_enabled(zram) && zram_test_flag(meta, index, ZRAM_WB)) {
+		struct bio_vec bvec;
+		unsigned long blk_idx = meta->table[index].handle;
 
-	if (is_partial_io(bvec))
-		/* Use  a temporary buffer to decompress the page */
-		uncmem = kmalloc(PAGE_SIZE, GFP_NOIO);
+		zram_slot_unlock(meta, index);
 
-	user_mem = kmap_atomic(page);
-	if (!is_partial_io(bvec))
-		uncmem = user_mem;
-
-	if (!uncmem) {
-		pr_err("Unable to allocate temp memory\n");
-		ret = -ENOMEM;
-		goto out_cleanup;
+		bvec.bv_page = page;
+		bvec.bv_len = PAGE_SIZE;
+		bvec.bv_offset = 0;
+		return read_from_bdev(zram, &bvec, blk_idx, bio, partial_io);
 	}
 
-	ret = zram_decompress_page(zram, uncmem, index);
+	ret = zram_read_from_zspool(zram, page, index);
+	zram_slot_unlock(meta, index);
+
 	/* Should NEVER happen. Return bio error if it does. */
 	if (unlikely(ret))
-		goto out_cleanup;
-
-	if (is_partial_io(bvec))
-		memcpy(user_mem + bvec->bv_offset, uncmem + offset,
-				bvec->bv_len);
+		pr_err("Decompression failed! err=%d, page=%u\n", ret, index);
 
-	flush_dcache_page(page);
-	ret = 0;
-out_cleanup:
-	kunmap_atomic(user_mem);
-	if (is_partial_io(bvec))
-		kfree(uncmem);
 	return ret;
 }
 
-static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
-			   int offset)
+static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
+			  u32 index, int offset, struct bio *bio)
 {
-	int ret = 0;
-	unsigned int clen;
-	unsigned long handle = 0;
+	int ret;
 	struct page *page;
-	unsigned char *user_mem, *cmem, *src, *uncmem = NULL;
-	struct zram_meta *meta = zram->meta;
-	struct zcomp_strm *zstrm = NULL;
-	unsigned long alloced_pages;
 
 	page = bvec->bv_page;
 	if (is_partial_io(bvec)) {
-		/*
-		 * This is a partial IO. We need to read the full page
-		 * before to write the changes.
-		 */
-		uncmem = kmalloc(PAGE_SIZE, GFP_NOIO);
-		if (!uncmem) {
-			ret = -ENOMEM;
-			goto out;
-		}
-		ret = zram_decompress_page(zram, uncmem, index);
-		if (ret)
-			goto out;
+		/* Use a temporary buffer to decompress the page */
+		page = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
+		if (!page)
+			return -ENOMEM;
 	}
 
-compress_again:
-	user_mem = kmap_atomic(page);
+	ret = __zram_bvec_read(zram, page, index, bio, is_partial_io(bvec));
+	if (unlikely(ret < 0))
+		goto out;
+
 	if (is_partial_io(bvec)) {
-		memcpy(uncmem + offset, user_mem + bvec->bv_offset,
-		       bvec->bv_len);
-		kunmap_atomic(user_mem);
-		user_mem = NULL;
-	} else {
-		uncmem = user_mem;
+		void *dst = kmap_atomic(bvec->bv_page);
+		void *src = kmap_atomic(page);
+
+		memcpy(dst + bvec->bv_offset, src + offset, bvec->bv_len);
+		kunmap_atomic(src);
+		kunmap_atomic(dst);
 	}
 
-	if (page_zero_filled(uncmem)) {
-		if (user_mem)
-			kunmap_atomic(user_mem);
+	flush_dcache_page(bvec->bv_page);
+out:
+	if (is_partial_io(bvec))
+		__free_page(page);
+
+	return ret;
+}
+
+static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
+				u32 index, struct bio *bio, bool allow_wb)
+{
+	int ret = 0;
+	unsigned int clen;
+	unsigned long handle = 0;
+	unsigned long element = 0;
+	enum zram_pageflags flags = 0;
+	struct page *page = bvec->bv_page;
+	unsigned char *src, *dst, *mem;
+	struct zram_meta *meta = zram->meta;
+	struct zcomp_strm *zstrm;
+	unsigned long alloced_pages;
+	u32 checksum = 0;
+	bool dedup = false, dedup_hit = false;
+
+	mem = kmap_atomic(page);
+	if (page_same_filled(mem, &element)) {
+		kunmap_atomic(mem);
 		/* Free memory associated with this sector now. */
-		bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+		zram_slot_lock(meta, index);
 		zram_free_page(zram, index);
-		zram_set_flag(meta, index, ZRAM_ZERO);
-		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+		zram_set_flag(meta, index, ZRAM_SAME);
+		meta->table[index].element = element;
+		zram_slot_unlock(meta, index);
 
-		atomic64_inc(&zram->stats.zero_pages);
-		ret = 0;
-		goto out;
+		atomic64_inc(&zram->stats.same_pages);
+		return 0;
 	}
+	kunmap_atomic(mem);
 
-	zstrm = zcomp_stream_get(zram->comp);
-	ret = zcomp_compress(zstrm, uncmem, &clen);
-	if (!is_partial_io(bvec)) {
-		kunmap_atomic(user_mem);
-		user_mem = NULL;
-		uncmem = NULL;
+	if (zram_dedup_enabled(meta)) {
+		checksum = zram_dedup_checksum(page);
+		handle = zram_dedup_find(zram, page, checksum, &clen);
+		if (handle) {
+			dedup = dedup_hit = true;
+			goto out;
+		}
 	}
 
+compress_again:
+	zstrm = zcomp_stream_get(zram->comps[ZRAM_PRIMARY_COMP]);
+	src = kmap_atomic(page);
+	ret = zcomp_compress(zstrm, src, &clen);
+	kunmap_atomic(src);
+
 	if (unlikely(ret)) {
+		zcomp_stream_put(zram->comps[ZRAM_PRIMARY_COMP]);
 		pr_err("Compression failed! err=%d\n", ret);
-		goto out;
+		if (handle)
+			zs_free(meta->mem_pool, handle);
+		return ret;
 	}
 
-	src = zstrm->buffer;
 	if (unlikely(clen > max_zpage_size)) {
+		if (zram_wb_enabled(zram) && allow_wb) {
+			zcomp_stream_put(zram->comps[ZRAM_PRIMARY_COMP]);
+			ret = write_to_bdev(zram, bvec, index, bio, &element);
+			if (!ret) {
+				if (handle)
+					zs_free(meta->mem_pool, handle);
+				flags = ZRAM_WB;
+				ret = 1;
+				goto out;
+			}
+			allow_wb = false;
+			goto compress_again;
+		}
 		clen = PAGE_SIZE;
-		if (is_partial_io(bvec))
-			src = uncmem;
 	}
 
 	/*
@@ -750,11 +1637,8 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 				__GFP_HIGHMEM |
 				__GFP_MOVABLE);
 	if (!handle) {
-		zcomp_stream_put(zram->comp);
-		zstrm = NULL;
-
+		zcomp_stream_put(zram->comps[ZRAM_PRIMARY_COMP]);
 		atomic64_inc(&zram->stats.writestall);
-
 		handle = zs_malloc(meta->mem_pool, clen,
 				GFP_NOIO | __GFP_HIGHMEM |
 				__GFP_MOVABLE);
@@ -763,54 +1647,391 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 
 		pr_err("Error allocating memory for compressed page: %u, size=%u\n",
 			index, clen);
-		ret = -ENOMEM;
-		goto out;
+		return -ENOMEM;
 	}
 
 	alloced_pages = zs_get_total_pages(meta->mem_pool);
 	update_used_max(zram, alloced_pages);
 
 	if (zram->limit_pages && alloced_pages > zram->limit_pages) {
+		zcomp_stream_put(zram->comps[ZRAM_PRIMARY_COMP]);
 		zs_free(meta->mem_pool, handle);
-		ret = -ENOMEM;
-		goto out;
+		return -ENOMEM;
 	}
 
-	cmem = zs_map_object(meta->mem_pool, handle, ZS_MM_WO);
+	dst = zs_map_object(meta->mem_pool, handle, ZS_MM_WO);
 
-	if ((clen == PAGE_SIZE) && !is_partial_io(bvec)) {
+	src = zstrm->buffer;
+	if (clen == PAGE_SIZE)
 		src = kmap_atomic(page);
-		memcpy(cmem, src, PAGE_SIZE);
+	memcpy(dst, src, clen);
+	if (clen == PAGE_SIZE)
 		kunmap_atomic(src);
-	} else {
-		memcpy(cmem, src, clen);
-	}
 
-	zcomp_stream_put(zram->comp);
-	zstrm = NULL;
+	zcomp_stream_put(zram->comps[ZRAM_PRIMARY_COMP]);
 	zs_unmap_object(meta->mem_pool, handle);
 
+	if (zram_dedup_enabled(meta))
+		dedup = zram_dedup_insert(zram, handle, clen, checksum);
+out:
 	/*
 	 * Free memory associated with this sector
 	 * before overwriting unused sectors.
 	 */
-	bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+	zram_slot_lock(meta, index);
 	zram_free_page(zram, index);
 
-	meta->table[index].handle = handle;
-	zram_set_obj_size(meta, index, clen);
-	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+	if (flags == ZRAM_WB) {
+		zram_set_flag(meta, index, ZRAM_WB);
+		meta->table[index].handle = element;
+	} else {
+		if (clen == PAGE_SIZE) {
+			zram_set_flag(meta, index, ZRAM_HUGE);
+			atomic64_inc(&zram->stats.huge_pages);
+		}
+		if (dedup) {
+			zram_set_flag(meta, index, ZRAM_DEDUP);
+			zram_set_checksum(meta, index, checksum);
+		}
+		meta->table[index].handle = handle;
+		zram_set_obj_size(meta, index, clen);
+	}
+	zram_slot_unlock(meta, index);
 
 	/* Update stats */
-	atomic64_add(clen, &zram->stats.compr_data_size);
+	if (flags != ZRAM_WB && !dedup_hit) {
+		atomic64_add(clen, &zram->stats.compr_data_size);
+		atomic64_inc(&zram->stats.comp_objs[ZRAM_PRIMARY_COMP]);
+	}
 	atomic64_inc(&zram->stats.pages_stored);
+	return ret;
+}
+
+static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
+				u32 index, int offset, struct bio *bio)
+{
+	int ret;
+	struct page *page = NULL;
+	void *src;
+	struct bio_vec vec;
+
+	vec = *bvec;
+	if (is_partial_io(bvec)) {
+		void *dst;
+		/*
+		 * This is a partial IO. We need to read the full page
+		 * before to write the changes.
+		 */
+		page = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
+		if (!page)
+			return -ENOMEM;
+
+		ret = __zram_bvec_read(zram, page, index, bio, true);
+		if (ret)
+			goto out;
+
+		src = kmap_atomic(bvec->bv_page);
+		dst = kmap_atomic(page);
+		memcpy(dst + offset, src + bvec->bv_offset, bvec->bv_len);
+		kunmap_atomic(dst);
+		kunmap_atomic(src);
+
+		vec.bv_page = page;
+		vec.bv_len = PAGE_SIZE;
+		vec.bv_offset = 0;
+	}
+
+	/*
+	 * The temporary page of a partial IO is released as soon as we
+	 * return, so it must never be handed to an asynchronous backing
+	 * device write.
+	 */
+	ret = __zram_bvec_write(zram, &vec, index, bio, !is_partial_io(bvec));
 out:
-	if (zstrm)
-		zcomp_stream_put(zram->comp);
 	if (is_partial_io(bvec))
-		kfree(uncmem);
+		__free_page(page);
+	return ret;
+}
+
+#ifdef CONFIG_ZRAM_MULTI_COMP
+/*
+ * This function will decompress (unless it's ZRAM_HUGE) the page and then
+ * attempt to compress it using provided compression algorithm priority
+ * (which is potentially more effective).
+ *
+ * Corresponding ZRAM slot should be locked.
+ */
+static int zram_recompress(struct zram *zram, u32 index, struct page *page,
+			   u32 threshold, u32 prio, u32 prio_max)
+{
+	struct zram_meta *meta = zram->meta;
+	struct zcomp_strm *zstrm = NULL;
+	unsigned long handle_old;
+	unsigned long handle_new;
+	unsigned int comp_len_old;
+	unsigned int comp_len_new;
+	unsigned int class_index_old;
+	unsigned int class_index_new;
+	u32 num_recomps = 0;
+	void *src, *dst;
+	bool idle;
+	int ret;
+
+	handle_old = meta->table[index].handle;
+	if (!handle_old)
+		return -EINVAL;
+
+	comp_len_old = zram_get_obj_size(meta, index);
+	/*
+	 * Do not recompress objects that are already "small enough".
+	 */
+	if (comp_len_old < threshold)
+		return 0;
+
+	ret = zram_read_from_zspool(zram, page, index);
+	if (ret)
+		return ret;
+
+	class_index_old = zs_lookup_class_index(meta->mem_pool, comp_len_old);
+	/*
+	 * Iterate the secondary comp algorithms list (in order of priority)
+	 * and try to recompress the page.
+	 */
+	for (; prio < prio_max; prio++) {
+		if (!zram->comps[prio])
+			continue;
+
+		/*
+		 * Skip if the object is already re-compressed with a higher
+		 * priority algorithm (or same algorithm).
+		 */
+		if (prio <= zram_get_priority(meta, index))
+			continue;
+
+		num_recomps++;
+		zstrm = zcomp_stream_get(zram->comps[prio]);
+		src = kmap_atomic(page);
+		ret = zcomp_compress(zstrm, src, &comp_len_new);
+		kunmap_atomic(src);
+
+		if (ret) {
+			zcomp_stream_put(zram->comps[prio]);
+			return ret;
+		}
+
+		class_index_new = zs_lookup_class_index(meta->mem_pool,
+							comp_len_new);
+
+		/* Continue until we make progress */
+		if (comp_len_new > max_zpage_size ||
+		    class_index_new >= class_index_old ||
+		    (threshold && comp_len_new >= threshold)) {
+			zcomp_stream_put(zram->comps[prio]);
+			zstrm = NULL;
+			continue;
+		}
+
+		/* Recompression was successful so break out */
+		break;
+	}
+
+	if (!zstrm) {
+		/*
+		 * Secondary algorithms failed to re-compress the page
+		 * in a way that would save memory, mark the object as
+		 * incompressible so that we will not try to compress
+		 * it again.
+		 *
+		 * We need to make sure that all secondary algorithms have
+		 * failed, so we test if the number of recompressions matches
+		 * the number of active secondary algorithms.
+		 */
+		if (num_recomps && num_recomps == zram->num_active_comps - 1)
+			zram_set_flag(meta, index, ZRAM_INCOMPRESSIBLE);
+		return 0;
+	}
+
+	/*
+	 * No direct reclaim (slow path) for handle allocation and no
+	 * re-compression attempt (unlike in __zram_bvec_write()) since
+	 * we already have stored that object in zsmalloc. If we cannot
+	 * alloc memory for recompressed object then we bail out and
+	 * simply keep the old (existing) object in zsmalloc.
+	 */
+	handle_new = zs_malloc(meta->mem_pool, comp_len_new,
+			       __GFP_KSWAPD_RECLAIM |
+			       __GFP_NOWARN |
+			       __GFP_HIGHMEM |
+			       __GFP_MOVABLE);
+	if (!handle_new) {
+		zcomp_stream_put(zram->comps[prio]);
+		return -ENOMEM;
+	}
+
+	dst = zs_map_object(meta->mem_pool, handle_new, ZS_MM_WO);
+	memcpy(dst, zstrm->buffer, comp_len_new);
+	zcomp_stream_put(zram->comps[prio]);
+
+	zs_unmap_object(meta->mem_pool, handle_new);
+
+	/* zram_free_page() drops ZRAM_IDLE, but recompression is no access */
+	idle = zram_test_flag(meta, index, ZRAM_IDLE);
+	zram_free_page(zram, index);
+	meta->table[index].handle = handle_new;
+	zram_set_obj_size(meta, index, comp_len_new);
+	zram_set_priority(meta, index, prio);
+	if (idle)
+		zram_set_flag(meta, index, ZRAM_IDLE);
+
+	atomic64_add(comp_len_new, &zram->stats.compr_data_size);
+	atomic64_inc(&zram->stats.comp_objs[prio]);
+	atomic64_inc(&zram->stats.pages_stored);
+
+	return 0;
+}
+
+#define RECOMPRESS_IDLE		(1 << 0)
+#define RECOMPRESS_HUGE		(1 << 1)
+
+static ssize_t recompress_store(struct device *dev,
+				struct device_attribute *attr,
+				const char *buf, size_t len)
+{
+	u32 prio = ZRAM_SECONDARY_COMP, prio_max = ZRAM_MAX_COMPS;
+	struct zram *zram = dev_to_zram(dev);
+	struct zram_meta *meta;
+	unsigned long nr_pages = zram->disksize >> PAGE_SHIFT;
+	char *args, *cur, *param, *val, *algo = NULL;
+	u32 mode = 0, threshold = 0;
+	unsigned long index;
+	struct page *page;
+	ssize_t ret;
+
+	args = kstrndup(buf, len, GFP_KERNEL);
+	if (!args)
+		return -ENOMEM;
+
+	cur = args;
+	while (*(cur = skip_spaces(cur))) {
+		cur = zram_next_arg(cur, &param, &val);
+
+		if (!val || !*val) {
+			ret = -EINVAL;
+			goto out;
+		}
+
+		if (!strcmp(param, "type")) {
+			if (!strcmp(val, "idle")) {
+				mode = RECOMPRESS_IDLE;
+			} else if (!strcmp(val, "huge")) {
+				mode = RECOMPRESS_HUGE;
+			} else if (!strcmp(val, "huge_idle")) {
+				mode = RECOMPRESS_IDLE | RECOMPRESS_HUGE;
+			} else {
+				ret = -EINVAL;
+				goto out;
+			}
+			continue;
+		}
+
+		if (!strcmp(param, "threshold")) {
+			/*
+			 * We will re-compress only idle objects equal or
+			 * greater in size than watermark.
+			 */
+			ret = kstrtouint(val, 10, &threshold);
+			if (ret)
+				goto out;
+			continue;
+		}
+
+		if (!strcmp(param, "algo")) {
+			algo = val;
+			continue;
+		}
+
+		ret = -EINVAL;
+		goto out;
+	}
+
+	ret = -EINVAL;
+	if (threshold >= PAGE_SIZE)
+		goto out;
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram))
+		goto release_init_lock;
+
+	if (algo) {
+		bool found = false;
+
+		for (; prio < ZRAM_MAX_COMPS; prio++) {
+			if (!zram->comp_algs[prio])
+				continue;
+
+			if (!strcmp(zram->comp_algs[prio], algo)) {
+				prio_max = prio + 1;
+				found = true;
+				break;
+			}
+		}
+
+		if (!found)
+			goto release_init_lock;
+	}
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page) {
+		ret = -ENOMEM;
+		goto release_init_lock;
+	}
+
+	ret = len;
+	meta = zram->meta;
+	for (index = 0; index < nr_pages; index++) {
+		int err = 0;
+
+		zram_slot_lock(meta, index);
+
+		if (!zram_allocated(meta, index))
+			goto next;
+
+		if (mode & RECOMPRESS_IDLE &&
+		    !zram_test_flag(meta, index, ZRAM_IDLE))
+			goto next;
+
+		if (mode & RECOMPRESS_HUGE &&
+		    !zram_test_flag(meta, index, ZRAM_HUGE))
+			goto next;
+
+		if (zram_test_flag(meta, index, ZRAM_WB) ||
+		    zram_test_flag(meta, index, ZRAM_UNDER_WB) ||
+		    zram_test_flag(meta, index, ZRAM_SAME) ||
+		    zram_test_flag(meta, index, ZRAM_DEDUP) ||
+		    zram_test_flag(meta, index, ZRAM_INCOMPRESSIBLE))
+			goto next;
+
+		err = zram_recompress(zram, index, page, threshold,
+				      prio, prio_max);
+next:
+		zram_slot_unlock(meta, index);
+		if (err) {
+			ret = err;
+			break;
+		}
+
+		cond_resched();
+	}
+
+	__free_page(page);
+
+release_init_lock:
+	up_read(&zram->init_lock);
+out:
+	kfree(args);
 	return ret;
 }
+#endif
 
 /*
  * zram_bio_discard - handler on discard request
@@ -842,17 +2063,31 @@ static void zram_bio_discard(struct zram *zram, u32 index,
 	}
 
 	while (n >= PAGE_SIZE) {
-		bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+		zram_slot_lock(meta, index);
 		zram_free_page(zram, index);
-		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+		zram_slot_unlock(meta, index);
 		atomic64_inc(&zram->stats.notify_free);
 		index++;
 		n -= PAGE_SIZE;
 	}
 }
 
+static void zram_accessed(struct zram *zram, u32 index)
+{
+	struct zram_meta *meta = zram->meta;
+
+	zram_slot_lock(meta, index);
+	zram_clear_flag(meta, index, ZRAM_IDLE);
+	zram_slot_unlock(meta, index);
+}
+
+/*
+ * Returns errno if it has some problem. Otherwise return 0 or 1.
+ * Returns 0 if IO request was done synchronously
+ * Returns 1 if IO request was successfully submitted.
+ */
 static int zram_bvec_rw(struct zram *zram, struct bio_vec *bvec, u32 index,
-			int offset, bool is_write)
+			int offset, bool is_write, struct bio *bio)
 {
 	unsigned long start_time = jiffies;
 	int rw_acct = is_write ? REQ_OP_WRITE : REQ_OP_READ;
@@ -863,24 +2098,156 @@ static int zram_bvec_rw(struct zram *zram, struct bio_vec *bvec, u32 index,
 
 	if (!is_write) {
 		atomic64_inc(&zram->stats.num_reads);
-		ret = zram_bvec_read(zram, bvec, index, offset);
+		ret = zram_bvec_read(zram, bvec, index, offset, bio);
 	} else {
 		atomic64_inc(&zram->stats.num_writes);
-		ret = zram_bvec_write(zram, bvec, index, offset);
+		ret = zram_bvec_write(zram, bvec, index, offset, bio);
 	}
 
 	generic_end_io_acct(rw_acct, &zram->disk->part0, start_time);
 
-	if (unlikely(ret)) {
+	if (unlikely(ret < 0)) {
 		if (!is_write)
 			atomic64_inc(&zram->stats.failed_reads);
 		else
 			atomic64_inc(&zram->stats.failed_writes);
+	} else {
+		zram_accessed(zram, index);
 	}
 
 	return ret;
 }
 
+#ifdef CONFIG_ZRAM_ASYNC_IO
+static struct workqueue_struct *zram_io_wq;
+
+/* state shared by every page of a bio handled by zram_io_wq */
+struct zram_bio_ctx {
+	struct zram *zram;
+	struct bio *bio;
+	atomic_t pending;
+	int error;
+};
+
+struct zram_bio_work {
+	struct work_struct work;
+	struct zram_bio_ctx *ctx;
+	struct bio_vec bvec;
+	u32 index;
+};
+
+static void zram_bio_work_fn(struct work_struct *work)
+{
+	struct zram_bio_work *zw = container_of(work, struct zram_bio_work,
+						work);
+	struct zram_bio_ctx *ctx = zw->ctx;
+	struct zram *zram = ctx->zram;
+	struct bio *bio = ctx->bio;
+
+	if (zram_bvec_rw(zram, &zw->bvec, zw->index, 0,
+			 op_is_write(bio_op(bio)), bio) < 0)
+		ctx->error = -EIO;
+
+	if (!atomic_dec_and_test(&ctx->pending))
+		return;
+
+	/*
+	 * The last page is done. Backing device reads and writes are
+	 * chained to @bio, so bio_endio() still waits for those.
+	 */
+	if (ctx->error)
+		bio->bi_error = ctx->error;
+	bio_endio(bio);
+	zram_meta_put(zram);
+	kfree(ctx);
+}
+
+/*
+ * Spread a multi-page bio over zram_io_wq so that its pages get
+ * (de)compressed in parallel on several CPUs. Only bios made of whole,
+ * page aligned segments (swap and page cache I/O) are handled here.
+ * Returns false if the bio has to go through the synchronous path.
+ */
+static bool zram_make_request_async(struct zram *zram, struct bio *bio,
+				    u32 index, int offset)
+{
+	struct zram_bio_ctx *ctx;
+	struct zram_bio_work *works;
+	struct bio_vec bvec;
+	struct bvec_iter iter;
+	unsigned int nr_pages = 0;
+	unsigned int i;
+
+	if (offset)
+		return false;
+
+	bio_for_each_segment(bvec, bio, iter) {
+		if (bvec.bv_offset || bvec.bv_len != PAGE_SIZE)
+			return false;
+		nr_pages++;
+	}
+
+	if (nr_pages < 2)
+		return false;
+
+	/* Never let reclaim stall on this; the sync path needs no memory */
+	ctx = kmalloc(sizeof(*ctx) + nr_pages * sizeof(*works),
+		      GFP_NOWAIT | __GFP_NOWARN);
+	if (!ctx)
+		return false;
+
+	/* Held until the last page completes, see zram_bio_work_fn() */
+	if (!zram_meta_get(zram)) {
+		kfree(ctx);
+		return false;
+	}
+
+	ctx->zram = zram;
+	ctx->bio = bio;
+	ctx->error = 0;
+	atomic_set(&ctx->pending, nr_pages);
+
+	works = (struct zram_bio_work *)(ctx + 1);
+	i = 0;
+	bio_for_each_segment(bvec, bio, iter) {
+		works[i].ctx = ctx;
+		works[i].bvec = bvec;
+		works[i].index = index + i;
+		INIT_WORK(&works[i].work, zram_bio_work_fn);
+		i++;
+	}
+
+	/* The submitter handles the first page itself instead of idling */
+	for (i = 1; i < nr_pages; i++)
+		queue_work(zram_io_wq, &works[i].work);
+	zram_bio_work_fn(&works[0].work);
+
+	return true;
+}
+
+static int zram_io_wq_init(void)
+{
+	zram_io_wq = alloc_workqueue("zram_io",
+			WQ_UNBOUND | WQ_HIGHPRI | WQ_MEM_RECLAIM, 0);
+	return zram_io_wq ? 0 : -ENOMEM;
+}
+
+static void zram_io_wq_destroy(void)
+{
+	if (zram_io_wq)
+		destroy_workqueue(zram_io_wq);
+	zram_io_wq = NULL;
+}
+#else
+static inline bool zram_make_request_async(struct zram *zram,
+				struct bio *bio, u32 index, int offset)
+{
+	return false;
+}
+static inline int zram_io_wq_init(void) { return 0; }
+static inline void zram_io_wq_destroy(void) {};
+#endif
+
 static void __zram_make_request(struct zram *zram, struct bio *bio)
 {
 	int offset;
@@ -898,6 +2265,9 @@ static void __zram_make_request(struct zram *zram, struct bio *bio)
 		return;
 	}
 
+	if (zram_make_request_async(zram, bio, index, offset))
+		return;
+
 	bio_for_each_segment(bvec, bio, iter) {
 		int max_transfer_size = PAGE_SIZE - offset;
 
@@ -913,17 +2283,17 @@ static void __zram_make_request(struct zram *zram, struct bio *bio)
 			bv.bv_offset = bvec.bv_offset;
 
 			if (zram_bvec_rw(zram, &bv, index, offset,
-					 op_is_write(bio_op(bio))) < 0)
+					 op_is_write(bio_op(bio)), bio) < 0)
 				goto out;
 
 			bv.bv_len = bvec.bv_len - max_transfer_size;
 			bv.bv_offset += max_transfer_size;
 			if (zram_bvec_rw(zram, &bv, index + 1, 0,
-					 op_is_write(bio_op(bio))) < 0)
+					 op_is_write(bio_op(bio)), bio) < 0)
 				goto out;
 		} else
 			if (zram_bvec_rw(zram, &bvec, index, offset,
-					 op_is_write(bio_op(bio))) < 0)
+					 op_is_write(bio_op(bio)), bio) < 0)
 				goto out;
 
 		update_position(&index, &offset, &bvec);
@@ -973,9 +2343,9 @@ static void zram_slot_free_notify(struct block_device *bdev,
 	zram = bdev->bd_disk->private_data;
 	meta = zram->meta;
 
-	bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+	zram_slot_lock(meta, index);
 	zram_free_page(zram, index);
-	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+	zram_slot_unlock(meta, index);
 	atomic64_inc(&zram->stats.notify_free);
 }
 
@@ -1004,7 +2374,7 @@ static int zram_rw_page(struct block_device *bdev, sector_t sector,
 	bv.bv_len = PAGE_SIZE;
 	bv.bv_offset = 0;
 
-	err = zram_bvec_rw(zram, &bv, index, offset, is_write);
+	err = zram_bvec_rw(zram, &bv, index, offset, is_write, NULL);
 put_zram:
 	zram_meta_put(zram);
 out:
@@ -1016,15 +2386,35 @@ static int zram_rw_page(struct block_device *bdev, sector_t sector,
 	 * bio->bi_end_io does things to handle the error
 	 * (e.g., SetPageError, set_page_dirty and extra works).
 	 */
-	if (err == 0)
+	switch (err) {
+	case 0:
 		page_endio(page, is_write, 0);
+		break;
+	case 1:
+		/* page_endio is done by the backing device bio completion */
+		err = 0;
+		break;
+	default:
+		break;
+	}
 	return err;
 }
 
+static void zram_destroy_comps(struct zcomp **comps)
+{
+	u32 prio;
+
+	for (prio = ZRAM_PRIMARY_COMP; prio < ZRAM_MAX_COMPS; prio++) {
+		if (comps[prio])
+			zcomp_destroy(comps[prio]);
+		comps[prio] = NULL;
+	}
+}
+
 static void zram_reset_device(struct zram *zram)
 {
 	struct zram_meta *meta;
-	struct zcomp *comp;
+	struct zcomp *comps[ZRAM_MAX_COMPS];
 	u64 disksize;
 
 	down_write(&zram->init_lock);
@@ -1037,7 +2427,9 @@ static void zram_reset_device(struct zram *zram)
 	}
 
 	meta = zram->meta;
-	comp = zram->comp;
+	memcpy(comps, zram->comps, sizeof(comps));
+	memset(zram->comps, 0, sizeof(zram->comps));
+	zram->num_active_comps = 0;
 	disksize = zram->disksize;
 	/*
 	 * Refcount will go down to 0 eventually and r/w handler
@@ -1061,7 +2453,8 @@ static void zram_reset_device(struct zram *zram)
 	up_write(&zram->init_lock);
 	/* I/O operation under all of CPU are done so let's free */
 	zram_meta_free(meta, disksize);
-	zcomp_destroy(comp);
+	zram_destroy_comps(comps);
+	reset_bdev(zram);
 }
 
 static ssize_t disksize_store(struct device *dev,
@@ -1072,35 +2465,44 @@ static ssize_t disksize_store(struct device *dev,
 	struct zram_meta *meta;
 	struct zram *zram = dev_to_zram(dev);
 	int err;
+	u32 prio;
 
 	disksize = memparse(buf, NULL);
 	if (!disksize)
 		return -EINVAL;
 
 	disksize = PAGE_ALIGN(disksize);
-	meta = zram_meta_alloc(zram->disk->disk_name, disksize);
+	meta = zram_meta_alloc(zram->disk->disk_name, disksize,
+				zram_use_dedup(zram));
 	if (!meta)
 		return -ENOMEM;
 
-	comp = zcomp_create(zram->compressor);
-	if (IS_ERR(comp)) {
-		pr_err("Cannot initialise %s compressing backend\n",
-				zram->compressor);
-		err = PTR_ERR(comp);
-		goto out_free_meta;
-	}
-
 	down_write(&zram->init_lock);
 	if (init_done(zram)) {
 		pr_info("Cannot change disksize for initialized device\n");
 		err = -EBUSY;
-		goto out_destroy_comp;
+		goto out_unlock;
+	}
+
+	for (prio = ZRAM_PRIMARY_COMP; prio < ZRAM_MAX_COMPS; prio++) {
+		if (!zram->comp_algs[prio])
+			continue;
+
+		comp = zcomp_create(zram->comp_algs[prio]);
+		if (IS_ERR(comp)) {
+			pr_err("Cannot initialise %s compressing backend\n",
+					zram->comp_algs[prio]);
+			err = PTR_ERR(comp);
+			goto out_destroy_comps;
+		}
+
+		zram->comps[prio] = comp;
+		zram->num_active_comps++;
 	}
 
 	init_waitqueue_head(&zram->io_done);
 	atomic_set(&zram->refcount, 1);
 	zram->meta = meta;
-	zram->comp = comp;
 	zram->disksize = disksize;
 	set_capacity(zram->disk, zram->disksize >> SECTOR_SHIFT);
 	zram_revalidate_disk(zram);
@@ -1108,10 +2510,11 @@ static ssize_t disksize_store(struct device *dev,
 
 	return len;
 
-out_destroy_comp:
+out_destroy_comps:
+	zram_destroy_comps(zram->comps);
+	zram->num_active_comps = 0;
+out_unlock:
 	up_write(&zram->init_lock);
-	zcomp_destroy(comp);
-out_free_meta:
 	zram_meta_free(meta, disksize);
 	return err;
 }
@@ -1193,6 +2596,19 @@ static DEVICE_ATTR_RW(mem_limit);
 static DEVICE_ATTR_RW(mem_used_max);
 static DEVICE_ATTR_RW(max_comp_streams);
 static DEVICE_ATTR_RW(comp_algorithm);
+static DEVICE_ATTR_WO(idle);
+#ifdef CONFIG_ZRAM_DEDUP
+static DEVICE_ATTR_RW(use_dedup);
+#endif
+#ifdef CONFIG_ZRAM_MULTI_COMP
+static DEVICE_ATTR_RW(recomp_algorithm);
+static DEVICE_ATTR_WO(recompress);
+#endif
+#ifdef CONFIG_ZRAM_WRITEBACK
+static DEVICE_ATTR_RW(backing_dev);
+static DEVICE_ATTR_WO(writeback);
+static DEVICE_ATTR_RO(bd_stat);
+#endif
 
 static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_disksize.attr,
@@ -1213,6 +2629,19 @@ static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_mem_used_max.attr,
 	&dev_attr_max_comp_streams.attr,
 	&dev_attr_comp_algorithm.attr,
+	&dev_attr_idle.attr,
+#ifdef CONFIG_ZRAM_DEDUP
+	&dev_attr_use_dedup.attr,
+#endif
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	&dev_attr_recomp_algorithm.attr,
+	&dev_attr_recompress.attr,
+#endif
+#ifdef CONFIG_ZRAM_WRITEBACK
+	&dev_attr_backing_dev.attr,
+	&dev_attr_writeback.attr,
+	&dev_attr_bd_stat.attr,
+#endif
 	&dev_attr_io_stat.attr,
 	&dev_attr_mm_stat.attr,
 	&dev_attr_debug_stat.attr,
@@ -1286,7 +2715,13 @@ static int zram_add(void)
 	blk_queue_io_min(zram->disk->queue, PAGE_SIZE);
 	blk_queue_io_opt(zram->disk->queue, PAGE_SIZE);
 	zram->disk->queue->limits.discard_granularity = PAGE_SIZE;
-	zram->disk->queue->limits.max_sectors = SECTORS_PER_PAGE;
+	/*
+	 * Let multi-page bios through: __zram_make_request() walks them a
+	 * page at a time, and zram_make_request_async() spreads their pages
+	 * over several CPUs.
+	 */
+	blk_queue_max_hw_sectors(zram->disk->queue,
+				 BIO_MAX_PAGES * SECTORS_PER_PAGE);
 	zram->disk->queue->limits.chunk_sectors = 0;
 	blk_queue_max_discard_sectors(zram->disk->queue, UINT_MAX);
 	/*
@@ -1312,7 +2747,7 @@ static int zram_add(void)
 				device_id);
 		goto out_free_disk;
 	}
-	strlcpy(zram->compressor, default_compressor, sizeof(zram->compressor));
+	comp_algorithm_set(zram, ZRAM_PRIMARY_COMP, default_compressor);
 	zram->meta = NULL;
 
 	pr_info("Added device: %s\n", zram->disk->disk_name);
@@ -1333,6 +2768,7 @@ static int zram_add(void)
 static int zram_remove(struct zram *zram)
 {
 	struct block_device *bdev;
+	u32 prio;
 
 	bdev = bdget_disk(zram->disk, 0);
 	if (!bdev)
@@ -1368,6 +2804,8 @@ static int zram_remove(struct zram *zram)
 	blk_cleanup_queue(zram->disk->queue);
 	del_gendisk(zram->disk);
 	put_disk(zram->disk);
+	for (prio = ZRAM_PRIMARY_COMP; prio < ZRAM_MAX_COMPS; prio++)
+		comp_algorithm_set(zram, prio, NULL);
 	kfree(zram);
 	return 0;
 }
@@ -1448,15 +2886,31 @@ static void destroy_devices(void)
 	idr_for_each(&zram_index_idr, &zram_remove_cb, NULL);
 	idr_destroy(&zram_index_idr);
 	unregister_blkdev(zram_major, "zram");
+	zram_io_wq_destroy();
+	cpuhp_remove_multi_state(CPUHP_ZCOMP_PREPARE);
 }
 
 static int __init zram_init(void)
 {
 	int ret;
 
+	ret = cpuhp_setup_state_multi(CPUHP_ZCOMP_PREPARE, "block/zram:prepare",
+				      zcomp_cpu_up_prepare, zcomp_cpu_dead);
+	if (ret < 0)
+		return ret;
+
+	ret = zram_io_wq_init();
+	if (ret) {
+		pr_err("Unable to allocate zram_io workqueue\n");
+		cpuhp_remove_multi_state(CPUHP_ZCOMP_PREPARE);
+		return ret;
+	}
+
 	ret = class_register(&zram_control_class);
 	if (ret) {
 		pr_err("Unable to register zram-control class\n");
+		zram_io_wq_destroy();
+		cpuhp_remove_multi_state(CPUHP_ZCOMP_PREPARE);
 		return ret;
 	}
 
@@ -1464,6 +2918,8 @@ static int __init zram_init(void)
 	if (zram_major <= 0) {
 		pr_err("Unable to get major number\n");
 		class_unregister(&zram_control_class);
+		zram_io_wq_destroy();
+		cpuhp_remove_multi_state(CPUHP_ZCOMP_PREPARE);
 		return -EBUSY;
 	}
 
@@ -43,6 +43,10 @@
 #include <linux/profile.h>
 #include <linux/notifier.h>
 #include <linux/string.h>
+#include <linux/bitmap.h>
+#include <linux/rculist_nulls.h>
+#include <linux/ktime.h>
+#include <linux/lowmemorykiller.h>
 #ifdef CONFIG_TEGRA_NVMAP
 #include <linux/nvmap.h>
 #endif
@@ -92,13 +96,140 @@ static unsigned long lowmem_count(struct shrinker *s,
 		global_node_page_state(NR_INACTIVE_FILE);
 }
 
+/*
+ * Processes are kept in buckets indexed by oom_score_adj, so that the
+ * shrinker only needs to look at the processes that are eligible for a
+ * kill instead of walking the whole task list on every call.
+ *
+ * Writers (fork, exit, exec and oom_score_adj updates) serialize on
+ * lowmem_bucket_lock, which is a leaf lock. It nests inside
+ * tasklist_lock, which is read-taken from hardirq context, so it must
+ * be taken with irqs disabled everywhere. The scanner walks the
+ * buckets locklessly under RCU; since a process can be moved to a
+ * different bucket while it is being looked at, the lists are nulls
+ * terminated with the bucket index and a walk that ends up on the wrong
+ * list is restarted.
+ */
+#define LOWMEM_NR_BUCKETS	(OOM_SCORE_ADJ_MAX - OOM_SCORE_ADJ_MIN + 1)
+
+static struct hlist_nulls_head lowmem_buckets[LOWMEM_NR_BUCKETS];
+static DECLARE_BITMAP(lowmem_bucket_map, LOWMEM_NR_BUCKETS);
+static DEFINE_SPINLOCK(lowmem_bucket_lock);
+static bool lowmem_buckets_ready;
+
+static inline unsigned int lowmem_adj_to_bucket(short oom_score_adj)
+{
+	return oom_score_adj - OOM_SCORE_ADJ_MIN;
+}
+
+static void __lowmem_bucket_add(struct task_struct *p)
+{
+	unsigned int idx = lowmem_adj_to_bucket(p->signal->oom_score_adj);
+
+	hlist_nulls_add_head_rcu(&p->lmk_node, &lowmem_buckets[idx]);
+	p->lmk_bucket = idx;
+	__set_bit(idx, lowmem_bucket_map);
+}
+
+static void __lowmem_bucket_del(struct task_struct *p)
+{
+	unsigned int idx = p->lmk_bucket;
+
+	if (hlist_nulls_unhashed(&p->lmk_node))
+		return;
+
+	hlist_nulls_del_init_rcu(&p->lmk_node);
+	if (hlist_nulls_empty(&lowmem_buckets[idx]))
+		__clear_bit(idx, lowmem_bucket_map);
+}
+
+void lowmem_task_add(struct task_struct *p)
+{
+	unsigned long flags;
+
+	if (!READ_ONCE(lowmem_buckets_ready))
+		return;
+
+	spin_lock_irqsave(&lowmem_bucket_lock, flags);
+	__lowmem_bucket_add(p);
+	spin_unlock_irqrestore(&lowmem_bucket_lock, flags);
+}
+
+void lowmem_task_del(struct task_struct *p)
+{
+	unsigned long flags;
+
+	if (!READ_ONCE(lowmem_buckets_ready))
+		return;
+
+	spin_lock_irqsave(&lowmem_bucket_lock, flags);
+	__lowmem_bucket_del(p);
+	spin_unlock_irqrestore(&lowmem_bucket_lock, flags);
+}
+
+void lowmem_task_replace(struct task_struct *old, struct task_struct *new)
+{
+	unsigned long flags;
+
+	if (!READ_ONCE(lowmem_buckets_ready))
+		return;
+
+	spin_lock_irqsave(&lowmem_bucket_lock, flags);
+	__lowmem_bucket_del(old);
+	__lowmem_bucket_add(new);
+	spin_unlock_irqrestore(&lowmem_bucket_lock, flags);
+}
+
+void lowmem_adj_update(struct task_struct *p)
+{
+	struct task_struct *leader;
+	unsigned long flags;
+
+	if (!READ_ONCE(lowmem_buckets_ready))
+		return;
+
+	spin_lock_irqsave(&lowmem_bucket_lock, flags);
+	/*
+	 * Only the current group leader is hashed; if an exec is switching
+	 * leaders under us, lowmem_task_replace() rehashes the new one with
+	 * the updated oom_score_adj.
+	 */
+	leader = READ_ONCE(p->group_leader);
+	if (!hlist_nulls_unhashed(&leader->lmk_node)) {
+		__lowmem_bucket_del(leader);
+		__lowmem_bucket_add(leader);
+	}
+	spin_unlock_irqrestore(&lowmem_bucket_lock, flags);
+}
+
+static void lowmem_buckets_init(void)
+{
+	struct task_struct *p;
+	int i;
+
+	for (i = 0; i < LOWMEM_NR_BUCKETS; i++)
+		INIT_HLIST_NULLS_HEAD(&lowmem_buckets[i], i);
+
+	/* Processes forked before we got here still need a bucket */
+	write_lock_irq(&tasklist_lock);
+	spin_lock(&lowmem_bucket_lock);
+	for_each_process(p)
+		__lowmem_bucket_add(p);
+	WRITE_ONCE(lowmem_buckets_ready, true);
+	spin_unlock(&lowmem_bucket_lock);
+	write_unlock_irq(&tasklist_lock);
+}
+
 static unsigned long lowmem_scan(struct shrinker *s, struct shrink_control *sc)
 {
 	struct task_struct *tsk;
 	struct task_struct *selected = NULL;
+	struct hlist_nulls_node *pos;
 	unsigned long rem = 0;
+	unsigned long idx, next, min_idx;
 	int tasksize;
 	int i;
+	int nr_scanned = 0;
 	short min_score_adj = OOM_SCORE_ADJ_MAX + 1;
 	int minfree = 0;
 	int selected_tasksize = 0;
@@ -115,6 +246,7 @@ static unsigned long lowmem_scan(struct shrinker *s, struct shrink_control *sc)
 				global_node_page_state(NR_SHMEM) -
 				global_node_page_state(NR_UNEVICTABLE) -
 				total_swapcache_pages();
+	u64 start;
 
 	if (lowmem_adj_size < array_size)
 		array_size = lowmem_adj_size;
@@ -139,47 +271,81 @@ static unsigned long lowmem_scan(struct shrinker *s, struct shrink_control *sc)
 	}
 
 	selected_oom_score_adj = min_score_adj;
+	min_idx = lowmem_adj_to_bucket(max_t(short, min_score_adj,
+					     OOM_SCORE_ADJ_MIN));
+	start = ktime_get_ns();
 
 	rcu_read_lock();
-	for_each_process(tsk) {
-		struct task_struct *p;
-		short oom_score_adj;
-
-		if (tsk->flags & PF_KTHREAD)
-			continue;
+	/*
+	 * Walk the non-empty buckets from the highest oom_score_adj down
+	 * and stop at the first one that yields a victim; within a bucket
+	 * the largest process wins.
+	 */
+	idx = find_last_bit(lowmem_bucket_map, LOWMEM_NR_BUCKETS);
+	while (idx < LOWMEM_NR_BUCKETS && idx >= min_idx) {
+restart:
+		hlist_nulls_for_each_entry_rcu(tsk, pos, &lowmem_buckets[idx],
+					       lmk_node) {
+			struct task_struct *p;
+			short oom_score_adj;
+
+			nr_scanned++;
+			if (tsk->flags & PF_KTHREAD)
+				continue;
 
-		p = find_lock_task_mm(tsk);
-		if (!p)
-			continue;
+			p = find_lock_task_mm(tsk);
+			if (!p)
+				continue;
 
-		if (task_lmk_waiting(p) &&
-		    time_before_eq(jiffies, lowmem_deathpending_timeout)) {
-			task_unlock(p);
-			rcu_read_unlock();
-			return 0;
-		}
-		oom_score_adj = p->signal->oom_score_adj;
-		if (oom_score_adj < min_score_adj) {
-			task_unlock(p);
-			continue;
-		}
-		tasksize = get_mm_rss(p->mm);
-		task_unlock(p);
-		if (tasksize <= 0)
-			continue;
-		if (selected) {
-			if (oom_score_adj < selected_oom_score_adj)
+			if (task_lmk_waiting(p) &&
+			    time_before_eq(jiffies, lowmem_deathpending_timeout)) {
+				task_unlock(p);
+				rcu_read_unlock();
+				trace_lowmemory_scan(NULL, min_score_adj, 0,
+						     nr_scanned,
+						     ktime_get_ns() - start);
+				return 0;
+			}
+			oom_score_adj = p->signal->oom_score_adj;
+			if (oom_score_adj < min_score_adj) {
+				task_unlock(p);
 				continue;
-			if (oom_score_adj == selected_oom_score_adj &&
-			    tasksize <= selected_tasksize)
+			}
+			tasksize = get_mm_rss(p->mm);
+			task_unlock(p);
+			if (tasksize <= 0)
 				continue;
+			if (selected) {
+				if (oom_score_adj < selected_oom_score_adj)
+					continue;
+				if (oom_score_adj == selected_oom_score_adj &&
+				    tasksize <= selected_tasksize)
+					continue;
+			}
+			selected = p;
+			selected_tasksize = tasksize;
+			selected_oom_score_adj = oom_score_adj;
+			lowmem_print(2, "select '%s' (%d), adj %hd, size %d, to kill\n",
+				     p->comm, p->pid, oom_score_adj, tasksize);
 		}
-		selected = p;
-		selected_tasksize = tasksize;
-		selected_oom_score_adj = oom_score_adj;
-		lowmem_print(2, "select '%s' (%d), adj %hd, size %d, to kill\n",
-			     p->comm, p->pid, oom_score_adj, tasksize);
+		/* We were moved to another bucket mid-walk, start over */
+		if (get_nulls_value(pos) != idx)
+			goto restart;
+		if (selected)
+			break;
+
+		/*
+		 * Nothing eligible in this bucket. find_last_bit() returns
+		 * its size argument when no lower bit is set, so don't let
+		 * it hand back the bucket we just scanned.
+		 */
+		next = find_last_bit(lowmem_bucket_map, idx);
+		if (next >= idx)
+			break;
+		idx = next;
 	}
+	trace_lowmemory_scan(selected, min_score_adj, selected_oom_score_adj,
+			     nr_scanned, ktime_get_ns() - start);
 	if (selected) {
 		long cache_size = other_file * (long)(PAGE_SIZE / 1024);
 		long cache_limit = minfree * (long)(PAGE_SIZE / 1024);
@@ -227,6 +393,7 @@ static struct shrinker lowmem_shrinker = {
 static int __init lowmem_init(void)
 {
 	int i = 0;
+	lowmem_buckets_init();
 	register_shrinker(&lowmem_shrinker);
 	for (i = 0; i < FREED_PROC_DEPTH; i++)
 		freed_procs[i] = &freed_procs_buffer[i * PROC_NAME_LENGTH];
@@ -34,6 +34,40 @@ TRACE_EVENT(lowmemory_kill,
 		__entry->pagecache_limit, __entry->free)
 );
 
+/*
+ * Emitted once per shrinker call that got as far as victim selection,
+ * with the time spent picking a victim. A latency histogram can be
+ * built from it with a hist trigger, e.g.
+ *
+ *   echo 'hist:keys=latency_us.log2:vals=nr_scanned' > \
+ *	events/lowmemorykiller/lowmemory_scan/trigger
+ */
+TRACE_EVENT(lowmemory_scan,
+	TP_PROTO(struct task_struct *victim, short min_adj, short victim_adj,
+		 int nr_scanned, u64 latency_ns),
+
+	TP_ARGS(victim, min_adj, victim_adj, nr_scanned, latency_ns),
+
+	TP_STRUCT__entry(
+			__field(pid_t, pid)
+			__field(short, min_adj)
+			__field(short, victim_adj)
+			__field(int, nr_scanned)
+			__field(u64, latency_us)
+	),
+
+	TP_fast_assign(
+			__entry->pid = victim ? victim->pid : 0;
+			__entry->min_adj = min_adj;
+			__entry->victim_adj = victim ? victim_adj : 0;
+			__entry->nr_scanned = nr_scanned;
+			__entry->latency_us = div_u64(latency_ns, NSEC_PER_USEC);
+	),
+
+	TP_printk("victim=%d min_adj=%hd victim_adj=%hd nr_scanned=%d latency=%lluus",
+		__entry->pid, __entry->min_adj, __entry->victim_adj,
+		__entry->nr_scanned, __entry->latency_us)
+);
 
 #endif /* if !defined(_TRACE_LOWMEMORYKILLER_H) || defined(TRACE_HEADER_MULTI_READ) */
 
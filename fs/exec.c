@@ -58,6 +58,7 @@
 #include <linux/compat.h>
 #include <linux/vmalloc.h>
 #include <linux/tegra_profiler.h>
+#include <linux/lowmemorykiller.h>
 
 #include <asm/uaccess.h>
 #include <asm/mmu_context.h>
@@ -1164,6 +1165,7 @@ static int de_thread(struct task_struct *tsk)
 
 		tsk->group_leader = tsk;
 		leader->group_leader = tsk;
+		lowmem_task_replace(leader, tsk);
 
 		tsk->exit_signal = SIGCHLD;
 		leader->exit_signal = -1;
@@ -154,6 +154,8 @@ int ext4_mpage_readpages(struct address_space *mapping,
 	int length;
 	unsigned relative_block = 0;
 	struct ext4_map_blocks map;
+	struct page *batch[PAGEVEC_SIZE];
+	unsigned int batch_idx = 0, batch_nr = 0;
 
 	memset(blocks, 0x0, sizeof(blocks));
 	map.m_pblk = 0;
@@ -165,14 +167,18 @@ int ext4_mpage_readpages(struct address_space *mapping,
 		int fully_mapped = 1;
 		unsigned first_hole = blocks_per_page;
 
-		prefetchw(&page->flags);
 		if (pages) {
-			page = list_entry(pages->prev, struct page, lru);
-			list_del(&page->lru);
-			if (add_to_page_cache_lru(page, mapping, page->index,
-				  readahead_gfp_mask(mapping)))
+			if (batch_idx == batch_nr) {
+				batch_nr = add_to_page_cache_lru_batch(mapping,
+						pages, batch, ARRAY_SIZE(batch),
+						readahead_gfp_mask(mapping));
+				batch_idx = 0;
+			}
+			page = batch[batch_idx++];
+			if (!page)
 				goto next_page;
 		}
+		prefetchw(&page->flags);
 
 		if (page_has_buffers(page))
 			goto confused;
@@ -323,7 +329,7 @@ int ext4_mpage_readpages(struct address_space *mapping,
 		else
 			unlock_page(page);
 	next_page:
-		if (pages)
+		if (pages && page)
 			put_page(page);
 	}
 	BUG_ON(pages && !list_empty(pages));
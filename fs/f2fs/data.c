@@ -1434,6 +1434,8 @@ static int f2fs_mpage_readpages(struct address_space *mapping,
 	sector_t last_block_in_file;
 	sector_t block_nr;
 	struct f2fs_map_blocks map;
+	struct page *batch[PAGEVEC_SIZE];
+	unsigned int batch_idx = 0, batch_nr = 0;
 
 	map.m_pblk = 0;
 	map.m_lblk = 0;
@@ -1445,13 +1447,14 @@ static int f2fs_mpage_readpages(struct address_space *mapping,
 
 	for (; nr_pages; nr_pages--) {
 		if (pages) {
-			page = list_last_entry(pages, struct page, lru);
-
-			prefetchw(&page->flags);
-			list_del(&page->lru);
-			if (add_to_page_cache_lru(page, mapping,
-						  page->index,
-						  readahead_gfp_mask(mapping)))
+			if (batch_idx == batch_nr) {
+				batch_nr = add_to_page_cache_lru_batch(mapping,
+						pages, batch, ARRAY_SIZE(batch),
+						readahead_gfp_mask(mapping));
+				batch_idx = 0;
+			}
+			page = batch[batch_idx++];
+			if (!page)
 				goto next_page;
 		}
 
@@ -1536,7 +1539,7 @@ static int f2fs_mpage_readpages(struct address_space *mapping,
 		}
 		unlock_page(page);
 next_page:
-		if (pages)
+		if (pages && page)
 			put_page(page);
 	}
 	BUG_ON(pages && !list_empty(pages));
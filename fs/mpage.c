@@ -402,24 +402,28 @@ mpage_readpages(struct address_space *mapping, struct list_head *pages,
 	struct buffer_head map_bh;
 	unsigned long first_logical_block = 0;
 	gfp_t gfp = readahead_gfp_mask(mapping);
+	struct page *batch[PAGEVEC_SIZE];
+	unsigned int batch_idx = 0, batch_nr = 0;
 
 	map_bh.b_state = 0;
 	map_bh.b_size = 0;
 	for (page_idx = 0; page_idx < nr_pages; page_idx++) {
-		struct page *page = lru_to_page(pages);
+		struct page *page;
 
-		prefetchw(&page->flags);
-		list_del(&page->lru);
-		if (!add_to_page_cache_lru(page, mapping,
-					page->index,
-					gfp)) {
+		if (batch_idx == batch_nr) {
+			batch_nr = add_to_page_cache_lru_batch(mapping, pages,
+					batch, ARRAY_SIZE(batch), gfp);
+			batch_idx = 0;
+		}
+		page = batch[batch_idx++];
+		if (page) {
 			bio = do_mpage_readpage(bio, page,
 					nr_pages - page_idx,
 					&last_block_in_bio, &map_bh,
 					&first_logical_block,
 					get_block, gfp);
+			put_page(page);
 		}
-		put_page(page);
 	}
 	BUG_ON(!list_empty(pages));
 	if (bio)
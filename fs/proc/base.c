@@ -88,6 +88,8 @@
 #include <linux/flex_array.h>
 #include <linux/posix-timers.h>
 #include <linux/cpufreq_times.h>
+#include <linux/lowmemorykiller.h>
+#include <linux/fault_latency.h>
 #ifdef CONFIG_HARDWALL
 #include <asm/hardwall.h>
 #endif
@@ -1122,6 +1124,7 @@ static int __set_oom_adj(struct file *file, int oom_adj, bool legacy)
 	if (!legacy && has_capability_noaudit(current, CAP_SYS_RESOURCE))
 		task->signal->oom_score_adj_min = (short)oom_adj;
 	trace_oom_score_adj_update(task);
+	lowmem_adj_update(task);
 
 	if (mm) {
 		struct task_struct *p;
@@ -1144,6 +1147,7 @@ static int __set_oom_adj(struct file *file, int oom_adj, bool legacy)
 				p->signal->oom_score_adj = oom_adj;
 				if (!legacy && has_capability_noaudit(current, CAP_SYS_RESOURCE))
 					p->signal->oom_score_adj_min = (short)oom_adj;
+				lowmem_adj_update(p);
 			}
 			task_unlock(p);
 		}
@@ -1541,6 +1545,79 @@ static const struct file_operations proc_pid_sched_autogroup_operations = {
 
 #endif /* CONFIG_SCHED_AUTOGROUP */
 
+#ifdef CONFIG_SCHED_WALT
+/*
+ * Print out the related thread group of a task, 0 if none:
+ */
+static int sched_group_id_show(struct seq_file *m, void *v)
+{
+	struct inode *inode = m->private;
+	struct task_struct *p;
+
+	p = get_proc_task(inode);
+	if (!p)
+		return -ESRCH;
+
+	seq_printf(m, "%u\n", sched_get_group_id(p));
+
+	put_task_struct(p);
+
+	return 0;
+}
+
+static ssize_t
+sched_group_id_write(struct file *file, const char __user *buf,
+	    size_t count, loff_t *offset)
+{
+	struct inode *inode = file_inode(file);
+	struct task_struct *p;
+	unsigned int group_id;
+	int err;
+
+	err = kstrtouint_from_user(buf, count, 0, &group_id);
+	if (err < 0)
+		return err;
+
+	p = get_proc_task(inode);
+	if (!p)
+		return -ESRCH;
+
+	/* Group members get higher frequencies and the big CPUs */
+	if (!capable(CAP_SYS_NICE)) {
+		count = -EPERM;
+		goto out;
+	}
+
+	err = security_task_setscheduler(p);
+	if (err) {
+		count = err;
+		goto out;
+	}
+
+	err = sched_set_group_id(p, group_id);
+	if (err)
+		count = err;
+
+out:
+	put_task_struct(p);
+
+	return count;
+}
+
+static int sched_group_id_open(struct inode *inode, struct file *filp)
+{
+	return single_open(filp, sched_group_id_show, inode);
+}
+
+static const struct file_operations proc_pid_sched_group_id_operations = {
+	.open		= sched_group_id_open,
+	.read		= seq_read,
+	.write		= sched_group_id_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+#endif /* CONFIG_SCHED_WALT */
+
 static ssize_t comm_write(struct file *file, const char __user *buf,
 				size_t count, loff_t *offset)
 {
@@ -3082,6 +3159,46 @@ static int proc_pid_personality(struct seq_file *m, struct pid_namespace *ns,
 	return err;
 }
 
+#ifdef CONFIG_KSM
+static int proc_pid_ksm_merging_pages(struct seq_file *m,
+				      struct pid_namespace *ns,
+				      struct pid *pid, struct task_struct *task)
+{
+	struct mm_struct *mm;
+
+	mm = get_task_mm(task);
+	if (mm) {
+		seq_printf(m, "%lu\n", mm->ksm_merging_pages);
+		mmput(mm);
+	}
+
+	return 0;
+}
+#endif
+
+#ifdef CONFIG_FAULT_LATENCY_HIST
+static int proc_pid_fault_latency(struct seq_file *m, struct pid_namespace *ns,
+				  struct pid *pid, struct task_struct *task)
+{
+	struct fault_latency_hist *sum;
+	struct mm_struct *mm;
+
+	mm = get_task_mm(task);
+	if (!mm)
+		return 0;
+
+	sum = kzalloc(sizeof(*sum), GFP_KERNEL);
+	if (sum) {
+		fault_latency_hist_add(sum, mm->fault_latency);
+		fault_latency_hist_show(m, sum);
+		kfree(sum);
+	}
+	mmput(mm);
+
+	return sum ? 0 : -ENOMEM;
+}
+#endif
+
 /*
  * Thread groups
  */
@@ -3107,6 +3224,9 @@ static const struct pid_entry tgid_base_stuff[] = {
 #endif
 #ifdef CONFIG_SCHED_AUTOGROUP
 	REG("autogroup",  S_IRUGO|S_IWUSR, proc_pid_sched_autogroup_operations),
+#endif
+#ifdef CONFIG_SCHED_WALT
+	REG("sched_group_id", S_IRUGO|S_IWUGO, proc_pid_sched_group_id_operations),
 #endif
 	REG("comm",      S_IRUGO|S_IWUSR, proc_pid_set_comm_operations),
 #ifdef CONFIG_HAVE_ARCH_TRACEHOOK
@@ -3193,6 +3313,12 @@ static const struct pid_entry tgid_base_stuff[] = {
 #ifdef CONFIG_CPU_FREQ_TIMES
 	ONE("time_in_state", 0444, proc_time_in_state_show),
 #endif
+#ifdef CONFIG_KSM
+	ONE("ksm_merging_pages", S_IRUSR, proc_pid_ksm_merging_pages),
+#endif
+#ifdef CONFIG_FAULT_LATENCY_HIST
+	ONE("fault_latency", S_IRUSR, proc_pid_fault_latency),
+#endif
 };
 
 static int proc_tgid_base_readdir(struct file *file, struct dir_context *ctx)
@@ -3207,6 +3333,18 @@ static const struct file_operations proc_tgid_base_operations = {
 	.llseek		= generic_file_llseek,
 };
 
+/*
+ * An open /proc/<pid> directory refers to the process for as long as it
+ * is open, even if the pid gets reused, so it can stand in for a pidfd.
+ */
+struct pid *tgid_pidfd_to_pid(const struct file *file)
+{
+	if (file->f_op != &proc_tgid_base_operations)
+		return ERR_PTR(-EBADF);
+
+	return proc_pid(file_inode(file));
+}
+
 static struct dentry *proc_tgid_base_lookup(struct inode *dir, struct dentry *dentry, unsigned int flags)
 {
 	return proc_pident_lookup(dir, dentry,
@@ -3506,6 +3644,9 @@ static const struct pid_entry tid_base_stuff[] = {
 	ONE("limits",	 S_IRUGO, proc_pid_limits),
 #ifdef CONFIG_SCHED_DEBUG
 	REG("sched",     S_IRUGO|S_IWUSR, proc_pid_sched_operations),
+#endif
+#ifdef CONFIG_SCHED_WALT
+	REG("sched_group_id", S_IRUGO|S_IWUGO, proc_pid_sched_group_id_operations),
 #endif
 	NOD("comm",      S_IFREG|S_IRUGO|S_IWUSR,
 			 &proc_tid_comm_inode_operations,
@@ -3589,6 +3730,12 @@ static const struct pid_entry tid_base_stuff[] = {
 #ifdef CONFIG_CPU_FREQ_TIMES
 	ONE("time_in_state", 0444, proc_time_in_state_show),
 #endif
+#ifdef CONFIG_KSM
+	ONE("ksm_merging_pages", S_IRUSR, proc_pid_ksm_merging_pages),
+#endif
+#ifdef CONFIG_FAULT_LATENCY_HIST
+	ONE("fault_latency", S_IRUSR, proc_pid_fault_latency),
+#endif
 };
 
 static int proc_tid_base_readdir(struct file *file, struct dir_context *ctx)
@@ -348,6 +348,9 @@ asmlinkage ssize_t compat_sys_preadv2(compat_ulong_t fd,
 asmlinkage ssize_t compat_sys_pwritev2(compat_ulong_t fd,
 		const struct compat_iovec __user *vec,
 		compat_ulong_t vlen, u32 pos_low, u32 pos_high, int flags);
+asmlinkage long compat_sys_process_madvise(compat_int_t pidfd,
+		const struct compat_iovec __user *vec, compat_size_t vlen,
+		compat_int_t behavior, compat_uint_t flags);
 
 #ifdef __ARCH_WANT_COMPAT_SYS_PREADV64
 asmlinkage long compat_sys_preadv64(unsigned long fd,
@@ -0,0 +1,144 @@
+#ifndef _LINUX_DAMON_H
+#define _LINUX_DAMON_H
+
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/types.h>
+
+/* Minimal size of a monitoring region */
+#define DAMON_MIN_REGION	PAGE_SIZE
+
+/**
+ * struct damon_addr_range - A half-open address range, [start, end).
+ */
+struct damon_addr_range {
+	unsigned long start;
+	unsigned long end;
+};
+
+/**
+ * struct damon_region - A region of a target address space.
+ * @ar:			The address range of the region.
+ * @sampling_addr:	Address of the sample for the next access check.
+ * @nr_accesses:	Number of sampling intervals the region was accessed
+ *			in, during the current aggregation interval.
+ * @age:		Number of aggregation intervals the access frequency
+ *			of the region stayed about the same.
+ * @last_nr_accesses:	@nr_accesses of the last aggregation interval.
+ * @list:		Entry in &damon_target->regions_list.
+ */
+struct damon_region {
+	struct damon_addr_range ar;
+	unsigned long sampling_addr;
+	unsigned int nr_accesses;
+	unsigned int age;
+	unsigned int last_nr_accesses;
+	struct list_head list;
+};
+
+/**
+ * struct damon_target - A monitored process.
+ * @pid:		The process, pinned while monitored.
+ * @nr_regions:		Number of regions in @regions_list.
+ * @regions_list:	The regions, sorted by address and not overlapping.
+ * @list:		Entry in &damon_ctx->targets.
+ */
+struct damon_target {
+	struct pid *pid;
+	unsigned int nr_regions;
+	struct list_head regions_list;
+	struct list_head list;
+};
+
+/**
+ * enum damos_action - What to do with the regions a scheme matches.
+ * @DAMOS_COLD:		Move the pages to the inactive LRU, like MADV_COLD.
+ * @DAMOS_PAGEOUT:	Reclaim the pages right away, like MADV_PAGEOUT.
+ * @DAMOS_STAT:		Only count the matching regions.
+ */
+enum damos_action {
+	DAMOS_COLD,
+	DAMOS_PAGEOUT,
+	DAMOS_STAT,
+	NR_DAMOS_ACTIONS,
+};
+
+/**
+ * struct damos - A data access monitoring based operation scheme.
+ *
+ * Regions whose size, number of accesses per aggregation interval and age
+ * (in aggregation intervals) are all within the given inclusive bounds get
+ * @action applied, after which their age starts from zero again.
+ *
+ * @stat_count and @stat_sz count the regions and bytes the scheme was
+ * applied to.
+ */
+struct damos {
+	unsigned long min_sz_region;
+	unsigned long max_sz_region;
+	unsigned int min_nr_accesses;
+	unsigned int max_nr_accesses;
+	unsigned int min_age_region;
+	unsigned int max_age_region;
+	enum damos_action action;
+	unsigned long stat_count;
+	unsigned long stat_sz;
+	struct list_head list;
+};
+
+/**
+ * struct damon_ctx - The monitoring context.
+ * @sample_interval:	Time between access checks, in microseconds.
+ * @aggr_interval:	Time between aggregations of the access checks, in
+ *			microseconds.
+ * @update_interval:	Time between updates of the monitored address ranges
+ *			from the vmas of the targets, in microseconds.
+ * @min_nr_regions:	Lower bound of the number of regions.
+ * @max_nr_regions:	Upper bound of the number of regions.
+ *
+ * @kdamond:		The monitoring thread, or NULL if not running.
+ * @kdamond_done:	Set by the monitoring thread when it stops by itself.
+ * @kdamond_lock:	Protects the above and the configuration; the
+ *			configuration can't be changed while @kdamond runs.
+ *
+ * @targets:		The monitored processes.
+ * @schemes:		The operation schemes to apply.
+ */
+struct damon_ctx {
+	unsigned long sample_interval;
+	unsigned long aggr_interval;
+	unsigned long update_interval;
+	unsigned long min_nr_regions;
+	unsigned long max_nr_regions;
+
+	struct task_struct *kdamond;
+	bool kdamond_done;
+	struct mutex kdamond_lock;
+
+	struct list_head targets;
+	struct list_head schemes;
+
+	/* private: */
+	unsigned int last_nr_regions;
+};
+
+#define damon_for_each_region(r, t) \
+	list_for_each_entry(r, &(t)->regions_list, list)
+
+#define damon_for_each_region_safe(r, next, t) \
+	list_for_each_entry_safe(r, next, &(t)->regions_list, list)
+
+#define damon_for_each_target(t, ctx) \
+	list_for_each_entry(t, &(ctx)->targets, list)
+
+#define damon_for_each_target_safe(t, next, ctx) \
+	list_for_each_entry_safe(t, next, &(ctx)->targets, list)
+
+#define damon_for_each_scheme(s, ctx) \
+	list_for_each_entry(s, &(ctx)->schemes, list)
+
+#define damon_for_each_scheme_safe(s, next, ctx) \
+	list_for_each_entry_safe(s, next, &(ctx)->schemes, list)
+
+#endif /* _LINUX_DAMON_H */
@@ -0,0 +1,84 @@
+#ifndef _LINUX_FAULT_LATENCY_H
+#define _LINUX_FAULT_LATENCY_H
+
+#include <linux/mm.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/types.h>
+
+struct mm_struct;
+struct seq_file;
+
+enum fault_latency_type {
+	FAULT_LATENCY_MINOR,	/* no I/O was needed */
+	FAULT_LATENCY_FILE,	/* major fault reading a file page */
+	FAULT_LATENCY_SWAP,	/* major fault reading from swap, e.g. zram */
+	NR_FAULT_LATENCY_TYPES,
+};
+
+/*
+ * Bucket 0 counts faults that took less than 1 << FAULT_LATENCY_SHIFT ns,
+ * bucket n faults that took [1 << (n + FAULT_LATENCY_SHIFT - 1),
+ * 1 << (n + FAULT_LATENCY_SHIFT)) ns, and the last bucket everything
+ * longer, from about 67ms on.
+ */
+#define FAULT_LATENCY_SHIFT		8
+#define NR_FAULT_LATENCY_BUCKETS	20
+
+struct fault_latency_hist {
+	unsigned long count[NR_FAULT_LATENCY_TYPES][NR_FAULT_LATENCY_BUCKETS];
+};
+
+#ifdef CONFIG_FAULT_LATENCY_HIST
+/*
+ * A fault that returned VM_FAULT_RETRY is handled again with
+ * FAULT_FLAG_TRIED; it is timed and classified from its first pass.
+ */
+static inline void fault_latency_start(unsigned int flags)
+{
+	if (flags & FAULT_FLAG_TRIED)
+		return;
+
+	current->fault_latency_start = local_clock();
+	current->fault_latency_major = false;
+	current->fault_latency_swapin = false;
+}
+
+/* do_swap_page() had to read the page from swap */
+static inline void fault_latency_swapin(void)
+{
+	current->fault_latency_swapin = true;
+}
+
+void fault_latency_account(struct mm_struct *mm, bool file, int ret);
+void fault_latency_hist_add(struct fault_latency_hist *sum,
+			    struct fault_latency_hist __percpu *hist);
+void fault_latency_hist_show(struct seq_file *m,
+			     struct fault_latency_hist *sum);
+int mm_fault_latency_init(struct mm_struct *mm);
+void mm_fault_latency_free(struct mm_struct *mm);
+#else
+static inline void fault_latency_start(unsigned int flags)
+{
+}
+
+static inline void fault_latency_swapin(void)
+{
+}
+
+static inline void fault_latency_account(struct mm_struct *mm, bool file,
+					 int ret)
+{
+}
+
+static inline int mm_fault_latency_init(struct mm_struct *mm)
+{
+	return 0;
+}
+
+static inline void mm_fault_latency_free(struct mm_struct *mm)
+{
+}
+#endif /* CONFIG_FAULT_LATENCY_HIST */
+
+#endif /* _LINUX_FAULT_LATENCY_H */
@@ -890,6 +890,8 @@ struct file_ra_state {
 
 	unsigned int ra_pages;		/* Maximum readahead window */
 	unsigned int mmap_miss;		/* Cache miss stat for mmap accesses */
+	unsigned int shrink;		/* Window scaled down by 1 << shrink
+					   after readahead misses */
 	loff_t prev_pos;		/* Cache last read() position */
 };
 
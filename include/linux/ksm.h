@@ -24,6 +24,8 @@ void __ksm_exit(struct mm_struct *mm);
 
 static inline int ksm_fork(struct mm_struct *mm, struct mm_struct *oldmm)
 {
+	/* Only pages merged by ksmd are counted, not those shared by fork */
+	mm->ksm_merging_pages = 0;
 	if (test_bit(MMF_VM_MERGEABLE, &oldmm->flags))
 		return __ksm_enter(mm);
 	return 0;
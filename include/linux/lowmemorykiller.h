@@ -0,0 +1,25 @@
+#ifndef _LINUX_LOWMEMORYKILLER_H
+#define _LINUX_LOWMEMORYKILLER_H
+
+struct task_struct;
+
+#ifdef CONFIG_ANDROID_LOW_MEMORY_KILLER
+/*
+ * The lowmemorykiller keeps every process in a bucket indexed by its
+ * oom_score_adj so that victim selection does not have to walk the
+ * whole task list. These hooks keep the buckets in sync; all of them
+ * take thread group leaders.
+ */
+void lowmem_task_add(struct task_struct *p);
+void lowmem_task_del(struct task_struct *p);
+void lowmem_task_replace(struct task_struct *old, struct task_struct *new);
+void lowmem_adj_update(struct task_struct *p);
+#else
+static inline void lowmem_task_add(struct task_struct *p) {}
+static inline void lowmem_task_del(struct task_struct *p) {}
+static inline void lowmem_task_replace(struct task_struct *old,
+				       struct task_struct *new) {}
+static inline void lowmem_adj_update(struct task_struct *p) {}
+#endif
+
+#endif /* _LINUX_LOWMEMORYKILLER_H */
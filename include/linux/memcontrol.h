@@ -29,6 +29,7 @@
 #include <linux/mmzone.h>
 #include <linux/writeback.h>
 #include <linux/page-flags.h>
+#include <linux/fault_latency.h>
 
 struct mem_cgroup;
 struct page;
@@ -107,6 +108,9 @@ struct mem_cgroup_stat_cpu {
 	unsigned long events[MEMCG_NR_EVENTS];
 	unsigned long nr_page_events;
 	unsigned long targets[MEM_CGROUP_NTARGETS];
+#ifdef CONFIG_FAULT_LATENCY_HIST
+	struct fault_latency_hist fault_latency;
+#endif
 };
 
 struct mem_cgroup_reclaim_iter {
@@ -559,6 +563,24 @@ static inline void mem_cgroup_count_vm_event(struct mm_struct *mm,
 out:
 	rcu_read_unlock();
 }
+
+#ifdef CONFIG_FAULT_LATENCY_HIST
+static inline void mem_cgroup_count_fault_latency(struct mm_struct *mm,
+					enum fault_latency_type type,
+					unsigned int bucket)
+{
+	struct mem_cgroup *memcg;
+
+	if (mem_cgroup_disabled())
+		return;
+
+	rcu_read_lock();
+	memcg = mem_cgroup_from_task(rcu_dereference(mm->owner));
+	if (likely(memcg))
+		this_cpu_inc(memcg->stat->fault_latency.count[type][bucket]);
+	rcu_read_unlock();
+}
+#endif
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 void mem_cgroup_split_huge_fixup(struct page *head);
 #endif
@@ -771,6 +793,12 @@ static inline
 void mem_cgroup_count_vm_event(struct mm_struct *mm, enum vm_event_item idx)
 {
 }
+
+static inline void mem_cgroup_count_fault_latency(struct mm_struct *mm,
+					enum fault_latency_type type,
+					unsigned int bucket)
+{
+}
 #endif /* CONFIG_MEMCG */
 
 #ifdef CONFIG_CGROUP_WRITEBACK
@@ -8,6 +8,7 @@
 #include <linux/spinlock.h>
 #include <linux/rbtree.h>
 #include <linux/rwsem.h>
+#include <linux/seqlock.h>
 #include <linux/completion.h>
 #include <linux/cpumask.h>
 #include <linux/uprobes.h>
@@ -366,6 +367,14 @@ struct vm_area_struct {
 	struct mempolicy *vm_policy;	/* NUMA policy for the VMA */
 #endif
 	struct vm_userfaultfd_ctx vm_userfaultfd_ctx;
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	/*
+	 * Bumped around every change to the fields the speculative
+	 * fault handler relies on; see vm_write_begin().
+	 */
+	seqcount_t vm_sequence;
+	struct rcu_head vm_rcu_head;	/* Deferred free, see free_vma() */
+#endif
 };
 
 struct core_thread {
@@ -404,6 +413,9 @@ struct kioctx_table;
 struct mm_struct {
 	struct vm_area_struct *mmap;		/* list of VMAs */
 	struct rb_root mm_rb;
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	rwlock_t mm_rb_lock;			/* Protects mm_rb against speculative lookups */
+#endif
 	u64 vmacache_seqnum;                   /* per-thread vmacache */
 #ifdef CONFIG_MMU
 	unsigned long (*get_unmapped_area) (struct file *filp,
@@ -527,9 +539,24 @@ struct mm_struct {
 #endif
 #ifdef CONFIG_HUGETLB_PAGE
 	atomic_long_t hugetlb_usage;
+#endif
+#ifdef CONFIG_KSM
+	/*
+	 * Number of pages of this mm merged into ksm pages, updated by
+	 * ksmd under ksm_thread_mutex.
+	 */
+	unsigned long ksm_merging_pages;
+#endif
+#ifdef CONFIG_FAULT_LATENCY_HIST
+	struct fault_latency_hist __percpu *fault_latency;
 #endif
 	struct work_struct async_put_work;
 
+#ifdef CONFIG_LRU_GEN
+	/* on the list of mms the multi-gen LRU aging walks, see vmscan.c */
+	struct list_head lru_gen_list;
+#endif
+
 #if IS_ENABLED(CONFIG_HMM)
 	/* HMM needs to track a few things per mm */
 	struct hmm *hmm;
@@ -222,11 +222,71 @@ struct zone_reclaim_stat {
 	unsigned long		recent_scanned[2];
 };
 
+#endif /* !__GENERATING_BOUNDS_H */
+
+/*
+ * The multi-gen LRU sorts evictable pages into generations by the time
+ * they were last found accessed. A page's generation number lives in
+ * page->flags (LRU_GEN_MASK) and is an index into lrugen->lists[],
+ * computed from a sequence number: max_seq is the youngest generation,
+ * min_seq[type] the oldest one of each type.
+ *
+ * Pages accessed through page tables are promoted to max_seq by the
+ * aging, which walks page tables rather than the rmap. Pages accessed
+ * through file descriptors are only counted (LRU_REFS_MASK) and sorted
+ * into tiers by order_base_2(refs + 1); tiers that refault more than
+ * the first tier of the other type get protected from eviction.
+ */
+#define MIN_NR_GENS		2
+#define MAX_NR_GENS		4
+#define MAX_NR_TIERS		4
+
+#ifndef __GENERATING_BOUNDS_H
+
+#ifdef CONFIG_LRU_GEN
+
+#define LRU_GEN_ANON		0
+#define LRU_GEN_FILE		1
+#define ANON_AND_FILE		2
+
+struct lru_gen_struct {
+	/* the youngest generation, shared by both types */
+	unsigned long max_seq;
+	/* the oldest generation of each type */
+	unsigned long min_seq[ANON_AND_FILE];
+	/* the multi-gen LRU lists */
+	struct list_head lists[MAX_NR_GENS][ANON_AND_FILE][MAX_NR_ZONES];
+	/* the sizes of the above lists */
+	long nr_pages[MAX_NR_GENS][ANON_AND_FILE][MAX_NR_ZONES];
+	/* refault/eviction averages of previous generations, per tier */
+	unsigned long avg_refaulted[ANON_AND_FILE][MAX_NR_TIERS];
+	unsigned long avg_total[ANON_AND_FILE][MAX_NR_TIERS];
+	/* pages kept back from eviction, per tier but the first */
+	unsigned long protected[ANON_AND_FILE][MAX_NR_TIERS - 1];
+	/* evictions and refaults of the current min_seq, per tier */
+	atomic_long_t evicted[ANON_AND_FILE][MAX_NR_TIERS];
+	atomic_long_t refaulted[ANON_AND_FILE][MAX_NR_TIERS];
+	/* whether this lruvec uses the lists above, see lru_gen_enabled() */
+	bool enabled;
+};
+
+#endif /* CONFIG_LRU_GEN */
+
 struct lruvec {
 	struct list_head		lists[NR_LRU_LISTS];
 	struct zone_reclaim_stat	reclaim_stat;
-	/* Evictions & activations on the inactive file list */
+	/*
+	 * Reclaim cost of each LRU type: pages that had to be written
+	 * out or that refaulted soon after eviction. Protected by the
+	 * node's lru_lock; see lru_note_cost().
+	 */
+	unsigned long			anon_cost;
+	unsigned long			file_cost;
+	/* Evictions & activations on the inactive lists */
 	atomic_long_t			inactive_age;
+#ifdef CONFIG_LRU_GEN
+	struct lru_gen_struct		lrugen;
+#endif
 #ifdef CONFIG_MEMCG
 	struct pglist_data *pgdat;
 #endif
@@ -260,13 +320,19 @@ enum zone_watermarks {
 #define low_wmark_pages(z) (z->watermark[WMARK_LOW])
 #define high_wmark_pages(z) (z->watermark[WMARK_HIGH])
 
+/*
+ * The pcp lists cache pages of every order up to PAGE_ALLOC_COSTLY_ORDER,
+ * one list per order and migrate type.
+ */
+#define NR_PCP_LISTS (MIGRATE_PCPTYPES * (PAGE_ALLOC_COSTLY_ORDER + 1))
+
 struct per_cpu_pages {
-	int count;		/* number of pages in the list */
+	int count;		/* number of base pages in the lists */
 	int high;		/* high watermark, emptying needed */
 	int batch;		/* chunk size for buddy add/remove */
 
-	/* Lists of pages, one per migrate type stored on the pcp-lists */
-	struct list_head lists[MIGRATE_PCPTYPES];
+	/* Lists of pages, indexed by order_to_pindex() */
+	struct list_head lists[NR_PCP_LISTS];
 };
 
 struct per_cpu_pageset {
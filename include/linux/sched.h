@@ -43,6 +43,7 @@ struct sched_param {
 #include <linux/seccomp.h>
 #include <linux/rcupdate.h>
 #include <linux/rculist.h>
+#include <linux/list_nulls.h>
 #include <linux/rtmutex.h>
 
 #include <linux/time.h>
@@ -63,6 +64,7 @@ struct sched_param {
 #include <asm/processor.h>
 
 #define SCHED_ATTR_SIZE_VER0	48	/* sizeof first published struct */
+#define SCHED_ATTR_SIZE_VER1	56	/* add: util_{min,max} */
 
 /*
  * Extended scheduling parameters data structure.
@@ -100,6 +102,12 @@ struct sched_param {
  *  @sched_runtime	representative of the task's runtime
  *  @sched_period	representative of the task's period
  *
+ * The @sched_util_min and @sched_util_max fields, in the [0..1024] range of
+ * SCHED_CAPACITY_SCALE, clamp the utilization the scheduler and schedutil
+ * see for a SCHED_NORMAL, SCHED_BATCH, SCHED_IDLE, SCHED_FIFO or SCHED_RR
+ * task. They are only updated when SCHED_FLAG_UTIL_CLAMP_MIN or
+ * SCHED_FLAG_UTIL_CLAMP_MAX is set in @sched_flags.
+ *
  * Given this task model, there are a multiplicity of scheduling algorithms
  * and policies, that can be used to ensure all the tasks will make their
  * timing constraints.
@@ -124,6 +132,10 @@ struct sched_attr {
 	u64 sched_runtime;
 	u64 sched_deadline;
 	u64 sched_period;
+
+	/* Utilization hints */
+	u32 sched_util_min;
+	u32 sched_util_max;
 };
 
 struct futex_pi_state;
@@ -1147,14 +1159,32 @@ struct eas_stats {
 	/* select_task_rq_fair() stats */
 	u64 cas_attempts;
 	u64 cas_count;
+
+	/* select_idle_cpu() and find_best_target() scan lengths */
+	u64 sis_scans;
+	u64 sis_scan_cpus;
+	u64 sis_scan_limited;
+	u64 fbt_scan_cpus;
 };
 
 struct sched_domain_shared {
 	atomic_t	ref;
 	atomic_t	nr_busy_cpus;
 	int		has_idle_cores;
+
+	/*
+	 * CPUs of the LLC running their idle task, set on idle entry and
+	 * cleared on idle exit. A superset of the idle CPUs: users must
+	 * still check idle_cpu().
+	 */
+	unsigned long	idle_cpus_span[0];
 };
 
+static inline struct cpumask *sds_idle_cpus(struct sched_domain_shared *sds)
+{
+	return to_cpumask(sds->idle_cpus_span);
+}
+
 struct sched_domain {
 	/* These fields must be setup */
 	struct sched_domain *parent;	/* top domain must be null terminated */
@@ -1378,10 +1408,39 @@ struct load_weight {
  * Then it is the load_weight's responsibility to consider overflow
  * issues.
  */
+/**
+ * struct util_est - Estimation utilization of FAIR tasks
+ * @enqueued: instantaneous estimated utilization of a task/cpu
+ * @ewma:     the Exponential Weighted Moving Average (EWMA)
+ *            utilization of a task
+ *
+ * Support data structure to track an Exponential Weighted Moving Average
+ * (EWMA) of a FAIR task's utilization. New samples are added to the moving
+ * average each time a task completes an activation. Sample's weight is chosen
+ * so that the EWMA will be relatively insensitive to transient changes to the
+ * task's workload.
+ *
+ * The enqueued attribute has a slightly different meaning for tasks and cpus:
+ * - task:   the task's util_avg at last task dequeue time
+ * - cfs_rq: the sum of util_est.enqueued for each RUNNABLE task on that CPU
+ * Thus, the util_est.enqueued of a task represents the contribution on the
+ * estimated utilization of the CPU where that task is currently enqueued.
+ *
+ * Only for tasks we track a moving average of the past instantaneous
+ * estimated utilization. This allows to absorb sporadic drops in utilization
+ * of an otherwise almost periodic task.
+ */
+struct util_est {
+	unsigned int enqueued;
+	unsigned int ewma;
+#define UTIL_EST_WEIGHT_SHIFT		2
+};
+
 struct sched_avg {
 	u64 last_update_time, load_sum;
 	u32 util_sum, util_fast_sum, period_contrib;
 	unsigned long load_avg, util_avg, util_fast_avg;
+	struct util_est util_est;
 #ifdef CONFIG_TASK_WEIGHT
 	u32 scaling_sum, scaling_fast_sum;
 	unsigned long scaling_avg, scaling_fast_avg;
@@ -1492,6 +1551,15 @@ struct ravg {
 	u32 curr_window, prev_window;
 	u16 active_windows;
 };
+
+/*
+ * Threads cooperating on the same piece of work (e.g. the stages of a
+ * rendering pipeline) can be put in a related thread group, whose demand
+ * is the sum of the WALT demand of its tasks. Group id 0 means no group.
+ */
+#define NR_RELATED_THREAD_GROUPS	20
+
+struct related_thread_group;
 #endif
 
 struct sched_entity {
@@ -1595,6 +1663,40 @@ struct sched_dl_entity {
 	struct hrtimer dl_timer;
 };
 
+enum uclamp_id {
+	UCLAMP_MIN = 0,		/* minimum utilization */
+	UCLAMP_MAX,		/* maximum utilization */
+	UCLAMP_CNT,
+};
+
+#ifdef CONFIG_UCLAMP_TASK
+/* Number of utilization clamp buckets */
+#define UCLAMP_BUCKETS CONFIG_UCLAMP_BUCKETS_COUNT
+
+/*
+ * Utilization clamp for a scheduling entity
+ * @value:		clamp value "assigned" to a se
+ * @bucket_id:		bucket index corresponding to the "assigned" value
+ * @active:		the se is currently refcounted in a rq's bucket
+ * @user_defined:	the requested clamp value comes from user-space
+ *
+ * The bucket_id is the index of the clamp bucket matching the clamp value
+ * which is pre-computed and stored to avoid expensive integer divisions from
+ * the fast path.
+ *
+ * The active bit is set whenever a task has got an "effective" value assigned,
+ * which can be different from the clamp value "requested" from user-space.
+ * This allows to know a task is refcounted in the rq's bucket corresponding
+ * to the "effective" bucket_id.
+ */
+struct uclamp_se {
+	unsigned int value		: SCHED_CAPACITY_SHIFT + 1;
+	unsigned int bucket_id		: 5;
+	unsigned int active		: 1;
+	unsigned int user_defined	: 1;
+};
+#endif /* CONFIG_UCLAMP_TASK */
+
 union rcu_special {
 	struct {
 		u8 blocked;
@@ -1665,6 +1767,12 @@ struct task_struct {
 	const struct sched_class *sched_class;
 	struct sched_entity se;
 	struct sched_rt_entity rt;
+#ifdef CONFIG_UCLAMP_TASK
+	/* Clamp values requested for a scheduling entity */
+	struct uclamp_se uclamp_req[UCLAMP_CNT];
+	/* Effective clamp values used for a scheduling entity */
+	struct uclamp_se uclamp[UCLAMP_CNT];
+#endif
 #ifdef CONFIG_SCHED_WALT
 	struct ravg ravg;
 	/*
@@ -1673,6 +1781,8 @@ struct task_struct {
 	 */
 	u32 init_load_pct;
 	u64 last_sleep_ts;
+	struct related_thread_group *grp;
+	struct list_head grp_list;
 #endif
 
 #ifdef CONFIG_CGROUP_SCHED
@@ -1711,6 +1821,11 @@ struct task_struct {
 #endif
 
 	struct list_head tasks;
+#ifdef CONFIG_ANDROID_LOW_MEMORY_KILLER
+	/* lowmemorykiller oom_score_adj bucket, thread group leaders only */
+	struct hlist_nulls_node lmk_node;
+	unsigned short lmk_bucket;
+#endif
 #ifdef CONFIG_SMP
 	struct plist_node pushable_tasks;
 	struct rb_node pushable_dl_tasks;
@@ -1737,6 +1852,9 @@ struct task_struct {
 	unsigned sched_contributes_to_load:1;
 	unsigned sched_migrated:1;
 	unsigned sched_remote_wakeup:1;
+#ifdef CONFIG_PSI
+	unsigned sched_psi_wake_requeue:1;
+#endif
 	unsigned :0; /* force alignment to the next boundary */
 
 	/* unserialized, strictly 'current' */
@@ -1953,6 +2071,10 @@ struct task_struct {
 	unsigned long ptrace_message;
 	siginfo_t *last_siginfo; /* For ptrace use.  */
 	struct task_io_accounting ioac;
+#ifdef CONFIG_PSI
+	/* Pressure stall state */
+	unsigned int psi_flags;
+#endif
 #if defined(CONFIG_TASK_XACCT)
 	u64 acct_rss_mem1;	/* accumulated rss usage */
 	u64 acct_vm_mem1;	/* accumulated virtual memory usage */
@@ -2049,6 +2171,12 @@ struct task_struct {
 #ifdef	CONFIG_TASK_DELAY_ACCT
 	struct task_delay_info *delays;
 #endif
+#ifdef CONFIG_FAULT_LATENCY_HIST
+	/* page fault being timed, kept across its VM_FAULT_RETRY passes */
+	u64 fault_latency_start;
+	bool fault_latency_major;
+	bool fault_latency_swapin;
+#endif
 #ifdef CONFIG_FAULT_INJECTION
 	int make_it_fail;
 #endif
@@ -2459,6 +2587,7 @@ extern void thread_group_cputime_adjusted(struct task_struct *p, cputime_t *ut,
 #define PF_KTHREAD	0x00200000	/* I am a kernel thread */
 #define PF_RANDOMIZE	0x00400000	/* randomize virtual address space */
 #define PF_SWAPWRITE	0x00800000	/* Allowed to write to swap */
+#define PF_MEMSTALL	0x01000000	/* Stalled due to lack of memory */
 #define PF_NO_SETAFFINITY 0x04000000	/* Userland is not allowed to meddle with cpus_allowed */
 #define PF_MCE_EARLY    0x08000000      /* Early kill for mce process policy */
 #define PF_MUTEX_TESTER	0x20000000	/* Thread belongs to the rt mutex tester */
@@ -2794,6 +2923,20 @@ extern int sched_setscheduler_nocheck(struct task_struct *, int,
 				      const struct sched_param *);
 extern int sched_setattr(struct task_struct *,
 			 const struct sched_attr *);
+#ifdef CONFIG_SCHED_WALT
+extern int sched_set_group_id(struct task_struct *p, unsigned int group_id);
+extern unsigned int sched_get_group_id(struct task_struct *p);
+#else
+static inline int
+sched_set_group_id(struct task_struct *p, unsigned int group_id)
+{
+	return -EINVAL;
+}
+static inline unsigned int sched_get_group_id(struct task_struct *p)
+{
+	return 0;
+}
+#endif
 extern struct task_struct *idle_task(int cpu);
 /**
  * is_idle_task - is the specified task an idle task?
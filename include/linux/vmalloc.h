@@ -48,7 +48,7 @@ struct vmap_area {
 	struct list_head list;          /* address sorted list */
 	struct llist_node purge_list;    /* "lazy purge" list */
 	struct vm_struct *vm;
-	struct rcu_head rcu_head;
+	unsigned long subtree_max_size; /* in the free tree only */
 };
 
 /*
@@ -52,6 +52,45 @@ DEFINE_EVENT(mm_filemap_op_page_cache, mm_filemap_add_to_page_cache,
 	TP_ARGS(page)
 	);
 
+TRACE_EVENT(mm_filemap_readahead,
+
+	TP_PROTO(struct address_space *mapping, struct file_ra_state *ra,
+		 pgoff_t index, unsigned long req_size, bool hit),
+
+	TP_ARGS(mapping, ra, index, req_size, hit),
+
+	TP_STRUCT__entry(
+		__field(dev_t, s_dev)
+		__field(unsigned long, i_ino)
+		__field(pgoff_t, index)
+		__field(unsigned long, req_size)
+		__field(bool, hit)
+		__field(pgoff_t, start)
+		__field(unsigned int, size)
+		__field(unsigned int, async_size)
+		__field(unsigned int, shrink)
+	),
+
+	TP_fast_assign(
+		__entry->s_dev = mapping->host->i_sb->s_dev;
+		__entry->i_ino = mapping->host->i_ino;
+		__entry->index = index;
+		__entry->req_size = req_size;
+		__entry->hit = hit;
+		__entry->start = ra->start;
+		__entry->size = ra->size;
+		__entry->async_size = ra->async_size;
+		__entry->shrink = ra->shrink;
+	),
+
+	TP_printk("dev %d:%d ino %lx index=%lu req=%lu %s ra=%lu+%u async=%u shrink=%u",
+		MAJOR(__entry->s_dev), MINOR(__entry->s_dev),
+		__entry->i_ino, __entry->index, __entry->req_size,
+		__entry->hit ? "hit" : "miss",
+		__entry->start, __entry->size, __entry->async_size,
+		__entry->shrink)
+);
+
 #endif /* _TRACE_FILEMAP_H */
 
 /* This part must be outside protection */
@@ -719,6 +719,66 @@ TRACE_EVENT(sched_load_avg_cpu,
 		  __entry->util_avg_pelt, __entry->util_avg_walt)
 );
 
+/*
+ * Tracepoint for the estimated utilization of a task at dequeue.
+ */
+TRACE_EVENT(sched_util_est_task,
+
+	TP_PROTO(struct task_struct *tsk, struct sched_avg *avg),
+
+	TP_ARGS(tsk, avg),
+
+	TP_STRUCT__entry(
+		__array( char,	comm,	TASK_COMM_LEN		)
+		__field( pid_t,		pid			)
+		__field( int,		cpu			)
+		__field( unsigned int,	util_avg		)
+		__field( unsigned int,	est_enqueued		)
+		__field( unsigned int,	est_ewma		)
+	),
+
+	TP_fast_assign(
+		memcpy(__entry->comm, tsk->comm, TASK_COMM_LEN);
+		__entry->pid			= tsk->pid;
+		__entry->cpu			= task_cpu(tsk);
+		__entry->util_avg		= avg->util_avg;
+		__entry->est_enqueued		= avg->util_est.enqueued;
+		__entry->est_ewma		= avg->util_est.ewma;
+	),
+
+	TP_printk("comm=%s pid=%d cpu=%d util_avg=%u util_est_ewma=%u util_est_enqueued=%u",
+		  __entry->comm, __entry->pid, __entry->cpu,
+		  __entry->util_avg, __entry->est_ewma,
+		  __entry->est_enqueued)
+);
+
+/*
+ * Tracepoint for the estimated utilization of a cpu.
+ */
+TRACE_EVENT(sched_util_est_cpu,
+
+	TP_PROTO(int cpu, struct cfs_rq *cfs_rq),
+
+	TP_ARGS(cpu, cfs_rq),
+
+	TP_STRUCT__entry(
+		__field( int,		cpu			)
+		__field( unsigned int,	util_avg		)
+		__field( unsigned int,	util_est_enqueued	)
+	),
+
+	TP_fast_assign(
+		__entry->cpu			= cpu;
+		__entry->util_avg		= cfs_rq->avg.util_avg;
+		__entry->util_est_enqueued	= cfs_rq->avg.util_est.enqueued;
+	),
+
+	TP_printk("cpu=%d util_avg=%u util_est_enqueued=%u",
+		  __entry->cpu,
+		  __entry->util_avg,
+		  __entry->util_est_enqueued)
+);
+
 /*
  * Tracepoint for sched_tune_config settings
  */
@@ -1103,6 +1163,37 @@ TRACE_EVENT(walt_migration_update_sum,
 		  __entry->cpu, __entry->cs, __entry->ps,
 		  __entry->nt_cs, __entry->nt_ps, __entry->pid)
 );
+
+/*
+ * Tracepoint for the aggregated demand of a related thread group
+ */
+TRACE_EVENT(walt_group_demand,
+
+	TP_PROTO(unsigned int id, unsigned int nr_tasks, u64 demand,
+		 unsigned long util, bool colocate),
+
+	TP_ARGS(id, nr_tasks, demand, util, colocate),
+
+	TP_STRUCT__entry(
+		__field(unsigned int,	id			)
+		__field(unsigned int,	nr_tasks		)
+		__field(	 u64,	demand			)
+		__field(unsigned long,	util			)
+		__field(	bool,	colocate		)
+	),
+
+	TP_fast_assign(
+		__entry->id		= id;
+		__entry->nr_tasks	= nr_tasks;
+		__entry->demand		= demand;
+		__entry->util		= util;
+		__entry->colocate	= colocate;
+	),
+
+	TP_printk("group %u: nr_tasks %u demand %llu util %lu colocate %d",
+		  __entry->id, __entry->nr_tasks, __entry->demand,
+		  __entry->util, __entry->colocate)
+);
 #endif /* CONFIG_SCHED_WALT */
 
 #endif /* CONFIG_SMP */
@@ -55,6 +55,7 @@
 #include <linux/shm.h>
 #include <linux/kcov.h>
 #include <linux/tegra_profiler.h>
+#include <linux/lowmemorykiller.h>
 
 #include "sched/tune.h"
 
@@ -72,6 +73,7 @@ static void __unhash_process(struct task_struct *p, bool group_dead)
 		detach_pid(p, PIDTYPE_SID);
 
 		list_del_rcu(&p->tasks);
+		lowmem_task_del(p);
 		list_del_init(&p->sibling);
 		__this_cpu_dec(process_counts);
 	}
@@ -844,6 +846,7 @@ void __noreturn do_exit(long code)
 
 	quadd_event_exit(tsk);
 	sched_autogroup_exit_task(tsk);
+	sched_set_group_id(tsk, 0);
 	cgroup_exit(tsk);
 
 	/*
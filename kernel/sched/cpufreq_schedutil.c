@@ -257,6 +257,7 @@ static void sugov_get_util(unsigned long *util, unsigned long *max, u64 time)
 		*util = min((*util + rt), max_cap);
 	}
 
+	*util = min(uclamp_util(rq, *util), max_cap);
 	*max = max_cap;
 }
 
@@ -31,6 +31,7 @@
 #include <linux/migrate.h>
 #include <linux/task_work.h>
 #include <linux/module.h>
+#include <linux/energy_model.h>
 
 #include <trace/events/sched.h>
 
@@ -764,6 +765,8 @@ void init_entity_runnable_average(struct sched_entity *se)
 	sa->util_sum = 0;
 	sa->util_fast_avg = 0;
 	sa->util_fast_sum = 0;
+	sa->util_est.enqueued = 0;
+	sa->util_est.ewma = 0;
 	/* when this task enqueue'ed, it will contribute to its cfs_rq's load_avg */
 
 #ifdef CONFIG_TASK_WEIGHT
@@ -3678,6 +3681,103 @@ static inline unsigned long cfs_rq_load_avg(struct cfs_rq *cfs_rq)
 
 static int idle_balance(struct rq *this_rq);
 
+static inline unsigned long _task_util_est(struct task_struct *p)
+{
+	struct util_est ue = READ_ONCE(p->se.avg.util_est);
+
+	return max(ue.ewma, ue.enqueued);
+}
+
+/*
+ * Add the estimated utilization of a waking task to the root cfs_rq before
+ * it gets enqueued, so that the frequency update done by the enqueue already
+ * sees it, instead of the util_avg decayed while the task was sleeping.
+ *
+ * The estimates are maintained whether UTIL_EST is set or not, only their
+ * users check the feature: toggling it with tasks enqueued must not leave
+ * their share behind in the root cfs_rq.
+ */
+static inline void util_est_enqueue(struct cfs_rq *cfs_rq,
+				    struct task_struct *p)
+{
+	unsigned int enqueued;
+
+	/* Update root cfs_rq's estimated utilization */
+	enqueued  = cfs_rq->avg.util_est.enqueued;
+	enqueued += _task_util_est(p);
+	WRITE_ONCE(cfs_rq->avg.util_est.enqueued, enqueued);
+
+	trace_sched_util_est_cpu(cpu_of(rq_of(cfs_rq)), cfs_rq);
+}
+
+/*
+ * Check if a (signed) value is within a specified (unsigned) margin,
+ * based on the observation that:
+ *
+ *     abs(x) < y := (unsigned)(x + y - 1) < (2 * y - 1)
+ *
+ * NOTE: this only works when value + maring < INT_MAX.
+ */
+static inline bool within_margin(int value, int margin)
+{
+	return ((unsigned int)(value + margin - 1) < (2 * margin - 1));
+}
+
+static void
+util_est_dequeue(struct cfs_rq *cfs_rq, struct task_struct *p, bool task_sleep)
+{
+	long last_ewma_diff;
+	struct util_est ue;
+
+	/* Update root cfs_rq's estimated utilization */
+	ue.enqueued  = cfs_rq->avg.util_est.enqueued;
+	ue.enqueued -= min_t(unsigned int, ue.enqueued, _task_util_est(p));
+	WRITE_ONCE(cfs_rq->avg.util_est.enqueued, ue.enqueued);
+
+	trace_sched_util_est_cpu(cpu_of(rq_of(cfs_rq)), cfs_rq);
+
+	/*
+	 * Skip update of task's estimated utilization when the task has not
+	 * yet completed an activation, e.g. being migrated.
+	 */
+	if (!task_sleep)
+		return;
+
+	/*
+	 * Skip update of task's estimated utilization when its EWMA is
+	 * already ~1% close to its last activation value.
+	 */
+	ue = p->se.avg.util_est;
+	ue.enqueued = p->se.avg.util_avg;
+	last_ewma_diff = ue.enqueued - ue.ewma;
+	if (within_margin(last_ewma_diff, (SCHED_CAPACITY_SCALE / 100)))
+		return;
+
+	/*
+	 * Update Task's estimated utilization
+	 *
+	 * When *p completes an activation we can consolidate another sample
+	 * of the task size. This is done by storing the current PELT value
+	 * as ue.enqueued and by using this value to update the Exponential
+	 * Weighted Moving Average (EWMA):
+	 *
+	 *  ewma(t) = w *  task_util(p) + (1-w) * ewma(t-1)
+	 *          = w *  task_util(p) +         ewma(t-1)  - w * ewma(t-1)
+	 *          = w * (task_util(p) -         ewma(t-1)) +     ewma(t-1)
+	 *          = w * (      last_ewma_diff            ) +     ewma(t-1)
+	 *          = w * (last_ewma_diff  +  ewma(t-1) / w)
+	 *
+	 * Where 'w' is the weight of new samples, which is configured to be
+	 * 0.25, thus making w=1/4 ( >>= UTIL_EST_WEIGHT_SHIFT)
+	 */
+	ue.ewma <<= UTIL_EST_WEIGHT_SHIFT;
+	ue.ewma  += last_ewma_diff;
+	ue.ewma >>= UTIL_EST_WEIGHT_SHIFT;
+	WRITE_ONCE(p->se.avg.util_est, ue);
+
+	trace_sched_util_est_task(p, &p->se.avg);
+}
+
 #else /* CONFIG_SMP */
 
 static inline int
@@ -3710,6 +3810,13 @@ static inline int idle_balance(struct rq *rq)
 	return 0;
 }
 
+static inline void
+util_est_enqueue(struct cfs_rq *cfs_rq, struct task_struct *p) {}
+
+static inline void
+util_est_dequeue(struct cfs_rq *cfs_rq, struct task_struct *p,
+		 bool task_sleep) {}
+
 #endif /* CONFIG_SMP */
 
 static void check_spread(struct cfs_rq *cfs_rq, struct sched_entity *se)
@@ -5022,6 +5129,14 @@ enqueue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 	int task_new = flags & ENQUEUE_WAKEUP_NEW;
 #endif
 
+	/*
+	 * The code below (indirectly) updates schedutil which looks at
+	 * the cfs_rq utilization to select a frequency.
+	 * Let's add the task's estimated utilization to the cfs_rq's
+	 * estimated utilization, before we update schedutil.
+	 */
+	util_est_enqueue(&rq->cfs, p);
+
 	/*
 	 * If in_iowait is set, the code below may not trigger any cpufreq
 	 * utilization updates, so do it here explicitly with the IOWAIT flag
@@ -5157,6 +5272,8 @@ static void dequeue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 	if (!se)
 		sub_nr_running(rq, 1);
 
+	util_est_dequeue(&rq->cfs, p, task_sleep);
+
 #ifdef CONFIG_SMP
 
 	/*
@@ -5955,13 +6072,13 @@ static void calc_sg_energy(struct energy_env *eenv)
 }
 
 /*
- * compute_energy() computes the absolute variation in energy consumption by
+ * compute_sg_energy() computes the absolute variation in energy consumption by
  * moving eenv.util_delta from EAS_CPU_PRV to EAS_CPU_NXT.
  *
- * NOTE: compute_energy() may fail when racing with sched_domain updates, in
+ * NOTE: compute_sg_energy() may fail when racing with sched_domain updates, in
  *       which case we abort by returning -EINVAL.
  */
-static int compute_energy(struct energy_env *eenv)
+static int compute_sg_energy(struct energy_env *eenv)
 {
 	struct cpumask visit_cpus;
 	int cpu_count;
@@ -6058,6 +6175,78 @@ static int compute_energy(struct energy_env *eenv)
 	return 0;
 }
 
+/*
+ * compute_energy() estimates, for each candidate of the eenv, the energy
+ * consumed by the performance domains spanned by @span which contain at
+ * least one candidate CPU. The other domains are not affected by the
+ * placement of the task and are skipped.
+ *
+ * Unlike compute_sg_energy() this neither walks the sched_group hierarchy
+ * nor accounts for idle power: every domain costs one pass over its CPUs
+ * and one lookup in its precomputed cost table, for all the candidates at
+ * once. The returned energies are already scaled.
+ *
+ * Returns -EINVAL if one of the CPUs in @span has no energy model, in which
+ * case the energies of the eenv are left in an undefined state.
+ */
+static int compute_energy(struct energy_env *eenv, const struct cpumask *span)
+{
+	unsigned long max_util[EAS_CPU_CNT], sum_util[EAS_CPU_CNT];
+	struct cpumask visit_cpus;
+	int cpu_idx, cpu;
+
+	cpumask_and(&visit_cpus, span, cpu_online_mask);
+
+	while (!cpumask_empty(&visit_cpus)) {
+		struct em_perf_domain *pd;
+		unsigned long scale_cpu;
+
+		cpu = cpumask_first(&visit_cpus);
+		pd = em_cpu_get(cpu);
+		if (!pd)
+			return -EINVAL;
+
+		cpumask_andnot(&visit_cpus, &visit_cpus, em_span_cpus(pd));
+		if (!cpumask_intersects(&eenv->cpus_mask, em_span_cpus(pd)))
+			continue;
+
+		memset(max_util, 0, sizeof(max_util));
+		memset(sum_util, 0, sizeof(sum_util));
+
+		for_each_cpu_and(cpu, em_span_cpus(pd), cpu_online_mask) {
+			unsigned long util = cpu_util_wake(cpu, eenv->p);
+			unsigned long min_util = capacity_min_of(cpu);
+
+			for (cpu_idx = EAS_CPU_PRV; cpu_idx < EAS_CPU_CNT; ++cpu_idx) {
+				unsigned long cpu_util = util;
+
+				if (eenv->cpu[cpu_idx].cpu_id < 0)
+					continue;
+
+				if (cpu == eenv->cpu[cpu_idx].cpu_id)
+					cpu_util += eenv->util_delta;
+
+				/* Minimum frequency capping, as group_max_util() */
+				max_util[cpu_idx] = max(max_util[cpu_idx],
+							max(cpu_util, min_util));
+				sum_util[cpu_idx] += cpu_util;
+			}
+		}
+
+		scale_cpu = arch_scale_cpu_capacity(NULL, cpumask_first(em_span_cpus(pd)));
+		for (cpu_idx = EAS_CPU_PRV; cpu_idx < EAS_CPU_CNT; ++cpu_idx) {
+			if (eenv->cpu[cpu_idx].cpu_id < 0)
+				continue;
+
+			eenv->cpu[cpu_idx].energy += em_pd_energy(pd,
+					min(max_util[cpu_idx], scale_cpu),
+					sum_util[cpu_idx], scale_cpu);
+		}
+	}
+
+	return 0;
+}
+
 static inline bool cpu_in_sg(struct sched_group *sg, int cpu)
 {
 	return cpu != -1 && cpumask_test_cpu(cpu, sched_group_cpus(sg));
@@ -6100,6 +6289,18 @@ static inline int select_energy_cpu_idx(struct energy_env *eenv)
 		cpumask_set_cpu(cpu, &eenv->cpus_mask);
 	}
 
+	/*
+	 * Use the energy model registered by the CPUFreq drivers when every
+	 * CPU of the domain has one, and fall back to the sched_group energy
+	 * data otherwise.
+	 */
+	if (sched_feat(ENERGY_MODEL) && em_cpu_get(sd_cpu) &&
+	    !compute_energy(eenv, sched_domain_span(sd)))
+		goto compare;
+
+	for (cpu_idx = EAS_CPU_PRV; cpu_idx < EAS_CPU_CNT; ++cpu_idx)
+		eenv->cpu[cpu_idx].energy = 0;
+
 	sg = sd->groups;
 	do {
 		/* Skip SGs which do not contains a candidate CPU */
@@ -6108,7 +6309,7 @@ static inline int select_energy_cpu_idx(struct energy_env *eenv)
 
 		eenv->sg_top = sg;
 		/* energy is unscaled to reduce rounding errors */
-		if (compute_energy(eenv) == -EINVAL)
+		if (compute_sg_energy(eenv) == -EINVAL)
 			return EAS_CPU_PRV;
 
 	} while (sg = sg->next, sg != sd->groups);
@@ -6117,6 +6318,8 @@ static inline int select_energy_cpu_idx(struct energy_env *eenv)
 	for (cpu_idx = EAS_CPU_PRV; cpu_idx < EAS_CPU_CNT; ++cpu_idx)
 		eenv->cpu[cpu_idx].energy >>= SCHED_CAPACITY_SHIFT;
 
+compare:
+
 	/*
 	 * Compute the dead-zone margin used to prevent too many task
 	 * migrations with negligible energy savings.
@@ -6265,6 +6468,23 @@ static inline unsigned long task_util(struct task_struct *p)
 	return p->se.avg.util_avg;
 }
 
+/*
+ * task_util_est returns the utilization a waking task is expected to have,
+ * which is what task placement should make room for: its util_avg decayed
+ * while it was sleeping, its estimated utilization did not.
+ */
+static inline unsigned long task_util_est(struct task_struct *p)
+{
+#ifdef CONFIG_SCHED_WALT
+	if (!walt_disabled && sysctl_sched_use_walt_task_util)
+		return task_util(p);
+#endif
+	if (!sched_feat(UTIL_EST))
+		return task_util(p);
+
+	return max(task_util(p), _task_util_est(p));
+}
+
 static inline unsigned long boosted_task_util(struct task_struct *p);
 
 static inline bool __task_fits(struct task_struct *p, int cpu, int util)
@@ -6388,12 +6608,12 @@ boosted_cpu_util(int cpu)
 static inline unsigned long
 boosted_task_util(struct task_struct *p)
 {
-	unsigned long util = task_util(p);
+	unsigned long util = task_util_est(p);
 	long margin = schedtune_task_margin(p);
 
 	trace_sched_boost_task(p, util, margin);
 
-	return util + margin;
+	return uclamp_task_util(p, util + margin);
 }
 
 static unsigned long capacity_spare_wake(int cpu, struct task_struct *p)
@@ -6643,6 +6863,28 @@ static inline int find_idlest_cpu(struct sched_domain *sd, struct task_struct *p
 	return new_cpu;
 }
 
+/*
+ * Track the CPUs of each LLC which run their idle task in
+ * sd_llc_shared->idle_cpus_span, so that wakeups only look at CPUs which
+ * were idle at some point. Every CPU only writes its own bit, and only
+ * when it changes, to keep the shared cacheline quiet.
+ */
+void update_idle_cpumask(struct rq *rq, bool idle)
+{
+	struct sched_domain_shared *sds;
+	int cpu = cpu_of(rq);
+
+	rcu_read_lock();
+	sds = rcu_dereference(per_cpu(sd_llc_shared, cpu));
+	if (sds && cpumask_test_cpu(cpu, sds_idle_cpus(sds)) != idle) {
+		if (idle)
+			cpumask_set_cpu(cpu, sds_idle_cpus(sds));
+		else
+			cpumask_clear_cpu(cpu, sds_idle_cpus(sds));
+	}
+	rcu_read_unlock();
+}
+
 #ifdef CONFIG_SCHED_SMT
 
 static inline void set_idle_cores(int cpu, int val)
@@ -6765,33 +7007,55 @@ static inline int select_idle_smt(struct task_struct *p, struct sched_domain *sd
  * Scan the LLC domain for idle CPUs; this is dynamically regulated by
  * comparing the average scan cost (tracked in sd->avg_scan_cost) against the
  * average idle time for this rq (as found in rq->avg_idle).
+ *
+ * Only the CPUs the LLC idle mask reports as idle are looked at, and with
+ * SIS_PROP at most as many of them as the idle time of this rq pays for.
  */
 static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd, int target)
 {
+	struct cpumask *cpus = this_cpu_cpumask_var_ptr(select_idle_mask);
 	struct sched_domain *this_sd;
-	u64 avg_cost, avg_idle = this_rq()->avg_idle;
+	u64 avg_cost, avg_idle;
 	u64 time, cost;
 	s64 delta;
-	int cpu;
+	int cpu, nr = INT_MAX, scanned = 0;
 
 	this_sd = rcu_dereference(*this_cpu_ptr(&sd_llc));
 	if (!this_sd)
 		return -1;
 
-	avg_cost = this_sd->avg_scan_cost;
-
 	/*
 	 * Due to large variance we need a large fuzz factor; hackbench in
 	 * particularly is sensitive here.
 	 */
-	if (sched_feat(SIS_AVG_CPU) && (avg_idle / 512) < avg_cost)
+	avg_idle = this_rq()->avg_idle / 512;
+	avg_cost = this_sd->avg_scan_cost + 1;
+
+	if (sched_feat(SIS_AVG_CPU) && avg_idle < avg_cost)
 		return -1;
 
+	if (sched_feat(SIS_PROP)) {
+		u64 span_avg = sd->span_weight * avg_idle;
+		if (span_avg > 4*avg_cost)
+			nr = div_u64(span_avg, avg_cost);
+		else
+			nr = 4;
+	}
+
+	cpumask_and(cpus, sched_domain_span(sd), tsk_cpus_allowed(p));
+	if (sd->shared)
+		cpumask_and(cpus, cpus, sds_idle_cpus(sd->shared));
+
 	time = local_clock();
 
-	for_each_cpu_wrap(cpu, sched_domain_span(sd), target) {
-		if (!cpumask_test_cpu(cpu, tsk_cpus_allowed(p)))
-			continue;
+	for_each_cpu_wrap(cpu, cpus, target) {
+		if (scanned == nr) {
+			schedstat_inc(this_rq()->eas_stats.sis_scan_limited);
+			schedstat_inc(sd->eas_stats.sis_scan_limited);
+			cpu = -1;
+			break;
+		}
+		scanned++;
 		if (idle_cpu(cpu))
 			break;
 	}
@@ -6801,6 +7065,11 @@ static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd, int t
 	delta = (s64)(time - cost) / 8;
 	this_sd->avg_scan_cost += delta;
 
+	schedstat_inc(this_rq()->eas_stats.sis_scans);
+	schedstat_inc(sd->eas_stats.sis_scans);
+	schedstat_add(this_rq()->eas_stats.sis_scan_cpus, scanned);
+	schedstat_add(sd->eas_stats.sis_scan_cpus, scanned);
+
 	return cpu;
 }
 
@@ -6941,7 +7210,21 @@ static int cpu_util_wake(int cpu, struct task_struct *p)
 		return cpu_util(cpu);
 
 	capacity = capacity_orig_of(cpu);
-	util = max_t(long, cpu_util(cpu) - task_util(p), 0);
+	util = max_t(long, __cpu_util(cpu, 0) - task_util(p), 0);
+
+	/*
+	 * The estimated utilization of the CPU only accounts for p when it
+	 * is enqueued there, i.e. when check_for_migration() looks at the
+	 * running task.
+	 */
+	if (cpu_util_est(cpu)) {
+		unsigned long estimated = cpu_util_est(cpu);
+
+		if (unlikely(task_on_rq_queued(p) || current == p))
+			estimated -= min_t(unsigned long, estimated,
+					   _task_util_est(p));
+		util = max(util, estimated);
+	}
 
 	return (util >= capacity) ? capacity : util;
 }
@@ -7055,8 +7338,55 @@ static int capacity_aware_wake_cpu(struct task_struct *p, int target,
 	return target_cpu;
 }
 
+/*
+ * Latency sensitive tasks get the first idle CPU find_best_target() comes
+ * across, in sched_group order. Look for it among the CPUs the LLC idle
+ * masks report as idle before walking all the CPUs of the sd_ea domain.
+ * Returns -1 if there is none, or if a group isn't covered by one LLC.
+ */
+static int find_best_idle_target(struct task_struct *p, struct sched_domain *sd,
+				 unsigned long min_util, unsigned long min_cap,
+				 int *scanned)
+{
+	struct cpumask *cpus = this_cpu_cpumask_var_ptr(select_idle_mask);
+	struct sched_group *sg = sd->groups;
+	int i;
+
+	do {
+		struct sched_domain *llc;
+
+		llc = rcu_dereference(per_cpu(sd_llc, group_first_cpu(sg)));
+		if (!llc || !llc->shared ||
+		    !cpumask_subset(sched_group_cpus(sg), sched_domain_span(llc)))
+			return -1;
+
+		cpumask_and(cpus, sched_group_cpus(sg), sds_idle_cpus(llc->shared));
+		for_each_cpu_and(i, cpus, tsk_cpus_allowed(p)) {
+			unsigned long new_util;
+
+			(*scanned)++;
+
+			if (!cpu_online(i) || walt_cpu_high_irqload(i))
+				continue;
+
+			if (capacity_orig_of(i) < min_cap)
+				continue;
+
+			new_util = max(min_util, cpu_util_wake(i, p) + task_util_est(p));
+			if (new_util > capacity_orig_of(i))
+				continue;
+
+			if (idle_cpu(i))
+				return i;
+		}
+	} while (sg = sg->next, sg != sd->groups);
+
+	return -1;
+}
+
 static inline int find_best_target(struct task_struct *p, int *backup_cpu,
-				   bool boosted, bool prefer_idle)
+				   bool boosted, bool prefer_idle,
+				   bool colocate)
 {
 	unsigned long best_idle_min_cap_orig = ULONG_MAX;
 	unsigned long min_util = boosted_task_util(p);
@@ -7072,6 +7402,8 @@ static inline int find_best_target(struct task_struct *p, int *backup_cpu,
 	int best_active_cpu = -1;
 	int best_idle_cpu = -1;
 	int target_cpu = -1;
+	unsigned long min_cap;
+	int scanned = 0;
 	int cpu, i;
 
 	*backup_cpu = -1;
@@ -7095,6 +7427,17 @@ static inline int find_best_target(struct task_struct *p, int *backup_cpu,
 		return -1;
 	}
 
+	/* Keep colocated related thread groups on the highest capacity CPUs */
+	min_cap = colocate ? capacity_orig_of(cpu) : 0;
+
+	if (prefer_idle) {
+		i = find_best_idle_target(p, sd, min_util, min_cap, &scanned);
+		if (i >= 0) {
+			target_cpu = i;
+			goto pref_idle;
+		}
+	}
+
 	/* Scan CPUs in all SDs */
 	sg = sd->groups;
 	do {
@@ -7103,19 +7446,24 @@ static inline int find_best_target(struct task_struct *p, int *backup_cpu,
 			unsigned long capacity_orig = capacity_orig_of(i);
 			unsigned long wake_util, new_util, min_capped_util;
 
+			scanned++;
+
 			if (!cpu_online(i))
 				continue;
 
 			if (walt_cpu_high_irqload(i))
 				continue;
 
+			if (capacity_orig < min_cap)
+				continue;
+
 			/*
 			 * p's blocked utilization is still accounted for on prev_cpu
 			 * so prev_cpu will receive a negative bias due to the double
 			 * accounting. However, the blocked utilization may be zero.
 			 */
 			wake_util = cpu_util_wake(i, p);
-			new_util = wake_util + task_util(p);
+			new_util = wake_util + task_util_est(p);
 
 			/*
 			 * Ensure minimum capacity to grant the required boost.
@@ -7171,15 +7519,8 @@ static inline int find_best_target(struct task_struct *p, int *backup_cpu,
 				 * Return the first IDLE CPU we find.
 				 */
 				if (idle_cpu(i)) {
-					schedstat_inc(p->se.statistics.nr_wakeups_fbt_pref_idle);
-					schedstat_inc(this_rq()->eas_stats.fbt_pref_idle);
-
-					trace_sched_find_best_target(p,
-							prefer_idle, min_util,
-							cpu, best_idle_cpu,
-							best_active_cpu, i);
-
-					return i;
+					target_cpu = i;
+					goto pref_idle;
 				}
 
 				/*
@@ -7353,6 +7694,20 @@ static inline int find_best_target(struct task_struct *p, int *backup_cpu,
 
 	schedstat_inc(p->se.statistics.nr_wakeups_fbt_count);
 	schedstat_inc(this_rq()->eas_stats.fbt_count);
+	schedstat_add(this_rq()->eas_stats.fbt_scan_cpus, scanned);
+	schedstat_add(sd->eas_stats.fbt_scan_cpus, scanned);
+
+	return target_cpu;
+
+pref_idle:
+	schedstat_inc(p->se.statistics.nr_wakeups_fbt_pref_idle);
+	schedstat_inc(this_rq()->eas_stats.fbt_pref_idle);
+	schedstat_add(this_rq()->eas_stats.fbt_scan_cpus, scanned);
+	schedstat_add(sd->eas_stats.fbt_scan_cpus, scanned);
+
+	trace_sched_find_best_target(p, prefer_idle, min_util, cpu,
+				     best_idle_cpu, best_active_cpu,
+				     target_cpu);
 
 	return target_cpu;
 }
@@ -7376,12 +7731,12 @@ static int wake_cap(struct task_struct *p, int cpu, int prev_cpu)
 	/* Bring task utilization in sync with prev_cpu */
 	sync_entity_load_avg(&p->se);
 
-	return min_cap * 1024 < task_util(p) * capacity_margin;
+	return min_cap * 1024 < task_util_est(p) * capacity_margin;
 }
 
 static int select_energy_cpu_brute(struct task_struct *p, int prev_cpu, int sync)
 {
-	bool boosted, prefer_idle;
+	bool boosted, prefer_idle, colocate;
 	struct sched_domain *sd;
 	int target_cpu;
 	int backup_cpu;
@@ -7407,6 +7762,9 @@ static int select_energy_cpu_brute(struct task_struct *p, int prev_cpu, int sync
 	boosted = get_sysctl_sched_cfs_boost() > 0;
 	prefer_idle = 0;
 #endif
+	boosted |= uclamp_boosted(p);
+	colocate = walt_task_colocated(p);
+	boosted |= colocate;
 
 	rcu_read_lock();
 
@@ -7419,12 +7777,23 @@ static int select_energy_cpu_brute(struct task_struct *p, int prev_cpu, int sync
 	sync_entity_load_avg(&p->se);
 
 	/* Find a cpu with sufficient capacity */
-	next_cpu = find_best_target(p, &backup_cpu, boosted, prefer_idle);
+	next_cpu = find_best_target(p, &backup_cpu, boosted, prefer_idle,
+				    colocate);
 	if (next_cpu == -1) {
 		target_cpu = prev_cpu;
 		goto unlock;
 	}
 
+	/*
+	 * A colocated related thread group leaves the lower capacity CPUs
+	 * whatever the energy cost: its tasks depend on each other, and the
+	 * group as a whole needs more than the capacity of these CPUs.
+	 */
+	if (colocate && capacity_orig_of(prev_cpu) < capacity_orig_of(next_cpu)) {
+		target_cpu = next_cpu;
+		goto unlock;
+	}
+
 	/* Unconditionally prefer IDLE CPUs for boosted/prefer_idle tasks */
 	if ((boosted || prefer_idle) && idle_cpu(next_cpu)) {
 		schedstat_inc(p->se.statistics.nr_wakeups_secb_idle_bt);
@@ -7438,7 +7807,7 @@ static int select_energy_cpu_brute(struct task_struct *p, int prev_cpu, int sync
 		int delta = 0;
 		struct energy_env eenv = {
 			.p              = p,
-			.util_delta     = task_util(p),
+			.util_delta     = task_util_est(p),
 			/* Task's previous CPU candidate */
 			.cpu[EAS_CPU_PRV] = {
 				.cpu_id = prev_cpu,
@@ -11270,6 +11639,10 @@ const struct sched_class fair_sched_class = {
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	.task_change_group	= task_change_group_fair,
 #endif
+
+#ifdef CONFIG_UCLAMP_TASK
+	.uclamp_enabled		= 1,
+#endif
 };
 
 #ifdef CONFIG_SCHED_DEBUG
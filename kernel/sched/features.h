@@ -55,6 +55,7 @@ SCHED_FEAT(TTWU_QUEUE, true)
  * When doing wakeups, attempt to limit superfluous scans of the LLC domain.
  */
 SCHED_FEAT(SIS_AVG_CPU, false)
+SCHED_FEAT(SIS_PROP, true)
 
 #ifdef HAVE_RT_PUSH_IPI
 /*
@@ -74,6 +75,13 @@ SCHED_FEAT(RT_RUNTIME_SHARE, true)
 SCHED_FEAT(LB_MIN, false)
 SCHED_FEAT(ATTACH_AGE_LOAD, true)
 
+/*
+ * UtilEstimation. Use estimated CPU utilization, restored on enqueue from
+ * the utilization of the tasks at their last dequeue, for frequency
+ * selection and task placement.
+ */
+SCHED_FEAT(UTIL_EST, true)
+
 /*
  * Energy aware scheduling. Use platform energy model to guide scheduling
  * decisions optimizing for energy efficiency.
@@ -84,6 +92,13 @@ SCHED_FEAT(ENERGY_AWARE, true)
 SCHED_FEAT(ENERGY_AWARE, false)
 #endif
 
+/*
+ * Estimate wakeup energy from the per performance domain cost tables of
+ * the energy model, when the CPUFreq drivers registered one, instead of
+ * walking the sched_group energy data.
+ */
+SCHED_FEAT(ENERGY_MODEL, true)
+
 /*
  * Capacity aware scheduling.
  */
@@ -11,6 +11,7 @@
 #include <linux/irq_work.h>
 #include <linux/tick.h>
 #include <linux/slab.h>
+#include <linux/psi.h>
 
 #include "cpupri.h"
 #include "cpudeadline.h"
@@ -36,13 +37,19 @@ extern atomic_long_t calc_load_tasks;
 
 extern void calc_global_load_tick(struct rq *this_rq);
 extern long calc_load_fold_active(struct rq *this_rq, long adjust);
+extern unsigned long calc_load(unsigned long load, unsigned long exp,
+			       unsigned long active);
+extern unsigned long calc_load_n(unsigned long load, unsigned long exp,
+				 unsigned long active, unsigned int n);
 
 #ifdef CONFIG_SMP
 extern void cpu_load_update_active(struct rq *this_rq);
 extern void check_for_migration(struct rq *rq, struct task_struct *p);
+extern void update_idle_cpumask(struct rq *rq, bool idle);
 #else
 static inline void cpu_load_update_active(struct rq *this_rq) { }
 static inline void check_for_migration(struct rq *rq, struct task_struct *p) { }
+static inline void update_idle_cpumask(struct rq *rq, bool idle) { }
 #endif
 
 #ifdef CONFIG_SCHED_SMT
@@ -301,6 +308,13 @@ struct task_group {
 #endif
 
 	struct cfs_bandwidth cfs_bandwidth;
+
+#ifdef CONFIG_UCLAMP_TASK_GROUP
+	/* Clamp values requested for a task group */
+	struct uclamp_se uclamp_req[UCLAMP_CNT];
+	/* Effective clamp values used for a task group */
+	struct uclamp_se uclamp[UCLAMP_CNT];
+#endif
 };
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
@@ -623,6 +637,48 @@ extern void rto_push_irq_work_func(struct irq_work *work);
 #endif
 #endif /* CONFIG_SMP */
 
+#ifdef CONFIG_UCLAMP_TASK
+/*
+ * struct uclamp_bucket - Utilization clamp bucket
+ * @value: utilization clamp value for tasks on this clamp bucket
+ * @tasks: number of RUNNABLE tasks on this clamp bucket
+ *
+ * Keep track of how many tasks are RUNNABLE for a given utilization
+ * clamp value.
+ */
+struct uclamp_bucket {
+	unsigned long value : SCHED_CAPACITY_SHIFT + 1;
+	unsigned long tasks : BITS_PER_LONG - SCHED_CAPACITY_SHIFT - 1;
+};
+
+/*
+ * struct uclamp_rq - rq's utilization clamp
+ * @value: currently active clamp values for a rq
+ * @bucket: utilization clamp buckets affecting a rq
+ *
+ * Keep track of RUNNABLE tasks on a rq to aggregate their clamp values.
+ * A clamp value is affecting a rq when there is at least one task RUNNABLE
+ * (or actually running) with that value.
+ *
+ * There are up to UCLAMP_CNT possible different clamp values, currently there
+ * are only two: minimum utilization and maximum utilization.
+ *
+ * All utilization clamping values are MAX aggregated, since:
+ * - for util_min: we want to run the CPU at least at the max of the minimum
+ *   utilization required by its currently RUNNABLE tasks.
+ * - for util_max: we want to allow the CPU to run up to the max of the
+ *   maximum utilization allowed by its currently RUNNABLE tasks.
+ *
+ * Since on each system we expect only a limited number of different
+ * utilization clamp values (UCLAMP_BUCKETS), use a simple array to track
+ * the metrics required to compute all the per-rq utilization clamp values.
+ */
+struct uclamp_rq {
+	unsigned int value;
+	struct uclamp_bucket bucket[UCLAMP_BUCKETS];
+};
+#endif /* CONFIG_UCLAMP_TASK */
+
 /*
  * This is the main, per-CPU runqueue data structure.
  *
@@ -672,6 +728,13 @@ struct rq {
 	struct rt_rq rt;
 	struct dl_rq dl;
 
+#ifdef CONFIG_UCLAMP_TASK
+	/* Utilization clamp values based on CPU's RUNNABLE tasks */
+	struct uclamp_rq uclamp[UCLAMP_CNT] ____cacheline_aligned;
+	unsigned int uclamp_flags;
+#define UCLAMP_FLAG_IDLE 0x01
+#endif
+
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	/* list of leaf cfs_rq on this cpu: */
 	struct list_head leaf_cfs_rq_list;
@@ -737,6 +800,8 @@ struct rq {
 	u64 avg_irqload;
 	u64 irqload_ts;
 	u64 cum_window_demand;
+	/* Number of enqueued tasks of each related thread group */
+	unsigned int grp_nr_running[NR_RELATED_THREAD_GROUPS];
 #endif /* CONFIG_SCHED_WALT */
 
 
@@ -1339,6 +1404,10 @@ struct sched_class {
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	void (*task_change_group) (struct task_struct *p, int type);
 #endif
+
+#ifdef CONFIG_UCLAMP_TASK
+	int uclamp_enabled;
+#endif
 };
 
 static inline void put_prev_task(struct rq *rq, struct task_struct *prev)
@@ -1635,6 +1704,7 @@ static inline unsigned long capacity_orig_of(int cpu)
 extern unsigned int sysctl_sched_use_walt_cpu_util;
 extern unsigned int walt_ravg_window;
 extern bool walt_disabled;
+extern unsigned long walt_cpu_group_util(int cpu);
 
 /*
  * cpu_util returns the amount of capacity of a CPU that is used by CFS
@@ -1679,9 +1749,30 @@ static inline unsigned long __cpu_util(int cpu, int delta)
 	return (delta >= capacity) ? capacity : delta;
 }
 
+/*
+ * cpu_util_est returns the estimated utilization of the CFS tasks enqueued
+ * on a CPU: the sum of their utilization at their last dequeue, see
+ * util_est_enqueue(). It restores the utilization of tasks right after
+ * they wake up, when their util_avg has decayed while they were sleeping.
+ * WALT already accounts for the demand of the enqueued tasks.
+ */
+static inline unsigned long cpu_util_est(int cpu)
+{
+#ifdef CONFIG_SCHED_WALT
+	if (!walt_disabled && sysctl_sched_use_walt_cpu_util)
+		return 0;
+#endif
+	if (!sched_feat(UTIL_EST))
+		return 0;
+
+	return READ_ONCE(cpu_rq(cpu)->cfs.avg.util_est.enqueued);
+}
+
 static inline unsigned long cpu_util(int cpu)
 {
-	return __cpu_util(cpu, 0);
+	unsigned long util = __cpu_util(cpu, 0);
+
+	return max(util, min(cpu_util_est(cpu), capacity_orig_of(cpu)));
 }
 
 static inline unsigned long cpu_util_freq(int cpu)
@@ -1689,10 +1780,18 @@ static inline unsigned long cpu_util_freq(int cpu)
 	unsigned long util = cpu_rq(cpu)->cfs.avg.util_avg;
 	unsigned long capacity = capacity_orig_of(cpu);
 
+	util = max(util, cpu_util_est(cpu));
+
 #ifdef CONFIG_SCHED_WALT
-	if (!walt_disabled && sysctl_sched_use_walt_cpu_util)
+	if (!walt_disabled && sysctl_sched_use_walt_cpu_util) {
 		util = div64_u64(cpu_rq(cpu)->prev_runnable_sum,
 				 walt_ravg_window >> SCHED_CAPACITY_SHIFT);
+		/*
+		 * The tasks of a related thread group hand work over to each
+		 * other, so ask for the frequency the whole group needs.
+		 */
+		util = max(util, walt_cpu_group_util(cpu));
+	}
 #endif
 	return (util >= capacity) ? capacity : util;
 }
@@ -2034,6 +2133,62 @@ static inline void cpufreq_update_util(struct rq *rq, unsigned int flags) {}
 static inline void cpufreq_update_this_cpu(struct rq *rq, unsigned int flags) {}
 #endif /* CONFIG_CPU_FREQ */
 
+#ifdef CONFIG_UCLAMP_TASK
+unsigned int uclamp_eff_value(struct task_struct *p, enum uclamp_id clamp_id);
+
+/*
+ * Clamp @util to the clamps of the RUNNABLE tasks of @rq, for frequency
+ * selection.
+ */
+static inline unsigned long uclamp_util(struct rq *rq, unsigned long util)
+{
+	unsigned long min_util = READ_ONCE(rq->uclamp[UCLAMP_MIN].value);
+	unsigned long max_util = READ_ONCE(rq->uclamp[UCLAMP_MAX].value);
+
+	/*
+	 * Since CPU's {min,max}_util clamps are MAX aggregated considering
+	 * RUNNABLE tasks with _different_ clamps, we can end up with an
+	 * inversion. Fix it now when the clamps are applied.
+	 */
+	if (unlikely(min_util >= max_util))
+		return min_util;
+
+	return clamp(util, min_util, max_util);
+}
+
+/* Clamp @util, a utilization of @p, to the effective clamps of @p. */
+static inline unsigned long uclamp_task_util(struct task_struct *p,
+					     unsigned long util)
+{
+	unsigned long min_util = uclamp_eff_value(p, UCLAMP_MIN);
+	unsigned long max_util = uclamp_eff_value(p, UCLAMP_MAX);
+
+	return clamp(util, min_util, max_util);
+}
+
+/* Whether @p asks for a minimum utilization, like a boosted task */
+static inline bool uclamp_boosted(struct task_struct *p)
+{
+	return uclamp_eff_value(p, UCLAMP_MIN) > 0;
+}
+#else
+static inline unsigned long uclamp_util(struct rq *rq, unsigned long util)
+{
+	return util;
+}
+
+static inline unsigned long uclamp_task_util(struct task_struct *p,
+					     unsigned long util)
+{
+	return util;
+}
+
+static inline bool uclamp_boosted(struct task_struct *p)
+{
+	return false;
+}
+#endif /* CONFIG_UCLAMP_TASK */
+
 #ifdef CONFIG_SCHED_WALT
 
 static inline bool
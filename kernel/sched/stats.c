@@ -10,7 +10,7 @@
  * bump this up when changing the output format or the meaning of an existing
  * format, so that tools can adapt (or abort)
  */
-#define SCHEDSTAT_VERSION 15
+#define SCHEDSTAT_VERSION 16
 
 #ifdef CONFIG_SMP
 static inline void show_easstat(struct seq_file *seq, struct eas_stats *stats)
@@ -29,8 +29,12 @@ static inline void show_easstat(struct seq_file *seq, struct eas_stats *stats)
 	    stats->fbt_attempts, stats->fbt_no_cpu, stats->fbt_no_sd,
 	    stats->fbt_pref_idle, stats->fbt_count);
 
-	seq_printf(seq, "%llu %llu\n",
+	seq_printf(seq, "%llu %llu ",
 	    stats->cas_attempts, stats->cas_count);
+
+	seq_printf(seq, "%llu %llu %llu %llu\n",
+	    stats->sis_scans, stats->sis_scan_cpus, stats->sis_scan_limited,
+	    stats->fbt_scan_cpus);
 }
 #endif
 
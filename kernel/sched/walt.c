@@ -42,6 +42,14 @@ static __read_mostly unsigned int walt_io_is_busy = 0;
 
 unsigned int sysctl_sched_walt_init_task_load_pct = 15;
 
+/*
+ * A related thread group is colocated on the CPUs of highest capacity once
+ * its demand goes above sched_group_upmigrate percent of the capacity of
+ * the smallest CPU, and until it drops below sched_group_downmigrate.
+ */
+unsigned int sysctl_sched_group_upmigrate_pct = 100;
+unsigned int sysctl_sched_group_downmigrate_pct = 90;
+
 /* true -> use PELT based load stats, false -> use window-based load stats */
 bool __read_mostly walt_disabled = false;
 
@@ -557,6 +565,117 @@ static int account_busy_for_task_demand(struct task_struct *p, int event)
 	return 1;
 }
 
+/*
+ * Related thread groups are statically allocated and never freed, so that
+ * p->grp can be dereferenced without any reference counting. A group is
+ * identified by its index in the array; group 0 is never used.
+ */
+static struct related_thread_group related_thread_groups[NR_RELATED_THREAD_GROUPS];
+
+static int __init walt_init_groups(void)
+{
+	struct related_thread_group *grp;
+	int i;
+
+	for (i = 1; i < NR_RELATED_THREAD_GROUPS; i++) {
+		grp = &related_thread_groups[i];
+		grp->id = i;
+		raw_spin_lock_init(&grp->lock);
+		INIT_LIST_HEAD(&grp->tasks);
+	}
+
+	return 0;
+}
+early_initcall(walt_init_groups);
+
+static inline unsigned long group_util(struct related_thread_group *grp)
+{
+	return div64_u64(READ_ONCE(grp->demand),
+			 walt_ravg_window >> SCHED_CAPACITY_SHIFT);
+}
+
+/*
+ * Must be called with grp->lock held. @min_cpu is the lowest capacity cpu
+ * of the root domain, or -1 if it is not known yet.
+ */
+static void
+group_update_colocate(int min_cpu, struct related_thread_group *grp)
+{
+	unsigned long util, thresh;
+	unsigned int pct;
+
+	util = group_util(grp);
+	if (min_cpu >= 0) {
+		pct = grp->colocate ? sysctl_sched_group_downmigrate_pct :
+				      sysctl_sched_group_upmigrate_pct;
+		thresh = capacity_orig_of(min_cpu) * pct / 100;
+		WRITE_ONCE(grp->colocate, util > thresh);
+	}
+
+	trace_walt_group_demand(grp->id, grp->nr_tasks, grp->demand, util,
+				grp->colocate);
+}
+
+/*
+ * Must be called with grp->lock held. The demand of the tasks of a group
+ * is only updated with the rq lock of the task held, so that the group
+ * demand always is the sum of the p->ravg.demand of its tasks.
+ */
+static void
+group_update_demand(struct rq *rq, struct related_thread_group *grp, s64 delta)
+{
+	if (delta < 0 && -delta > grp->demand)
+		delta = -(s64)grp->demand;
+	WRITE_ONCE(grp->demand, grp->demand + delta);
+
+	group_update_colocate(READ_ONCE(rq->rd->min_cap_orig_cpu), grp);
+}
+
+int sched_group_migrate_handler(struct ctl_table *table, int write,
+				void __user *buffer, size_t *lenp,
+				loff_t *ppos)
+{
+	unsigned int old_up, old_down;
+	struct related_thread_group *grp;
+	static DEFINE_MUTEX(mutex);
+	unsigned long flags;
+	int ret, i, min_cpu;
+
+	mutex_lock(&mutex);
+	old_up = sysctl_sched_group_upmigrate_pct;
+	old_down = sysctl_sched_group_downmigrate_pct;
+
+	ret = proc_dointvec_minmax(table, write, buffer, lenp, ppos);
+	if (ret || !write)
+		goto unlock;
+
+	if (sysctl_sched_group_downmigrate_pct >
+	    sysctl_sched_group_upmigrate_pct) {
+		sysctl_sched_group_upmigrate_pct = old_up;
+		sysctl_sched_group_downmigrate_pct = old_down;
+		ret = -EINVAL;
+		goto unlock;
+	}
+
+	/* The root domain is freed by RCU-sched when domains are rebuilt */
+	rcu_read_lock_sched();
+	min_cpu = READ_ONCE(cpu_rq(raw_smp_processor_id())->rd->min_cap_orig_cpu);
+	rcu_read_unlock_sched();
+
+	/* Don't wait for the next demand change to apply the thresholds */
+	for (i = 1; i < NR_RELATED_THREAD_GROUPS; i++) {
+		grp = &related_thread_groups[i];
+
+		raw_spin_lock_irqsave(&grp->lock, flags);
+		group_update_colocate(min_cpu, grp);
+		raw_spin_unlock_irqrestore(&grp->lock, flags);
+	}
+
+unlock:
+	mutex_unlock(&mutex);
+	return ret;
+}
+
 /*
  * Called when new window is starting for a task, to record cpu usage over
  * recently concluded window(s). Normally 'samples' should be 1. It can be > 1
@@ -625,6 +744,12 @@ static void update_history(struct rq *rq, struct task_struct *p,
 			fixup_cum_window_demand(rq, demand);
 	}
 
+	if (p->grp) {
+		raw_spin_lock(&p->grp->lock);
+		group_update_demand(rq, p->grp, (s64)demand - p->ravg.demand);
+		raw_spin_unlock(&p->grp->lock);
+	}
+
 	p->ravg.demand = demand;
 
 done:
@@ -901,3 +1026,124 @@ void walt_init_new_task_load(struct task_struct *p)
 	for (i = 0; i < RAVG_HIST_SIZE_MAX; ++i)
 		p->ravg.sum_history[i] = init_load_windows;
 }
+
+/**
+ * sched_set_group_id - move a task to a related thread group
+ * @p: the task
+ * @group_id: the group, in [1, NR_RELATED_THREAD_GROUPS), or 0 to remove @p
+ *	      from its current group
+ *
+ * The demand of a group is the sum of the demand of its tasks. It drives
+ * the frequency of the CPUs running the group and, above the
+ * sched_group_upmigrate threshold, colocates the group on the CPUs of
+ * highest capacity.
+ *
+ * Return: 0 on success, -EINVAL for an invalid group, -EAGAIN if @p has
+ * not been woken up for the first time yet, or -ESRCH if @p is exiting.
+ */
+int sched_set_group_id(struct task_struct *p, unsigned int group_id)
+{
+	struct related_thread_group *grp = NULL, *old;
+	struct rq_flags rf;
+	struct rq *rq;
+	bool queued;
+	int ret = 0;
+
+	if (group_id >= NR_RELATED_THREAD_GROUPS)
+		return -EINVAL;
+	if (group_id)
+		grp = &related_thread_groups[group_id];
+
+	/*
+	 * p->grp is only stable under the rq lock: a writer that saw p
+	 * before PF_EXITING got set can still be adding it to a group,
+	 * and do_exit() must then find it there.
+	 */
+	rq = task_rq_lock(p, &rf);
+
+	old = p->grp;
+	if (old == grp)
+		goto unlock;
+
+	/* The demand of a new task is reset by wake_up_new_task() */
+	if (grp && p->state == TASK_NEW) {
+		ret = -EAGAIN;
+		goto unlock;
+	}
+
+	/* do_exit() removes the task from its group after setting PF_EXITING */
+	if (grp && (p->flags & PF_EXITING)) {
+		ret = -ESRCH;
+		goto unlock;
+	}
+
+	queued = task_on_rq_queued(p);
+	if (queued)
+		walt_dec_group_nr_running(rq, p);
+
+	if (old) {
+		raw_spin_lock(&old->lock);
+		list_del_init(&p->grp_list);
+		old->nr_tasks--;
+		group_update_demand(rq, old, -(s64)p->ravg.demand);
+		raw_spin_unlock(&old->lock);
+	}
+
+	if (grp) {
+		raw_spin_lock(&grp->lock);
+		list_add(&p->grp_list, &grp->tasks);
+		grp->nr_tasks++;
+		group_update_demand(rq, grp, p->ravg.demand);
+		raw_spin_unlock(&grp->lock);
+	}
+
+	WRITE_ONCE(p->grp, grp);
+
+	if (queued)
+		walt_inc_group_nr_running(rq, p);
+
+unlock:
+	task_rq_unlock(rq, p, &rf);
+
+	return ret;
+}
+
+unsigned int sched_get_group_id(struct task_struct *p)
+{
+	struct related_thread_group *grp = READ_ONCE(p->grp);
+
+	return grp ? grp->id : 0;
+}
+
+/*
+ * Whether the related thread group of @p, if any, is to be placed on the
+ * CPUs of highest capacity.
+ */
+bool walt_task_colocated(struct task_struct *p)
+{
+	struct related_thread_group *grp = READ_ONCE(p->grp);
+
+	if (walt_disabled || !grp)
+		return false;
+
+	return READ_ONCE(grp->colocate);
+}
+
+/*
+ * The highest utilization of the related thread groups having tasks
+ * enqueued on @cpu.
+ */
+unsigned long walt_cpu_group_util(int cpu)
+{
+	struct rq *rq = cpu_rq(cpu);
+	unsigned long util = 0;
+	int i;
+
+	for (i = 1; i < NR_RELATED_THREAD_GROUPS; i++) {
+		if (!READ_ONCE(rq->grp_nr_running[i]))
+			continue;
+		util = max(util, group_util(&related_thread_groups[i]));
+	}
+
+	return util;
+}
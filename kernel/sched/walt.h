@@ -34,6 +34,33 @@ void walt_account_irqtime(int cpu, struct task_struct *curr, u64 delta,
 u64 walt_irqload(int cpu);
 int walt_cpu_high_irqload(int cpu);
 
+struct related_thread_group {
+	unsigned int id;
+	raw_spinlock_t lock;
+	struct list_head tasks;
+	unsigned int nr_tasks;
+	/* Sum of the WALT demand of the tasks in the group */
+	u64 demand;
+	/* Group to be placed on the CPUs of highest capacity */
+	bool colocate;
+};
+
+bool walt_task_colocated(struct task_struct *p);
+
+static inline void walt_inc_group_nr_running(struct rq *rq,
+					     struct task_struct *p)
+{
+	if (p->grp)
+		rq->grp_nr_running[p->grp->id]++;
+}
+
+static inline void walt_dec_group_nr_running(struct rq *rq,
+					     struct task_struct *p)
+{
+	if (p->grp)
+		rq->grp_nr_running[p->grp->id]--;
+}
+
 #else /* CONFIG_SCHED_WALT */
 
 static inline void walt_update_task_ravg(struct task_struct *p, struct rq *rq,
@@ -50,6 +77,10 @@ static inline u64 walt_ktime_clock(void) { return 0; }
 
 #define walt_cpu_high_irqload(cpu) false
 
+static inline bool walt_task_colocated(struct task_struct *p) { return false; }
+static inline void walt_inc_group_nr_running(struct rq *rq, struct task_struct *p) { }
+static inline void walt_dec_group_nr_running(struct rq *rq, struct task_struct *p) { }
+
 #endif /* CONFIG_SCHED_WALT */
 
 #if defined(CONFIG_CFS_BANDWIDTH) && defined(CONFIG_SCHED_WALT)
@@ -0,0 +1,1127 @@
+/*
+ * Data access monitor
+ *
+ * Tracks how often the regions of the address spaces of a set of processes
+ * are accessed, at a cost that doesn't grow with their size. Every region
+ * is assumed to have a uniform access pattern, so checking one randomly
+ * picked page per region each sampling interval is enough to estimate the
+ * access frequency of the whole region. At each aggregation interval,
+ * adjacent regions with similar frequencies are merged and the regions are
+ * split again at random points, so they keep adapting to the actual access
+ * pattern while their number stays between min_nr_regions and
+ * max_nr_regions.
+ *
+ * Accesses are detected through the accessed bits in the page tables, as
+ * reclaim and idle page tracking do: the accessed bit of the sampled page
+ * is cleared and the page is marked idle, and at the next check the page
+ * counts as accessed if either has changed since.
+ *
+ * The results are reported by the damon_aggregated tracepoint at every
+ * aggregation interval, and operation schemes can act on the regions with
+ * a given access pattern, e.g. reclaim the ones that haven't been accessed
+ * for a while. The interface is in debugfs, under damon/:
+ *
+ *  attrs	sampling, aggregation and update intervals in microseconds,
+ *		minimum and maximum number of regions
+ *  target_ids	pids of the processes to monitor
+ *  schemes	one scheme per line, "min_sz max_sz min_nr_accesses
+ *		max_nr_accesses min_age max_age action", with the number of
+ *		accesses counted per aggregation interval, the ages in
+ *		aggregation intervals and the action one of 0 (cold),
+ *		1 (pageout) or 2 (stat). Reading also shows the number of
+ *		regions and bytes each scheme was applied to.
+ *  monitor_on	"on" or "off"
+ *
+ * E.g. with the default 100ms aggregation interval, "4096 18446744073709551615
+ * 0 0 100 4294967295 1" pages out the regions not accessed for 10 seconds.
+ */
+
+#define pr_fmt(fmt) "damon: " fmt
+
+#include <linux/damon.h>
+#include <linux/debugfs.h>
+#include <linux/delay.h>
+#include <linux/kthread.h>
+#include <linux/mm.h>
+#include <linux/mmu_notifier.h>
+#include <linux/page_idle.h>
+#include <linux/random.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/damon.h>
+
+#include "internal.h"
+
+/* Get a random number in [l, r) */
+#define damon_rand(l, r) ((l) + prandom_u32_max((r) - (l)))
+
+static struct damon_ctx damon_ctx = {
+	.sample_interval = 5 * USEC_PER_MSEC,
+	.aggr_interval = 100 * USEC_PER_MSEC,
+	.update_interval = USEC_PER_SEC,
+	.min_nr_regions = 10,
+	.max_nr_regions = 1000,
+	.kdamond_lock = __MUTEX_INITIALIZER(damon_ctx.kdamond_lock),
+	.targets = LIST_HEAD_INIT(damon_ctx.targets),
+	.schemes = LIST_HEAD_INIT(damon_ctx.schemes),
+};
+
+/*
+ * Regions and targets
+ */
+
+static struct damon_region *damon_new_region(unsigned long start,
+					     unsigned long end)
+{
+	struct damon_region *r;
+
+	r = kmalloc(sizeof(*r), GFP_KERNEL);
+	if (!r)
+		return NULL;
+
+	r->ar.start = start;
+	r->ar.end = end;
+	r->nr_accesses = 0;
+	r->age = 0;
+	r->last_nr_accesses = 0;
+	INIT_LIST_HEAD(&r->list);
+	return r;
+}
+
+/* Insert @r in front of @next, which may be the list head */
+static void damon_insert_region(struct damon_region *r, struct list_head *next,
+				struct damon_target *t)
+{
+	list_add_tail(&r->list, next);
+	t->nr_regions++;
+}
+
+static void damon_destroy_region(struct damon_region *r,
+				 struct damon_target *t)
+{
+	list_del(&r->list);
+	t->nr_regions--;
+	kfree(r);
+}
+
+static inline unsigned long damon_sz_region(struct damon_region *r)
+{
+	return r->ar.end - r->ar.start;
+}
+
+static void damon_destroy_regions(struct damon_target *t)
+{
+	struct damon_region *r, *next;
+
+	damon_for_each_region_safe(r, next, t)
+		damon_destroy_region(r, t);
+}
+
+static void damon_destroy_target(struct damon_target *t)
+{
+	damon_destroy_regions(t);
+	list_del(&t->list);
+	put_pid(t->pid);
+	kfree(t);
+}
+
+static struct mm_struct *damon_get_mm(struct damon_target *t)
+{
+	struct task_struct *task;
+	struct mm_struct *mm;
+
+	task = get_pid_task(t->pid, PIDTYPE_PID);
+	if (!task)
+		return NULL;
+
+	mm = get_task_mm(task);
+	put_task_struct(task);
+	return mm;
+}
+
+static bool damon_targets_alive(struct damon_ctx *ctx)
+{
+	struct damon_target *t;
+	struct task_struct *task;
+
+	damon_for_each_target(t, ctx) {
+		task = get_pid_task(t->pid, PIDTYPE_PID);
+		if (task) {
+			put_task_struct(task);
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Monitored address ranges
+ */
+
+static inline unsigned long sz_range(struct damon_addr_range *r)
+{
+	return r->end - r->start;
+}
+
+/*
+ * Find the three ranges covering the mappings of @mm apart from the two
+ * biggest unmapped gaps. In the usual layout these are the heap, the mmap
+ * area and the stack, and the huge gaps between them are not worth
+ * monitoring.
+ */
+static int damon_three_regions_of(struct mm_struct *mm,
+				  struct damon_addr_range regions[3])
+{
+	struct damon_addr_range gap = {0}, first_gap = {0}, second_gap = {0};
+	struct vm_area_struct *vma, *last_vma = NULL;
+	unsigned long start = 0, end = 0;
+
+	down_read(&mm->mmap_sem);
+	for (vma = mm->mmap; vma; vma = vma->vm_next) {
+		if (!last_vma) {
+			start = vma->vm_start;
+			goto next;
+		}
+
+		gap.start = last_vma->vm_end;
+		gap.end = vma->vm_start;
+		if (sz_range(&gap) > sz_range(&second_gap)) {
+			swap(gap, second_gap);
+			if (sz_range(&second_gap) > sz_range(&first_gap))
+				swap(second_gap, first_gap);
+		}
+next:
+		last_vma = vma;
+	}
+	if (last_vma)
+		end = last_vma->vm_end;
+	up_read(&mm->mmap_sem);
+
+	if (!sz_range(&second_gap) || !sz_range(&first_gap))
+		return -EINVAL;
+
+	if (first_gap.start > second_gap.start)
+		swap(first_gap, second_gap);
+
+	regions[0].start = start;
+	regions[0].end = first_gap.start;
+	regions[1].start = first_gap.end;
+	regions[1].end = second_gap.start;
+	regions[2].start = second_gap.end;
+	regions[2].end = end;
+	return 0;
+}
+
+/* Split @r into @nr_pieces regions of about the same size */
+static void damon_split_evenly(struct damon_target *t, struct damon_region *r,
+			       unsigned long nr_pieces)
+{
+	unsigned long sz_piece, start, orig_end = r->ar.end;
+	struct damon_region *n, *prev = r;
+
+	sz_piece = ALIGN_DOWN(damon_sz_region(r) / nr_pieces, DAMON_MIN_REGION);
+	if (!sz_piece)
+		return;
+
+	r->ar.end = r->ar.start + sz_piece;
+	for (start = r->ar.end; start + sz_piece <= orig_end;
+	     start += sz_piece) {
+		n = damon_new_region(start, start + sz_piece);
+		if (!n)
+			break;
+		damon_insert_region(n, prev->list.next, t);
+		prev = n;
+	}
+	/* The last piece takes the remainder */
+	prev->ar.end = orig_end;
+}
+
+static void damon_init_regions(struct damon_ctx *ctx, struct damon_target *t)
+{
+	struct damon_addr_range regions[3];
+	struct damon_region *r;
+	struct mm_struct *mm;
+	int i, err;
+
+	mm = damon_get_mm(t);
+	if (!mm)
+		return;
+	err = damon_three_regions_of(mm, regions);
+	mmput(mm);
+	if (err)
+		return;
+
+	for (i = 0; i < 3; i++) {
+		r = damon_new_region(regions[i].start, regions[i].end);
+		if (!r)
+			return;
+		damon_insert_region(r, &t->regions_list, t);
+		damon_split_evenly(t, r, ctx->min_nr_regions / 3);
+	}
+}
+
+static bool damon_intersect(struct damon_region *r, struct damon_addr_range *re)
+{
+	return !(r->ar.end <= re->start || re->end <= r->ar.start);
+}
+
+/* Fit the regions of @t to the current mappings, keeping their history */
+static void damon_apply_three_regions(struct damon_target *t,
+				      struct damon_addr_range bregions[3])
+{
+	struct damon_region *r, *next;
+	unsigned int i;
+
+	/* Drop the regions that are no longer mapped */
+	damon_for_each_region_safe(r, next, t) {
+		for (i = 0; i < 3; i++) {
+			if (damon_intersect(r, &bregions[i]))
+				break;
+		}
+		if (i == 3)
+			damon_destroy_region(r, t);
+	}
+
+	/* Stretch or shrink the regions at the edges of each range */
+	for (i = 0; i < 3; i++) {
+		struct damon_region *first = NULL, *last = NULL;
+		struct damon_addr_range *br = &bregions[i];
+		struct list_head *pos = &t->regions_list;
+
+		damon_for_each_region(r, t) {
+			if (r->ar.start >= br->end) {
+				pos = &r->list;
+				break;
+			}
+			if (damon_intersect(r, br)) {
+				if (!first)
+					first = r;
+				last = r;
+			}
+		}
+
+		if (first) {
+			first->ar.start = br->start;
+			last->ar.end = br->end;
+			continue;
+		}
+
+		r = damon_new_region(br->start, br->end);
+		if (r)
+			damon_insert_region(r, pos, t);
+	}
+}
+
+static void damon_update_regions(struct damon_ctx *ctx)
+{
+	struct damon_addr_range regions[3];
+	struct damon_target *t;
+	struct mm_struct *mm;
+	int err;
+
+	damon_for_each_target(t, ctx) {
+		mm = damon_get_mm(t);
+		if (!mm)
+			continue;
+		err = damon_three_regions_of(mm, regions);
+		mmput(mm);
+		if (!err)
+			damon_apply_three_regions(t, regions);
+	}
+}
+
+/*
+ * Access checks
+ */
+
+static struct page *damon_get_page(unsigned long pfn)
+{
+	struct page *page;
+
+	if (!pfn_valid(pfn))
+		return NULL;
+
+	/* Only user memory pages are on the LRU, as for idle page tracking */
+	page = pfn_to_page(pfn);
+	if (!PageLRU(page) || !get_page_unless_zero(page))
+		return NULL;
+
+	if (unlikely(!PageLRU(page))) {
+		put_page(page);
+		return NULL;
+	}
+	return page;
+}
+
+/*
+ * Look up the pte or, for a transparent huge page, the pmd mapping @addr
+ * and return it locked. Called with mmap_sem held.
+ */
+static int damon_follow_pte_pmd(struct mm_struct *mm, unsigned long addr,
+				pte_t **ptep, pmd_t **pmdp, spinlock_t **ptlp)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+	pte_t *pte;
+
+	pgd = pgd_offset(mm, addr);
+	if (pgd_none(*pgd) || unlikely(pgd_bad(*pgd)))
+		return -EINVAL;
+
+	pud = pud_offset(pgd, addr);
+	if (pud_none(*pud) || unlikely(pud_bad(*pud)))
+		return -EINVAL;
+
+	pmd = pmd_offset(pud, addr);
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	if (pmd_trans_huge(*pmd)) {
+		*ptlp = pmd_lock(mm, pmd);
+		if (pmd_trans_huge(*pmd)) {
+			*pmdp = pmd;
+			return 0;
+		}
+		spin_unlock(*ptlp);
+	}
+#endif
+	if (pmd_none(*pmd) || unlikely(pmd_bad(*pmd)))
+		return -EINVAL;
+
+	pte = pte_offset_map_lock(mm, pmd, addr, ptlp);
+	if (!pte_present(*pte)) {
+		pte_unmap_unlock(pte, *ptlp);
+		return -EINVAL;
+	}
+	*ptep = pte;
+	return 0;
+}
+
+static void damon_mkold(struct mm_struct *mm, unsigned long addr)
+{
+	struct vm_area_struct *vma;
+	bool referenced = false;
+	struct page *page = NULL;
+	pte_t *pte = NULL;
+	pmd_t *pmd = NULL;
+	spinlock_t *ptl;
+
+	vma = find_vma(mm, addr);
+	if (!vma || vma->vm_start > addr)
+		return;
+
+	if (damon_follow_pte_pmd(mm, addr, &pte, &pmd, &ptl))
+		return;
+
+	if (pte) {
+		page = damon_get_page(pte_pfn(*pte));
+		if (page)
+			referenced = ptep_clear_young_notify(vma, addr, pte);
+		pte_unmap_unlock(pte, ptl);
+	}
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	else {
+		page = damon_get_page(pmd_pfn(*pmd));
+		if (page)
+			referenced = pmdp_clear_young_notify(vma, addr, pmd);
+		spin_unlock(ptl);
+	}
+#endif
+	if (!page)
+		return;
+
+	/* Don't lose the access for reclaim, see page_referenced_one() */
+	if (referenced)
+		set_page_young(page);
+	set_page_idle(page);
+	put_page(page);
+}
+
+static bool damon_young(struct mm_struct *mm, unsigned long addr,
+			unsigned long *page_sz)
+{
+	struct page *page = NULL;
+	bool young = false;
+	pte_t *pte = NULL;
+	pmd_t *pmd = NULL;
+	spinlock_t *ptl;
+
+	*page_sz = PAGE_SIZE;
+	if (damon_follow_pte_pmd(mm, addr, &pte, &pmd, &ptl))
+		return false;
+
+	if (pte) {
+		page = damon_get_page(pte_pfn(*pte));
+		young = pte_young(*pte);
+		pte_unmap_unlock(pte, ptl);
+	}
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	else {
+		page = damon_get_page(pmd_pfn(*pmd));
+		young = pmd_young(*pmd);
+		spin_unlock(ptl);
+		*page_sz = HPAGE_PMD_SIZE;
+	}
+#endif
+	if (!page)
+		return false;
+
+	young = young || !page_is_idle(page) ||
+		mmu_notifier_test_young(mm, addr);
+	put_page(page);
+	return young;
+}
+
+static void damon_prepare_access_checks(struct damon_ctx *ctx)
+{
+	struct damon_target *t;
+	struct damon_region *r;
+	struct mm_struct *mm;
+
+	damon_for_each_target(t, ctx) {
+		mm = damon_get_mm(t);
+		if (!mm)
+			continue;
+
+		down_read(&mm->mmap_sem);
+		damon_for_each_region(r, t) {
+			r->sampling_addr = damon_rand(r->ar.start, r->ar.end);
+			damon_mkold(mm, r->sampling_addr);
+		}
+		up_read(&mm->mmap_sem);
+		mmput(mm);
+	}
+}
+
+/* Returns the highest number of accesses of any region */
+static unsigned int damon_check_accesses(struct damon_ctx *ctx)
+{
+	unsigned int max_nr_accesses = 0;
+	struct damon_target *t;
+	struct damon_region *r;
+	struct mm_struct *mm;
+
+	damon_for_each_target(t, ctx) {
+		unsigned long last_addr = 0, last_sz = 0;
+		bool young = false;
+
+		mm = damon_get_mm(t);
+		if (!mm)
+			continue;
+
+		down_read(&mm->mmap_sem);
+		damon_for_each_region(r, t) {
+			/* Neighbouring samples may share a huge page */
+			if (!last_sz || ALIGN_DOWN(last_addr, last_sz) !=
+			    ALIGN_DOWN(r->sampling_addr, last_sz)) {
+				young = damon_young(mm, r->sampling_addr,
+						    &last_sz);
+				last_addr = r->sampling_addr;
+			}
+			if (young)
+				r->nr_accesses++;
+			max_nr_accesses = max(r->nr_accesses, max_nr_accesses);
+		}
+		up_read(&mm->mmap_sem);
+		mmput(mm);
+	}
+	return max_nr_accesses;
+}
+
+/*
+ * Aggregation
+ */
+
+/* The maximum size of a region merging is allowed to create */
+static unsigned long damon_region_sz_limit(struct damon_ctx *ctx)
+{
+	struct damon_target *t;
+	struct damon_region *r;
+	unsigned long sz = 0;
+
+	damon_for_each_target(t, ctx) {
+		damon_for_each_region(r, t)
+			sz += damon_sz_region(r);
+	}
+
+	sz /= ctx->min_nr_regions;
+	return max_t(unsigned long, sz, DAMON_MIN_REGION);
+}
+
+static void damon_merge_two_regions(struct damon_target *t,
+				    struct damon_region *l,
+				    struct damon_region *r)
+{
+	unsigned long sz_l = damon_sz_region(l), sz_r = damon_sz_region(r);
+
+	l->nr_accesses = (l->nr_accesses * sz_l + r->nr_accesses * sz_r) /
+			 (sz_l + sz_r);
+	l->age = (l->age * sz_l + r->age * sz_r) / (sz_l + sz_r);
+	l->ar.end = r->ar.end;
+	damon_destroy_region(r, t);
+}
+
+#define diff_of(a, b) ((a) > (b) ? (a) - (b) : (b) - (a))
+
+/*
+ * Age the regions whose access frequency didn't change by more than
+ * @thres and merge adjacent ones with similar frequencies.
+ */
+static void kdamond_merge_regions(struct damon_ctx *ctx, unsigned int thres,
+				  unsigned long sz_limit)
+{
+	struct damon_region *r, *prev, *next;
+	struct damon_target *t;
+
+	damon_for_each_target(t, ctx) {
+		prev = NULL;
+		damon_for_each_region_safe(r, next, t) {
+			if (diff_of(r->nr_accesses, r->last_nr_accesses) > thres)
+				r->age = 0;
+			else
+				r->age++;
+
+			if (prev && prev->ar.end == r->ar.start &&
+			    diff_of(prev->nr_accesses, r->nr_accesses) <= thres &&
+			    damon_sz_region(prev) + damon_sz_region(r) <= sz_limit)
+				damon_merge_two_regions(t, prev, r);
+			else
+				prev = r;
+		}
+	}
+}
+
+static void damon_apply_scheme(struct damon_target *t, struct damon_region *r,
+			       struct damos *s)
+{
+	struct mm_struct *mm;
+
+	if (s->action == DAMOS_STAT)
+		return;
+
+	mm = damon_get_mm(t);
+	if (!mm)
+		return;
+
+	down_read(&mm->mmap_sem);
+	madvise_cold_or_pageout_range(mm, r->ar.start, r->ar.end,
+				      s->action == DAMOS_PAGEOUT);
+	up_read(&mm->mmap_sem);
+	mmput(mm);
+}
+
+static void kdamond_apply_schemes(struct damon_ctx *ctx)
+{
+	struct damon_target *t;
+	struct damon_region *r;
+	struct damos *s;
+	unsigned long sz;
+
+	damon_for_each_target(t, ctx) {
+		damon_for_each_region(r, t) {
+			damon_for_each_scheme(s, ctx) {
+				sz = damon_sz_region(r);
+				if (sz < s->min_sz_region || sz > s->max_sz_region)
+					continue;
+				if (r->nr_accesses < s->min_nr_accesses ||
+				    r->nr_accesses > s->max_nr_accesses)
+					continue;
+				if (r->age < s->min_age_region ||
+				    r->age > s->max_age_region)
+					continue;
+
+				s->stat_count++;
+				s->stat_sz += sz;
+				damon_apply_scheme(t, r, s);
+				/* Give the action time to take effect */
+				if (s->action != DAMOS_STAT)
+					r->age = 0;
+			}
+		}
+	}
+}
+
+static void kdamond_reset_aggregated(struct damon_ctx *ctx)
+{
+	struct damon_target *t;
+	struct damon_region *r;
+
+	damon_for_each_target(t, ctx) {
+		damon_for_each_region(r, t) {
+			trace_damon_aggregated(t, r);
+			r->last_nr_accesses = r->nr_accesses;
+			r->nr_accesses = 0;
+		}
+	}
+}
+
+static void damon_split_region_at(struct damon_target *t,
+				  struct damon_region *r, unsigned long sz_r)
+{
+	struct damon_region *n;
+
+	n = damon_new_region(r->ar.start + sz_r, r->ar.end);
+	if (!n)
+		return;
+
+	r->ar.end = n->ar.start;
+	n->age = r->age;
+	n->last_nr_accesses = r->last_nr_accesses;
+	damon_insert_region(n, r->list.next, t);
+}
+
+/* Split every region into up to @nr_subs regions of random sizes */
+static void damon_split_regions_of(struct damon_target *t, int nr_subs)
+{
+	struct damon_region *r, *next;
+	unsigned long sz_region, sz_sub;
+	int i;
+
+	damon_for_each_region_safe(r, next, t) {
+		sz_region = damon_sz_region(r);
+
+		for (i = 0; i < nr_subs - 1 &&
+		     sz_region > 2 * DAMON_MIN_REGION; i++) {
+			/* Leave 10% to 90% of the region on the left */
+			sz_sub = ALIGN_DOWN(damon_rand(1, 10) * sz_region / 10,
+					    DAMON_MIN_REGION);
+			if (!sz_sub || sz_sub >= sz_region)
+				continue;
+
+			damon_split_region_at(t, r, sz_sub);
+			sz_region = sz_sub;
+		}
+	}
+}
+
+static void kdamond_split_regions(struct damon_ctx *ctx)
+{
+	unsigned int nr_regions = 0;
+	struct damon_target *t;
+	int nr_subregions = 2;
+
+	damon_for_each_target(t, ctx)
+		nr_regions += t->nr_regions;
+
+	if (nr_regions > ctx->max_nr_regions / 2)
+		return;
+
+	/* The regions didn't change, maybe their middles are different */
+	if (ctx->last_nr_regions == nr_regions &&
+	    nr_regions < ctx->max_nr_regions / 3)
+		nr_subregions = 3;
+
+	damon_for_each_target(t, ctx)
+		damon_split_regions_of(t, nr_subregions);
+
+	ctx->last_nr_regions = nr_regions;
+}
+
+static int kdamond_fn(void *data)
+{
+	struct damon_ctx *ctx = data;
+	ktime_t last_aggregation, last_update, now;
+	unsigned int max_nr_accesses;
+	struct damon_target *t;
+	unsigned long sz_limit;
+
+	pr_debug("kdamond (%d) starts\n", current->pid);
+
+	damon_for_each_target(t, ctx)
+		damon_init_regions(ctx, t);
+	sz_limit = damon_region_sz_limit(ctx);
+	last_aggregation = last_update = ktime_get();
+
+	while (!kthread_should_stop() && damon_targets_alive(ctx)) {
+		damon_prepare_access_checks(ctx);
+		usleep_range(ctx->sample_interval, ctx->sample_interval + 1);
+		max_nr_accesses = damon_check_accesses(ctx);
+
+		now = ktime_get();
+		if (ktime_us_delta(now, last_aggregation) >= ctx->aggr_interval) {
+			kdamond_merge_regions(ctx, max_nr_accesses / 10,
+					      sz_limit);
+			kdamond_apply_schemes(ctx);
+			kdamond_reset_aggregated(ctx);
+			kdamond_split_regions(ctx);
+			last_aggregation = now;
+		}
+
+		if (ktime_us_delta(now, last_update) >= ctx->update_interval) {
+			damon_update_regions(ctx);
+			sz_limit = damon_region_sz_limit(ctx);
+			last_update = now;
+		}
+	}
+
+	damon_for_each_target(t, ctx)
+		damon_destroy_regions(t);
+
+	pr_debug("kdamond (%d) finishes\n", current->pid);
+
+	/* Pairs with damon_kdamond_running() */
+	smp_store_release(&ctx->kdamond_done, true);
+	return 0;
+}
+
+/*
+ * Control, with kdamond_lock held
+ */
+
+static bool damon_kdamond_running(struct damon_ctx *ctx)
+{
+	return ctx->kdamond && !smp_load_acquire(&ctx->kdamond_done);
+}
+
+/* Stop the monitoring thread, or collect it if it stopped by itself */
+static void damon_stop(struct damon_ctx *ctx)
+{
+	if (!ctx->kdamond)
+		return;
+
+	kthread_stop(ctx->kdamond);
+	put_task_struct(ctx->kdamond);
+	ctx->kdamond = NULL;
+}
+
+static int damon_start(struct damon_ctx *ctx)
+{
+	struct task_struct *task;
+
+	if (damon_kdamond_running(ctx))
+		return -EBUSY;
+	damon_stop(ctx);
+
+	if (list_empty(&ctx->targets))
+		return -EINVAL;
+
+	ctx->kdamond_done = false;
+	ctx->last_nr_regions = 0;
+	task = kthread_create(kdamond_fn, ctx, "kdamond");
+	if (IS_ERR(task))
+		return PTR_ERR(task);
+
+	/* kdamond may exit by itself, keep it around for damon_stop() */
+	get_task_struct(task);
+	ctx->kdamond = task;
+	wake_up_process(task);
+	return 0;
+}
+
+/*
+ * debugfs interface
+ */
+
+static char *damon_user_input(const char __user *buf, size_t count,
+			      loff_t *ppos)
+{
+	char *kbuf;
+
+	/* Every write replaces the whole setting */
+	if (*ppos || !count || count > PAGE_SIZE)
+		return ERR_PTR(-EINVAL);
+
+	kbuf = kmalloc(count + 1, GFP_KERNEL);
+	if (!kbuf)
+		return ERR_PTR(-ENOMEM);
+
+	if (copy_from_user(kbuf, buf, count)) {
+		kfree(kbuf);
+		return ERR_PTR(-EFAULT);
+	}
+	kbuf[count] = '\0';
+	return kbuf;
+}
+
+static int damon_attrs_show(struct seq_file *m, void *v)
+{
+	struct damon_ctx *ctx = &damon_ctx;
+
+	mutex_lock(&ctx->kdamond_lock);
+	seq_printf(m, "%lu %lu %lu %lu %lu\n", ctx->sample_interval,
+		   ctx->aggr_interval, ctx->update_interval,
+		   ctx->min_nr_regions, ctx->max_nr_regions);
+	mutex_unlock(&ctx->kdamond_lock);
+	return 0;
+}
+
+static ssize_t damon_attrs_write(struct file *file, const char __user *buf,
+				 size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = &damon_ctx;
+	unsigned long sample, aggr, update, min_nr, max_nr;
+	ssize_t ret = count;
+	char *kbuf;
+
+	kbuf = damon_user_input(buf, count, ppos);
+	if (IS_ERR(kbuf))
+		return PTR_ERR(kbuf);
+
+	if (sscanf(kbuf, "%lu %lu %lu %lu %lu", &sample, &aggr, &update,
+		   &min_nr, &max_nr) != 5) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	/* Every monitored process has at least three regions */
+	if (!sample || aggr < sample || !update || min_nr < 3 ||
+	    max_nr < min_nr) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	mutex_lock(&ctx->kdamond_lock);
+	if (damon_kdamond_running(ctx)) {
+		ret = -EBUSY;
+	} else {
+		ctx->sample_interval = sample;
+		ctx->aggr_interval = aggr;
+		ctx->update_interval = update;
+		ctx->min_nr_regions = min_nr;
+		ctx->max_nr_regions = max_nr;
+	}
+	mutex_unlock(&ctx->kdamond_lock);
+out:
+	kfree(kbuf);
+	return ret;
+}
+
+static int damon_target_ids_show(struct seq_file *m, void *v)
+{
+	struct damon_ctx *ctx = &damon_ctx;
+	struct damon_target *t;
+
+	mutex_lock(&ctx->kdamond_lock);
+	damon_for_each_target(t, ctx)
+		seq_printf(m, "%d ", pid_vnr(t->pid));
+	seq_putc(m, '\n');
+	mutex_unlock(&ctx->kdamond_lock);
+	return 0;
+}
+
+static ssize_t damon_target_ids_write(struct file *file,
+				      const char __user *buf,
+				      size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = &damon_ctx;
+	struct damon_target *t, *next;
+	LIST_HEAD(targets);
+	LIST_HEAD(old);
+	ssize_t ret = count;
+	char *kbuf, *pos;
+	int nr, parsed;
+	struct pid *pid;
+
+	kbuf = damon_user_input(buf, count, ppos);
+	if (IS_ERR(kbuf))
+		return PTR_ERR(kbuf);
+
+	for (pos = kbuf; sscanf(pos, "%d%n", &nr, &parsed) == 1;
+	     pos += parsed) {
+		pid = find_get_pid(nr);
+		if (!pid) {
+			ret = -EINVAL;
+			goto free_targets;
+		}
+
+		t = kmalloc(sizeof(*t), GFP_KERNEL);
+		if (!t) {
+			put_pid(pid);
+			ret = -ENOMEM;
+			goto free_targets;
+		}
+		t->pid = pid;
+		t->nr_regions = 0;
+		INIT_LIST_HEAD(&t->regions_list);
+		list_add_tail(&t->list, &targets);
+	}
+
+	mutex_lock(&ctx->kdamond_lock);
+	if (damon_kdamond_running(ctx)) {
+		ret = -EBUSY;
+	} else {
+		/* Free the old targets below */
+		list_splice_init(&ctx->targets, &old);
+		list_splice_init(&targets, &ctx->targets);
+		list_splice(&old, &targets);
+	}
+	mutex_unlock(&ctx->kdamond_lock);
+
+free_targets:
+	list_for_each_entry_safe(t, next, &targets, list)
+		damon_destroy_target(t);
+	kfree(kbuf);
+	return ret;
+}
+
+static int damon_schemes_show(struct seq_file *m, void *v)
+{
+	struct damon_ctx *ctx = &damon_ctx;
+	struct damos *s;
+
+	mutex_lock(&ctx->kdamond_lock);
+	damon_for_each_scheme(s, ctx)
+		seq_printf(m, "%lu %lu %u %u %u %u %d %lu %lu\n",
+			   s->min_sz_region, s->max_sz_region,
+			   s->min_nr_accesses, s->max_nr_accesses,
+			   s->min_age_region, s->max_age_region,
+			   s->action, s->stat_count, s->stat_sz);
+	mutex_unlock(&ctx->kdamond_lock);
+	return 0;
+}
+
+static ssize_t damon_schemes_write(struct file *file, const char __user *buf,
+				   size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = &damon_ctx;
+	struct damos *s, *next;
+	unsigned int action;
+	LIST_HEAD(schemes);
+	LIST_HEAD(old);
+	ssize_t ret = count;
+	char *kbuf, *pos;
+	int parsed;
+
+	kbuf = damon_user_input(buf, count, ppos);
+	if (IS_ERR(kbuf))
+		return PTR_ERR(kbuf);
+
+	for (pos = kbuf;; pos += parsed) {
+		s = kzalloc(sizeof(*s), GFP_KERNEL);
+		if (!s) {
+			ret = -ENOMEM;
+			goto free_schemes;
+		}
+
+		if (sscanf(pos, "%lu %lu %u %u %u %u %u%n",
+			   &s->min_sz_region, &s->max_sz_region,
+			   &s->min_nr_accesses, &s->max_nr_accesses,
+			   &s->min_age_region, &s->max_age_region,
+			   &action, &parsed) != 7) {
+			kfree(s);
+			break;
+		}
+
+		if (action >= NR_DAMOS_ACTIONS ||
+		    s->min_sz_region > s->max_sz_region ||
+		    s->min_nr_accesses > s->max_nr_accesses ||
+		    s->min_age_region > s->max_age_region) {
+			kfree(s);
+			ret = -EINVAL;
+			goto free_schemes;
+		}
+		s->action = action;
+		list_add_tail(&s->list, &schemes);
+	}
+
+	mutex_lock(&ctx->kdamond_lock);
+	if (damon_kdamond_running(ctx)) {
+		ret = -EBUSY;
+	} else {
+		/* Free the old schemes below */
+		list_splice_init(&ctx->schemes, &old);
+		list_splice_init(&schemes, &ctx->schemes);
+		list_splice(&old, &schemes);
+	}
+	mutex_unlock(&ctx->kdamond_lock);
+
+free_schemes:
+	list_for_each_entry_safe(s, next, &schemes, list) {
+		list_del(&s->list);
+		kfree(s);
+	}
+	kfree(kbuf);
+	return ret;
+}
+
+static int damon_monitor_on_show(struct seq_file *m, void *v)
+{
+	struct damon_ctx *ctx = &damon_ctx;
+
+	mutex_lock(&ctx->kdamond_lock);
+	seq_puts(m, damon_kdamond_running(ctx) ? "on\n" : "off\n");
+	mutex_unlock(&ctx->kdamond_lock);
+	return 0;
+}
+
+static ssize_t damon_monitor_on_write(struct file *file,
+				      const char __user *buf,
+				      size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = &damon_ctx;
+	ssize_t ret = count;
+	char *kbuf, *cmd;
+	int err = 0;
+
+	kbuf = damon_user_input(buf, count, ppos);
+	if (IS_ERR(kbuf))
+		return PTR_ERR(kbuf);
+
+	cmd = strim(kbuf);
+	mutex_lock(&ctx->kdamond_lock);
+	if (!strcmp(cmd, "on"))
+		err = damon_start(ctx);
+	else if (!strcmp(cmd, "off"))
+		damon_stop(ctx);
+	else
+		err = -EINVAL;
+	mutex_unlock(&ctx->kdamond_lock);
+
+	if (err)
+		ret = err;
+	kfree(kbuf);
+	return ret;
+}
+
+#define DAMON_DEBUGFS_FOPS(name)					\
+static int damon_##name##_open(struct inode *inode, struct file *file)	\
+{									\
+	return single_open(file, damon_##name##_show, NULL);		\
+}									\
+									\
+static const struct file_operations damon_##name##_fops = {		\
+	.open = damon_##name##_open,					\
+	.read = seq_read,						\
+	.write = damon_##name##_write,					\
+	.llseek = seq_lseek,						\
+	.release = single_release,					\
+}
+
+DAMON_DEBUGFS_FOPS(attrs);
+DAMON_DEBUGFS_FOPS(target_ids);
+DAMON_DEBUGFS_FOPS(schemes);
+DAMON_DEBUGFS_FOPS(monitor_on);
+
+static int __init damon_init(void)
+{
+	static const struct {
+		const char *name;
+		const struct file_operations *fops;
+	} files[] = {
+		{ "attrs", &damon_attrs_fops },
+		{ "target_ids", &damon_target_ids_fops },
+		{ "schemes", &damon_schemes_fops },
+		{ "monitor_on", &damon_monitor_on_fops },
+	};
+	struct dentry *root;
+	int i;
+
+	root = debugfs_create_dir("damon", NULL);
+	if (!root) {
+		pr_err("failed to create the debugfs directory\n");
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(files); i++) {
+		if (!debugfs_create_file(files[i].name, S_IRUSR | S_IWUSR,
+					 root, NULL, files[i].fops)) {
+			pr_err("failed to create the debugfs files\n");
+			debugfs_remove_recursive(root);
+			return -ENOMEM;
+		}
+	}
+	return 0;
+}
+late_initcall(damon_init);
@@ -84,6 +84,7 @@ SYSCALL_DEFINE4(fadvise64_64, int, fd, loff_t, offset, loff_t, len, int, advice)
 	switch (advice) {
 	case POSIX_FADV_NORMAL:
 		f.file->f_ra.ra_pages = bdi->ra_pages;
+		f.file->f_ra.shrink = 0;
 		spin_lock(&f.file->f_lock);
 		f.file->f_mode &= ~FMODE_RANDOM;
 		spin_unlock(&f.file->f_lock);
@@ -95,6 +96,7 @@ SYSCALL_DEFINE4(fadvise64_64, int, fd, loff_t, offset, loff_t, len, int, advice)
 		break;
 	case POSIX_FADV_SEQUENTIAL:
 		f.file->f_ra.ra_pages = bdi->ra_pages * 2;
+		f.file->f_ra.shrink = 0;
 		spin_lock(&f.file->f_lock);
 		f.file->f_mode &= ~FMODE_RANDOM;
 		spin_unlock(&f.file->f_lock);
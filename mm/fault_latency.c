@@ -0,0 +1,104 @@
+/*
+ * Page fault latency histograms
+ *
+ * handle_mm_fault() times every fault with local_clock() and counts it in
+ * a log2 latency bucket, by fault type, in per-cpu histograms of both the
+ * faulting mm and its memcg. They are read from /proc/<pid>/fault_latency
+ * and memory.fault_latency.
+ */
+
+#include <linux/fault_latency.h>
+#include <linux/log2.h>
+#include <linux/memcontrol.h>
+#include <linux/mm.h>
+#include <linux/seq_file.h>
+
+static const char * const fault_latency_names[NR_FAULT_LATENCY_TYPES] = {
+	"minor",
+	"file",
+	"swap",
+};
+
+/*
+ * @file tells whether the faulting vma maps a regular file; a major fault
+ * on it still reads from swap if do_swap_page() found a swap entry, e.g.
+ * for a COW page of a MAP_PRIVATE mapping.
+ */
+void fault_latency_account(struct mm_struct *mm, bool file, int ret)
+{
+	struct task_struct *tsk = current;
+	enum fault_latency_type type;
+	unsigned int bucket = 0;
+	s64 delta;
+
+	if (ret & VM_FAULT_MAJOR)
+		tsk->fault_latency_major = true;
+
+	/* The fault is accounted once, by its last pass */
+	if (ret & VM_FAULT_RETRY)
+		return;
+
+	delta = local_clock() - tsk->fault_latency_start;
+
+	if (!tsk->fault_latency_major)
+		type = FAULT_LATENCY_MINOR;
+	else if (file && !tsk->fault_latency_swapin)
+		type = FAULT_LATENCY_FILE;
+	else
+		type = FAULT_LATENCY_SWAP;
+
+	/* local_clock() may go backwards when the task changed cpus */
+	if (delta > 0)
+		bucket = min_t(unsigned int, fls64(delta >> FAULT_LATENCY_SHIFT),
+			       NR_FAULT_LATENCY_BUCKETS - 1);
+
+	this_cpu_inc(mm->fault_latency->count[type][bucket]);
+	mem_cgroup_count_fault_latency(mm, type, bucket);
+}
+
+void fault_latency_hist_add(struct fault_latency_hist *sum,
+			    struct fault_latency_hist __percpu *hist)
+{
+	int cpu, type, bucket;
+
+	for_each_possible_cpu(cpu) {
+		struct fault_latency_hist *h = per_cpu_ptr(hist, cpu);
+
+		for (type = 0; type < NR_FAULT_LATENCY_TYPES; type++)
+			for (bucket = 0; bucket < NR_FAULT_LATENCY_BUCKETS; bucket++)
+				sum->count[type][bucket] += h->count[type][bucket];
+	}
+}
+
+/*
+ * The first line holds the lower bound of each bucket in ns, every other
+ * line the number of faults of one type that fell into each bucket.
+ */
+void fault_latency_hist_show(struct seq_file *m, struct fault_latency_hist *sum)
+{
+	int type, bucket;
+
+	seq_puts(m, "ns");
+	for (bucket = 0; bucket < NR_FAULT_LATENCY_BUCKETS; bucket++)
+		seq_printf(m, " %llu", bucket ?
+			   1ULL << (bucket + FAULT_LATENCY_SHIFT - 1) : 0);
+	seq_putc(m, '\n');
+
+	for (type = 0; type < NR_FAULT_LATENCY_TYPES; type++) {
+		seq_puts(m, fault_latency_names[type]);
+		for (bucket = 0; bucket < NR_FAULT_LATENCY_BUCKETS; bucket++)
+			seq_printf(m, " %lu", sum->count[type][bucket]);
+		seq_putc(m, '\n');
+	}
+}
+
+int mm_fault_latency_init(struct mm_struct *mm)
+{
+	mm->fault_latency = alloc_percpu(struct fault_latency_hist);
+	return mm->fault_latency ? 0 : -ENOMEM;
+}
+
+void mm_fault_latency_free(struct mm_struct *mm)
+{
+	free_percpu(mm->fault_latency);
+}
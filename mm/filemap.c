@@ -35,6 +35,7 @@
 #include <linux/memcontrol.h>
 #include <linux/cleancache.h>
 #include <linux/rmap.h>
+#include <linux/psi.h>
 #include "internal.h"
 
 #define CREATE_TRACE_POINTS
@@ -110,14 +111,19 @@
  *   ->tasklist_lock            (memory_failure, collect_procs_ao)
  */
 
-static int page_cache_tree_insert(struct address_space *mapping,
-				  struct page *page, void **shadowp)
+/*
+ * The swap cache shares these helpers with the page cache, and swap
+ * cache pages are indexed by their swap offset rather than by
+ * page->index, hence the explicit @index.
+ */
+int page_cache_tree_insert(struct address_space *mapping, pgoff_t index,
+			   struct page *page, void **shadowp)
 {
 	struct radix_tree_node *node;
 	void **slot;
 	int error;
 
-	error = __radix_tree_create(&mapping->page_tree, page->index, 0,
+	error = __radix_tree_create(&mapping->page_tree, index, 0,
 				    &node, &slot);
 	if (error)
 		return error;
@@ -143,8 +149,7 @@ static int page_cache_tree_insert(struct address_space *mapping,
 			if (node)
 				workingset_node_pages_dec(node);
 			/* Wakeup waiters for exceptional entry lock */
-			dax_wake_mapping_entry_waiter(mapping, page->index,
-						      true);
+			dax_wake_mapping_entry_waiter(mapping, index, true);
 		}
 	}
 	radix_tree_replace_slot(slot, page);
@@ -166,8 +171,8 @@ static int page_cache_tree_insert(struct address_space *mapping,
 	return 0;
 }
 
-static void page_cache_tree_delete(struct address_space *mapping,
-				   struct page *page, void *shadow)
+void page_cache_tree_delete(struct address_space *mapping, pgoff_t index,
+			    struct page *page, void *shadow)
 {
 	int i, nr = PageHuge(page) ? 1 : hpage_nr_pages(page);
 
@@ -179,7 +184,7 @@ static void page_cache_tree_delete(struct address_space *mapping,
 		struct radix_tree_node *node;
 		void **slot;
 
-		__radix_tree_lookup(&mapping->page_tree, page->index + i,
+		__radix_tree_lookup(&mapping->page_tree, index + i,
 				    &node, &slot);
 
 		radix_tree_clear_tags(&mapping->page_tree, node, slot);
@@ -281,7 +286,7 @@ void __delete_from_page_cache(struct page *page, void *shadow)
 		}
 	}
 
-	page_cache_tree_delete(mapping, page, shadow);
+	page_cache_tree_delete(mapping, page->index, page, shadow);
 
 	page->mapping = NULL;
 	/* Leave page->index set: truncation lookup relies upon it */
@@ -636,7 +641,7 @@ int replace_page_cache_page(struct page *old, struct page *new, gfp_t gfp_mask)
 
 		spin_lock_irqsave(&mapping->tree_lock, flags);
 		__delete_from_page_cache(old, NULL);
-		error = page_cache_tree_insert(mapping, new, NULL);
+		error = page_cache_tree_insert(mapping, offset, new, NULL);
 		BUG_ON(error);
 
 		/*
@@ -689,7 +694,7 @@ static int __add_to_page_cache_locked(struct page *page,
 	page->index = offset;
 
 	spin_lock_irq(&mapping->tree_lock);
-	error = page_cache_tree_insert(mapping, page, shadowp);
+	error = page_cache_tree_insert(mapping, offset, page, shadowp);
 	radix_tree_preload_end();
 	if (unlikely(error))
 		goto err_insert;
@@ -730,6 +735,24 @@ int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
 }
 EXPORT_SYMBOL(add_to_page_cache_locked);
 
+static void page_cache_lru_add(struct page *page, void *shadow, gfp_t gfp_mask)
+{
+	/*
+	 * The page might have been evicted from cache only
+	 * recently, in which case it should be activated like
+	 * any other repeatedly accessed page.
+	 * The exception is pages getting rewritten; evicting other
+	 * data from the working set, only to cache data that will
+	 * get overwritten with something else, is a waste of memory.
+	 */
+	if (!(gfp_mask & __GFP_WRITE) &&
+	    shadow && workingset_refault(page, shadow))
+		SetPageActive(page);
+	else
+		ClearPageActive(page);
+	lru_cache_add(page);
+}
+
 int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 				pgoff_t offset, gfp_t gfp_mask)
 {
@@ -741,27 +764,105 @@ int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 					 gfp_mask, &shadow);
 	if (unlikely(ret))
 		__ClearPageLocked(page);
-	else {
-		/*
-		 * The page might have been evicted from cache only
-		 * recently, in which case it should be activated like
-		 * any other repeatedly accessed page.
-		 * The exception is pages getting rewritten; evicting other
-		 * data from the working set, only to cache data that will
-		 * get overwritten with something else, is a waste of memory.
-		 */
-		if (!(gfp_mask & __GFP_WRITE) &&
-		    shadow && workingset_refault(shadow)) {
-			SetPageActive(page);
-			workingset_activation(page);
-		} else
-			ClearPageActive(page);
-		lru_cache_add(page);
-	}
+	else
+		page_cache_lru_add(page, shadow, gfp_mask);
 	return ret;
 }
 EXPORT_SYMBOL_GPL(add_to_page_cache_lru);
 
+/**
+ * add_to_page_cache_lru_batch - add readahead pages to the pagecache
+ * @mapping:	the address_space to add the pages to
+ * @pages:	list of new pages with ->index set, as built by readahead
+ * @batch:	array receiving the pages taken off @pages
+ * @nr:		size of @batch
+ * @gfp_mask:	page allocation mode
+ *
+ * Takes up to PAGEVEC_SIZE pages off the tail of @pages, in file order, and
+ * adds them to the pagecache and the LRU like add_to_page_cache_lru() does,
+ * but inserts them all under a single acquisition of the tree_lock.
+ *
+ * On return each @batch slot either holds a locked pagecache page, whose
+ * reference is now owned by the caller, or is NULL if the page could not be
+ * added, in which case it has already been released.
+ *
+ * Returns the number of slots of @batch that were filled.
+ */
+unsigned int add_to_page_cache_lru_batch(struct address_space *mapping,
+					 struct list_head *pages,
+					 struct page **batch, unsigned int nr,
+					 gfp_t gfp_mask)
+{
+	struct mem_cgroup *memcg[PAGEVEC_SIZE];
+	void *shadow[PAGEVEC_SIZE];
+	unsigned long failed = 0;
+	unsigned int i, count = 0;
+
+	nr = min_t(unsigned int, nr, PAGEVEC_SIZE);
+
+	while (count < nr && !list_empty(pages)) {
+		struct page *page = list_last_entry(pages, struct page, lru);
+
+		VM_BUG_ON_PAGE(PageSwapBacked(page), page);
+		list_del(&page->lru);
+		__SetPageLocked(page);
+		shadow[count] = NULL;
+		if (mem_cgroup_try_charge(page, current->mm, gfp_mask,
+					  &memcg[count], false)) {
+			__ClearPageLocked(page);
+			put_page(page);
+			page = NULL;
+		}
+		batch[count++] = page;
+	}
+
+	if (radix_tree_maybe_preload(gfp_mask & GFP_RECLAIM_MASK)) {
+		failed = ~0UL;
+		goto finish;
+	}
+
+	spin_lock_irq(&mapping->tree_lock);
+	for (i = 0; i < count; i++) {
+		struct page *page = batch[i];
+
+		if (!page)
+			continue;
+		get_page(page);
+		page->mapping = mapping;
+		if (unlikely(page_cache_tree_insert(mapping, page->index,
+						    page, &shadow[i]))) {
+			/* Leave page->index set: truncation relies upon it */
+			page->mapping = NULL;
+			put_page(page);
+			failed |= 1UL << i;
+			continue;
+		}
+		__inc_node_page_state(page, NR_FILE_PAGES);
+	}
+	radix_tree_preload_end();
+	spin_unlock_irq(&mapping->tree_lock);
+
+finish:
+	for (i = 0; i < count; i++) {
+		struct page *page = batch[i];
+
+		if (!page)
+			continue;
+		if (failed & (1UL << i)) {
+			mem_cgroup_cancel_charge(page, memcg[i], false);
+			__ClearPageLocked(page);
+			put_page(page);
+			batch[i] = NULL;
+			continue;
+		}
+		mem_cgroup_commit_charge(page, memcg[i], false, false);
+		trace_mm_filemap_add_to_page_cache(page);
+		page_cache_lru_add(page, shadow[i], gfp_mask);
+	}
+	return count;
+}
+EXPORT_SYMBOL_GPL(add_to_page_cache_lru_batch);
+
 #ifdef CONFIG_NUMA
 struct page *__page_cache_alloc(gfp_t gfp)
 {
@@ -799,13 +900,32 @@ wait_queue_head_t *page_waitqueue(struct page *page)
 }
 EXPORT_SYMBOL(page_waitqueue);
 
+/*
+ * A page that is still being read in but already sits on the active
+ * list was activated by workingset_refault(): the waiter is stalling on
+ * memory it recently had to give up, not just on IO.
+ */
+static inline bool page_thrashing(struct page *page)
+{
+	return PageActive(page) && !PageUptodate(page);
+}
+
 void wait_on_page_bit(struct page *page, int bit_nr)
 {
 	DEFINE_WAIT_BIT(wait, &page->flags, bit_nr);
+	unsigned long pflags;
+	bool thrashing;
 
-	if (test_bit(bit_nr, &page->flags))
-		__wait_on_bit(page_waitqueue(page), &wait, bit_wait_io,
-							TASK_UNINTERRUPTIBLE);
+	if (!test_bit(bit_nr, &page->flags))
+		return;
+
+	thrashing = page_thrashing(page);
+	if (thrashing)
+		psi_memstall_enter(&pflags);
+	__wait_on_bit(page_waitqueue(page), &wait, bit_wait_io,
+						TASK_UNINTERRUPTIBLE);
+	if (thrashing)
+		psi_memstall_leave(&pflags);
 }
 EXPORT_SYMBOL(wait_on_page_bit);
 
@@ -822,12 +942,22 @@ EXPORT_SYMBOL(wait_on_page_bit_timeout);
 int wait_on_page_bit_killable(struct page *page, int bit_nr)
 {
 	DEFINE_WAIT_BIT(wait, &page->flags, bit_nr);
+	unsigned long pflags;
+	bool thrashing;
+	int ret;
 
 	if (!test_bit(bit_nr, &page->flags))
 		return 0;
 
-	return __wait_on_bit(page_waitqueue(page), &wait,
-			     bit_wait_io, TASK_KILLABLE);
+	thrashing = page_thrashing(page);
+	if (thrashing)
+		psi_memstall_enter(&pflags);
+	ret = __wait_on_bit(page_waitqueue(page), &wait,
+			    bit_wait_io, TASK_KILLABLE);
+	if (thrashing)
+		psi_memstall_leave(&pflags);
+
+	return ret;
 }
 
 int wait_on_page_bit_killable_timeout(struct page *page,
@@ -945,9 +1075,15 @@ void __lock_page(struct page *page)
 {
 	struct page *page_head = compound_head(page);
 	DEFINE_WAIT_BIT(wait, &page_head->flags, PG_locked);
+	bool thrashing = page_thrashing(page_head);
+	unsigned long pflags;
 
+	if (thrashing)
+		psi_memstall_enter(&pflags);
 	__wait_on_bit_lock(page_waitqueue(page_head), &wait, bit_wait_io,
 							TASK_UNINTERRUPTIBLE);
+	if (thrashing)
+		psi_memstall_leave(&pflags);
 }
 EXPORT_SYMBOL(__lock_page);
 
@@ -955,9 +1091,18 @@ int __lock_page_killable(struct page *page)
 {
 	struct page *page_head = compound_head(page);
 	DEFINE_WAIT_BIT(wait, &page_head->flags, PG_locked);
+	bool thrashing = page_thrashing(page_head);
+	unsigned long pflags;
+	int ret;
 
-	return __wait_on_bit_lock(page_waitqueue(page_head), &wait,
+	if (thrashing)
+		psi_memstall_enter(&pflags);
+	ret = __wait_on_bit_lock(page_waitqueue(page_head), &wait,
 					bit_wait_io, TASK_KILLABLE);
+	if (thrashing)
+		psi_memstall_leave(&pflags);
+
+	return ret;
 }
 EXPORT_SYMBOL_GPL(__lock_page_killable);
 
@@ -2035,6 +2180,7 @@ static void do_sync_mmap_readahead(struct vm_area_struct *vma,
 				   pgoff_t offset)
 {
 	struct address_space *mapping = file->f_mapping;
+	unsigned long max;
 
 	/* If we don't want any read-ahead, don't bother */
 	if (vma->vm_flags & VM_RAND_READ)
@@ -2059,13 +2205,22 @@ static void do_sync_mmap_readahead(struct vm_area_struct *vma,
 	if (ra->mmap_miss > MMAP_LOTSAMISS)
 		return;
 
+	/*
+	 * A fault outside the last read-around window means that window
+	 * was mostly wasted, so make the next one smaller.
+	 */
+	if (ra->size && !ra_has_index(ra, offset))
+		ra_shrink(ra);
+
 	/*
 	 * mmap read-around
 	 */
-	ra->start = max_t(long, 0, offset - ra->ra_pages / 2);
-	ra->size = ra->ra_pages;
-	ra->async_size = ra->ra_pages / 4;
+	max = ra_max_pages(ra);
+	ra->start = max_t(long, 0, offset - max / 2);
+	ra->size = max;
+	ra->async_size = max / 4;
 	ra_submit(ra, mapping, file);
+	trace_mm_filemap_readahead(mapping, ra, offset, 1, false);
 }
 
 /*
@@ -1911,7 +1911,8 @@ static void __split_huge_page_tail(struct page *head, int tail,
 			 (1L << PG_active) |
 			 (1L << PG_locked) |
 			 (1L << PG_unevictable) |
-			 (1L << PG_dirty)));
+			 (1L << PG_dirty) |
+			 LRU_GEN_MASK | LRU_REFS_MASK));
 
 	/*
 	 * After clearing PageTail the gup refcount can be released.
@@ -15,6 +15,7 @@
 #include <linux/mm.h>
 #include <linux/pagemap.h>
 #include <linux/tracepoint-defs.h>
+#include <linux/srcu.h>
 
 /*
  * The set of flags that only affect watermark checking and reclaim
@@ -38,6 +39,12 @@
 
 int do_swap_page(struct fault_env *fe, pte_t orig_pte);
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+extern struct srcu_struct vma_srcu;
+extern struct vm_area_struct *find_vma_srcu(struct mm_struct *mm,
+					    unsigned long addr);
+#endif
+
 void free_pgtables(struct mmu_gather *tlb, struct vm_area_struct *start_vma,
 		unsigned long floor, unsigned long ceiling);
 
@@ -46,6 +53,11 @@ void unmap_page_range(struct mmu_gather *tlb,
 			     unsigned long addr, unsigned long end,
 			     struct zap_details *details);
 
+int page_cache_tree_insert(struct address_space *mapping, pgoff_t index,
+			   struct page *page, void **shadowp);
+void page_cache_tree_delete(struct address_space *mapping, pgoff_t index,
+			    struct page *page, void *shadow);
+
 extern int __do_page_cache_readahead(struct address_space *mapping,
 		struct file *filp, pgoff_t offset, unsigned long nr_to_read,
 		unsigned long lookahead_size);
@@ -60,6 +72,29 @@ static inline unsigned long ra_submit(struct file_ra_state *ra,
 					ra->start, ra->size, ra->async_size);
 }
 
+/*
+ * The readahead window of a file that keeps missing is scaled down, by up
+ * to 1 << RA_MAX_SHRINK, and grows back each time a readahead marker is hit.
+ */
+#define RA_MAX_SHRINK	3
+
+static inline unsigned long ra_max_pages(struct file_ra_state *ra)
+{
+	return max(ra->ra_pages >> ra->shrink, 1U);
+}
+
+static inline void ra_shrink(struct file_ra_state *ra)
+{
+	if (ra->shrink < RA_MAX_SHRINK)
+		ra->shrink++;
+}
+
+static inline void ra_grow(struct file_ra_state *ra)
+{
+	if (ra->shrink)
+		ra->shrink--;
+}
+
 /*
  * Turn a non-refcounted page (->_refcount == 0) into refcounted with
  * a count of one.
@@ -84,6 +119,9 @@ extern unsigned long highest_memmap_pfn;
  */
 extern int isolate_lru_page(struct page *page);
 extern void putback_lru_page(struct page *page);
+extern unsigned long reclaim_pages(struct list_head *page_list);
+extern unsigned long madvise_cold_or_pageout_range(struct mm_struct *mm,
+		unsigned long start, unsigned long end, bool pageout);
 extern bool pgdat_reclaimable(struct pglist_data *pgdat);
 
 /*
@@ -23,11 +23,13 @@
 #include <linux/pagemap.h>
 #include <linux/rmap.h>
 #include <linux/spinlock.h>
-#include <linux/jhash.h>
+#include <linux/xxhash.h>
+#include <linux/hash.h>
 #include <linux/delay.h>
 #include <linux/kthread.h>
 #include <linux/wait.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
 #include <linux/rbtree.h>
 #include <linux/memory.h>
 #include <linux/mmu_notifier.h>
@@ -129,6 +131,7 @@ struct ksm_scan {
  * @list: linked into migrate_nodes, pending placement in the proper node tree
  * @hlist: hlist head of rmap_items using this ksm page
  * @kpfn: page frame number of this ksm page (perhaps temporarily on wrong nid)
+ * @checksum: checksum of the ksm page, for the stable filter
  * @nid: NUMA node id of stable tree in which linked (may not match kpfn)
  */
 struct stable_node {
@@ -141,6 +144,7 @@ struct stable_node {
 	};
 	struct hlist_head hlist;
 	unsigned long kpfn;
+	u32 checksum;
 #ifdef CONFIG_NUMA
 	int nid;
 #endif
@@ -154,6 +158,8 @@ struct stable_node {
  * @mm: the memory structure this rmap_item is pointing into
  * @address: the virtual address this rmap_item tracks (+ flags in low bits)
  * @oldchecksum: previous checksum of the page at that virtual address
+ * @age: number of scans in which the page was not merged (saturating)
+ * @remaining_skips: how many more scans are going to skip this page
  * @node: rb node of this rmap_item in the unstable tree
  * @head: pointer to stable_node heading this list in the stable tree
  * @hlist: link into hlist of rmap_items hanging off that stable_node
@@ -169,6 +175,8 @@ struct rmap_item {
 	struct mm_struct *mm;
 	unsigned long address;		/* + low bits used for flags below */
 	unsigned int oldchecksum;	/* when unstable */
+	u8 age;
+	u8 remaining_skips;
 	union {
 		struct rb_node node;	/* when node of unstable tree */
 		struct {		/* when listed from stable tree */
@@ -217,8 +225,12 @@ static unsigned long ksm_pages_unshared;
 /* The number of rmap_items in use: to calculate pages_volatile */
 static unsigned long ksm_rmap_items;
 
+/* The number of pages skipped by the smart scan */
+static unsigned long ksm_pages_skipped;
+
 /* Number of pages ksmd should scan in one batch */
-static unsigned int ksm_thread_pages_to_scan = 100;
+#define DEFAULT_PAGES_TO_SCAN	100
+static unsigned int ksm_thread_pages_to_scan = DEFAULT_PAGES_TO_SCAN;
 
 /* Milliseconds ksmd should sleep between batches */
 static unsigned int ksm_thread_sleep_millisecs = 20;
@@ -232,6 +244,46 @@ static int ksm_nr_node_ids = 1;
 #define ksm_nr_node_ids		1
 #endif
 
+/* Skip pages that repeatedly fail to merge */
+static bool ksm_smart_scan = true;
+
+/*
+ * The stable filter is a bloom filter over the checksums of all the ksm
+ * pages: a page whose checksum misses it cannot be identical to any of
+ * them, so the stable tree walk and its page compares are skipped.
+ * Entries are never removed, the filter is rebuilt after every full scan
+ * instead. Without a filter every page goes to the stable tree.
+ */
+#define STABLE_FILTER_MIN_BITS	15
+#define STABLE_FILTER_MAX_BITS	30
+static unsigned long *stable_filter;
+static unsigned int stable_filter_bits;
+
+/*
+ * The advisor sets pages_to_scan after every full scan: it is doubled
+ * while at least KSM_ADVISOR_MIN_YIELD per mille of the scanned pages
+ * got merged and halved otherwise, then capped so that ksmd stays within
+ * advisor_max_cpu percent of a CPU.
+ */
+enum ksm_advisor_type {
+	KSM_ADVISOR_NONE,
+	KSM_ADVISOR_YIELD,
+};
+static enum ksm_advisor_type ksm_advisor;
+
+#define KSM_ADVISOR_MIN_YIELD	10
+
+static unsigned int ksm_advisor_max_cpu = 20;
+static unsigned long ksm_advisor_min_pages_to_scan = 100;
+static unsigned long ksm_advisor_max_pages_to_scan = 30000;
+
+static struct advisor_ctx {
+	ktime_t start_scan;
+	u64 cpu_time;
+	unsigned long scanned;
+	unsigned long merged;
+} advisor_ctx;
+
 #define KSM_RUN_STOP	0
 #define KSM_RUN_MERGE	1
 #define KSM_RUN_UNMERGE	2
@@ -499,6 +551,7 @@ static void remove_node_from_stable_tree(struct stable_node *stable_node)
 			ksm_pages_sharing--;
 		else
 			ksm_pages_shared--;
+		rmap_item->mm->ksm_merging_pages--;
 		put_anon_vma(rmap_item->anon_vma);
 		rmap_item->address &= PAGE_MASK;
 		cond_resched();
@@ -628,6 +681,7 @@ static void remove_rmap_item_from_tree(struct rmap_item *rmap_item)
 		else
 			ksm_pages_shared--;
 
+		rmap_item->mm->ksm_merging_pages--;
 		put_anon_vma(rmap_item->anon_vma);
 		rmap_item->address &= PAGE_MASK;
 
@@ -823,11 +877,69 @@ static u32 calc_checksum(struct page *page)
 {
 	u32 checksum;
 	void *addr = kmap_atomic(page);
-	checksum = jhash2(addr, PAGE_SIZE / 4, 17);
+	checksum = xxhash(addr, PAGE_SIZE, 0);
 	kunmap_atomic(addr);
 	return checksum;
 }
 
+static void stable_filter_add(u32 checksum)
+{
+	if (!stable_filter)
+		return;
+
+	__set_bit(checksum & (BIT(stable_filter_bits) - 1), stable_filter);
+	__set_bit(hash_32(checksum, stable_filter_bits), stable_filter);
+}
+
+static bool stable_filter_may_contain(u32 checksum)
+{
+	if (!stable_filter)
+		return true;
+
+	return test_bit(checksum & (BIT(stable_filter_bits) - 1),
+			stable_filter) &&
+	       test_bit(hash_32(checksum, stable_filter_bits), stable_filter);
+}
+
+/*
+ * Drop the checksums of the ksm pages freed since the last rebuild, and
+ * resize the filter to about 8 bits per ksm page, which keeps the false
+ * positive rate around 5%.
+ */
+static void stable_filter_rebuild(void)
+{
+	struct stable_node *stable_node;
+	struct rb_node *node;
+	unsigned int bits;
+	int nid;
+
+	bits = ilog2(roundup_pow_of_two(max(ksm_pages_shared, 1UL) * 8));
+	bits = clamp_t(unsigned int, bits, STABLE_FILTER_MIN_BITS,
+		       STABLE_FILTER_MAX_BITS);
+
+	if (!stable_filter || bits != stable_filter_bits) {
+		vfree(stable_filter);
+		stable_filter = vzalloc(BITS_TO_LONGS(BIT(bits)) *
+					sizeof(unsigned long));
+		if (!stable_filter)
+			return;
+		stable_filter_bits = bits;
+	} else {
+		bitmap_zero(stable_filter, BIT(bits));
+	}
+
+	for (nid = 0; nid < ksm_nr_node_ids; nid++) {
+		for (node = rb_first(root_stable_tree + nid); node;
+		     node = rb_next(node)) {
+			stable_node = rb_entry(node, struct stable_node, node);
+			stable_filter_add(stable_node->checksum);
+			cond_resched();
+		}
+	}
+	list_for_each_entry(stable_node, &migrate_nodes, list)
+		stable_filter_add(stable_node->checksum);
+}
+
 static int memcmp_pages(struct page *page1, struct page *page2)
 {
 	char *addr1, *addr2;
@@ -1291,6 +1403,8 @@ static struct stable_node *stable_tree_insert(struct page *kpage)
 
 	INIT_HLIST_HEAD(&stable_node->hlist);
 	stable_node->kpfn = kpfn;
+	stable_node->checksum = calc_checksum(kpage);
+	stable_filter_add(stable_node->checksum);
 	set_page_stable_node(kpage, stable_node);
 	DO_NUMA(stable_node->nid = nid);
 	rb_link_node(&stable_node->node, parent, new);
@@ -1396,13 +1510,18 @@ static void stable_tree_append(struct rmap_item *rmap_item,
 		ksm_pages_sharing++;
 	else
 		ksm_pages_shared++;
+
+	rmap_item->mm->ksm_merging_pages++;
+	rmap_item->age = 0;
+	advisor_ctx.merged++;
 }
 
 /*
  * cmp_and_merge_page - first see if page can be merged into the stable tree;
  * if not, compare checksum to previous and if it's the same, see if page can
  * be inserted into the unstable tree, or merged with a page already there and
- * both transferred to the stable tree.
+ * both transferred to the stable tree. The stable tree is only searched when
+ * the checksum hits the stable filter.
  *
  * @page: the page that we are searching identical page to.
  * @rmap_item: the reverse mapping into the virtual address of this page
@@ -1430,8 +1549,12 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 			return;
 	}
 
+	checksum = calc_checksum(page);
+
 	/* We first start with searching the page inside the stable tree */
-	kpage = stable_tree_search(page);
+	kpage = NULL;
+	if (stable_node || stable_filter_may_contain(checksum))
+		kpage = stable_tree_search(page);
 	if (kpage == page && rmap_item->head == stable_node) {
 		put_page(kpage);
 		return;
@@ -1460,7 +1583,6 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 	 * don't want to insert it in the unstable tree, and we don't want
 	 * to waste our time searching for something identical to it there.
 	 */
-	checksum = calc_checksum(page);
 	if (rmap_item->oldchecksum != checksum) {
 		rmap_item->oldchecksum = checksum;
 		return;
@@ -1555,6 +1677,113 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 	return rmap_item;
 }
 
+static unsigned int skip_age(u8 age)
+{
+	if (age <= 3)
+		return 1;
+	if (age <= 5)
+		return 2;
+	if (age <= 8)
+		return 4;
+
+	return 8;
+}
+
+/*
+ * should_skip_rmap_item - decide if a page that keeps failing to merge
+ * can be left out of this scan.
+ *
+ * Pages are scanned normally for their first scans, then a growing number
+ * of scans (up to 8) is skipped between two looks at them. Merging a page
+ * resets its age.
+ */
+static bool should_skip_rmap_item(struct page *page,
+				  struct rmap_item *rmap_item)
+{
+	u8 age;
+
+	if (!ksm_smart_scan)
+		return false;
+
+	/*
+	 * Never skip ksm pages: cmp_and_merge_page() will essentially ignore
+	 * them, but they still have to be processed properly.
+	 */
+	if (PageKsm(page))
+		return false;
+
+	age = rmap_item->age;
+	if (age != U8_MAX)
+		rmap_item->age++;
+
+	/*
+	 * Young pages are not skipped, they need a chance to go through
+	 * both the checksum and the unstable tree stages.
+	 */
+	if (age < 3)
+		return false;
+
+	/* Out of skips: scan it now, and compute how many to skip next */
+	if (!rmap_item->remaining_skips) {
+		rmap_item->remaining_skips = skip_age(age);
+		return false;
+	}
+
+	ksm_pages_skipped++;
+	rmap_item->remaining_skips--;
+	remove_rmap_item_from_tree(rmap_item);
+	return true;
+}
+
+static void ksm_advisor_start_scan(void)
+{
+	advisor_ctx.start_scan = ktime_get();
+	advisor_ctx.cpu_time = task_sched_runtime(current);
+	advisor_ctx.scanned = 0;
+	advisor_ctx.merged = 0;
+}
+
+/*
+ * ksm_advisor_full_scan_done - tune pages_to_scan after a full scan
+ *
+ * Called by ksmd with ksm_thread_mutex held. The first full scan after
+ * the advisor is enabled only starts the measurements.
+ */
+static void ksm_advisor_full_scan_done(void)
+{
+	unsigned long pages = ksm_thread_pages_to_scan;
+	unsigned long yield, cpu_percent;
+	u64 elapsed, cpu_time;
+
+	if (ksm_advisor == KSM_ADVISOR_NONE)
+		return;
+
+	if (!ktime_to_ns(advisor_ctx.start_scan))
+		goto out;
+
+	elapsed = ktime_to_ns(ktime_sub(ktime_get(), advisor_ctx.start_scan));
+	cpu_time = task_sched_runtime(current) - advisor_ctx.cpu_time;
+	cpu_percent = elapsed ? div64_u64(cpu_time * 100, elapsed) : 100;
+	yield = advisor_ctx.scanned ?
+		advisor_ctx.merged * 1000 / advisor_ctx.scanned : 0;
+
+	if (yield >= KSM_ADVISOR_MIN_YIELD)
+		pages *= 2;
+	else
+		pages /= 2;
+
+	/* ksmd's CPU usage scales with the number of pages per batch */
+	if (cpu_percent > ksm_advisor_max_cpu)
+		pages = min(pages, ksm_thread_pages_to_scan *
+				   ksm_advisor_max_cpu / cpu_percent);
+
+	pages = clamp(pages, ksm_advisor_min_pages_to_scan,
+		      ksm_advisor_max_pages_to_scan);
+	ksm_thread_pages_to_scan = min_t(unsigned long, pages, UINT_MAX);
+out:
+	ksm_advisor_start_scan();
+}
+
 static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 {
 	struct mm_struct *mm;
@@ -1650,6 +1879,13 @@ static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 					ksm_scan.rmap_list =
 							&rmap_item->rmap_list;
 					ksm_scan.address += PAGE_SIZE;
+
+					if (should_skip_rmap_item(*page,
+								  rmap_item)) {
+						put_page(*page);
+						cond_resched();
+						continue;
+					}
 				} else
 					put_page(*page);
 				up_read(&mm->mmap_sem);
@@ -1709,6 +1945,8 @@ static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 	if (slot != &ksm_mm_head)
 		goto next_mm;
 
+	stable_filter_rebuild();
+	ksm_advisor_full_scan_done();
 	ksm_scan.seqnr++;
 	return NULL;
 }
@@ -1729,6 +1967,7 @@ static void ksm_do_scan(unsigned int scan_npages)
 			return;
 		cmp_and_merge_page(page, rmap_item);
 		put_page(page);
+		advisor_ctx.scanned++;
 	}
 }
 
@@ -2144,6 +2383,10 @@ static ssize_t pages_to_scan_store(struct kobject *kobj,
 	int err;
 	unsigned long nr_pages;
 
+	/* The advisor owns pages_to_scan while it is enabled */
+	if (ksm_advisor != KSM_ADVISOR_NONE)
+		return -EINVAL;
+
 	err = kstrtoul(buf, 10, &nr_pages);
 	if (err || nr_pages > UINT_MAX)
 		return -EINVAL;
@@ -2305,6 +2548,154 @@ static ssize_t full_scans_show(struct kobject *kobj,
 }
 KSM_ATTR_RO(full_scans);
 
+static ssize_t pages_skipped_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_skipped);
+}
+KSM_ATTR_RO(pages_skipped);
+
+static ssize_t smart_scan_show(struct kobject *kobj,
+			       struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_smart_scan);
+}
+
+static ssize_t smart_scan_store(struct kobject *kobj,
+				struct kobj_attribute *attr,
+				const char *buf, size_t count)
+{
+	int err;
+	bool value;
+
+	err = kstrtobool(buf, &value);
+	if (err)
+		return -EINVAL;
+
+	ksm_smart_scan = value;
+	return count;
+}
+KSM_ATTR(smart_scan);
+
+static ssize_t advisor_mode_show(struct kobject *kobj,
+				 struct kobj_attribute *attr, char *buf)
+{
+	const char *output;
+
+	if (ksm_advisor == KSM_ADVISOR_NONE)
+		output = "[none] yield";
+	else
+		output = "none [yield]";
+
+	return sprintf(buf, "%s\n", output);
+}
+
+static ssize_t advisor_mode_store(struct kobject *kobj,
+				  struct kobj_attribute *attr, const char *buf,
+				  size_t count)
+{
+	enum ksm_advisor_type advisor;
+
+	if (sysfs_streq("yield", buf))
+		advisor = KSM_ADVISOR_YIELD;
+	else if (sysfs_streq("none", buf))
+		advisor = KSM_ADVISOR_NONE;
+	else
+		return -EINVAL;
+
+	mutex_lock(&ksm_thread_mutex);
+	if (advisor != ksm_advisor) {
+		ksm_advisor = advisor;
+		advisor_ctx.start_scan = ktime_set(0, 0);
+		if (advisor == KSM_ADVISOR_NONE)
+			ksm_thread_pages_to_scan = DEFAULT_PAGES_TO_SCAN;
+	}
+	mutex_unlock(&ksm_thread_mutex);
+
+	return count;
+}
+KSM_ATTR(advisor_mode);
+
+static ssize_t advisor_max_cpu_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_advisor_max_cpu);
+}
+
+static ssize_t advisor_max_cpu_store(struct kobject *kobj,
+				     struct kobj_attribute *attr,
+				     const char *buf, size_t count)
+{
+	int err;
+	unsigned long value;
+
+	err = kstrtoul(buf, 10, &value);
+	if (err || !value || value > 100)
+		return -EINVAL;
+
+	ksm_advisor_max_cpu = value;
+	return count;
+}
+KSM_ATTR(advisor_max_cpu);
+
+static ssize_t advisor_min_pages_to_scan_show(struct kobject *kobj,
+					      struct kobj_attribute *attr,
+					      char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_advisor_min_pages_to_scan);
+}
+
+static ssize_t advisor_min_pages_to_scan_store(struct kobject *kobj,
+					       struct kobj_attribute *attr,
+					       const char *buf, size_t count)
+{
+	int err;
+	unsigned long value;
+
+	err = kstrtoul(buf, 10, &value);
+	if (err || !value || value > UINT_MAX)
+		return -EINVAL;
+
+	mutex_lock(&ksm_thread_mutex);
+	if (value > ksm_advisor_max_pages_to_scan)
+		err = -EINVAL;
+	else
+		ksm_advisor_min_pages_to_scan = value;
+	mutex_unlock(&ksm_thread_mutex);
+
+	return err ? err : count;
+}
+KSM_ATTR(advisor_min_pages_to_scan);
+
+static ssize_t advisor_max_pages_to_scan_show(struct kobject *kobj,
+					      struct kobj_attribute *attr,
+					      char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_advisor_max_pages_to_scan);
+}
+
+static ssize_t advisor_max_pages_to_scan_store(struct kobject *kobj,
+					       struct kobj_attribute *attr,
+					       const char *buf, size_t count)
+{
+	int err;
+	unsigned long value;
+
+	err = kstrtoul(buf, 10, &value);
+	if (err || !value || value > UINT_MAX)
+		return -EINVAL;
+
+	mutex_lock(&ksm_thread_mutex);
+	if (value < ksm_advisor_min_pages_to_scan)
+		err = -EINVAL;
+	else
+		ksm_advisor_max_pages_to_scan = value;
+	mutex_unlock(&ksm_thread_mutex);
+
+	return err ? err : count;
+}
+KSM_ATTR(advisor_max_pages_to_scan);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
@@ -2317,6 +2708,12 @@ static struct attribute *ksm_attrs[] = {
 #ifdef CONFIG_NUMA
 	&merge_across_nodes_attr.attr,
 #endif
+	&pages_skipped_attr.attr,
+	&smart_scan_attr.attr,
+	&advisor_mode_attr.attr,
+	&advisor_max_cpu_attr.attr,
+	&advisor_min_pages_to_scan_attr.attr,
+	&advisor_max_pages_to_scan_attr.attr,
 	NULL,
 };
 
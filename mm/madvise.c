@@ -17,10 +17,15 @@
 #include <linux/fs.h>
 #include <linux/file.h>
 #include <linux/blkdev.h>
+#include <linux/compat.h>
+#include <linux/proc_fs.h>
+#include <linux/ptrace.h>
+#include <linux/uio.h>
 #include <linux/backing-dev.h>
 #include <linux/swap.h>
 #include <linux/swapops.h>
 #include <linux/mmu_notifier.h>
+#include <linux/page_idle.h>
 #include "internal.h"
 
 #include <asm/tlb.h>
@@ -37,6 +42,8 @@ static int madvise_need_mmap_write(int behavior)
 	case MADV_WILLNEED:
 	case MADV_DONTNEED:
 	case MADV_FREE:
+	case MADV_COLD:
+	case MADV_PAGEOUT:
 		return 0;
 	default:
 		/* be safe, default to 1. list exceptions explicitly */
@@ -133,7 +140,9 @@ static long madvise_behavior(struct vm_area_struct *vma,
 	/*
 	 * vm_flags is protected by the mmap_sem held in write mode.
 	 */
-	vma->vm_flags = new_flags;
+	vm_write_begin(vma);
+	WRITE_ONCE(vma->vm_flags, new_flags);
+	vm_write_end(vma);
 
 out:
 	if (error == -ENOMEM)
@@ -259,6 +268,191 @@ static long madvise_willneed(struct vm_area_struct *vma,
 	return 0;
 }
 
+struct madvise_walk_private {
+	struct list_head page_list;
+	bool pageout;
+};
+
+/*
+ * Forget that the page was accessed and move it towards eviction: to the
+ * inactive list, or onto the private list for reclaim_pages().
+ */
+static void madvise_cold_or_pageout_page(struct page *page,
+					 struct madvise_walk_private *private)
+{
+	ClearPageReferenced(page);
+	test_and_clear_page_young(page);
+
+	if (!private->pageout) {
+		deactivate_page(page);
+		return;
+	}
+	if (!isolate_lru_page(page))
+		list_add(&page->lru, &private->page_list);
+}
+
+static int madvise_cold_or_pageout_pte_range(pmd_t *pmd, unsigned long addr,
+				unsigned long end, struct mm_walk *walk)
+{
+	struct madvise_walk_private *private = walk->private;
+	struct vm_area_struct *vma = walk->vma;
+	pte_t *orig_pte, *pte, ptent;
+	spinlock_t *ptl;
+	struct page *page;
+
+	if (fatal_signal_pending(current))
+		return -EINTR;
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	if (pmd_trans_huge(*pmd)) {
+		pmd_t orig_pmd;
+
+		ptl = pmd_trans_huge_lock(pmd, vma);
+		if (!ptl)
+			return 0;
+
+		orig_pmd = *pmd;
+		if (is_huge_zero_pmd(orig_pmd))
+			goto huge_unlock;
+
+		/*
+		 * Don't split the huge page for a partial range, and leave
+		 * pages shared with other processes alone.
+		 */
+		page = pmd_page(orig_pmd);
+		if (end - addr != HPAGE_PMD_SIZE || page_mapcount(page) != 1)
+			goto huge_unlock;
+
+		if (pmd_young(orig_pmd))
+			pmdp_test_and_clear_young(vma, addr, pmd);
+		madvise_cold_or_pageout_page(page, private);
+huge_unlock:
+		spin_unlock(ptl);
+		return 0;
+	}
+#endif
+	if (pmd_trans_unstable(pmd))
+		return 0;
+
+	orig_pte = pte = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
+	arch_enter_lazy_mmu_mode();
+	for (; addr != end; pte++, addr += PAGE_SIZE) {
+		ptent = *pte;
+		if (!pte_present(ptent))
+			continue;
+
+		page = vm_normal_page(vma, addr, ptent);
+		if (!page)
+			continue;
+
+		/* pte-mapped THPs would need to be split first */
+		if (PageTransCompound(page) || page_mapcount(page) != 1)
+			continue;
+
+		if (pte_young(ptent))
+			ptep_test_and_clear_young(vma, addr, pte);
+		madvise_cold_or_pageout_page(page, private);
+	}
+	arch_leave_lazy_mmu_mode();
+	pte_unmap_unlock(orig_pte, ptl);
+	cond_resched();
+	return 0;
+}
+
+static int madvise_cold_or_pageout_test_walk(unsigned long start,
+				unsigned long end, struct mm_walk *walk)
+{
+	/* Skip the vmas the LRU doesn't manage */
+	if (walk->vma->vm_flags & (VM_LOCKED | VM_HUGETLB | VM_PFNMAP))
+		return 1;
+	return 0;
+}
+
+/**
+ * madvise_cold_or_pageout_range - deactivate or reclaim a range of memory
+ * @mm: address space to operate on
+ * @start: start of the range
+ * @end: end of the range
+ * @pageout: reclaim the pages instead of only deactivating them
+ *
+ * Clear the accessed bits of the pages mapped in [@start, @end) that are
+ * not shared with other processes and either move them to the inactive
+ * LRU or reclaim them right away. The caller holds mmap_sem for read.
+ *
+ * Returns the number of reclaimed pages.
+ */
+unsigned long madvise_cold_or_pageout_range(struct mm_struct *mm,
+					    unsigned long start,
+					    unsigned long end, bool pageout)
+{
+	struct madvise_walk_private private = {
+		.page_list = LIST_HEAD_INIT(private.page_list),
+		.pageout = pageout,
+	};
+	struct mm_walk walk = {
+		.pmd_entry = madvise_cold_or_pageout_pte_range,
+		.test_walk = madvise_cold_or_pageout_test_walk,
+		.mm = mm,
+		.private = &private,
+	};
+
+	/* Pages still sitting in the pagevecs can't be isolated */
+	if (pageout)
+		lru_add_drain();
+
+	walk_page_range(start, end, &walk);
+
+	if (list_empty(&private.page_list))
+		return 0;
+	return reclaim_pages(&private.page_list);
+}
+
+static long madvise_cold(struct vm_area_struct *vma,
+			 struct vm_area_struct **prev,
+			 unsigned long start, unsigned long end)
+{
+	*prev = vma;
+	if (vma->vm_flags & (VM_LOCKED|VM_HUGETLB|VM_PFNMAP))
+		return -EINVAL;
+
+	madvise_cold_or_pageout_range(vma->vm_mm, start, end, false);
+	return 0;
+}
+
+/*
+ * Only page out the page cache of files the caller could open for writing,
+ * or it could tell which pages of a shared file others are using by timing
+ * the refaults.
+ */
+static bool can_do_pageout(struct vm_area_struct *vma)
+{
+	struct inode *inode;
+
+	if (vma_is_anonymous(vma))
+		return true;
+	if (!vma->vm_file)
+		return false;
+
+	inode = file_inode(vma->vm_file);
+	return inode_owner_or_capable(inode) ||
+		inode_permission(inode, MAY_WRITE) == 0;
+}
+
+static long madvise_pageout(struct vm_area_struct *vma,
+			    struct vm_area_struct **prev,
+			    unsigned long start, unsigned long end)
+{
+	*prev = vma;
+	if (vma->vm_flags & (VM_LOCKED|VM_HUGETLB|VM_PFNMAP))
+		return -EINVAL;
+
+	if (!can_do_pageout(vma))
+		return 0;
+
+	madvise_cold_or_pageout_range(vma->vm_mm, start, end, true);
+	return 0;
+}
+
 static int madvise_free_pte_range(pmd_t *pmd, unsigned long addr,
 				unsigned long end, struct mm_walk *walk)
 
@@ -579,6 +773,10 @@ madvise_vma(struct vm_area_struct *vma, struct vm_area_struct **prev,
 		return madvise_remove(vma, prev, start, end);
 	case MADV_WILLNEED:
 		return madvise_willneed(vma, prev, start, end);
+	case MADV_COLD:
+		return madvise_cold(vma, prev, start, end);
+	case MADV_PAGEOUT:
+		return madvise_pageout(vma, prev, start, end);
 	case MADV_FREE:
 		/*
 		 * XXX: In this implementation, MADV_FREE works like
@@ -607,6 +805,8 @@ madvise_behavior_valid(int behavior)
 	case MADV_WILLNEED:
 	case MADV_DONTNEED:
 	case MADV_FREE:
+	case MADV_COLD:
+	case MADV_PAGEOUT:
 #ifdef CONFIG_KSM
 	case MADV_MERGEABLE:
 	case MADV_UNMERGEABLE:
@@ -668,6 +868,11 @@ madvise_behavior_valid(int behavior)
  *  MADV_DONTDUMP - the application wants to prevent pages in the given range
  *		from being included in its core dump.
  *  MADV_DODUMP - cancel MADV_DONTDUMP: no longer exclude from core dump.
+ *  MADV_COLD - the application is not expected to use this memory soon,
+ *		deactivate pages in this range so that they can be reclaimed
+ *		easily if memory pressure happens.
+ *  MADV_PAGEOUT - the application is not expected to use this memory soon,
+ *		page out the pages in this range immediately.
  *
  * return values:
  *  zero    - success
@@ -680,7 +885,8 @@ madvise_behavior_valid(int behavior)
  *  -EBADF  - map exists, but area maps something that isn't a file.
  *  -EAGAIN - a kernel resource was temporarily unavailable.
  */
-SYSCALL_DEFINE3(madvise, unsigned long, start, size_t, len_in, int, behavior)
+int do_madvise(struct mm_struct *mm, unsigned long start, size_t len_in,
+	       int behavior)
 {
 	unsigned long end, tmp;
 	struct vm_area_struct *vma, *prev;
@@ -715,10 +921,10 @@ SYSCALL_DEFINE3(madvise, unsigned long, start, size_t, len_in, int, behavior)
 
 	write = madvise_need_mmap_write(behavior);
 	if (write) {
-		if (down_write_killable(&current->mm->mmap_sem))
+		if (down_write_killable(&mm->mmap_sem))
 			return -EINTR;
 	} else {
-		down_read(&current->mm->mmap_sem);
+		down_read(&mm->mmap_sem);
 	}
 
 	/*
@@ -726,7 +932,7 @@ SYSCALL_DEFINE3(madvise, unsigned long, start, size_t, len_in, int, behavior)
 	 * ranges, just ignore them, but return -ENOMEM at the end.
 	 * - different from the way of handling in mlock etc.
 	 */
-	vma = find_vma_prev(current->mm, start, &prev);
+	vma = find_vma_prev(mm, start, &prev);
 	if (vma && start > vma->vm_start)
 		prev = vma;
 
@@ -763,14 +969,149 @@ SYSCALL_DEFINE3(madvise, unsigned long, start, size_t, len_in, int, behavior)
 		if (prev)
 			vma = prev->vm_next;
 		else	/* madvise_remove dropped mmap_sem */
-			vma = find_vma(current->mm, start);
+			vma = find_vma(mm, start);
 	}
 out:
 	blk_finish_plug(&plug);
 	if (write)
-		up_write(&current->mm->mmap_sem);
+		up_write(&mm->mmap_sem);
 	else
-		up_read(&current->mm->mmap_sem);
+		up_read(&mm->mmap_sem);
 
 	return error;
 }
+
+SYSCALL_DEFINE3(madvise, unsigned long, start, size_t, len_in, int, behavior)
+{
+	return do_madvise(current->mm, start, len_in, behavior);
+}
+
+static bool process_madvise_behavior_valid(int behavior)
+{
+	switch (behavior) {
+	case MADV_COLD:
+	case MADV_PAGEOUT:
+	case MADV_WILLNEED:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static ssize_t do_process_madvise(int pidfd, struct iov_iter *iter,
+				  int behavior, unsigned int flags)
+{
+	struct task_struct *task;
+	struct mm_struct *mm;
+	size_t total_len;
+	struct pid *pid;
+	ssize_t ret = 0;
+	struct fd f;
+
+	if (flags)
+		return -EINVAL;
+
+	if (!process_madvise_behavior_valid(behavior))
+		return -EINVAL;
+
+	f = fdget(pidfd);
+	if (!f.file)
+		return -EBADF;
+
+	pid = tgid_pidfd_to_pid(f.file);
+	if (IS_ERR(pid)) {
+		ret = PTR_ERR(pid);
+		goto put_fd;
+	}
+
+	task = get_pid_task(pid, PIDTYPE_PID);
+	if (!task) {
+		ret = -ESRCH;
+		goto put_fd;
+	}
+
+	/* The hints reveal which ranges are mapped, as /proc/pid/maps does */
+	mm = mm_access(task, PTRACE_MODE_READ_FSCREDS);
+	if (IS_ERR_OR_NULL(mm)) {
+		ret = IS_ERR(mm) ? PTR_ERR(mm) : -ESRCH;
+		goto put_task;
+	}
+
+	/* Reclaiming another process' memory affects its performance */
+	if (!capable(CAP_SYS_NICE)) {
+		ret = -EPERM;
+		goto put_mm;
+	}
+
+	total_len = iov_iter_count(iter);
+	while (iov_iter_count(iter)) {
+		struct iovec iovec = iov_iter_iovec(iter);
+
+		ret = do_madvise(mm, (unsigned long)iovec.iov_base,
+				 iovec.iov_len, behavior);
+		if (ret < 0)
+			break;
+		iov_iter_advance(iter, iovec.iov_len);
+	}
+
+	/* Report partial progress before the error, like writev() */
+	if (total_len != iov_iter_count(iter))
+		ret = total_len - iov_iter_count(iter);
+
+put_mm:
+	mmput(mm);
+put_task:
+	put_task_struct(task);
+put_fd:
+	fdput(f);
+	return ret;
+}
+
+/*
+ * The process_madvise(2) system call.
+ *
+ * Apply the advice to the ranges described by @vec in the address space of
+ * the process referred to by @pidfd, an open /proc/<pid> directory. Only
+ * the hints that don't change the contents of the memory are supported:
+ * MADV_COLD, MADV_PAGEOUT and MADV_WILLNEED. The caller needs
+ * CAP_SYS_NICE and ptrace read access to the process. @flags must be 0.
+ *
+ * Returns the number of bytes advised, which may be less than requested
+ * if an error occurred after some ranges were advised.
+ */
+SYSCALL_DEFINE5(process_madvise, int, pidfd, const struct iovec __user *, vec,
+		size_t, vlen, int, behavior, unsigned int, flags)
+{
+	struct iovec iovstack[UIO_FASTIOV], *iov = iovstack;
+	struct iov_iter iter;
+	ssize_t ret;
+
+	ret = import_iovec(READ, vec, vlen, ARRAY_SIZE(iovstack), &iov, &iter);
+	if (ret < 0)
+		return ret;
+
+	ret = do_process_madvise(pidfd, &iter, behavior, flags);
+	kfree(iov);
+	return ret;
+}
+
+#ifdef CONFIG_COMPAT
+COMPAT_SYSCALL_DEFINE5(process_madvise, compat_int_t, pidfd,
+		       const struct compat_iovec __user *, vec,
+		       compat_size_t, vlen, compat_int_t, behavior,
+		       compat_uint_t, flags)
+{
+	struct iovec iovstack[UIO_FASTIOV], *iov = iovstack;
+	struct iov_iter iter;
+	ssize_t ret;
+
+	ret = compat_import_iovec(READ, vec, vlen, ARRAY_SIZE(iovstack), &iov,
+				  &iter);
+	if (ret < 0)
+		return ret;
+
+	ret = do_process_madvise(pidfd, &iter, behavior, flags);
+	kfree(iov);
+	return ret;
+}
+#endif
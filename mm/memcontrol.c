@@ -63,6 +63,7 @@
 #include <linux/lockdep.h>
 #include <linux/file.h>
 #include <linux/tracehook.h>
+#include <linux/parser.h>
 #include "internal.h"
 #include <net/sock.h>
 #include <net/ip.h>
@@ -2047,8 +2048,8 @@ static void lock_page_lru(struct page *page, int *isolated)
 		struct lruvec *lruvec;
 
 		lruvec = mem_cgroup_page_lruvec(page, zone->zone_pgdat);
-		ClearPageLRU(page);
 		del_page_from_lru_list(page, lruvec, page_lru(page));
+		ClearPageLRU(page);
 		*isolated = 1;
 	} else
 		*isolated = 0;
@@ -2687,6 +2688,80 @@ static ssize_t mem_cgroup_force_empty_write(struct kernfs_open_file *of,
 	return mem_cgroup_force_empty(memcg) ?: nbytes;
 }
 
+enum {
+	MEMORY_RECLAIM_SWAPPINESS,
+	MEMORY_RECLAIM_NULL,
+};
+
+static const match_table_t memory_reclaim_tokens = {
+	{ MEMORY_RECLAIM_SWAPPINESS,	"swappiness=%d" },
+	{ MEMORY_RECLAIM_NULL,		NULL },
+};
+
+/*
+ * "<size> [swappiness=<0-100>]": synchronously reclaims <size> bytes from
+ * the memcg and its descendants, without reporting memory pressure. Fails
+ * with -EAGAIN if the amount could not be reclaimed.
+ */
+static ssize_t memory_reclaim(struct kernfs_open_file *of, char *buf,
+			      size_t nbytes, loff_t off)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_css(of_css(of));
+	unsigned int nr_retries = MEM_CGROUP_RECLAIM_RETRIES;
+	unsigned long nr_to_reclaim, nr_reclaimed = 0;
+	substring_t args[MAX_OPT_ARGS];
+	int swappiness = -1;
+	char *old_buf, *start;
+
+	buf = strstrip(buf);
+	old_buf = buf;
+	nr_to_reclaim = memparse(buf, &buf) / PAGE_SIZE;
+	if (buf == old_buf)
+		return -EINVAL;
+
+	buf = strstrip(buf);
+	while ((start = strsep(&buf, " ")) != NULL) {
+		if (!strlen(start))
+			continue;
+		switch (match_token(start, memory_reclaim_tokens, args)) {
+		case MEMORY_RECLAIM_SWAPPINESS:
+			if (match_int(&args[0], &swappiness))
+				return -EINVAL;
+			if (swappiness < 0 || swappiness > 100)
+				return -EINVAL;
+			break;
+		default:
+			return -EINVAL;
+		}
+	}
+
+	while (nr_reclaimed < nr_to_reclaim) {
+		unsigned long reclaimed;
+
+		if (signal_pending(current))
+			return -EINTR;
+
+		/*
+		 * Before the last attempt, flush the per-cpu LRU caches in
+		 * the hope that they hold more evictable pages.
+		 */
+		if (!nr_retries)
+			lru_add_drain_all();
+
+		reclaimed = proactive_reclaim_mem_cgroup_pages(memcg,
+				min(nr_to_reclaim - nr_reclaimed,
+				    SWAP_CLUSTER_MAX),
+				swappiness < 0 ? NULL : &swappiness);
+
+		if (!reclaimed && !nr_retries--)
+			return -EAGAIN;
+
+		nr_reclaimed += reclaimed;
+	}
+
+	return nbytes;
+}
+
 static u64 mem_cgroup_hierarchy_read(struct cgroup_subsys_state *css,
 				     struct cftype *cft)
 {
@@ -3915,6 +3990,26 @@ static ssize_t memcg_write_event_control(struct kernfs_open_file *of,
 	return ret;
 }
 
+#ifdef CONFIG_FAULT_LATENCY_HIST
+static int memcg_fault_latency_show(struct seq_file *m, void *v)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_css(seq_css(m));
+	struct fault_latency_hist *sum;
+	struct mem_cgroup *iter;
+
+	sum = kzalloc(sizeof(*sum), GFP_KERNEL);
+	if (!sum)
+		return -ENOMEM;
+
+	for_each_mem_cgroup_tree(iter, memcg)
+		fault_latency_hist_add(sum, &iter->stat->fault_latency);
+	fault_latency_hist_show(m, sum);
+
+	kfree(sum);
+	return 0;
+}
+#endif
+
 static struct cftype mem_cgroup_legacy_files[] = {
 	{
 		.name = "usage_in_bytes",
@@ -3953,6 +4048,10 @@ static struct cftype mem_cgroup_legacy_files[] = {
 		.name = "force_empty",
 		.write = mem_cgroup_force_empty_write,
 	},
+	{
+		.name = "reclaim",
+		.write = memory_reclaim,
+	},
 	{
 		.name = "use_hierarchy",
 		.write_u64 = mem_cgroup_hierarchy_write,
@@ -3987,6 +4086,12 @@ static struct cftype mem_cgroup_legacy_files[] = {
 		.name = "numa_stat",
 		.seq_show = memcg_numa_stat_show,
 	},
+#endif
+#ifdef CONFIG_FAULT_LATENCY_HIST
+	{
+		.name = "fault_latency",
+		.seq_show = memcg_fault_latency_show,
+	},
 #endif
 	{
 		.name = "kmem.limit_in_bytes",
@@ -5334,6 +5439,16 @@ static struct cftype memory_files[] = {
 		.flags = CFTYPE_NOT_ON_ROOT,
 		.seq_show = memory_stat_show,
 	},
+#ifdef CONFIG_FAULT_LATENCY_HIST
+	{
+		.name = "fault_latency",
+		.seq_show = memcg_fault_latency_show,
+	},
+#endif
+	{
+		.name = "reclaim",
+		.write = memory_reclaim,
+	},
 	{ }	/* terminate */
 };
 
@@ -65,6 +65,7 @@
 #include <linux/debugfs.h>
 #include <linux/userfaultfd_k.h>
 #include <linux/dax.h>
+#include <linux/shmem_fs.h>
 
 #include <asm/io.h>
 #include <asm/mmu_context.h>
@@ -2061,6 +2062,124 @@ int apply_to_page_range(struct mm_struct *mm, unsigned long addr,
 }
 EXPORT_SYMBOL_GPL(apply_to_page_range);
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+static bool vma_has_changed(struct fault_env *fe)
+{
+	int ret = RB_EMPTY_NODE(&fe->vma->vm_rb);
+	unsigned int seq = READ_ONCE(fe->vma->vm_sequence.sequence);
+
+	/*
+	 * Matches both the wmb in write_seqcount_{begin,end}() and
+	 * the rwlock release in vma_rb_erase().
+	 */
+	smp_rmb();
+
+	return ret || seq != fe->sequence;
+}
+
+/*
+ * A speculative fault holds neither the mmap_sem nor a reference on the
+ * page table, so take the pte lock with irqs disabled: that holds off
+ * the TLB shootdown IPI (or the sched-RCU grace period when page tables
+ * are freed through RCU) any page table freeing has to wait for. Once
+ * the lock is held, a VMA that has not changed and a pmd that still
+ * points to the same table mean the snapshot taken at fault start is
+ * still valid, and anyone wanting to change it now has to wait for us.
+ *
+ * The lock is only tried: the holder may be waiting for our CPU to
+ * answer a TLB flush IPI.
+ */
+static bool pte_spinlock(struct fault_env *fe)
+{
+	bool ret = false;
+	pmd_t pmdval;
+
+	if (!(fe->flags & FAULT_FLAG_SPECULATIVE)) {
+		fe->ptl = pte_lockptr(fe->vma->vm_mm, fe->pmd);
+		spin_lock(fe->ptl);
+		return true;
+	}
+
+	local_irq_disable();
+	if (vma_has_changed(fe))
+		goto out;
+
+	pmdval = READ_ONCE(*fe->pmd);
+	if (!pmd_same(pmdval, fe->orig_pmd))
+		goto out;
+
+	fe->ptl = pte_lockptr(fe->vma->vm_mm, &pmdval);
+	if (unlikely(!spin_trylock(fe->ptl)))
+		goto out;
+
+	if (vma_has_changed(fe)) {
+		spin_unlock(fe->ptl);
+		goto out;
+	}
+
+	ret = true;
+out:
+	local_irq_enable();
+	return ret;
+}
+
+static bool pte_map_lock(struct fault_env *fe)
+{
+	bool ret = false;
+	pte_t *pte;
+	spinlock_t *ptl;
+	pmd_t pmdval;
+
+	if (!(fe->flags & FAULT_FLAG_SPECULATIVE)) {
+		fe->pte = pte_offset_map_lock(fe->vma->vm_mm, fe->pmd,
+					      fe->address, &fe->ptl);
+		return true;
+	}
+
+	/* Same as pte_spinlock(), but the pte is not mapped yet. */
+	local_irq_disable();
+	if (vma_has_changed(fe))
+		goto out;
+
+	pmdval = READ_ONCE(*fe->pmd);
+	if (!pmd_same(pmdval, fe->orig_pmd))
+		goto out;
+
+	ptl = pte_lockptr(fe->vma->vm_mm, &pmdval);
+	pte = pte_offset_map(&pmdval, fe->address);
+	if (unlikely(!spin_trylock(ptl))) {
+		pte_unmap(pte);
+		goto out;
+	}
+
+	if (vma_has_changed(fe)) {
+		pte_unmap_unlock(pte, ptl);
+		goto out;
+	}
+
+	fe->pte = pte;
+	fe->ptl = ptl;
+	ret = true;
+out:
+	local_irq_enable();
+	return ret;
+}
+#else
+static inline bool pte_spinlock(struct fault_env *fe)
+{
+	fe->ptl = pte_lockptr(fe->vma->vm_mm, fe->pmd);
+	spin_lock(fe->ptl);
+	return true;
+}
+
+static inline bool pte_map_lock(struct fault_env *fe)
+{
+	fe->pte = pte_offset_map_lock(fe->vma->vm_mm, fe->pmd, fe->address,
+				      &fe->ptl);
+	return true;
+}
+#endif /* CONFIG_SPECULATIVE_PAGE_FAULT */
+
 /*
  * handle_pte_fault chooses page fault handler according to an entry which was
  * read non-atomically.  Before making any commitment, on those architectures
@@ -2185,7 +2304,7 @@ static inline int wp_page_reuse(struct fault_env *fe, pte_t orig_pte,
 
 	flush_cache_page(vma, fe->address, pte_pfn(orig_pte));
 	entry = pte_mkyoung(orig_pte);
-	entry = maybe_mkwrite(pte_mkdirty(entry), vma);
+	entry = __maybe_mkwrite(pte_mkdirty(entry), fe->vma_flags);
 	if (ptep_set_access_flags(vma, fe->address, fe->pte, entry, 1))
 		update_mmu_cache(vma, fe->address, fe->pte);
 	pte_unmap_unlock(fe->pte, fe->ptl);
@@ -2246,6 +2365,12 @@ static int wp_page_copy(struct fault_env *fe, pte_t orig_pte,
 	const unsigned long mmun_end = mmun_start + PAGE_SIZE;
 	struct mem_cgroup *memcg;
 	gfp_t gfp = GFP_HIGHUSER_MOVABLE;
+	/*
+	 * The vma policy may be replaced under a speculative fault, which
+	 * only runs on vmas without one: allocate with the task policy.
+	 */
+	struct vm_area_struct *alloc_vma =
+		fe->flags & FAULT_FLAG_SPECULATIVE ? NULL : vma;
 
 	if (IS_ENABLED(CONFIG_CMA) && (flags & FAULT_FLAG_NO_CMA))
 		gfp &= ~__GFP_MOVABLE;
@@ -2254,11 +2379,12 @@ static int wp_page_copy(struct fault_env *fe, pte_t orig_pte,
 		goto oom;
 
 	if (is_zero_pfn(pte_pfn(orig_pte))) {
-		new_page = alloc_zeroed_user_highpage(gfp, vma, fe->address);
+		new_page = alloc_zeroed_user_highpage(gfp, alloc_vma,
+						      fe->address);
 		if (!new_page)
 			goto oom;
 	} else {
-		new_page = alloc_page_vma(gfp, vma,
+		new_page = alloc_page_vma(gfp, alloc_vma,
 				fe->address);
 		if (!new_page)
 			goto oom;
@@ -2275,7 +2401,14 @@ static int wp_page_copy(struct fault_env *fe, pte_t orig_pte,
 	/*
 	 * Re-check the pte - we dropped the lock
 	 */
-	fe->pte = pte_offset_map_lock(mm, fe->pmd, fe->address, &fe->ptl);
+	if (!pte_map_lock(fe)) {
+		mmu_notifier_invalidate_range_end(mm, mmun_start, mmun_end);
+		mem_cgroup_cancel_charge(new_page, memcg, false);
+		put_page(new_page);
+		if (old_page)
+			put_page(old_page);
+		return VM_FAULT_RETRY;
+	}
 	if (likely(pte_same(*fe->pte, orig_pte))) {
 		if (old_page) {
 			if (!PageAnon(old_page)) {
@@ -2287,8 +2420,8 @@ static int wp_page_copy(struct fault_env *fe, pte_t orig_pte,
 			inc_mm_counter_fast(mm, MM_ANONPAGES);
 		}
 		flush_cache_page(vma, fe->address, pte_pfn(orig_pte));
-		entry = mk_pte(new_page, vma->vm_page_prot);
-		entry = maybe_mkwrite(pte_mkdirty(entry), vma);
+		entry = mk_pte(new_page, fe->vma_page_prot);
+		entry = __maybe_mkwrite(pte_mkdirty(entry), fe->vma_flags);
 		/*
 		 * Clear the pte entry and flush it first, before updating the
 		 * pte with the new entry. This will avoid a race condition
@@ -2298,7 +2431,7 @@ static int wp_page_copy(struct fault_env *fe, pte_t orig_pte,
 		ptep_clear_flush_notify(vma, fe->address, fe->pte);
 		page_add_new_anon_rmap(new_page, vma, fe->address, false);
 		mem_cgroup_commit_charge(new_page, memcg, false, false);
-		lru_cache_add_active_or_unevictable(new_page, vma);
+		__lru_cache_add_active_or_unevictable(new_page, fe->vma_flags);
 		/*
 		 * We call the notify macro here because, when using secondary
 		 * mmu page tables (such as kvm shadow page tables), we want the
@@ -2349,7 +2482,7 @@ static int wp_page_copy(struct fault_env *fe, pte_t orig_pte,
 		 * Don't let another task, with possibly unlocked vma,
 		 * keep the mlocked page.
 		 */
-		if (page_copied && (vma->vm_flags & VM_LOCKED)) {
+		if (page_copied && (fe->vma_flags & VM_LOCKED)) {
 			lock_page(old_page);	/* LRU manipulation */
 			if (PageMlocked(old_page))
 				munlock_vma_page(old_page);
@@ -2474,7 +2607,7 @@ static int do_wp_page(struct fault_env *fe, pte_t orig_pte, unsigned int flags)
 		 * We should not cow pages in a shared writeable mapping.
 		 * Just mark the pages writable and/or call ops->pfn_mkwrite.
 		 */
-		if ((vma->vm_flags & (VM_WRITE|VM_SHARED)) ==
+		if ((fe->vma_flags & (VM_WRITE|VM_SHARED)) ==
 				     (VM_WRITE|VM_SHARED))
 			return wp_pfn_shared(fe, orig_pte);
 
@@ -2492,8 +2625,11 @@ static int do_wp_page(struct fault_env *fe, pte_t orig_pte, unsigned int flags)
 			get_page(old_page);
 			pte_unmap_unlock(fe->pte, fe->ptl);
 			lock_page(old_page);
-			fe->pte = pte_offset_map_lock(vma->vm_mm, fe->pmd,
-					fe->address, &fe->ptl);
+			if (!pte_map_lock(fe)) {
+				unlock_page(old_page);
+				put_page(old_page);
+				return VM_FAULT_RETRY;
+			}
 			if (!pte_same(*fe->pte, orig_pte)) {
 				unlock_page(old_page);
 				pte_unmap_unlock(fe->pte, fe->ptl);
@@ -2517,7 +2653,7 @@ static int do_wp_page(struct fault_env *fe, pte_t orig_pte, unsigned int flags)
 			return wp_page_reuse(fe, orig_pte, old_page, 0, 0);
 		}
 		unlock_page(old_page);
-	} else if (unlikely((vma->vm_flags & (VM_WRITE|VM_SHARED)) ==
+	} else if (unlikely((fe->vma_flags & (VM_WRITE|VM_SHARED)) ==
 					(VM_WRITE|VM_SHARED))) {
 		return wp_page_shared(fe, orig_pte, old_page);
 	}
@@ -2670,6 +2806,7 @@ int do_swap_page(struct fault_env *fe, pte_t orig_pte)
 
 		/* Had to read the page from swap area: Major fault */
 		ret = VM_FAULT_MAJOR;
+		fault_latency_swapin();
 		count_vm_event(PGMAJFAULT);
 		mem_cgroup_count_vm_event(vma->vm_mm, PGMAJFAULT);
 	} else if (PageHWPoison(page)) {
@@ -2815,12 +2952,13 @@ bool is_vma_temporary_stack(struct vm_area_struct *vma);
 static int do_anonymous_page(struct fault_env *fe)
 {
 	struct vm_area_struct *vma = fe->vma;
+	struct vm_area_struct *alloc_vma;
 	struct mem_cgroup *memcg;
 	struct page *page;
 	pte_t entry;
 
 	/* File mapping without ->vm_ops ? */
-	if (vma->vm_flags & VM_SHARED)
+	if (fe->vma_flags & VM_SHARED)
 		return VM_FAULT_SIGBUS;
 
 	/*
@@ -2832,21 +2970,26 @@ static int do_anonymous_page(struct fault_env *fe)
 	 * parallel threads are excluded by other means.
 	 *
 	 * Here we only have down_read(mmap_sem).
+	 *
+	 * A speculative fault only gets here when the page table already
+	 * exists, and pte_map_lock() checks the pmd did not change.
 	 */
-	if (pte_alloc(vma->vm_mm, fe->pmd, fe->address))
-		return VM_FAULT_OOM;
+	if (!(fe->flags & FAULT_FLAG_SPECULATIVE)) {
+		if (pte_alloc(vma->vm_mm, fe->pmd, fe->address))
+			return VM_FAULT_OOM;
 
-	/* See the comment in pte_alloc_one_map() */
-	if (unlikely(pmd_trans_unstable(fe->pmd)))
-		return 0;
+		/* See the comment in pte_alloc_one_map() */
+		if (unlikely(pmd_trans_unstable(fe->pmd)))
+			return 0;
+	}
 
 	/* Use the zero-page for reads */
 	if (!(fe->flags & FAULT_FLAG_WRITE) &&
 			!mm_forbids_zeropage(vma->vm_mm)) {
 		entry = pte_mkspecial(pfn_pte(my_zero_pfn(fe->address),
-						vma->vm_page_prot));
-		fe->pte = pte_offset_map_lock(vma->vm_mm, fe->pmd, fe->address,
-				&fe->ptl);
+						fe->vma_page_prot));
+		if (!pte_map_lock(fe))
+			return VM_FAULT_RETRY;
 		if (!pte_none(*fe->pte))
 			goto unlock;
 		/* Deliver the page fault to userland, check inside PT lock */
@@ -2860,11 +3003,15 @@ static int do_anonymous_page(struct fault_env *fe)
 	/* Allocate our own private page. */
 	if (unlikely(anon_vma_prepare(vma)))
 		goto oom;
-	if (vma->vm_flags & VM_LOCKED || vma->vm_flags & FAULT_FLAG_NO_CMA ||
+	/* See wp_page_copy() for the NULL vma */
+	alloc_vma = fe->flags & FAULT_FLAG_SPECULATIVE ? NULL : vma;
+	if (fe->vma_flags & VM_LOCKED || fe->vma_flags & FAULT_FLAG_NO_CMA ||
 	    is_vma_temporary_stack(vma)) {
-		page = alloc_zeroed_user_highpage(GFP_HIGHUSER, vma, fe->address);
+		page = alloc_zeroed_user_highpage(GFP_HIGHUSER, alloc_vma,
+						  fe->address);
 	} else {
-		page = alloc_zeroed_user_highpage_movable(vma, fe->address);
+		page = alloc_zeroed_user_highpage_movable(alloc_vma,
+							  fe->address);
 	}
 	if (!page)
 		goto oom;
@@ -2879,12 +3026,15 @@ static int do_anonymous_page(struct fault_env *fe)
 	 */
 	__SetPageUptodate(page);
 
-	entry = mk_pte(page, vma->vm_page_prot);
-	if (vma->vm_flags & VM_WRITE)
+	entry = mk_pte(page, fe->vma_page_prot);
+	if (fe->vma_flags & VM_WRITE)
 		entry = pte_mkwrite(pte_mkdirty(entry));
 
-	fe->pte = pte_offset_map_lock(vma->vm_mm, fe->pmd, fe->address,
-			&fe->ptl);
+	if (!pte_map_lock(fe)) {
+		mem_cgroup_cancel_charge(page, memcg, false);
+		put_page(page);
+		return VM_FAULT_RETRY;
+	}
 	if (!pte_none(*fe->pte))
 		goto release;
 
@@ -2899,7 +3049,7 @@ static int do_anonymous_page(struct fault_env *fe)
 	inc_mm_counter_fast(vma->vm_mm, MM_ANONPAGES);
 	page_add_new_anon_rmap(page, vma, fe->address, false);
 	mem_cgroup_commit_charge(page, memcg, false, false);
-	lru_cache_add_active_or_unevictable(page, vma);
+	__lru_cache_add_active_or_unevictable(page, fe->vma_flags);
 setpte:
 	set_pte_at(vma->vm_mm, fe->address, fe->pte, entry);
 
@@ -3583,6 +3733,15 @@ static int handle_pte_fault(struct fault_env *fe)
 	pteval_t prot_vm_none = pgprot_val(vm_get_page_prot(VM_NONE));
 	bool fix_prot = false;
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	if (fe->flags & FAULT_FLAG_SPECULATIVE) {
+		/*
+		 * handle_speculative_fault() walked the page table with irqs
+		 * disabled and left fe->pte NULL if the pte was none.
+		 */
+		entry = fe->orig_pte;
+	} else
+#endif
 	if (unlikely(pmd_none(*fe->pmd))) {
 		/*
 		 * Leave __pte_alloc() until later: because vm_ops->fault may
@@ -3627,6 +3786,13 @@ static int handle_pte_fault(struct fault_env *fe)
 			return do_fault(fe);
 	}
 
+	/* Swap-in and NUMA migration may sleep on the page lock */
+	if ((fe->flags & FAULT_FLAG_SPECULATIVE) &&
+	    (!pte_present(entry) || pte_protnone(entry))) {
+		pte_unmap(fe->pte);
+		return VM_FAULT_RETRY;
+	}
+
 	if (!pte_present(entry))
 		return do_swap_page(fe, entry);
 
@@ -3644,8 +3810,10 @@ static int handle_pte_fault(struct fault_env *fe)
 			return VM_FAULT_SIGSEGV; /* access not granted */
 		fix_prot = true;
 	}
-	fe->ptl = pte_lockptr(fe->vma->vm_mm, fe->pmd);
-	spin_lock(fe->ptl);
+	if (!pte_spinlock(fe)) {
+		pte_unmap(fe->pte);
+		return VM_FAULT_RETRY;
+	}
 	if (unlikely(!pte_same(*fe->pte, entry)))
 		goto unlock;
 	if (fix_prot) {
@@ -3690,6 +3858,8 @@ static int __handle_mm_fault(struct vm_area_struct *vma, unsigned long address,
 		.vma = vma,
 		.address = address,
 		.flags = flags,
+		.vma_flags = vma->vm_flags,
+		.vma_page_prot = vma->vm_page_prot,
 	};
 	struct mm_struct *mm = vma->vm_mm;
 	pgd_t *pgd;
@@ -3730,6 +3900,16 @@ static int __handle_mm_fault(struct vm_area_struct *vma, unsigned long address,
 	return handle_pte_fault(&fe);
 }
 
+/*
+ * Whether @vma maps a regular file: a major fault on shmem always comes
+ * back from swap.
+ */
+static inline bool fault_reads_file(struct vm_area_struct *vma)
+{
+	return IS_ENABLED(CONFIG_FAULT_LATENCY_HIST) && vma->vm_file &&
+	       !shmem_mapping(vma->vm_file->f_mapping);
+}
+
 /*
  * By the time we get here, we already hold the mm semaphore
  *
@@ -3739,8 +3919,13 @@ static int __handle_mm_fault(struct vm_area_struct *vma, unsigned long address,
 int handle_mm_fault(struct vm_area_struct *vma, unsigned long address,
 		unsigned int flags)
 {
+	struct mm_struct *mm = vma->vm_mm;
+	/* the vma may be gone once the fault dropped the mmap_sem */
+	bool file = fault_reads_file(vma);
 	int ret;
 
+	fault_latency_start(flags);
+
 	__set_current_state(TASK_RUNNING);
 
 	count_vm_event(PGFAULT);
@@ -3801,10 +3986,145 @@ int handle_mm_fault(struct vm_area_struct *vma, unsigned long address,
 		ret = VM_FAULT_SIGBUS;
 	}
 
+	fault_latency_account(mm, file, ret);
 	return ret;
 }
 EXPORT_SYMBOL_GPL(handle_mm_fault);
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Try to handle a user fault without taking the mmap_sem.
+ *
+ * The VMA is looked up under vma_srcu, which keeps it from being freed,
+ * and its vm_sequence is sampled. Everything the fault needs from the
+ * VMA is copied into the fault_env, and the page table is walked with
+ * irqs disabled. The snapshot is validated once the pte lock is held,
+ * see pte_map_lock(), before anything is installed.
+ *
+ * Only faults on private anonymous memory that neither sleep on a page
+ * lock nor need a page table allocated are handled. Anything else, and
+ * any race with a VMA or page table change, returns VM_FAULT_RETRY and
+ * the caller falls back to the regular mmap_sem protected path.
+ *
+ * @vm_flags is the access the arch fault handler requires from the VMA.
+ */
+int handle_speculative_fault(struct mm_struct *mm, unsigned long address,
+			     unsigned int flags, unsigned long vm_flags)
+{
+	struct fault_env fe = {
+		.address = address,
+	};
+	struct vm_area_struct *vma;
+	pgd_t *pgd, pgdval;
+	pud_t *pud, pudval;
+	int ret, idx;
+
+	/* Nothing may release the mmap_sem we do not hold */
+	flags &= ~(FAULT_FLAG_ALLOW_RETRY | FAULT_FLAG_KILLABLE);
+	flags |= FAULT_FLAG_SPECULATIVE;
+	fe.flags = flags;
+
+	fault_latency_start(flags);
+	check_sync_rss_stat(current);
+
+	idx = srcu_read_lock(&vma_srcu);
+	vma = find_vma_srcu(mm, address);
+	if (!vma)
+		goto out_abort;
+	fe.vma = vma;
+
+	fe.sequence = raw_read_seqcount(&vma->vm_sequence);
+	if (fe.sequence & 1)
+		goto out_abort;
+
+	/* Only private anonymous mappings, the rest may sleep */
+	if (!vma_is_anonymous(vma))
+		goto out_abort;
+
+	fe.vma_flags = READ_ONCE(vma->vm_flags);
+	fe.vma_page_prot = READ_ONCE(vma->vm_page_prot);
+	if (fe.vma_flags & (VM_SHARED | VM_HUGETLB | VM_PFNMAP |
+			    VM_MIXEDMAP | VM_LOCKED))
+		goto out_abort;
+	if (!(fe.vma_flags & vm_flags))
+		goto out_abort;
+
+	/* Stack expansion needs the mmap_sem */
+	if (address < READ_ONCE(vma->vm_start) ||
+	    READ_ONCE(vma->vm_end) <= address)
+		goto out_abort;
+
+	/* anon_vma_prepare() may need to allocate */
+	if (!READ_ONCE(vma->anon_vma))
+		goto out_abort;
+
+	if (userfaultfd_armed(vma) || vma_policy(vma))
+		goto out_abort;
+
+	if (!arch_vma_access_permitted(vma, flags & FAULT_FLAG_WRITE,
+				       flags & FAULT_FLAG_INSTRUCTION,
+				       flags & FAULT_FLAG_REMOTE))
+		goto out_abort;
+
+	/*
+	 * Walk the page table with irqs disabled so it cannot be freed
+	 * under us, see pte_spinlock().
+	 */
+	local_irq_disable();
+	pgd = pgd_offset(mm, address);
+	pgdval = READ_ONCE(*pgd);
+	if (pgd_none(pgdval) || unlikely(pgd_bad(pgdval)))
+		goto out_walk;
+
+	pud = pud_offset(pgd, address);
+	pudval = READ_ONCE(*pud);
+	if (pud_none(pudval) || unlikely(pud_bad(pudval)))
+		goto out_walk;
+
+	fe.pmd = pmd_offset(pud, address);
+	fe.orig_pmd = READ_ONCE(*fe.pmd);
+	/*
+	 * A missing page table needs an allocation and huge pmds have their
+	 * own fault paths, leave both to the regular handler.
+	 */
+	if (pmd_none(fe.orig_pmd) || pmd_trans_huge(fe.orig_pmd) ||
+	    pmd_devmap(fe.orig_pmd) || unlikely(pmd_bad(fe.orig_pmd)))
+		goto out_walk;
+
+	fe.pte = pte_offset_map(&fe.orig_pmd, address);
+	fe.orig_pte = READ_ONCE(*fe.pte);
+	barrier();
+	if (pte_none(fe.orig_pte)) {
+		pte_unmap(fe.pte);
+		fe.pte = NULL;
+	}
+	local_irq_enable();
+
+	ret = handle_pte_fault(&fe);
+	/*
+	 * Errors are retried too: the regular path knows how to deal with
+	 * the memcg OOM killer and signals.
+	 */
+	if (ret & (VM_FAULT_ERROR | VM_FAULT_RETRY))
+		goto out_abort;
+
+	srcu_read_unlock(&vma_srcu, idx);
+
+	count_vm_event(SPECULATIVE_PGFAULT);
+	count_vm_event(PGFAULT);
+	mem_cgroup_count_vm_event(mm, PGFAULT);
+	fault_latency_account(mm, false, ret);
+	return ret;
+
+out_walk:
+	local_irq_enable();
+out_abort:
+	srcu_read_unlock(&vma_srcu, idx);
+	count_vm_event(SPECULATIVE_PGFAULT_ABORT);
+	return VM_FAULT_RETRY;
+}
+#endif /* CONFIG_SPECULATIVE_PAGE_FAULT */
+
 #ifndef __PAGETABLE_PUD_FOLDED
 /*
  * Allocate page upper directory.
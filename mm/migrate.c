@@ -1461,6 +1461,7 @@ int migrate_replace_page(struct page *page, struct page *newpage)
 	    __isolate_lru_page(page, ISOLATE_UNEVICTABLE) == 0) {
 		struct lruvec *lruvec = mem_cgroup_page_lruvec(page, zone->zone_pgdat);
 		del_page_from_lru_list(page, lruvec, page_lru(page));
+		ClearPageLRU(page);
 		spin_unlock_irqrestore(zone_lru_lock(zone), flags);
 	} else {
 		spin_unlock_irqrestore(zone_lru_lock(zone), flags);
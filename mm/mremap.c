@@ -349,6 +349,14 @@ static unsigned long move_vma(struct vm_area_struct *vma,
 	if (!new_vma)
 		return -ENOMEM;
 
+	/*
+	 * Keep speculative faults out of both ranges while the page
+	 * tables move, they would populate the old range behind our back.
+	 */
+	vm_write_begin(vma);
+	if (new_vma != vma)
+		vm_write_begin(new_vma);
+
 	moved_len = move_page_tables(vma, old_addr, new_vma, new_addr, old_len,
 				     need_rmap_locks);
 	if (moved_len < old_len) {
@@ -357,14 +365,20 @@ static unsigned long move_vma(struct vm_area_struct *vma,
 		err = vma->vm_ops->mremap(new_vma);
 	}
 
-	if (unlikely(err)) {
-		/*
-		 * On error, move entries back from new area to old,
-		 * which will succeed since page tables still there,
-		 * and then proceed to unmap new area instead of old.
-		 */
+	/*
+	 * On error, move entries back from new area to old,
+	 * which will succeed since page tables still there,
+	 * and then proceed to unmap new area instead of old.
+	 */
+	if (unlikely(err))
 		move_page_tables(new_vma, new_addr, vma, old_addr, moved_len,
 				 true);
+
+	if (new_vma != vma)
+		vm_write_end(new_vma);
+	vm_write_end(vma);
+
+	if (unlikely(err)) {
 		vma = new_vma;
 		old_len = new_len;
 		old_addr = new_addr;
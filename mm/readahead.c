@@ -22,6 +22,8 @@
 
 #include "internal.h"
 
+#include <trace/events/filemap.h>
+
 /*
  * Initialise a struct file's readahead state.  Assumes that the caller has
  * memset *ra to zero.
@@ -112,7 +114,6 @@ static int read_pages(struct address_space *mapping, struct file *filp,
 		struct list_head *pages, unsigned int nr_pages, gfp_t gfp)
 {
 	struct blk_plug plug;
-	unsigned page_idx;
 	int ret;
 
 	blk_start_plug(&plug);
@@ -124,12 +125,18 @@ static int read_pages(struct address_space *mapping, struct file *filp,
 		goto out;
 	}
 
-	for (page_idx = 0; page_idx < nr_pages; page_idx++) {
-		struct page *page = lru_to_page(pages);
-		list_del(&page->lru);
-		if (!add_to_page_cache_lru(page, mapping, page->index, gfp))
-			mapping->a_ops->readpage(filp, page);
-		put_page(page);
+	while (!list_empty(pages)) {
+		struct page *batch[PAGEVEC_SIZE];
+		unsigned int i, nr;
+
+		nr = add_to_page_cache_lru_batch(mapping, pages, batch,
+						 ARRAY_SIZE(batch), gfp);
+		for (i = 0; i < nr; i++) {
+			if (!batch[i])
+				continue;
+			mapping->a_ops->readpage(filp, batch[i]);
+			put_page(batch[i]);
+		}
 	}
 	ret = 0;
 
@@ -369,7 +376,7 @@ ondemand_readahead(struct address_space *mapping,
 		   bool hit_readahead_marker, pgoff_t offset,
 		   unsigned long req_size)
 {
-	unsigned long max = ra->ra_pages;
+	unsigned long max = ra_max_pages(ra);
 	pgoff_t prev_offset;
 
 	/*
@@ -438,8 +445,10 @@ ondemand_readahead(struct address_space *mapping,
 
 	/*
 	 * standalone, small random read
-	 * Read as is, and do not pollute the readahead state.
+	 * Read as is, and do not pollute the readahead state other than
+	 * to make the next window of this file smaller.
 	 */
+	ra_shrink(ra);
 	return __do_page_cache_readahead(mapping, filp, offset, req_size, 0);
 
 initial_readahead:
@@ -491,6 +500,7 @@ void page_cache_sync_readahead(struct address_space *mapping,
 
 	/* do read-ahead */
 	ondemand_readahead(mapping, ra, filp, false, offset, req_size);
+	trace_mm_filemap_readahead(mapping, ra, offset, req_size, false);
 }
 EXPORT_SYMBOL_GPL(page_cache_sync_readahead);
 
@@ -533,8 +543,12 @@ page_cache_async_readahead(struct address_space *mapping,
 	if (inode_read_congested(mapping->host))
 		return;
 
+	/* the previous window was used, let the next one grow again */
+	ra_grow(ra);
+
 	/* do read-ahead */
 	ondemand_readahead(mapping, ra, filp, true, offset, req_size);
+	trace_mm_filemap_readahead(mapping, ra, offset, req_size, true);
 }
 EXPORT_SYMBOL_GPL(page_cache_async_readahead);
 
@@ -210,7 +210,10 @@ static void pagevec_move_tail_fn(struct page *page, struct lruvec *lruvec,
 
 	if (PageLRU(page) && !PageActive(page) && !PageUnevictable(page)) {
 		enum lru_list lru = page_lru_base_type(page);
-		list_move_tail(&page->lru, &lruvec->lists[lru]);
+
+		del_page_from_lru_list(page, lruvec, lru);
+		ClearPageActive(page);
+		add_page_to_lru_list_tail(page, lruvec, lru);
 		(*pgmoved)++;
 	}
 }
@@ -258,6 +261,39 @@ static void update_page_reclaim_stat(struct lruvec *lruvec,
 		reclaim_stat->recent_rotated[file]++;
 }
 
+/**
+ * lru_note_cost - account reclaim cost against an LRU type
+ * @lruvec: the lruvec the cost was incurred on
+ * @file: whether the cost is for file or anon pages
+ * @nr_pages: number of pages written out or refaulting
+ *
+ * Called with the node's lru_lock held. The costs are decayed once
+ * they exceed a quarter of the LRU size so that they reflect recent
+ * reclaim behaviour rather than the whole history of the lruvec.
+ */
+void lru_note_cost(struct lruvec *lruvec, bool file, unsigned int nr_pages)
+{
+	unsigned long lrusize;
+
+	if (!nr_pages)
+		return;
+
+	if (file)
+		lruvec->file_cost += nr_pages;
+	else
+		lruvec->anon_cost += nr_pages;
+
+	lrusize = lruvec_lru_size(lruvec, LRU_INACTIVE_ANON, MAX_NR_ZONES) +
+		  lruvec_lru_size(lruvec, LRU_ACTIVE_ANON, MAX_NR_ZONES) +
+		  lruvec_lru_size(lruvec, LRU_INACTIVE_FILE, MAX_NR_ZONES) +
+		  lruvec_lru_size(lruvec, LRU_ACTIVE_FILE, MAX_NR_ZONES);
+
+	if (lruvec->file_cost + lruvec->anon_cost > lrusize / 4) {
+		lruvec->file_cost /= 2;
+		lruvec->anon_cost /= 2;
+	}
+}
+
 static void __activate_page(struct page *page, struct lruvec *lruvec,
 			    void *arg)
 {
@@ -351,6 +387,38 @@ static void __lru_cache_activate_page(struct page *page)
 	put_cpu_var(lru_add_pvec);
 }
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * The multi-gen LRU does not activate pages accessed through file
+ * descriptors. The first access sets PG_referenced, the following ones
+ * are counted in LRU_REFS_MASK, which reclaim turns into a tier and
+ * protects against eviction based on the refaults of that tier.
+ */
+static void lru_gen_inc_refs(struct page *page)
+{
+	unsigned long old_flags, new_flags;
+
+	if (PageUnevictable(page))
+		return;
+
+	if (!PageReferenced(page)) {
+		SetPageReferenced(page);
+		return;
+	}
+
+	do {
+		old_flags = READ_ONCE(page->flags);
+		if ((old_flags & LRU_REFS_MASK) == LRU_REFS_MASK)
+			return;
+		new_flags = old_flags + BIT(LRU_REFS_PGOFF);
+	} while (cmpxchg(&page->flags, old_flags, new_flags) != old_flags);
+}
+#else
+static inline void lru_gen_inc_refs(struct page *page)
+{
+}
+#endif
+
 /*
  * Mark a page as having seen activity.
  *
@@ -364,7 +432,9 @@ static void __lru_cache_activate_page(struct page *page)
 void mark_page_accessed(struct page *page)
 {
 	page = compound_head(page);
-	if (!PageActive(page) && !PageUnevictable(page) &&
+	if (lru_gen_enabled()) {
+		lru_gen_inc_refs(page);
+	} else if (!PageActive(page) && !PageUnevictable(page) &&
 			PageReferenced(page)) {
 
 		/*
@@ -378,8 +448,7 @@ void mark_page_accessed(struct page *page)
 		else
 			__lru_cache_activate_page(page);
 		ClearPageReferenced(page);
-		if (page_is_file_cache(page))
-			workingset_activation(page);
+		workingset_activation(page);
 	} else if (!PageReferenced(page)) {
 		SetPageReferenced(page);
 	}
@@ -458,21 +527,24 @@ void add_page_to_unevictable_list(struct page *page)
 }
 
 /**
- * lru_cache_add_active_or_unevictable
+ * __lru_cache_add_active_or_unevictable
  * @page:  the page to be added to LRU
- * @vma:   vma in which page is mapped for determining reclaimability
+ * @vma_flags:  vma flags of the mapping, for determining reclaimability
  *
  * Place @page on the active or unevictable LRU list, depending on its
  * evictability.  Note that if the page is not evictable, it goes
  * directly back onto it's zone's unevictable list, it does NOT use a
  * per cpu pagevec.
+ *
+ * Takes the flags rather than the vma so that the speculative fault
+ * path can pass the snapshot it validated under the pte lock.
  */
-void lru_cache_add_active_or_unevictable(struct page *page,
-					 struct vm_area_struct *vma)
+void __lru_cache_add_active_or_unevictable(struct page *page,
+					   unsigned long vma_flags)
 {
 	VM_BUG_ON_PAGE(PageLRU(page), page);
 
-	if (likely((vma->vm_flags & (VM_LOCKED | VM_SPECIAL)) != VM_LOCKED)) {
+	if (likely((vma_flags & (VM_LOCKED | VM_SPECIAL)) != VM_LOCKED)) {
 		SetPageActive(page);
 		lru_cache_add(page);
 		return;
@@ -535,7 +607,6 @@ static void lru_deactivate_file_fn(struct page *page, struct lruvec *lruvec,
 	del_page_from_lru_list(page, lruvec, lru + active);
 	ClearPageActive(page);
 	ClearPageReferenced(page);
-	add_page_to_lru_list(page, lruvec, lru);
 
 	if (PageWriteback(page) || PageDirty(page)) {
 		/*
@@ -543,13 +614,14 @@ static void lru_deactivate_file_fn(struct page *page, struct lruvec *lruvec,
 		 * It can make readahead confusing.  But race window
 		 * is _really_ small and  it's non-critical problem.
 		 */
+		add_page_to_lru_list(page, lruvec, lru);
 		SetPageReclaim(page);
 	} else {
 		/*
 		 * The page's writeback ends up during pagevec
 		 * We moves tha page into tail of inactive.
 		 */
-		list_move_tail(&page->lru, &lruvec->lists[lru]);
+		add_page_to_lru_list_tail(page, lruvec, lru);
 		__count_vm_event(PGROTATED);
 	}
 
@@ -562,7 +634,8 @@ static void lru_deactivate_file_fn(struct page *page, struct lruvec *lruvec,
 static void lru_deactivate_fn(struct page *page, struct lruvec *lruvec,
 			    void *arg)
 {
-	if (PageLRU(page) && PageActive(page) && !PageUnevictable(page)) {
+	if (PageLRU(page) && (PageActive(page) || lru_gen_enabled()) &&
+	    !PageUnevictable(page)) {
 		int file = page_is_file_cache(page);
 		int lru = page_lru_base_type(page);
 
@@ -645,7 +718,9 @@ void deactivate_file_page(struct page *page)
  */
 void deactivate_page(struct page *page)
 {
-	if (PageLRU(page) && PageActive(page) && !PageUnevictable(page)) {
+	/* the multi-gen LRU does not use PG_active, see lru_gen_add_page() */
+	if (PageLRU(page) && (PageActive(page) || lru_gen_enabled()) &&
+	    !PageUnevictable(page)) {
 		struct pagevec *pvec = &get_cpu_var(lru_deactivate_pvecs);
 
 		get_page(page);
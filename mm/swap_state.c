@@ -19,6 +19,7 @@
 #include <linux/migrate.h>
 
 #include <asm/pgtable.h>
+#include "internal.h"
 
 /*
  * swapper_space is a fiction, retained to simplify the path through
@@ -77,8 +78,10 @@ void show_swap_cache_info(void)
 /*
  * __add_to_swap_cache resembles add_to_page_cache_locked on swapper_space,
  * but sets SwapCache flag and private instead of mapping and index.
+ * A shadow entry left behind by the page's previous eviction is
+ * returned in @shadowp, if non-NULL.
  */
-int __add_to_swap_cache(struct page *page, swp_entry_t entry)
+int __add_to_swap_cache(struct page *page, swp_entry_t entry, void **shadowp)
 {
 	int error;
 	struct address_space *address_space;
@@ -93,10 +96,9 @@ int __add_to_swap_cache(struct page *page, swp_entry_t entry)
 
 	address_space = swap_address_space(entry);
 	spin_lock_irq(&address_space->tree_lock);
-	error = radix_tree_insert(&address_space->page_tree,
-				  swp_offset(entry), page);
+	error = page_cache_tree_insert(address_space, swp_offset(entry),
+				       page, shadowp);
 	if (likely(!error)) {
-		address_space->nrpages++;
 		__inc_node_page_state(page, NR_FILE_PAGES);
 		INC_CACHE_INFO(add_total);
 	}
@@ -124,7 +126,7 @@ int add_to_swap_cache(struct page *page, swp_entry_t entry, gfp_t gfp_mask)
 
 	error = radix_tree_maybe_preload(gfp_mask);
 	if (!error) {
-		error = __add_to_swap_cache(page, entry);
+		error = __add_to_swap_cache(page, entry, NULL);
 		radix_tree_preload_end();
 	}
 	return error;
@@ -132,9 +134,10 @@ int add_to_swap_cache(struct page *page, swp_entry_t entry, gfp_t gfp_mask)
 
 /*
  * This must be called only on pages that have
- * been verified to be in the swap cache.
+ * been verified to be in the swap cache.  If @shadow is
+ * non-NULL, it is left in the page's slot for refault detection.
  */
-void __delete_from_swap_cache(struct page *page)
+void __delete_from_swap_cache(struct page *page, void *shadow)
 {
 	swp_entry_t entry;
 	struct address_space *address_space;
@@ -145,14 +148,53 @@ void __delete_from_swap_cache(struct page *page)
 
 	entry.val = page_private(page);
 	address_space = swap_address_space(entry);
-	radix_tree_delete(&address_space->page_tree, swp_offset(entry));
+	page_cache_tree_delete(address_space, swp_offset(entry), page, shadow);
 	set_page_private(page, 0);
 	ClearPageSwapCache(page);
-	address_space->nrpages--;
 	__dec_node_page_state(page, NR_FILE_PAGES);
 	INC_CACHE_INFO(del_total);
 }
 
+/**
+ * clear_shadow_from_swap_cache - drop the shadow entry of a swap slot
+ * @entry: the swap entry being freed
+ *
+ * Once a swap entry is freed its slot can be reused by an unrelated
+ * page, so a stale shadow entry must not outlive it.
+ */
+void clear_shadow_from_swap_cache(swp_entry_t entry)
+{
+	struct address_space *address_space = swap_address_space(entry);
+	struct radix_tree_node *node;
+	unsigned long flags;
+	void **slot;
+
+	spin_lock_irqsave(&address_space->tree_lock, flags);
+	if (!__radix_tree_lookup(&address_space->page_tree, swp_offset(entry),
+				 &node, &slot))
+		goto unlock;
+	if (!radix_tree_exceptional_entry(*slot))
+		goto unlock;
+	radix_tree_replace_slot(slot, NULL);
+	address_space->nrexceptional--;
+	if (!node)
+		goto unlock;
+	workingset_node_shadows_dec(node);
+	/*
+	 * Don't track node without shadow entries.
+	 *
+	 * Avoid acquiring the list_lru lock if already untracked.
+	 * The list_empty() test is safe as node->private_list is
+	 * protected by mapping->tree_lock.
+	 */
+	if (!workingset_node_shadows(node) &&
+	    !list_empty(&node->private_list))
+		list_lru_del(&workingset_shadow_nodes, &node->private_list);
+	__radix_tree_delete_node(&address_space->page_tree, node);
+unlock:
+	spin_unlock_irqrestore(&address_space->tree_lock, flags);
+}
+
 /**
  * add_to_swap - allocate swap space for a page
  * @page: page we want to move to swap
@@ -224,7 +266,7 @@ void delete_from_swap_cache(struct page *page)
 
 	address_space = swap_address_space(entry);
 	spin_lock_irq(&address_space->tree_lock);
-	__delete_from_swap_cache(page);
+	__delete_from_swap_cache(page, NULL);
 	spin_unlock_irq(&address_space->tree_lock);
 
 	swapcache_free(entry);
@@ -301,6 +343,7 @@ struct page *__read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 {
 	struct page *found_page, *new_page = NULL;
 	struct address_space *swapper_space = swap_address_space(entry);
+	void *shadow = NULL;
 	int err;
 	*new_page_allocated = false;
 
@@ -362,13 +405,18 @@ struct page *__read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 		/* May fail (-ENOMEM) if radix-tree node allocation failed. */
 		__SetPageLocked(new_page);
 		__SetPageSwapBacked(new_page);
-		err = __add_to_swap_cache(new_page, entry);
+		err = __add_to_swap_cache(new_page, entry, &shadow);
 		if (likely(!err)) {
 			radix_tree_preload_end();
 			/*
-			 * Initiate read into locked page and return.
+			 * The page may have been swapped out only recently;
+			 * if so, activate it like any other repeatedly
+			 * accessed page. Then initiate read into locked
+			 * page and return.
 			 */
-			lru_cache_add_anon(new_page);
+			if (shadow && workingset_refault(new_page, shadow))
+				SetPageActive(new_page);
+			lru_cache_add(new_page);
 			*new_page_allocated = true;
 			return new_page;
 		}
@@ -821,6 +821,7 @@ static unsigned char swap_entry_free(struct swap_info_struct *p,
 		atomic_long_inc(&nr_swap_pages);
 		p->inuse_pages--;
 		frontswap_invalidate_page(p->type, offset);
+		clear_shadow_from_swap_cache(entry);
 		if (p->flags & SWP_BLKDEV) {
 			struct gendisk *disk = p->bdev->bd_disk;
 			if (disk->fops->swap_slot_free_notify)
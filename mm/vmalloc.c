@@ -22,7 +22,7 @@
 #include <linux/kallsyms.h>
 #include <linux/list.h>
 #include <linux/notifier.h>
-#include <linux/rbtree.h>
+#include <linux/rbtree_augmented.h>
 #include <linux/radix-tree.h>
 #include <linux/rcupdate.h>
 #include <linux/pfn.h>
@@ -294,13 +294,46 @@ LIST_HEAD(vmap_area_list);
 static LLIST_HEAD(vmap_purge_list);
 static struct rb_root vmap_area_root = RB_ROOT;
 
-/* The vmap cache globals are protected by vmap_area_lock */
-static struct rb_node *free_vmap_cache;
-static unsigned long cached_hole_size;
-static unsigned long cached_vstart;
-static unsigned long cached_align;
+/*
+ * The free KVA space is kept in its own address sorted rbtree and list,
+ * protected by vmap_area_lock as well. Every node of the tree also records
+ * the size of the biggest free block in its subtree, so the lowest block
+ * that can hold a request is found in O(log n) instead of walking all the
+ * busy areas.
+ */
+static struct rb_root free_vmap_area_root = RB_ROOT;
+static LIST_HEAD(free_vmap_area_list);
 
-static unsigned long vmap_area_pcpu_hole;
+/*
+ * Spare vmap_area for splitting a free block in two, preloaded before
+ * taking vmap_area_lock so that it can be allocated with the caller's gfp
+ * flags instead of GFP_NOWAIT.
+ */
+static DEFINE_PER_CPU(struct vmap_area *, ne_fit_preload_node);
+
+static inline unsigned long va_size(struct vmap_area *va)
+{
+	return va->va_end - va->va_start;
+}
+
+static inline unsigned long get_subtree_max_size(struct rb_node *node)
+{
+	struct vmap_area *va;
+
+	va = rb_entry_safe(node, struct vmap_area, rb_node);
+	return va ? va->subtree_max_size : 0;
+}
+
+static inline unsigned long compute_subtree_max_size(struct vmap_area *va)
+{
+	return max3(va_size(va),
+		    get_subtree_max_size(va->rb_node.rb_left),
+		    get_subtree_max_size(va->rb_node.rb_right));
+}
+
+RB_DECLARE_CALLBACKS(static, free_vmap_area_rb_augment_cb,
+		     struct vmap_area, rb_node, unsigned long,
+		     subtree_max_size, compute_subtree_max_size)
 
 static struct vmap_area *__find_vmap_area(unsigned long addr)
 {
@@ -321,36 +354,398 @@ static struct vmap_area *__find_vmap_area(unsigned long addr)
 	return NULL;
 }
 
-static void __insert_vmap_area(struct vmap_area *va)
-{
-	struct rb_node **p = &vmap_area_root.rb_node;
-	struct rb_node *parent = NULL;
-	struct rb_node *tmp;
+/*
+ * Find where @va goes in the tree, searching from the root of @root or, if
+ * it is NULL, from @from. Overlapping areas are a bug.
+ */
+static struct rb_node **find_va_links(struct vmap_area *va,
+				      struct rb_root *root,
+				      struct rb_node *from,
+				      struct rb_node **parent)
+{
+	struct vmap_area *tmp_va;
+	struct rb_node **link;
+
+	if (root) {
+		link = &root->rb_node;
+		if (unlikely(!*link)) {
+			*parent = NULL;
+			return link;
+		}
+	} else {
+		link = &from;
+	}
 
-	while (*p) {
-		struct vmap_area *tmp_va;
+	do {
+		tmp_va = rb_entry(*link, struct vmap_area, rb_node);
 
-		parent = *p;
-		tmp_va = rb_entry(parent, struct vmap_area, rb_node);
-		if (va->va_start < tmp_va->va_end)
-			p = &(*p)->rb_left;
-		else if (va->va_end > tmp_va->va_start)
-			p = &(*p)->rb_right;
+		if (va->va_end <= tmp_va->va_start)
+			link = &(*link)->rb_left;
+		else if (va->va_start >= tmp_va->va_end)
+			link = &(*link)->rb_right;
 		else
 			BUG();
+	} while (*link);
+
+	*parent = &tmp_va->rb_node;
+	return link;
+}
+
+/* The list entry that will follow an area linked at @link under @parent */
+static struct list_head *get_va_next_sibling(struct rb_node *parent,
+					     struct rb_node **link)
+{
+	struct list_head *list;
+
+	/* The tree is empty, there is no free space at all */
+	if (unlikely(!parent))
+		return NULL;
+
+	list = &rb_entry(parent, struct vmap_area, rb_node)->list;
+	return &parent->rb_right == link ? list->next : list;
+}
+
+static void link_va(struct vmap_area *va, struct rb_root *root,
+		    struct rb_node *parent, struct rb_node **link,
+		    struct list_head *head)
+{
+	/* The area isn't on the list yet, but its predecessor is known */
+	if (likely(parent)) {
+		head = &rb_entry(parent, struct vmap_area, rb_node)->list;
+		if (&parent->rb_right != link)
+			head = head->prev;
 	}
 
-	rb_link_node(&va->rb_node, parent, p);
-	rb_insert_color(&va->rb_node, &vmap_area_root);
+	rb_link_node(&va->rb_node, parent, link);
+	if (root == &free_vmap_area_root) {
+		/*
+		 * Let the rotations see the new area as empty, the caller
+		 * propagates its real size with augment_tree_propagate_from().
+		 */
+		va->subtree_max_size = 0;
+		rb_insert_augmented(&va->rb_node, root,
+				    &free_vmap_area_rb_augment_cb);
+	} else {
+		rb_insert_color(&va->rb_node, root);
+	}
 
-	/* address-sort this list */
-	tmp = rb_prev(&va->rb_node);
-	if (tmp) {
-		struct vmap_area *prev;
-		prev = rb_entry(tmp, struct vmap_area, rb_node);
-		list_add_rcu(&va->list, &prev->list);
-	} else
-		list_add_rcu(&va->list, &vmap_area_list);
+	list_add(&va->list, head);
+}
+
+static void unlink_va(struct vmap_area *va, struct rb_root *root)
+{
+	if (WARN_ON(RB_EMPTY_NODE(&va->rb_node)))
+		return;
+
+	if (root == &free_vmap_area_root)
+		rb_erase_augmented(&va->rb_node, root,
+				   &free_vmap_area_rb_augment_cb);
+	else
+		rb_erase(&va->rb_node, root);
+
+	list_del(&va->list);
+	RB_CLEAR_NODE(&va->rb_node);
+}
+
+/*
+ * Update subtree_max_size from @va up to the root after the size of @va
+ * changed or @va was inserted. Stops as soon as an ancestor is unaffected.
+ */
+static void augment_tree_propagate_from(struct vmap_area *va)
+{
+	struct rb_node *node = &va->rb_node;
+	unsigned long new_va_sub_max_size;
+
+	while (node) {
+		va = rb_entry(node, struct vmap_area, rb_node);
+		new_va_sub_max_size = compute_subtree_max_size(va);
+
+		if (va->subtree_max_size == new_va_sub_max_size)
+			break;
+
+		va->subtree_max_size = new_va_sub_max_size;
+		node = rb_parent(&va->rb_node);
+	}
+}
+
+static void insert_vmap_area(struct vmap_area *va, struct rb_root *root,
+			     struct list_head *head)
+{
+	struct rb_node **link;
+	struct rb_node *parent;
+
+	link = find_va_links(va, root, NULL, &parent);
+	link_va(va, root, parent, link, head);
+}
+
+static void insert_vmap_area_augment(struct vmap_area *va,
+				     struct rb_node *from,
+				     struct rb_root *root,
+				     struct list_head *head)
+{
+	struct rb_node **link;
+	struct rb_node *parent;
+
+	if (from)
+		link = find_va_links(va, NULL, from, &parent);
+	else
+		link = find_va_links(va, root, NULL, &parent);
+
+	link_va(va, root, parent, link, head);
+	augment_tree_propagate_from(va);
+}
+
+/*
+ * Return the freed area @va to the free space, coalescing it with the free
+ * blocks right before and after it. @va is freed if it was merged.
+ */
+static void merge_or_add_vmap_area(struct vmap_area *va,
+				   struct rb_root *root,
+				   struct list_head *head)
+{
+	struct vmap_area *sibling;
+	struct list_head *next;
+	struct rb_node **link;
+	struct rb_node *parent;
+	bool merged = false;
+
+	link = find_va_links(va, root, NULL, &parent);
+
+	next = get_va_next_sibling(parent, link);
+	if (unlikely(!next))
+		goto insert;
+
+	/* |<------VA------>|<-----Next----->| */
+	if (next != head) {
+		sibling = list_entry(next, struct vmap_area, list);
+		if (sibling->va_start == va->va_end) {
+			sibling->va_start = va->va_start;
+			kfree(va);
+			va = sibling;
+			merged = true;
+		}
+	}
+
+	/* |<-----Prev----->|<------VA------>| */
+	if (next->prev != head) {
+		sibling = list_entry(next->prev, struct vmap_area, list);
+		if (sibling->va_end == va->va_start) {
+			/*
+			 * Unlink the merged next block before growing the
+			 * previous one, so that the rotations of the erase
+			 * don't compute subtree sizes from a stale va_end.
+			 */
+			if (merged)
+				unlink_va(va, root);
+
+			sibling->va_end = va->va_end;
+			kfree(va);
+			va = sibling;
+			merged = true;
+		}
+	}
+
+insert:
+	if (!merged)
+		link_va(va, root, parent, link, head);
+	augment_tree_propagate_from(va);
+}
+
+static inline bool is_within_this_va(struct vmap_area *va, unsigned long size,
+				     unsigned long align, unsigned long vstart)
+{
+	unsigned long nva_start_addr;
+
+	if (va->va_start > vstart)
+		nva_start_addr = ALIGN(va->va_start, align);
+	else
+		nva_start_addr = ALIGN(vstart, align);
+
+	/* Can overflow because of a big size or alignment */
+	if (nva_start_addr + size < nva_start_addr ||
+	    nva_start_addr < vstart)
+		return false;
+
+	return nva_start_addr + size <= va->va_end;
+}
+
+/*
+ * Find the free block with the lowest address that can hold @size bytes
+ * aligned to @align at or above @vstart.
+ */
+static struct vmap_area *find_vmap_lowest_match(unsigned long size,
+						unsigned long align,
+						unsigned long vstart)
+{
+	struct vmap_area *va;
+	struct rb_node *node;
+	unsigned long length;
+
+	node = free_vmap_area_root.rb_node;
+
+	/* Leave room for the alignment overhead */
+	length = size + align - 1;
+
+	while (node) {
+		va = rb_entry(node, struct vmap_area, rb_node);
+
+		if (get_subtree_max_size(node->rb_left) >= length &&
+		    vstart < va->va_start) {
+			node = node->rb_left;
+			continue;
+		}
+
+		if (is_within_this_va(va, size, align, vstart))
+			return va;
+
+		/* Only descend to the right if something there is big enough */
+		if (get_subtree_max_size(node->rb_right) >= length) {
+			node = node->rb_right;
+			continue;
+		}
+
+		/*
+		 * Nothing fits below this node because of vstart or the
+		 * alignment. Go back up to the first right subtree that can
+		 * hold the request, moving vstart past the blocks already
+		 * checked so the same subtree isn't entered again.
+		 */
+		while ((node = rb_parent(node))) {
+			va = rb_entry(node, struct vmap_area, rb_node);
+			if (is_within_this_va(va, size, align, vstart))
+				return va;
+
+			if (get_subtree_max_size(node->rb_right) >= length &&
+			    vstart <= va->va_start) {
+				vstart = va->va_start + 1;
+				node = node->rb_right;
+				break;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+enum fit_type {
+	NOTHING_FIT = 0,
+	FL_FIT_TYPE = 1,	/* full fit */
+	LE_FIT_TYPE = 2,	/* left edge fit */
+	RE_FIT_TYPE = 3,	/* right edge fit */
+	NE_FIT_TYPE = 4		/* no edge fit */
+};
+
+static enum fit_type classify_va_fit_type(struct vmap_area *va,
+					  unsigned long nva_start_addr,
+					  unsigned long size)
+{
+	if (nva_start_addr < va->va_start ||
+	    nva_start_addr + size > va->va_end)
+		return NOTHING_FIT;
+
+	if (va->va_start == nva_start_addr) {
+		if (va->va_end == nva_start_addr + size)
+			return FL_FIT_TYPE;
+		return LE_FIT_TYPE;
+	}
+	if (va->va_end == nva_start_addr + size)
+		return RE_FIT_TYPE;
+	return NE_FIT_TYPE;
+}
+
+/* Carve [nva_start_addr, nva_start_addr + size) out of the free block @va */
+static int adjust_va_to_fit_type(struct vmap_area *va,
+				 unsigned long nva_start_addr,
+				 unsigned long size, enum fit_type type)
+{
+	struct vmap_area *lva = NULL;
+
+	switch (type) {
+	case FL_FIT_TYPE:
+		/*
+		 * |---------------|
+		 * V      NVA      V
+		 * |---------------|
+		 */
+		unlink_va(va, &free_vmap_area_root);
+		kfree(va);
+		return 0;
+	case LE_FIT_TYPE:
+		/*
+		 * |-------|-------|
+		 * V  NVA  V   VA  V
+		 * |-------|-------|
+		 */
+		va->va_start += size;
+		break;
+	case RE_FIT_TYPE:
+		/*
+		 * |-------|-------|
+		 * V   VA  V  NVA  V
+		 * |-------|-------|
+		 */
+		va->va_end = nva_start_addr;
+		break;
+	case NE_FIT_TYPE:
+		/*
+		 * |---|-------|---|
+		 * V LVA  NVA   VA V
+		 * |---|-------|---|
+		 */
+		lva = __this_cpu_xchg(ne_fit_preload_node, NULL);
+		if (unlikely(!lva)) {
+			lva = kmalloc(sizeof(*lva), GFP_NOWAIT);
+			if (!lva)
+				return -ENOMEM;
+		}
+
+		lva->va_start = va->va_start;
+		lva->va_end = nva_start_addr;
+		va->va_start = nva_start_addr + size;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	augment_tree_propagate_from(va);
+	if (lva)
+		insert_vmap_area_augment(lva, &va->rb_node,
+					 &free_vmap_area_root,
+					 &free_vmap_area_list);
+	return 0;
+}
+
+/*
+ * Take the lowest suitable range out of the free space. Returns @vend if
+ * there is none.
+ */
+static unsigned long __alloc_vmap_area(unsigned long size, unsigned long align,
+				       unsigned long vstart, unsigned long vend)
+{
+	unsigned long nva_start_addr;
+	struct vmap_area *va;
+	enum fit_type type;
+
+	va = find_vmap_lowest_match(size, align, vstart);
+	if (unlikely(!va))
+		return vend;
+
+	if (va->va_start > vstart)
+		nva_start_addr = ALIGN(va->va_start, align);
+	else
+		nva_start_addr = ALIGN(vstart, align);
+
+	if (nva_start_addr + size > vend)
+		return vend;
+
+	type = classify_va_fit_type(va, nva_start_addr, size);
+	if (WARN_ON_ONCE(type == NOTHING_FIT))
+		return vend;
+
+	if (adjust_va_to_fit_type(va, nva_start_addr, size, type))
+		return vend;
+
+	return nva_start_addr;
 }
 
 static void purge_vmap_area_lazy(void);
@@ -366,11 +761,9 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 				unsigned long vstart, unsigned long vend,
 				int node, gfp_t gfp_mask)
 {
-	struct vmap_area *va;
-	struct rb_node *n;
+	struct vmap_area *va, *pva;
 	unsigned long addr;
 	int purged = 0;
-	struct vmap_area *first;
 
 	BUG_ON(!size);
 	BUG_ON(offset_in_page(size));
@@ -390,84 +783,29 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 	kmemleak_scan_area(&va->rb_node, SIZE_MAX, gfp_mask & GFP_RECLAIM_MASK);
 
 retry:
-	spin_lock(&vmap_area_lock);
 	/*
-	 * Invalidate cache if we have more permissive parameters.
-	 * cached_hole_size notes the largest hole noticed _below_
-	 * the vmap_area cached in free_vmap_cache: if size fits
-	 * into that hole, we want to scan from vstart to reuse
-	 * the hole instead of allocating above free_vmap_cache.
-	 * Note that __free_vmap_area may update free_vmap_cache
-	 * without updating cached_hole_size or cached_align.
+	 * Preload this CPU with a spare vmap_area in case the free block
+	 * has to be split. Migrating to another CPU before taking the lock
+	 * only means falling back to a GFP_NOWAIT allocation.
 	 */
-	if (!free_vmap_cache ||
-			size < cached_hole_size ||
-			vstart < cached_vstart ||
-			align < cached_align) {
-nocache:
-		cached_hole_size = 0;
-		free_vmap_cache = NULL;
-	}
-	/* record if we encounter less permissive parameters */
-	cached_vstart = vstart;
-	cached_align = align;
-
-	/* find starting point for our search */
-	if (free_vmap_cache) {
-		first = rb_entry(free_vmap_cache, struct vmap_area, rb_node);
-		addr = ALIGN(first->va_end, align);
-		if (addr < vstart)
-			goto nocache;
-		if (addr + size < addr)
-			goto overflow;
+	pva = NULL;
+	if (!this_cpu_read(ne_fit_preload_node))
+		pva = kmalloc_node(sizeof(struct vmap_area),
+				   gfp_mask & GFP_RECLAIM_MASK, node);
 
-	} else {
-		addr = ALIGN(vstart, align);
-		if (addr + size < addr)
-			goto overflow;
-
-		n = vmap_area_root.rb_node;
-		first = NULL;
-
-		while (n) {
-			struct vmap_area *tmp;
-			tmp = rb_entry(n, struct vmap_area, rb_node);
-			if (tmp->va_end >= addr) {
-				first = tmp;
-				if (tmp->va_start <= addr)
-					break;
-				n = n->rb_left;
-			} else
-				n = n->rb_right;
-		}
-
-		if (!first)
-			goto found;
-	}
-
-	/* from the starting point, walk areas until a suitable hole is found */
-	while (addr + size > first->va_start && addr + size <= vend) {
-		if (addr + cached_hole_size < first->va_start)
-			cached_hole_size = first->va_start - addr;
-		addr = ALIGN(first->va_end, align);
-		if (addr + size < addr)
-			goto overflow;
-
-		if (list_is_last(&first->list, &vmap_area_list))
-			goto found;
+	spin_lock(&vmap_area_lock);
 
-		first = list_next_entry(first, list);
-	}
+	if (pva && __this_cpu_cmpxchg(ne_fit_preload_node, NULL, pva))
+		kfree(pva);
 
-found:
-	if (addr + size > vend)
+	addr = __alloc_vmap_area(size, align, vstart, vend);
+	if (unlikely(addr == vend))
 		goto overflow;
 
 	va->va_start = addr;
 	va->va_end = addr + size;
 	va->flags = 0;
-	__insert_vmap_area(va);
-	free_vmap_cache = &va->rb_node;
+	insert_vmap_area(va, &vmap_area_root, &vmap_area_list);
 	spin_unlock(&vmap_area_lock);
 
 	BUG_ON(!IS_ALIGNED(va->va_start, align));
@@ -514,37 +852,8 @@ EXPORT_SYMBOL_GPL(unregister_vmap_purge_notifier);
 
 static void __free_vmap_area(struct vmap_area *va)
 {
-	BUG_ON(RB_EMPTY_NODE(&va->rb_node));
-
-	if (free_vmap_cache) {
-		if (va->va_end < cached_vstart) {
-			free_vmap_cache = NULL;
-		} else {
-			struct vmap_area *cache;
-			cache = rb_entry(free_vmap_cache, struct vmap_area, rb_node);
-			if (va->va_start <= cache->va_start) {
-				free_vmap_cache = rb_prev(&va->rb_node);
-				/*
-				 * We don't try to update cached_hole_size or
-				 * cached_align, but it won't go very wrong.
-				 */
-			}
-		}
-	}
-	rb_erase(&va->rb_node, &vmap_area_root);
-	RB_CLEAR_NODE(&va->rb_node);
-	list_del_rcu(&va->list);
-
-	/*
-	 * Track the highest possible candidate for pcpu area
-	 * allocation.  Areas outside of vmalloc area can be returned
-	 * here too, consider only end addresses which fall inside
-	 * vmalloc area proper.
-	 */
-	if (va->va_end > VMALLOC_START && va->va_end <= VMALLOC_END)
-		vmap_area_pcpu_hole = max(vmap_area_pcpu_hole, va->va_end);
-
-	kfree_rcu(va, rcu_head);
+	unlink_va(va, &vmap_area_root);
+	merge_or_add_vmap_area(va, &free_vmap_area_root, &free_vmap_area_list);
 }
 
 /*
@@ -686,10 +995,15 @@ static void __purge_vmap_area_lazy(unsigned long *start, unsigned long *end,
 				flush_tlb_kernel_range(va->va_start, va->va_end);
 	}
 
+	/*
+	 * The areas were already taken out of the busy tree when they were
+	 * freed, return the whole batch to the free space in one go.
+	 */
 	if (nr) {
 		spin_lock(&vmap_area_lock);
 		llist_for_each_entry_safe(va, n_va, valist, purge_list)
-			__free_vmap_area(va);
+			merge_or_add_vmap_area(va, &free_vmap_area_root,
+					       &free_vmap_area_list);
 		spin_unlock(&vmap_area_lock);
 	}
 	spin_unlock(&purge_lock);
@@ -716,6 +1030,13 @@ static void purge_vmap_area_lazy(void)
 	__purge_vmap_area_lazy(&start, &end, 1, 0);
 }
 
+static void purge_vmap_area_work_fn(struct work_struct *work)
+{
+	try_purge_vmap_area_lazy();
+}
+
+static DECLARE_WORK(purge_vmap_area_work, purge_vmap_area_work_fn);
+
 /*
  * Free a vmap area, caller ensuring that the area has been unmapped
  * and flush_cache_vunmap had been called for the correct range
@@ -725,14 +1046,25 @@ static void free_vmap_area_noflush(struct vmap_area *va)
 {
 	int nr_lazy;
 
+	/* Keep the busy tree small, the range stays unusable until purged */
+	spin_lock(&vmap_area_lock);
+	unlink_va(va, &vmap_area_root);
+	spin_unlock(&vmap_area_lock);
+
 	nr_lazy = atomic_add_return((va->va_end - va->va_start) >> PAGE_SHIFT,
 				    &vmap_lazy_nr);
 
 	/* After this point, we may free va at any time */
 	llist_add(&va->purge_list, &vmap_purge_list);
 
+	/*
+	 * Don't make the unlucky caller that crosses the threshold pay for
+	 * the TLB flush and the merging of the whole batch, let a worker
+	 * purge it. Allocations that run out of space still purge
+	 * synchronously.
+	 */
 	if (unlikely(nr_lazy > lazy_max_pages()))
-		try_purge_vmap_area_lazy();
+		schedule_work(&purge_vmap_area_work);
 }
 
 /*
@@ -1244,6 +1576,39 @@ void __init vm_area_register_early(struct vm_struct *vm, size_t align)
 	vm_area_add_early(vm);
 }
 
+/* Everything that isn't busy after the early registrations is free */
+static void __init vmap_init_free_space(void)
+{
+	unsigned long vmap_start = 1;
+	const unsigned long vmap_end = ULONG_MAX;
+	struct vmap_area *busy, *free;
+
+	list_for_each_entry(busy, &vmap_area_list, list) {
+		if (busy->va_start > vmap_start) {
+			free = kzalloc(sizeof(struct vmap_area), GFP_NOWAIT);
+			if (!WARN_ON_ONCE(!free)) {
+				free->va_start = vmap_start;
+				free->va_end = busy->va_start;
+				insert_vmap_area_augment(free, NULL,
+							 &free_vmap_area_root,
+							 &free_vmap_area_list);
+			}
+		}
+		vmap_start = busy->va_end;
+	}
+
+	if (vmap_end > vmap_start) {
+		free = kzalloc(sizeof(struct vmap_area), GFP_NOWAIT);
+		if (!WARN_ON_ONCE(!free)) {
+			free->va_start = vmap_start;
+			free->va_end = vmap_end;
+			insert_vmap_area_augment(free, NULL,
+						 &free_vmap_area_root,
+						 &free_vmap_area_list);
+		}
+	}
+}
+
 void __init vmalloc_init(void)
 {
 	struct vmap_area *va;
@@ -1265,15 +1630,17 @@ void __init vmalloc_init(void)
 	/* Import existing vmlist entries. */
 	for (tmp = vmlist; tmp; tmp = tmp->next) {
 		va = kzalloc(sizeof(struct vmap_area), GFP_NOWAIT);
+		if (WARN_ON_ONCE(!va))
+			continue;
+
 		va->flags = VM_VM_AREA;
 		va->va_start = (unsigned long)tmp->addr;
 		va->va_end = va->va_start + tmp->size;
 		va->vm = tmp;
-		__insert_vmap_area(va);
+		insert_vmap_area(va, &vmap_area_root, &vmap_area_list);
 	}
 
-	vmap_area_pcpu_hole = VMALLOC_END;
-
+	vmap_init_free_space();
 	vmap_initialized = true;
 }
 
@@ -1741,6 +2108,15 @@ void *__vmalloc_node_range(unsigned long size, unsigned long align,
 	return NULL;
 }
 
+/*
+ * This is only for performance analysis of vmalloc and stress purpose.
+ * It is required by vmalloc test module, therefore do not use it other
+ * than that.
+ */
+#ifdef CONFIG_TEST_VMALLOC_MODULE
+EXPORT_SYMBOL_GPL(__vmalloc_node_range);
+#endif
+
 /**
  *	__vmalloc_node  -  allocate virtually contiguous memory
  *	@size:		allocation size
@@ -2321,85 +2697,67 @@ EXPORT_SYMBOL_GPL(free_vm_area);
 #ifdef CONFIG_SMP
 static struct vmap_area *node_to_va(struct rb_node *n)
 {
-	return n ? rb_entry(n, struct vmap_area, rb_node) : NULL;
+	return rb_entry_safe(n, struct vmap_area, rb_node);
 }
 
 /**
- * pvm_find_next_prev - find the next and prev vmap_area surrounding @end
- * @end: target address
- * @pnext: out arg for the next vmap_area
- * @pprev: out arg for the previous vmap_area
+ * pvm_find_va_enclose_addr - find the free block containing @addr
+ * @addr: target address
  *
- * Returns: %true if either or both of next and prev are found,
- *	    %false if no vmap_area exists
- *
- * Find vmap_areas end addresses of which enclose @end.  ie. if not
- * NULL, *pnext->va_end > @end and *pprev->va_end <= @end.
+ * Returns: the free vmap_area containing @addr or, if there is none, the
+ *	    closest one below it, %NULL if there is no free block below @addr
  */
-static bool pvm_find_next_prev(unsigned long end,
-			       struct vmap_area **pnext,
-			       struct vmap_area **pprev)
+static struct vmap_area *pvm_find_va_enclose_addr(unsigned long addr)
 {
-	struct rb_node *n = vmap_area_root.rb_node;
-	struct vmap_area *va = NULL;
+	struct vmap_area *va, *tmp;
+	struct rb_node *n;
+
+	n = free_vmap_area_root.rb_node;
+	va = NULL;
 
 	while (n) {
-		va = rb_entry(n, struct vmap_area, rb_node);
-		if (end < va->va_end)
-			n = n->rb_left;
-		else if (end > va->va_end)
+		tmp = rb_entry(n, struct vmap_area, rb_node);
+		if (tmp->va_start <= addr) {
+			va = tmp;
+			if (tmp->va_end >= addr)
+				break;
+
 			n = n->rb_right;
-		else
-			break;
+		} else {
+			n = n->rb_left;
+		}
 	}
 
-	if (!va)
-		return false;
-
-	if (va->va_end > end) {
-		*pnext = va;
-		*pprev = node_to_va(rb_prev(&(*pnext)->rb_node));
-	} else {
-		*pprev = va;
-		*pnext = node_to_va(rb_next(&(*pprev)->rb_node));
-	}
-	return true;
+	return va;
 }
 
 /**
- * pvm_determine_end - find the highest aligned address between two vmap_areas
- * @pnext: in/out arg for the next vmap_area
- * @pprev: in/out arg for the previous vmap_area
+ * pvm_determine_end_from_reverse - find the highest aligned address
+ * of a free block below VMALLOC_END
+ * @va: in/out arg for the free block to start the search from
  * @align: alignment
  *
- * Returns: determined end address
- *
- * Find the highest aligned address between *@pnext and *@pprev below
- * VMALLOC_END.  *@pnext and *@pprev are adjusted so that the aligned
- * down address is between the end addresses of the two vmap_areas.
- *
- * Please note that the address returned by this function may fall
- * inside *@pnext vmap_area.  The caller is responsible for checking
- * that.
+ * Returns: the determined end address within *@va, 0 if no free block
+ *	    below *@va fits. *@va is updated to the block the address is in.
  */
-static unsigned long pvm_determine_end(struct vmap_area **pnext,
-				       struct vmap_area **pprev,
-				       unsigned long align)
+static unsigned long pvm_determine_end_from_reverse(struct vmap_area **va,
+						    unsigned long align)
 {
-	const unsigned long vmalloc_end = VMALLOC_END & ~(align - 1);
+	unsigned long vmalloc_end = VMALLOC_END & ~(align - 1);
 	unsigned long addr;
 
-	if (*pnext)
-		addr = min((*pnext)->va_start & ~(align - 1), vmalloc_end);
-	else
-		addr = vmalloc_end;
+	if (unlikely(!*va))
+		return 0;
 
-	while (*pprev && (*pprev)->va_end > addr) {
-		*pnext = *pprev;
-		*pprev = node_to_va(rb_prev(&(*pnext)->rb_node));
+	for (; &(*va)->list != &free_vmap_area_list;
+	     *va = list_prev_entry(*va, list)) {
+		addr = min((*va)->va_end & ~(align - 1), vmalloc_end);
+		if ((*va)->va_start < addr)
+			return addr;
 	}
 
-	return addr;
+	*va = NULL;
+	return 0;
 }
 
 /**
@@ -2419,12 +2777,12 @@ static unsigned long pvm_determine_end(struct vmap_area **pnext,
  * to gigabytes.  To avoid interacting with regular vmallocs, these
  * areas are allocated from top.
  *
- * Despite its complicated look, this allocator is rather simple.  It
- * does everything top-down and scans areas from the end looking for
- * matching slot.  While scanning, if any of the areas overlaps with
- * existing vmap_area, the base address is pulled down to fit the
- * area.  Scanning is repeated till all the areas fit and then all
- * necessary data structres are inserted and the result is returned.
+ * Despite its complicated look, this allocator is rather simple. It
+ * does everything top-down and scans free blocks from the end looking
+ * for matching base. While scanning, if any of the areas do not fit the
+ * base address is pulled down to fit the area. Scanning is repeated till
+ * all the areas fit and then all necessary data structures are inserted
+ * and the result is returned.
  */
 struct vm_struct **pcpu_get_vm_areas(const unsigned long *offsets,
 				     const size_t *sizes, int nr_vms,
@@ -2432,11 +2790,12 @@ struct vm_struct **pcpu_get_vm_areas(const unsigned long *offsets,
 {
 	const unsigned long vmalloc_start = ALIGN(VMALLOC_START, align);
 	const unsigned long vmalloc_end = VMALLOC_END & ~(align - 1);
-	struct vmap_area **vas, *prev, *next;
+	struct vmap_area **vas, *va;
 	struct vm_struct **vms;
 	int area, area2, last_area, term_area;
-	unsigned long base, start, end, last_end;
+	unsigned long base, start, size, end, last_end;
 	bool purged = false;
+	enum fit_type type;
 
 	/* verify parameters and allocate data structures */
 	BUG_ON(offset_in_page(align) || !is_power_of_2(align));
@@ -2489,49 +2848,38 @@ struct vm_struct **pcpu_get_vm_areas(const unsigned long *offsets,
 	start = offsets[area];
 	end = start + sizes[area];
 
-	if (!pvm_find_next_prev(vmap_area_pcpu_hole, &next, &prev)) {
-		base = vmalloc_end - last_end;
-		goto found;
-	}
-	base = pvm_determine_end(&next, &prev, align) - end;
+	va = pvm_find_va_enclose_addr(vmalloc_end);
+	base = pvm_determine_end_from_reverse(&va, align) - end;
 
 	while (true) {
-		BUG_ON(next && next->va_end <= base + end);
-		BUG_ON(prev && prev->va_end > base + end);
-
 		/*
 		 * base might have underflowed, add last_end before
 		 * comparing.
 		 */
-		if (base + last_end < vmalloc_start + last_end) {
-			spin_unlock(&vmap_area_lock);
-			if (!purged) {
-				purge_vmap_area_lazy();
-				purged = true;
-				goto retry;
-			}
-			goto err_free;
-		}
+		if (base + last_end < vmalloc_start + last_end)
+			goto overflow;
+
+		/* No free block is left to fit the areas in */
+		if (!va)
+			goto overflow;
 
 		/*
-		 * If next overlaps, move base downwards so that it's
-		 * right below next and then recheck.
+		 * If the area doesn't fit below the end of the free block,
+		 * move base downwards and recheck.
 		 */
-		if (next && next->va_start < base + end) {
-			base = pvm_determine_end(&next, &prev, align) - end;
+		if (base + end > va->va_end) {
+			base = pvm_determine_end_from_reverse(&va, align) - end;
 			term_area = area;
 			continue;
 		}
 
 		/*
-		 * If prev overlaps, shift down next and prev and move
-		 * base so that it's right below new next and then
-		 * recheck.
+		 * If the area starts below the free block, move on to the
+		 * previous free block and recheck.
 		 */
-		if (prev && prev->va_end > base + start)  {
-			next = prev;
-			prev = node_to_va(rb_prev(&next->rb_node));
-			base = pvm_determine_end(&next, &prev, align) - end;
+		if (base + start < va->va_start) {
+			va = node_to_va(rb_prev(&va->rb_node));
+			base = pvm_determine_end_from_reverse(&va, align) - end;
 			term_area = area;
 			continue;
 		}
@@ -2543,21 +2891,33 @@ struct vm_struct **pcpu_get_vm_areas(const unsigned long *offsets,
 		area = (area + nr_vms - 1) % nr_vms;
 		if (area == term_area)
 			break;
+
 		start = offsets[area];
 		end = start + sizes[area];
-		pvm_find_next_prev(base + end, &next, &prev);
+		va = pvm_find_va_enclose_addr(base + end);
 	}
-found:
-	/* we've found a fitting base, insert all va's */
+
+	/* we've found a fitting base, carve out and insert all va's */
 	for (area = 0; area < nr_vms; area++) {
-		struct vmap_area *va = vas[area];
+		start = base + offsets[area];
+		size = sizes[area];
 
-		va->va_start = base + offsets[area];
-		va->va_end = va->va_start + sizes[area];
-		__insert_vmap_area(va);
-	}
+		va = pvm_find_va_enclose_addr(start);
+		if (WARN_ON_ONCE(!va))
+			goto recovery;
+
+		type = classify_va_fit_type(va, start, size);
+		if (WARN_ON_ONCE(type == NOTHING_FIT))
+			goto recovery;
 
-	vmap_area_pcpu_hole = base + offsets[last_area];
+		if (adjust_va_to_fit_type(va, start, size, type))
+			goto recovery;
+
+		va = vas[area];
+		va->va_start = start;
+		va->va_end = start + size;
+		insert_vmap_area(va, &vmap_area_root, &vmap_area_list);
+	}
 
 	spin_unlock(&vmap_area_lock);
 
@@ -2569,6 +2929,33 @@ struct vm_struct **pcpu_get_vm_areas(const unsigned long *offsets,
 	kfree(vas);
 	return vms;
 
+recovery:
+	/* Give back the areas inserted so far, they may get merged */
+	while (area--) {
+		__free_vmap_area(vas[area]);
+		vas[area] = NULL;
+	}
+
+overflow:
+	spin_unlock(&vmap_area_lock);
+	if (!purged) {
+		purge_vmap_area_lazy();
+		purged = true;
+
+		/* Replace the areas that recovery gave back */
+		for (area = 0; area < nr_vms; area++) {
+			if (vas[area])
+				continue;
+
+			vas[area] = kzalloc(sizeof(struct vmap_area),
+					    GFP_KERNEL);
+			if (!vas[area])
+				goto err_free;
+		}
+
+		goto retry;
+	}
+
 err_free:
 	for (area = 0; area < nr_vms; area++) {
 		kfree(vas[area]);
@@ -47,6 +47,8 @@
 #include <linux/prefetch.h>
 #include <linux/printk.h>
 #include <linux/dax.h>
+#include <linux/psi.h>
+#include <linux/memory_hotplug.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -103,6 +105,12 @@ struct scan_control {
 	/* One of the zones is ready for compaction */
 	unsigned int compaction_ready:1;
 
+	/* Requested through memory.reclaim rather than by an allocation */
+	unsigned int proactive:1;
+
+	/* Overrides the memcg's swappiness for proactive reclaim */
+	int *proactive_swappiness;
+
 	/* Incremented by the number of inactive pages that were scanned */
 	unsigned long nr_scanned;
 
@@ -284,6 +292,13 @@ static void adjust_scan_control(struct scan_control *sc)
 		sc->may_swap = 0;
 }
 
+static int sc_swappiness(struct scan_control *sc, struct mem_cgroup *memcg)
+{
+	if (sc->proactive && sc->proactive_swappiness)
+		return *sc->proactive_swappiness;
+	return mem_cgroup_swappiness(memcg);
+}
+
 /*
  * Add a shrinker callback to be called from the vm.
  */
@@ -722,8 +737,13 @@ static int __remove_mapping(struct address_space *mapping, struct page *page,
 
 	if (PageSwapCache(page)) {
 		swp_entry_t swap = { .val = page_private(page) };
+		void *shadow = NULL;
+
+		/* Shadow is packed before swapout drops page->mem_cgroup */
+		if (reclaimed && !mapping_exiting(mapping))
+			shadow = workingset_eviction(mapping, page);
 		mem_cgroup_swapout(page, swap);
-		__delete_from_swap_cache(page);
+		__delete_from_swap_cache(page, shadow);
 		spin_unlock_irqrestore(&mapping->tree_lock, flags);
 		swapcache_free(swap);
 	} else {
@@ -959,6 +979,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 				      unsigned long *ret_nr_congested,
 				      unsigned long *ret_nr_writeback,
 				      unsigned long *ret_nr_immediate,
+				      unsigned long *ret_nr_pageout,
 				      bool force_reclaim)
 {
 	LIST_HEAD(ret_pages);
@@ -970,6 +991,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 	unsigned long nr_reclaimed = 0;
 	unsigned long nr_writeback = 0;
 	unsigned long nr_immediate = 0;
+	unsigned long nr_pageout = 0;
 
 	cond_resched();
 
@@ -1197,6 +1219,8 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			case PAGE_ACTIVATE:
 				goto activate_locked;
 			case PAGE_SUCCESS:
+				nr_pageout += hpage_nr_pages(page);
+
 				if (PageWriteback(page))
 					goto keep;
 				if (PageDirty(page))
@@ -1316,6 +1340,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 	*ret_nr_unqueued_dirty += nr_unqueued_dirty;
 	*ret_nr_writeback += nr_writeback;
 	*ret_nr_immediate += nr_immediate;
+	*ret_nr_pageout += nr_pageout;
 	return nr_reclaimed;
 }
 
@@ -1327,7 +1352,7 @@ unsigned long reclaim_clean_pages_from_list(struct zone *zone,
 		.priority = DEF_PRIORITY,
 		.may_unmap = 1,
 	};
-	unsigned long ret, dummy1, dummy2, dummy3, dummy4, dummy5;
+	unsigned long ret, dummy1, dummy2, dummy3, dummy4, dummy5, dummy6;
 	struct page *page, *next;
 	LIST_HEAD(clean_pages);
 	adjust_scan_control(&sc);
@@ -1342,12 +1367,81 @@ unsigned long reclaim_clean_pages_from_list(struct zone *zone,
 
 	ret = shrink_page_list(&clean_pages, zone->zone_pgdat, &sc,
 			TTU_UNMAP|TTU_IGNORE_ACCESS,
-			&dummy1, &dummy2, &dummy3, &dummy4, &dummy5, true);
+			&dummy1, &dummy2, &dummy3, &dummy4, &dummy5, &dummy6,
+			true);
 	list_splice(&clean_pages, page_list);
 	mod_node_page_state(zone->zone_pgdat, NR_ISOLATED_FILE, -ret);
 	return ret;
 }
 
+static unsigned long reclaim_node_pages(struct list_head *page_list,
+					struct pglist_data *pgdat)
+{
+	struct scan_control sc = {
+		.gfp_mask = GFP_KERNEL,
+		.priority = DEF_PRIORITY,
+		.may_writepage = 1,
+		.may_unmap = 1,
+		.may_swap = 1,
+	};
+	unsigned long ret, dummy1, dummy2, dummy3, dummy4, dummy5, dummy6;
+	struct page *page;
+
+	adjust_scan_control(&sc);
+	ret = shrink_page_list(page_list, pgdat, &sc, TTU_UNMAP,
+			&dummy1, &dummy2, &dummy3, &dummy4, &dummy5, &dummy6,
+			true);
+
+	while (!list_empty(page_list)) {
+		page = lru_to_page(page_list);
+		list_del(&page->lru);
+		putback_lru_page(page);
+	}
+	return ret;
+}
+
+/*
+ * reclaim_pages - reclaim a list of isolated pages regardless of their age
+ * @page_list: pages taken off the LRU with isolate_lru_page()
+ *
+ * The caller has already decided that the pages are cold, e.g. because
+ * userspace or the access monitor said so, so the reference checks are
+ * skipped. Pages that cannot be reclaimed are put back on the LRU.
+ * Returns the number of reclaimed pages.
+ */
+unsigned long reclaim_pages(struct list_head *page_list)
+{
+	unsigned long pflags = current->flags;
+	unsigned long nr_reclaimed = 0;
+	LIST_HEAD(node_page_list);
+	struct page *page;
+	int nid = NUMA_NO_NODE;
+
+	/* Don't recurse into reclaim while writing the pages out */
+	current->flags |= PF_MEMALLOC;
+
+	while (!list_empty(page_list)) {
+		page = lru_to_page(page_list);
+		if (nid == NUMA_NO_NODE)
+			nid = page_to_nid(page);
+		if (nid == page_to_nid(page)) {
+			ClearPageActive(page);
+			list_move(&page->lru, &node_page_list);
+			continue;
+		}
+
+		nr_reclaimed += reclaim_node_pages(&node_page_list,
+						   NODE_DATA(nid));
+		nid = NUMA_NO_NODE;
+	}
+	if (!list_empty(&node_page_list))
+		nr_reclaimed += reclaim_node_pages(&node_page_list,
+						   NODE_DATA(nid));
+
+	tsk_restore_flags(current, pflags, PF_MEMALLOC);
+	return nr_reclaimed;
+}
+
 /*
  * Attempt to remove the specified page from its LRU.  Only take this page
  * if it is of the appropriate PageActive status.  Pages which are being
@@ -1356,7 +1450,9 @@ unsigned long reclaim_clean_pages_from_list(struct zone *zone,
  * page:	page to consider
  * mode:	one of the LRU isolation modes defined above
  *
- * returns 0 on success, -ve errno on failure.
+ * returns 0 on success, -ve errno on failure.  On success the page is
+ * pinned, and the caller clears PageLRU once it took the page off its
+ * list: with PG_lru still set, the multi-gen LRU keeps PG_active.
  */
 int __isolate_lru_page(struct page *page, isolate_mode_t mode)
 {
@@ -1419,15 +1515,13 @@ int __isolate_lru_page(struct page *page, isolate_mode_t mode)
 	if ((mode & ISOLATE_UNMAPPED) && page_mapped(page))
 		return ret;
 
-	if (likely(get_page_unless_zero(page))) {
-		/*
-		 * Be careful not to clear PageLRU until after we're
-		 * sure the page is not being freed elsewhere -- the
-		 * page release code relies on it.
-		 */
-		ClearPageLRU(page);
+	/*
+	 * Be careful not to clear PageLRU until after we're sure the page
+	 * is not being freed elsewhere -- the page release code relies on
+	 * it.
+	 */
+	if (likely(get_page_unless_zero(page)))
 		ret = 0;
-	}
 
 	return ret;
 }
@@ -1513,6 +1607,7 @@ static unsigned long isolate_lru_pages(unsigned long nr_to_scan,
 			nr_taken += nr_pages;
 			nr_zone_taken[page_zonenum(page)] += nr_pages;
 			list_move(&page->lru, dst);
+			ClearPageLRU(page);
 			break;
 
 		case -EBUSY:
@@ -1601,8 +1696,9 @@ int isolate_lru_page(struct page *page)
 		if (PageLRU(page)) {
 			int lru = page_lru(page);
 			get_page(page);
-			ClearPageLRU(page);
+			/* with PG_lru still set, the multi-gen LRU keeps PG_active */
 			del_page_from_lru_list(page, lruvec, lru);
+			ClearPageLRU(page);
 			ret = 0;
 		}
 		spin_unlock_irq(zone_lru_lock(zone));
@@ -1725,6 +1821,7 @@ putback_inactive_pages(struct lruvec *lruvec, struct list_head *page_list)
 			int file = is_file_lru(lru);
 			int numpages = hpage_nr_pages(page);
 			reclaim_stat->recent_rotated[file] += numpages;
+			workingset_age_nonresident(lruvec, numpages);
 		}
 		if (put_page_testzero(page)) {
 			__ClearPageLRU(page);
@@ -1801,6 +1898,7 @@ shrink_inactive_list(unsigned long nr_to_scan, struct lruvec *lruvec,
 	unsigned long nr_unqueued_dirty = 0;
 	unsigned long nr_writeback = 0;
 	unsigned long nr_immediate = 0;
+	unsigned long nr_pageout = 0;
 	isolate_mode_t isolate_mode = 0;
 	int file = is_file_lru(lru);
 	int safe = 0;
@@ -1849,11 +1947,14 @@ shrink_inactive_list(unsigned long nr_to_scan, struct lruvec *lruvec,
 
 	nr_reclaimed = shrink_page_list(&page_list, pgdat, sc, TTU_UNMAP,
 				&nr_dirty, &nr_unqueued_dirty, &nr_congested,
-				&nr_writeback, &nr_immediate,
+				&nr_writeback, &nr_immediate, &nr_pageout,
 				false);
 
 	spin_lock_irq(&pgdat->lru_lock);
 
+	/* Pages that had to be written back count as reclaim cost */
+	lru_note_cost(lruvec, file, nr_pageout);
+
 	if (global_reclaim(sc)) {
 		if (current_is_kswapd())
 			__count_vm_events(PGSTEAL_KSWAPD, nr_reclaimed);
@@ -2178,12 +2279,12 @@ static void get_scan_count(struct lruvec *lruvec, struct mem_cgroup *memcg,
 			   struct scan_control *sc, unsigned long *nr,
 			   unsigned long *lru_pages)
 {
-	int swappiness = mem_cgroup_swappiness(memcg);
+	int swappiness = sc_swappiness(sc, memcg);
 	struct zone_reclaim_stat *reclaim_stat = &lruvec->reclaim_stat;
 	u64 fraction[2];
 	u64 denominator = 0;	/* gcc */
 	struct pglist_data *pgdat = lruvec_pgdat(lruvec);
-	unsigned long anon_prio, file_prio;
+	unsigned long anon_cost, file_cost, total_cost;
 	enum scan_balance scan_balance;
 	unsigned long anon, file;
 	bool force_scan = false;
@@ -2289,31 +2390,17 @@ static void get_scan_count(struct lruvec *lruvec, struct mem_cgroup *memcg,
 
 	scan_balance = SCAN_FRACT;
 
-	/*
-	 * With swappiness at 100, anonymous and file have the same priority.
-	 * This scanning priority is essentially the inverse of IO cost.
-	 */
-	anon_prio = swappiness;
-	file_prio = 200 - anon_prio;
-
-	/*
-	 * OK, so we have swap space and a fair amount of page cache
-	 * pages.  We use the recently rotated / recently scanned
-	 * ratios to determine how valuable each cache is.
-	 *
-	 * Because workloads change over time (and to avoid overflow)
-	 * we keep these statistics as a floating average, which ends
-	 * up weighing recent references more than old ones.
-	 *
-	 * anon in [0], file in [1]
-	 */
-
 	anon  = lruvec_lru_size(lruvec, LRU_ACTIVE_ANON, MAX_NR_ZONES) +
 		lruvec_lru_size(lruvec, LRU_INACTIVE_ANON, MAX_NR_ZONES);
 	file  = lruvec_lru_size(lruvec, LRU_ACTIVE_FILE, MAX_NR_ZONES) +
 		lruvec_lru_size(lruvec, LRU_INACTIVE_FILE, MAX_NR_ZONES);
 
 	spin_lock_irq(&pgdat->lru_lock);
+	/*
+	 * The recently rotated / recently scanned ratios no longer
+	 * steer the balance, but they are still reported through
+	 * memory.stat; keep them a floating average.
+	 */
 	if (unlikely(reclaim_stat->recent_scanned[0] > anon / 4)) {
 		reclaim_stat->recent_scanned[0] /= 2;
 		reclaim_stat->recent_rotated[0] /= 2;
@@ -2325,17 +2412,32 @@ static void get_scan_count(struct lruvec *lruvec, struct mem_cgroup *memcg,
 	}
 
 	/*
-	 * The amount of pressure on anon vs file pages is inversely
-	 * proportional to the fraction of recently scanned pages on
-	 * each list that were recently referenced and in active use.
+	 * Calculate the pressure balance between anon and file pages.
+	 *
+	 * The amount of pressure we put on each LRU is inversely
+	 * proportional to the cost of reclaiming each list, as
+	 * determined by the share of pages that are refaulting, times
+	 * the relative IO cost of bringing back a swapped out
+	 * anonymous page vs reloading a filesystem page (swappiness).
+	 *
+	 * Although we limit that influence to ensure no list gets
+	 * left behind completely: at least a third of the pressure is
+	 * applied, before swappiness.
+	 *
+	 * With swappiness at 100, anon and file have equal IO cost.
 	 */
-	ap = anon_prio * (reclaim_stat->recent_scanned[0] + 1);
-	ap /= reclaim_stat->recent_rotated[0] + 1;
-
-	fp = file_prio * (reclaim_stat->recent_scanned[1] + 1);
-	fp /= reclaim_stat->recent_rotated[1] + 1;
+	total_cost = lruvec->anon_cost + lruvec->file_cost;
+	anon_cost = total_cost + lruvec->anon_cost;
+	file_cost = total_cost + lruvec->file_cost;
+	total_cost = anon_cost + file_cost;
 	spin_unlock_irq(&pgdat->lru_lock);
 
+	ap = swappiness * (total_cost + 1);
+	ap /= anon_cost + 1;
+
+	fp = (200 - swappiness) * (total_cost + 1);
+	fp /= file_cost + 1;
+
 	fraction[0] = ap;
 	fraction[1] = fp;
 	denominator = ap + fp + 1;
@@ -2403,6 +2505,965 @@ static void get_scan_count(struct lruvec *lruvec, struct mem_cgroup *memcg,
 	}
 }
 
+#ifdef CONFIG_LRU_GEN
+
+/*
+ * The multi-gen LRU. Generations and tiers are explained in mmzone.h,
+ * page placement in lru_gen_add_page().
+ *
+ * The aging produces young generations: it walks the page tables of the
+ * processes on lru_gen_mm_list, moves pages found accessed into the
+ * youngest generation and then increments max_seq. It runs when reclaim
+ * is about to evict from the second youngest generation.
+ *
+ * The eviction consumes old generations: it isolates pages from the
+ * oldest generation of the LRU type whose first tier refaults less,
+ * keeps back the tiers of that type refaulting more than the first tier
+ * of the other type, and increments min_seq once a generation is empty.
+ */
+
+#ifdef CONFIG_LRU_GEN_ENABLED
+DEFINE_STATIC_KEY_TRUE(lru_gen_key);
+#else
+DEFINE_STATIC_KEY_FALSE(lru_gen_key);
+#endif
+
+#define MIN_LRU_BATCH		BITS_PER_LONG
+#define MAX_LRU_BATCH		(MIN_LRU_BATCH * 64)
+
+static struct lru_gen_mm_list {
+	struct list_head head;
+	spinlock_t lock;
+} lru_gen_mm_list = {
+	.head = LIST_HEAD_INIT(lru_gen_mm_list.head),
+	.lock = __SPIN_LOCK_UNLOCKED(lru_gen_mm_list.lock),
+};
+
+void lru_gen_add_mm(struct mm_struct *mm)
+{
+	spin_lock(&lru_gen_mm_list.lock);
+	list_add_tail(&mm->lru_gen_list, &lru_gen_mm_list.head);
+	spin_unlock(&lru_gen_mm_list.lock);
+}
+
+void lru_gen_del_mm(struct mm_struct *mm)
+{
+	spin_lock(&lru_gen_mm_list.lock);
+	list_del(&mm->lru_gen_list);
+	spin_unlock(&lru_gen_mm_list.lock);
+}
+
+static int get_nr_gens(struct lruvec *lruvec, int type)
+{
+	return lruvec->lrugen.max_seq - lruvec->lrugen.min_seq[type] + 1;
+}
+
+static int get_swappiness(struct mem_cgroup *memcg, struct scan_control *sc)
+{
+	if (!sc->may_swap || get_nr_swap_pages() <= 0)
+		return 0;
+
+	return sc_swappiness(sc, memcg);
+}
+
+/*
+ * Refault feedback: a tier's position is its refault rate, averaged
+ * with the previous generations and scaled by the swappiness based gain
+ * of its type. The comparison errs on the side of the setpoint until the
+ * sample under test has seen a minimum number of refaults.
+ */
+struct ctrl_pos {
+	unsigned long refaulted;
+	unsigned long total;
+	int gain;
+};
+
+static void read_ctrl_pos(struct lruvec *lruvec, int type, int tier, int gain,
+			  struct ctrl_pos *pos)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+
+	pos->refaulted = lrugen->avg_refaulted[type][tier] +
+			 atomic_long_read(&lrugen->refaulted[type][tier]);
+	pos->total = lrugen->avg_total[type][tier] +
+		     atomic_long_read(&lrugen->evicted[type][tier]);
+	if (tier)
+		pos->total += lrugen->protected[type][tier - 1];
+	pos->gain = gain;
+}
+
+static void reset_ctrl_pos(struct lruvec *lruvec, int type)
+{
+	int tier;
+	unsigned long sum;
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+
+	for (tier = 0; tier < MAX_NR_TIERS; tier++) {
+		sum = lrugen->avg_refaulted[type][tier] +
+		      atomic_long_read(&lrugen->refaulted[type][tier]);
+		WRITE_ONCE(lrugen->avg_refaulted[type][tier], sum / 2);
+
+		sum = lrugen->avg_total[type][tier] +
+		      atomic_long_read(&lrugen->evicted[type][tier]);
+		if (tier)
+			sum += lrugen->protected[type][tier - 1];
+		WRITE_ONCE(lrugen->avg_total[type][tier], sum / 2);
+
+		atomic_long_set(&lrugen->refaulted[type][tier], 0);
+		atomic_long_set(&lrugen->evicted[type][tier], 0);
+		if (tier)
+			WRITE_ONCE(lrugen->protected[type][tier - 1], 0);
+	}
+}
+
+/* Whether @pv refaults no more than the setpoint @sp */
+static bool positive_ctrl_err(struct ctrl_pos *sp, struct ctrl_pos *pv)
+{
+	return pv->refaulted < MIN_LRU_BATCH ||
+	       pv->refaulted * (sp->total + MIN_LRU_BATCH) * sp->gain <=
+	       (sp->refaulted + 1) * pv->total * pv->gain;
+}
+
+/* Moves @page out of the oldest generation, under the lru_lock */
+static int page_inc_gen(struct lruvec *lruvec, struct page *page,
+			bool reclaiming)
+{
+	int type = page_is_file_cache(page);
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int new_gen, old_gen = lru_gen_from_seq(lrugen->min_seq[type]);
+	unsigned long new_flags, old_flags;
+
+	VM_BUG_ON_PAGE(page_lru_gen(page) != old_gen, page);
+
+	new_gen = (old_gen + 1) % MAX_NR_GENS;
+	do {
+		old_flags = READ_ONCE(page->flags);
+		new_flags = old_flags & ~(LRU_GEN_MASK | LRU_REFS_MASK |
+					  BIT(PG_referenced));
+		new_flags |= (new_gen + 1UL) << LRU_GEN_PGOFF;
+		/* for end_page_writeback() */
+		if (reclaiming)
+			new_flags |= BIT(PG_reclaim);
+	} while (cmpxchg(&page->flags, old_flags, new_flags) != old_flags);
+
+	lru_gen_update_size(lruvec, page, old_gen, new_gen);
+
+	return new_gen;
+}
+
+/* Moves @page into the youngest generation, under the lru_lock */
+static void page_promote(struct lruvec *lruvec, struct page *page)
+{
+	int type = page_is_file_cache(page);
+	int zone = page_zonenum(page);
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int new_gen = lru_gen_from_seq(lrugen->max_seq);
+	int old_gen = page_lru_gen(page);
+
+	if (old_gen < 0 || old_gen == new_gen)
+		return;
+
+	set_mask_bits(&page->flags, LRU_GEN_MASK,
+		      (new_gen + 1UL) << LRU_GEN_PGOFF);
+	lru_gen_update_size(lruvec, page, old_gen, new_gen);
+	list_move(&page->lru, &lrugen->lists[new_gen][type][zone]);
+}
+
+/******************************************************************************
+ *                          the aging
+ ******************************************************************************/
+
+struct lru_gen_walk {
+	struct lruvec *lruvec;
+	struct pglist_data *pgdat;
+	unsigned long max_seq;
+	bool can_swap;
+};
+
+static int lru_gen_walk_test(unsigned long start, unsigned long end,
+			     struct mm_walk *walk)
+{
+	struct vm_area_struct *vma = walk->vma;
+	struct lru_gen_walk *priv = walk->private;
+
+	if (vma->vm_flags & (VM_LOCKED | VM_SPECIAL | VM_HUGETLB))
+		return 1;
+
+	/* MADV_SEQUENTIAL and MADV_RANDOM opt out of the page table scan */
+	if (vma->vm_flags & (VM_SEQ_READ | VM_RAND_READ))
+		return 1;
+
+	if (vma_is_anonymous(vma) && !priv->can_swap)
+		return 1;
+
+	return 0;
+}
+
+static int lru_gen_walk_pmd(pmd_t *pmd, unsigned long addr, unsigned long end,
+			    struct mm_walk *walk)
+{
+	struct vm_area_struct *vma = walk->vma;
+	struct lru_gen_walk *priv = walk->private;
+	struct pglist_data *pgdat = priv->pgdat;
+	pte_t *pte, *orig_pte;
+	bool locked = false;
+	spinlock_t *ptl;
+
+	/* huge pmds are left to the rmap walk in shrink_page_list() */
+	if (pmd_trans_unstable(pmd))
+		return 0;
+
+	orig_pte = pte = pte_offset_map_lock(walk->mm, pmd, addr, &ptl);
+	for (; addr != end; pte++, addr += PAGE_SIZE) {
+		pte_t ptent = *pte;
+		struct page *page;
+
+		if (!pte_present(ptent) || !pte_young(ptent))
+			continue;
+
+		page = vm_normal_page(vma, addr, ptent);
+		if (!page || page_to_nid(page) != pgdat->node_id)
+			continue;
+		page = compound_head(page);
+
+		if (!locked) {
+			spin_lock_irq(&pgdat->lru_lock);
+			/* racing with reclaim of the same lruvec */
+			if (priv->lruvec->lrugen.max_seq != priv->max_seq) {
+				spin_unlock_irq(&pgdat->lru_lock);
+				break;
+			}
+			locked = true;
+		}
+
+		/* stable under the lru_lock for pages on the LRU */
+		if (!PageLRU(page) ||
+		    mem_cgroup_page_lruvec(page, pgdat) != priv->lruvec)
+			continue;
+
+		if (ptep_test_and_clear_young(vma, addr, pte))
+			page_promote(priv->lruvec, page);
+	}
+	if (locked)
+		spin_unlock_irq(&pgdat->lru_lock);
+	pte_unmap_unlock(orig_pte, ptl);
+
+	cond_resched();
+
+	return 0;
+}
+
+/*
+ * Walks the page tables of every mm charged to @memcg and promotes the
+ * pages found young on @lruvec. mms whose mmap_sem is contended are
+ * skipped rather than waited for; their pages still get a chance from
+ * the rmap when they reach the oldest generation.
+ */
+static void lru_gen_walk_mms(struct lruvec *lruvec, struct mem_cgroup *memcg,
+			     unsigned long max_seq, bool can_swap)
+{
+	struct lru_gen_walk priv = {
+		.lruvec = lruvec,
+		.pgdat = lruvec_pgdat(lruvec),
+		.max_seq = max_seq,
+		.can_swap = can_swap,
+	};
+	struct mm_walk walk = {
+		.pmd_entry = lru_gen_walk_pmd,
+		.test_walk = lru_gen_walk_test,
+		.private = &priv,
+	};
+	struct mm_struct *mm, *prev = NULL;
+	struct list_head *pos;
+
+	spin_lock(&lru_gen_mm_list.lock);
+	pos = lru_gen_mm_list.head.next;
+	while (pos != &lru_gen_mm_list.head) {
+		mm = list_entry(pos, struct mm_struct, lru_gen_list);
+		pos = pos->next;
+
+		if (memcg && !mm_match_cgroup(mm, memcg))
+			continue;
+		if (!mmget_not_zero(mm))
+			continue;
+		spin_unlock(&lru_gen_mm_list.lock);
+
+		/* the reference on @mm keeps it on the list */
+		if (prev)
+			mmput_async(prev);
+		prev = mm;
+
+		if (down_read_trylock(&mm->mmap_sem)) {
+			walk.mm = mm;
+			walk_page_range(FIRST_USER_ADDRESS, mm->highest_vm_end,
+					&walk);
+			up_read(&mm->mmap_sem);
+		}
+
+		spin_lock(&lru_gen_mm_list.lock);
+		/* someone else aged this lruvec in the meantime */
+		if (READ_ONCE(lruvec->lrugen.max_seq) != max_seq)
+			break;
+		pos = mm->lru_gen_list.next;
+	}
+	spin_unlock(&lru_gen_mm_list.lock);
+
+	if (prev)
+		mmput_async(prev);
+}
+
+/*
+ * Forcibly merges the oldest generation of @type into the next one, to
+ * make room for a new generation. Returns false if it needs to be called
+ * again after dropping the lru_lock.
+ */
+static bool inc_min_seq(struct lruvec *lruvec, int type)
+{
+	int zone;
+	int remaining = MAX_LRU_BATCH;
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int new_gen, old_gen = lru_gen_from_seq(lrugen->min_seq[type]);
+
+	for (zone = 0; zone < MAX_NR_ZONES; zone++) {
+		struct list_head *head = &lrugen->lists[old_gen][type][zone];
+
+		while (!list_empty(head)) {
+			struct page *page = lru_to_page(head);
+
+			new_gen = page_inc_gen(lruvec, page, false);
+			list_move_tail(&page->lru,
+				       &lrugen->lists[new_gen][type][zone]);
+
+			if (!--remaining)
+				return false;
+		}
+	}
+
+	reset_ctrl_pos(lruvec, type);
+	WRITE_ONCE(lrugen->min_seq[type], lrugen->min_seq[type] + 1);
+
+	return true;
+}
+
+/* Retires the oldest generations once they are empty */
+static void try_to_inc_min_seq(struct lruvec *lruvec, bool can_swap)
+{
+	int gen, type, zone;
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	unsigned long min_seq[ANON_AND_FILE];
+
+	for (type = 0; type < ANON_AND_FILE; type++) {
+		min_seq[type] = lrugen->min_seq[type];
+		if (type == LRU_GEN_ANON && !can_swap)
+			continue;
+
+		while (min_seq[type] + MIN_NR_GENS <= lrugen->max_seq) {
+			gen = lru_gen_from_seq(min_seq[type]);
+
+			for (zone = 0; zone < MAX_NR_ZONES; zone++) {
+				if (!list_empty(&lrugen->lists[gen][type][zone]))
+					goto next;
+			}
+
+			min_seq[type]++;
+		}
+next:
+		;
+	}
+
+	/*
+	 * With swap available, anon pages must not be left older than file
+	 * pages, so that both types age on the same timeline.
+	 */
+	if (can_swap) {
+		min_seq[LRU_GEN_ANON] = min(min_seq[LRU_GEN_ANON],
+					    min_seq[LRU_GEN_FILE]);
+		min_seq[LRU_GEN_FILE] = max(min_seq[LRU_GEN_ANON],
+					    lrugen->min_seq[LRU_GEN_FILE]);
+	}
+
+	for (type = 0; type < ANON_AND_FILE; type++) {
+		if (min_seq[type] == lrugen->min_seq[type])
+			continue;
+
+		reset_ctrl_pos(lruvec, type);
+		WRITE_ONCE(lrugen->min_seq[type], min_seq[type]);
+	}
+}
+
+static void inc_max_seq(struct lruvec *lruvec, unsigned long max_seq)
+{
+	int prev, type, zone;
+	struct pglist_data *pgdat = lruvec_pgdat(lruvec);
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+
+	spin_lock_irq(&pgdat->lru_lock);
+restart:
+	if (max_seq != lrugen->max_seq)
+		goto unlock;
+
+	for (type = 0; type < ANON_AND_FILE; type++) {
+		if (get_nr_gens(lruvec, type) != MAX_NR_GENS)
+			continue;
+
+		if (!inc_min_seq(lruvec, type)) {
+			spin_unlock_irq(&pgdat->lru_lock);
+			cond_resched();
+			spin_lock_irq(&pgdat->lru_lock);
+			goto restart;
+		}
+	}
+
+	/*
+	 * The second youngest generation is about to become the third
+	 * youngest one: move its pages from the active to the inactive
+	 * LRU sizes, see lru_gen_is_active().
+	 */
+	prev = lru_gen_from_seq(lrugen->max_seq - 1);
+	for (type = 0; type < ANON_AND_FILE; type++) {
+		for (zone = 0; zone < MAX_NR_ZONES; zone++) {
+			enum lru_list lru = type * LRU_FILE;
+			long delta = lrugen->nr_pages[prev][type][zone];
+
+			if (!delta)
+				continue;
+
+			update_lru_size(lruvec, lru, zone, delta);
+			update_lru_size(lruvec, lru + LRU_ACTIVE, zone, -delta);
+		}
+	}
+
+	WRITE_ONCE(lrugen->max_seq, lrugen->max_seq + 1);
+unlock:
+	spin_unlock_irq(&pgdat->lru_lock);
+}
+
+static void lru_gen_age(struct lruvec *lruvec, struct mem_cgroup *memcg,
+			bool can_swap)
+{
+	unsigned long max_seq = READ_ONCE(lruvec->lrugen.max_seq);
+
+	lru_gen_walk_mms(lruvec, memcg, max_seq, can_swap);
+	inc_max_seq(lruvec, max_seq);
+}
+
+/******************************************************************************
+ *                          the eviction
+ ******************************************************************************/
+
+/*
+ * Returns true if @page was moved out of the oldest generation rather
+ * than considered for eviction.
+ */
+static bool sort_page(struct lruvec *lruvec, struct page *page, int tier_idx)
+{
+	bool success;
+	int gen;
+	int type = page_is_file_cache(page);
+	int zone = page_zonenum(page);
+	int tier = lru_tier_from_refs(page_lru_refs(page));
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+
+	VM_BUG_ON_PAGE(!PageLRU(page), page);
+
+	/* mlocked or otherwise unevictable by now */
+	if (!page_evictable(page)) {
+		success = lru_gen_del_page(lruvec, page);
+		VM_BUG_ON_PAGE(!success, page);
+		SetPageUnevictable(page);
+		add_page_to_lru_list(page, lruvec, LRU_UNEVICTABLE);
+		return true;
+	}
+
+	/* protected by its tier */
+	if (tier > tier_idx) {
+		gen = page_inc_gen(lruvec, page, false);
+		list_move_tail(&page->lru, &lrugen->lists[gen][type][zone]);
+		WRITE_ONCE(lrugen->protected[type][tier - 1],
+			   lrugen->protected[type][tier - 1] +
+			   hpage_nr_pages(page));
+		return true;
+	}
+
+	/* waiting for writeback */
+	if (PageLocked(page) || PageWriteback(page) ||
+	    (type == LRU_GEN_FILE && PageDirty(page))) {
+		gen = page_inc_gen(lruvec, page, true);
+		list_move(&page->lru, &lrugen->lists[gen][type][zone]);
+		return true;
+	}
+
+	return false;
+}
+
+static bool isolate_page(struct lruvec *lruvec, struct page *page,
+			 struct scan_control *sc)
+{
+	bool success;
+
+	if (!sc->may_unmap && page_mapped(page))
+		return false;
+
+	if (!(sc->may_writepage && (sc->gfp_mask & __GFP_IO)) &&
+	    (PageDirty(page) || (PageAnon(page) && !PageSwapCache(page))))
+		return false;
+
+	if (!get_page_unless_zero(page))
+		return false;
+
+	ClearPageLRU(page);
+
+	/* a single access through a file descriptor does not count */
+	if (!PageReferenced(page))
+		set_mask_bits(&page->flags, LRU_REFS_MASK, 0);
+
+	/* for shrink_page_list() */
+	ClearPageReclaim(page);
+	ClearPageReferenced(page);
+
+	success = lru_gen_del_page(lruvec, page);
+	VM_BUG_ON_PAGE(!success, page);
+
+	return true;
+}
+
+static int scan_pages(struct lruvec *lruvec, struct scan_control *sc,
+		      int type, int tier, struct list_head *list,
+		      int *nr_taken)
+{
+	int zone;
+	int gen;
+	int scanned = 0;
+	int isolated = 0;
+	int remaining = MAX_LRU_BATCH;
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	struct pglist_data *pgdat = lruvec_pgdat(lruvec);
+
+	if (get_nr_gens(lruvec, type) == MIN_NR_GENS)
+		return 0;
+
+	gen = lru_gen_from_seq(lrugen->min_seq[type]);
+
+	for (zone = sc->reclaim_idx; zone >= 0; zone--) {
+		LIST_HEAD(moved);
+		int skipped = 0;
+		struct list_head *head = &lrugen->lists[gen][type][zone];
+
+		while (!list_empty(head)) {
+			struct page *page = lru_to_page(head);
+			int delta = hpage_nr_pages(page);
+
+			scanned += delta;
+
+			if (sort_page(lruvec, page, tier))
+				;
+			else if (isolate_page(lruvec, page, sc)) {
+				list_add(&page->lru, list);
+				isolated += delta;
+			} else {
+				list_move(&page->lru, &moved);
+				skipped += delta;
+			}
+
+			if (!--remaining ||
+			    max(isolated, skipped) >= MIN_LRU_BATCH)
+				break;
+		}
+
+		/* retry the skipped pages after the rest of the generation */
+		if (skipped)
+			list_splice(&moved, head);
+
+		if (!remaining || isolated >= MIN_LRU_BATCH)
+			break;
+	}
+
+	if (global_reclaim(sc)) {
+		__mod_node_page_state(pgdat, NR_PAGES_SCANNED, scanned);
+		if (current_is_kswapd())
+			__count_vm_events(PGSCAN_KSWAPD, scanned);
+		else
+			__count_vm_events(PGSCAN_DIRECT, scanned);
+	}
+	__mod_node_page_state(pgdat, NR_ISOLATED_ANON + type, isolated);
+	*nr_taken = isolated;
+
+	return scanned;
+}
+
+static int get_tier_idx(struct lruvec *lruvec, int type, int swappiness)
+{
+	int tier;
+	struct ctrl_pos sp, pv;
+	int gain[ANON_AND_FILE] = { swappiness, 200 - swappiness };
+
+	/*
+	 * Protect the tiers of @type that refault more than the first tier
+	 * of the other type: the eviction stops at the first tier that
+	 * does not.
+	 */
+	read_ctrl_pos(lruvec, !type, 0, gain[!type], &sp);
+	for (tier = 1; tier < MAX_NR_TIERS; tier++) {
+		read_ctrl_pos(lruvec, type, tier, gain[type], &pv);
+		if (!positive_ctrl_err(&sp, &pv))
+			break;
+	}
+
+	return tier - 1;
+}
+
+static int get_type_to_scan(struct lruvec *lruvec, int swappiness)
+{
+	struct ctrl_pos sp, pv;
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+
+	if (!swappiness)
+		return LRU_GEN_FILE;
+
+	/* keep anon pages from falling behind, see try_to_inc_min_seq() */
+	if (lrugen->min_seq[LRU_GEN_ANON] < lrugen->min_seq[LRU_GEN_FILE])
+		return LRU_GEN_ANON;
+
+	/* evict file pages unless they refault more than anon pages */
+	read_ctrl_pos(lruvec, LRU_GEN_ANON, 0, swappiness, &sp);
+	read_ctrl_pos(lruvec, LRU_GEN_FILE, 0, 200 - swappiness, &pv);
+
+	return positive_ctrl_err(&sp, &pv) ? LRU_GEN_FILE : LRU_GEN_ANON;
+}
+
+static int isolate_pages(struct lruvec *lruvec, struct scan_control *sc,
+			 int swappiness, int *type_scanned,
+			 struct list_head *list, int *nr_taken)
+{
+	int i;
+	int type = get_type_to_scan(lruvec, swappiness);
+	int scanned = 0;
+
+	for (i = !swappiness; i < ANON_AND_FILE; i++) {
+		int tier = get_tier_idx(lruvec, type, swappiness);
+
+		scanned = scan_pages(lruvec, sc, type, tier, list, nr_taken);
+		if (scanned)
+			break;
+
+		type = !type;
+	}
+
+	*type_scanned = type;
+
+	return scanned;
+}
+
+static bool should_run_aging(struct lruvec *lruvec, bool can_swap)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+
+	/* only the two youngest generations are left to evict from */
+	return lrugen->min_seq[!can_swap] + MIN_NR_GENS > lrugen->max_seq;
+}
+
+static int evict_pages(struct lruvec *lruvec, struct mem_cgroup *memcg,
+		       struct scan_control *sc, int swappiness)
+{
+	int type;
+	int scanned;
+	int nr_taken = 0;
+	bool need_aging;
+	unsigned long reclaimed;
+	unsigned long nr_dirty = 0, nr_unqueued_dirty = 0, nr_congested = 0;
+	unsigned long nr_writeback = 0, nr_immediate = 0, nr_pageout = 0;
+	LIST_HEAD(list);
+	struct pglist_data *pgdat = lruvec_pgdat(lruvec);
+
+	spin_lock_irq(&pgdat->lru_lock);
+	try_to_inc_min_seq(lruvec, swappiness);
+	need_aging = should_run_aging(lruvec, swappiness);
+	spin_unlock_irq(&pgdat->lru_lock);
+
+	if (need_aging)
+		lru_gen_age(lruvec, memcg, swappiness);
+
+	spin_lock_irq(&pgdat->lru_lock);
+	scanned = isolate_pages(lruvec, sc, swappiness, &type, &list,
+				&nr_taken);
+	spin_unlock_irq(&pgdat->lru_lock);
+
+	if (list_empty(&list))
+		return scanned;
+
+	reclaimed = shrink_page_list(&list, pgdat, sc, TTU_UNMAP,
+				     &nr_dirty, &nr_unqueued_dirty,
+				     &nr_congested, &nr_writeback,
+				     &nr_immediate, &nr_pageout, false);
+
+	spin_lock_irq(&pgdat->lru_lock);
+	if (global_reclaim(sc)) {
+		if (current_is_kswapd())
+			__count_vm_events(PGSTEAL_KSWAPD, reclaimed);
+		else
+			__count_vm_events(PGSTEAL_DIRECT, reclaimed);
+	}
+
+	putback_inactive_pages(lruvec, &list);
+	__mod_node_page_state(pgdat, NR_ISOLATED_ANON + type, -nr_taken);
+	spin_unlock_irq(&pgdat->lru_lock);
+
+	mem_cgroup_uncharge_list(&list);
+	free_hot_cold_page_list(&list, true);
+
+	sc->nr_reclaimed += reclaimed;
+
+	return scanned;
+}
+
+static unsigned long lru_gen_nr_pages(struct lruvec *lruvec,
+				      struct scan_control *sc, bool can_swap)
+{
+	int gen, type, zone;
+	unsigned long seq;
+	unsigned long total = 0;
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+
+	for (type = !can_swap; type < ANON_AND_FILE; type++) {
+		for (seq = READ_ONCE(lrugen->min_seq[type]);
+		     seq <= READ_ONCE(lrugen->max_seq); seq++) {
+			gen = lru_gen_from_seq(seq);
+
+			for (zone = 0; zone <= sc->reclaim_idx; zone++)
+				total += max(READ_ONCE(lrugen->nr_pages[gen][type][zone]),
+					     0L);
+		}
+	}
+
+	return total;
+}
+
+/*
+ * Reclaims from @lruvec if it is on the multi-gen LRU and returns true,
+ * returns false to have the classic LRU handle it.
+ */
+static bool lru_gen_shrink_lruvec(struct lruvec *lruvec,
+				  struct mem_cgroup *memcg,
+				  struct scan_control *sc,
+				  unsigned long *lru_pages)
+{
+	struct blk_plug plug;
+	unsigned long nr_to_scan;
+	unsigned long scanned = 0;
+	unsigned long nr_reclaimed = sc->nr_reclaimed;
+	int swappiness = get_swappiness(memcg, sc);
+
+	if (!READ_ONCE(lruvec->lrugen.enabled))
+		return false;
+
+	*lru_pages = lru_gen_nr_pages(lruvec, sc, swappiness);
+
+	nr_to_scan = *lru_pages >> sc->priority;
+	if (!nr_to_scan && !global_reclaim(sc))
+		nr_to_scan = min(*lru_pages, SWAP_CLUSTER_MAX);
+
+	lru_add_drain();
+
+	blk_start_plug(&plug);
+	while (scanned < nr_to_scan) {
+		int delta = evict_pages(lruvec, memcg, sc, swappiness);
+
+		if (!delta)
+			break;
+
+		scanned += delta;
+		if (sc->nr_reclaimed - nr_reclaimed >= sc->nr_to_reclaim)
+			break;
+
+		cond_resched();
+	}
+	blk_finish_plug(&plug);
+
+	return true;
+}
+
+/******************************************************************************
+ *                          the runtime switch
+ ******************************************************************************/
+
+static bool fill_evictable(struct lruvec *lruvec)
+{
+	enum lru_list lru;
+	int remaining = MAX_LRU_BATCH;
+
+	for_each_evictable_lru(lru) {
+		struct list_head *head = &lruvec->lists[lru];
+
+		while (!list_empty(head)) {
+			struct page *page = lru_to_page(head);
+
+			VM_BUG_ON_PAGE(PageUnevictable(page), page);
+			VM_BUG_ON_PAGE(PageActive(page) != is_active_lru(lru), page);
+			VM_BUG_ON_PAGE(page_lru_gen(page) >= 0, page);
+
+			del_page_from_lru_list(page, lruvec, lru);
+			add_page_to_lru_list(page, lruvec, lru);
+
+			if (!--remaining)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+static bool drain_evictable(struct lruvec *lruvec)
+{
+	int gen, type, zone;
+	int remaining = MAX_LRU_BATCH;
+
+	for (gen = 0; gen < MAX_NR_GENS; gen++) {
+		for (type = 0; type < ANON_AND_FILE; type++) {
+			for (zone = 0; zone < MAX_NR_ZONES; zone++) {
+				struct list_head *head;
+
+				head = &lruvec->lrugen.lists[gen][type][zone];
+				while (!list_empty(head)) {
+					struct page *page = lru_to_page(head);
+
+					VM_BUG_ON_PAGE(page_lru_gen(page) != gen,
+						       page);
+
+					/* picks up PG_active if still young */
+					del_page_from_lru_list(page, lruvec,
+							       page_lru(page));
+					add_page_to_lru_list(page, lruvec,
+							     page_lru(page));
+
+					if (!--remaining)
+						return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Moves the pages of every lruvec between the classic and the multi-gen
+ * LRU lists. The lru_lock is dropped every MAX_LRU_BATCH pages; reclaim
+ * running in the meantime only sees the lists its lruvec is switched to.
+ */
+static void lru_gen_change_state(bool enable)
+{
+	static DEFINE_MUTEX(state_mutex);
+	struct mem_cgroup *memcg;
+
+	get_online_mems();
+	mutex_lock(&state_mutex);
+
+	if (enable == lru_gen_enabled())
+		goto unlock;
+
+	if (enable)
+		static_branch_enable(&lru_gen_key);
+	else
+		static_branch_disable(&lru_gen_key);
+
+	memcg = mem_cgroup_iter(NULL, NULL, NULL);
+	do {
+		struct pglist_data *pgdat;
+
+		for_each_online_pgdat(pgdat) {
+			struct lruvec *lruvec = mem_cgroup_lruvec(pgdat, memcg);
+
+			spin_lock_irq(&pgdat->lru_lock);
+			WRITE_ONCE(lruvec->lrugen.enabled, enable);
+			while (!(enable ? fill_evictable(lruvec) :
+					  drain_evictable(lruvec))) {
+				spin_unlock_irq(&pgdat->lru_lock);
+				cond_resched();
+				spin_lock_irq(&pgdat->lru_lock);
+			}
+			spin_unlock_irq(&pgdat->lru_lock);
+		}
+
+		cond_resched();
+	} while ((memcg = mem_cgroup_iter(NULL, memcg, NULL)));
+unlock:
+	mutex_unlock(&state_mutex);
+	put_online_mems();
+}
+
+void lru_gen_init_lruvec(struct lruvec *lruvec)
+{
+	int gen, type, zone;
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+
+	lrugen->max_seq = MIN_NR_GENS + 1;
+	lrugen->enabled = lru_gen_enabled();
+
+	for (gen = 0; gen < MAX_NR_GENS; gen++)
+		for (type = 0; type < ANON_AND_FILE; type++)
+			for (zone = 0; zone < MAX_NR_ZONES; zone++)
+				INIT_LIST_HEAD(&lrugen->lists[gen][type][zone]);
+}
+
+#ifdef CONFIG_SYSFS
+static ssize_t enabled_show(struct kobject *kobj,
+			    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", lru_gen_enabled());
+}
+
+static ssize_t enabled_store(struct kobject *kobj,
+			     struct kobj_attribute *attr,
+			     const char *buf, size_t count)
+{
+	bool enable;
+
+	if (kstrtobool(buf, &enable))
+		return -EINVAL;
+
+	lru_gen_change_state(enable);
+
+	return count;
+}
+
+static struct kobj_attribute lru_gen_enabled_attr =
+	__ATTR(enabled, 0644, enabled_show, enabled_store);
+
+static struct attribute *lru_gen_attrs[] = {
+	&lru_gen_enabled_attr.attr,
+	NULL,
+};
+
+static struct attribute_group lru_gen_attr_group = {
+	.attrs = lru_gen_attrs,
+	.name = "lru_gen",
+};
+
+static int __init lru_gen_sysfs_init(void)
+{
+	int err;
+
+	err = sysfs_create_group(mm_kobj, &lru_gen_attr_group);
+	if (err)
+		pr_err("lru_gen: register sysfs failed\n");
+
+	return err;
+}
+late_initcall(lru_gen_sysfs_init);
+#endif /* CONFIG_SYSFS */
+
+#else /* !CONFIG_LRU_GEN */
+
+static bool lru_gen_shrink_lruvec(struct lruvec *lruvec,
+				  struct mem_cgroup *memcg,
+				  struct scan_control *sc,
+				  unsigned long *lru_pages)
+{
+	return false;
+}
+
+#endif /* CONFIG_LRU_GEN */
+
 /*
  * This is a basic per-node page freer.  Used by both kswapd and direct reclaim.
  */
@@ -2419,6 +3480,9 @@ static void shrink_node_memcg(struct pglist_data *pgdat, struct mem_cgroup *memc
 	struct blk_plug plug;
 	bool scan_adjusted;
 
+	if (lru_gen_shrink_lruvec(lruvec, memcg, sc, lru_pages))
+		return;
+
 	get_scan_count(lruvec, memcg, sc, nr, lru_pages);
 
 	/* Record the original scan target for proportional adjustments later */
@@ -2647,10 +3711,15 @@ static bool shrink_node(pg_data_t *pgdat, struct scan_control *sc)
 					    memcg, sc->nr_scanned - scanned,
 					    lru_pages);
 
-			/* Record the group's reclaim efficiency */
-			vmpressure(sc->gfp_mask, memcg, false,
-				   sc->nr_scanned - scanned,
-				   sc->nr_reclaimed - reclaimed);
+			/*
+			 * Record the group's reclaim efficiency. Proactive
+			 * reclaim is not a sign of memory pressure and must
+			 * not wake up listeners such as the lowmemorykiller.
+			 */
+			if (!sc->proactive)
+				vmpressure(sc->gfp_mask, memcg, false,
+					   sc->nr_scanned - scanned,
+					   sc->nr_reclaimed - reclaimed);
 
 			/*
 			 * Direct reclaim and kswapd have to scan all memory
@@ -2684,9 +3753,10 @@ static bool shrink_node(pg_data_t *pgdat, struct scan_control *sc)
 		}
 
 		/* Record the subtree's reclaim efficiency */
-		vmpressure(sc->gfp_mask, sc->target_mem_cgroup, true,
-			   sc->nr_scanned - nr_scanned,
-			   sc->nr_reclaimed - nr_reclaimed);
+		if (!sc->proactive)
+			vmpressure(sc->gfp_mask, sc->target_mem_cgroup, true,
+				   sc->nr_scanned - nr_scanned,
+				   sc->nr_reclaimed - nr_reclaimed);
 
 		if (sc->nr_reclaimed - nr_reclaimed)
 			reclaimable = true;
@@ -2860,8 +3930,9 @@ static unsigned long do_try_to_free_pages(struct zonelist *zonelist,
 		__count_zid_vm_events(ALLOCSTALL, sc->reclaim_idx, 1);
 
 	do {
-		vmpressure_prio(sc->gfp_mask, sc->target_mem_cgroup,
-				sc->priority);
+		if (!sc->proactive)
+			vmpressure_prio(sc->gfp_mask, sc->target_mem_cgroup,
+					sc->priority);
 		sc->nr_scanned = 0;
 		shrink_zones(zonelist, sc);
 
@@ -3125,13 +4196,16 @@ unsigned long mem_cgroup_shrink_node(struct mem_cgroup *memcg,
 	return sc.nr_reclaimed;
 }
 
-unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *memcg,
-					   unsigned long nr_pages,
-					   gfp_t gfp_mask,
-					   bool may_swap)
+static unsigned long __try_to_free_mem_cgroup_pages(struct mem_cgroup *memcg,
+						    unsigned long nr_pages,
+						    gfp_t gfp_mask,
+						    bool may_swap,
+						    bool proactive,
+						    int *swappiness)
 {
 	struct zonelist *zonelist;
 	unsigned long nr_reclaimed;
+	unsigned long pflags;
 	int nid;
 	struct scan_control sc = {
 		.nr_to_reclaim = max(nr_pages, SWAP_CLUSTER_MAX),
@@ -3143,6 +4217,8 @@ unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *memcg,
 		.may_writepage = !laptop_mode,
 		.may_unmap = 1,
 		.may_swap = may_swap,
+		.proactive = proactive,
+		.proactive_swappiness = swappiness,
 	};
 
 	adjust_scan_control(&sc);
@@ -3160,14 +4236,44 @@ unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *memcg,
 					    sc.gfp_mask,
 					    sc.reclaim_idx);
 
+	psi_memstall_enter(&pflags);
 	current->flags |= PF_MEMALLOC;
 	nr_reclaimed = do_try_to_free_pages(zonelist, &sc);
 	current->flags &= ~PF_MEMALLOC;
+	psi_memstall_leave(&pflags);
 
 	trace_mm_vmscan_memcg_reclaim_end(nr_reclaimed);
 
 	return nr_reclaimed;
 }
+
+unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *memcg,
+					   unsigned long nr_pages,
+					   gfp_t gfp_mask,
+					   bool may_swap)
+{
+	return __try_to_free_mem_cgroup_pages(memcg, nr_pages, gfp_mask,
+					      may_swap, false, NULL);
+}
+
+/**
+ * proactive_reclaim_mem_cgroup_pages - reclaim from a memcg on request
+ * @memcg: the memcg to reclaim from, including its descendants
+ * @nr_pages: number of pages to try to reclaim
+ * @swappiness: swappiness to use instead of the memcg's, or NULL
+ *
+ * Same as try_to_free_mem_cgroup_pages() with swapping allowed, except
+ * that the reclaim does not report vmpressure events.
+ *
+ * Returns the number of pages reclaimed.
+ */
+unsigned long proactive_reclaim_mem_cgroup_pages(struct mem_cgroup *memcg,
+						 unsigned long nr_pages,
+						 int *swappiness)
+{
+	return __try_to_free_mem_cgroup_pages(memcg, nr_pages, GFP_KERNEL,
+					      true, true, swappiness);
+}
 #endif
 
 static void age_active_anon(struct pglist_data *pgdat,
@@ -3175,7 +4281,8 @@ static void age_active_anon(struct pglist_data *pgdat,
 {
 	struct mem_cgroup *memcg;
 
-	if (!total_swap_pages)
+	/* the multi-gen LRU ages anon pages along with file pages */
+	if (!total_swap_pages || lru_gen_enabled())
 		return;
 
 	memcg = mem_cgroup_iter(NULL, NULL, NULL);
@@ -3312,6 +4419,7 @@ static int balance_pgdat(pg_data_t *pgdat, int order, int classzone_idx)
 	int i;
 	unsigned long nr_soft_reclaimed;
 	unsigned long nr_soft_scanned;
+	unsigned long pflags;
 	struct zone *zone;
 	struct scan_control sc = {
 		.gfp_mask = GFP_KERNEL,
@@ -3322,6 +4430,7 @@ static int balance_pgdat(pg_data_t *pgdat, int order, int classzone_idx)
 		.may_swap = 1,
 	};
 	adjust_scan_control(&sc);
+	psi_memstall_enter(&pflags);
 	count_vm_event(PAGEOUTRUN);
 
 	do {
@@ -3426,6 +4535,7 @@ static int balance_pgdat(pg_data_t *pgdat, int order, int classzone_idx)
 		pgdat->kswapd_failures++;
 
 out:
+	psi_memstall_leave(&pflags);
 	/*
 	 * Return the order kswapd stopped reclaiming at as
 	 * prepare_kswapd_sleep() takes it into account. If another caller
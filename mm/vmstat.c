@@ -1020,6 +1020,11 @@ const char * const vmstat_text[] = {
 	"drop_pagecache",
 	"drop_slab",
 
+	"zone_lock_alloc",
+	"zone_lock_free",
+	"pcp_alloc_highorder",
+	"pcp_free_highorder",
+
 #ifdef CONFIG_NUMA_BALANCING
 	"numa_pte_updates",
 	"numa_huge_pte_updates",
@@ -1090,6 +1095,10 @@ const char * const vmstat_text[] = {
 	"vmacache_find_calls",
 	"vmacache_find_hits",
 #endif
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	"speculative_pgfault",
+	"speculative_pgfault_abort",
+#endif
 #endif /* CONFIG_VM_EVENTS_COUNTERS */
 };
 #endif /* CONFIG_PROC_FS || CONFIG_SYSFS || CONFIG_NUMA */
@@ -12,6 +12,7 @@
 #include <linux/swap.h>
 #include <linux/fs.h>
 #include <linux/mm.h>
+#include <linux/mm_inline.h>
 
 /*
  *		Double CLOCK lists
@@ -141,8 +142,11 @@
  *
  *		Implementation
  *
- * For each node's file LRU lists, a counter for inactive evictions
- * and activations is maintained (node->inactive_age).
+ * For each node's LRU lists, a counter for inactive evictions and
+ * activations is maintained (node->inactive_age).  Anonymous pages
+ * take part as well: their shadow entries are stored in the swap
+ * cache slot of the swap entry they were written to, and they are
+ * cleared when that swap entry is freed.
  *
  * On eviction, a snapshot of this counter (along with some bits to
  * identify the node) is stored in the now empty page cache radix tree
@@ -194,6 +198,103 @@ static void unpack_shadow(void *shadow, int *memcgidp, pg_data_t **pgdat,
 	*evictionp = entry << bucket_order;
 }
 
+#ifdef CONFIG_LRU_GEN
+
+/*
+ * The multi-gen LRU does not measure refault distances. Its shadow
+ * entries record the oldest generation at eviction time together with
+ * the access count of the page, and a refault only counts against the
+ * tier the page was evicted from while that generation is still the
+ * oldest one. The per-tier refault rates are then compared in reclaim,
+ * see get_type_to_scan() in vmscan.c.
+ */
+static void *lru_gen_eviction(struct page *page)
+{
+	int type = page_is_file_cache(page);
+	int refs = page_lru_refs(page);
+	int tier = lru_tier_from_refs(refs);
+	struct mem_cgroup *memcg = page_memcg(page);
+	struct pglist_data *pgdat = page_pgdat(page);
+	struct lru_gen_struct *lrugen;
+	unsigned long token;
+
+	lrugen = &mem_cgroup_lruvec(pgdat, memcg)->lrugen;
+	token = (READ_ONCE(lrugen->min_seq[type]) << LRU_REFS_WIDTH) | refs;
+	atomic_long_add(hpage_nr_pages(page), &lrugen->evicted[type][tier]);
+
+	return pack_shadow(mem_cgroup_id(memcg), pgdat, token << bucket_order);
+}
+
+static bool lru_gen_refault(struct page *page, void *shadow)
+{
+	int type = page_is_file_cache(page);
+	struct lru_gen_struct *lrugen;
+	struct pglist_data *pgdat;
+	struct mem_cgroup *memcg;
+	unsigned long token;
+	unsigned long min_seq;
+	int memcgid, refs;
+
+	unpack_shadow(shadow, &memcgid, &pgdat, &token);
+	token >>= bucket_order;
+
+	rcu_read_lock();
+	/* see workingset_refault() */
+	memcg = mem_cgroup_from_id(memcgid);
+	if (!mem_cgroup_disabled() && !memcg)
+		goto out;
+
+	lrugen = &mem_cgroup_lruvec(pgdat, memcg)->lrugen;
+	min_seq = READ_ONCE(lrugen->min_seq[type]);
+	if ((token >> LRU_REFS_WIDTH) !=
+	    (min_seq & (EVICTION_MASK >> LRU_REFS_WIDTH)))
+		goto out;
+
+	refs = token & (BIT(LRU_REFS_WIDTH) - 1);
+	atomic_long_add(hpage_nr_pages(page),
+			&lrugen->refaulted[type][lru_tier_from_refs(refs)]);
+	inc_node_state(pgdat, WORKINGSET_REFAULT);
+
+	/* restore the access count, so the page lands in the same tier */
+	if (refs) {
+		set_mask_bits(&page->flags, LRU_REFS_MASK,
+			      (unsigned long)refs << LRU_REFS_PGOFF);
+		SetPageReferenced(page);
+	}
+out:
+	rcu_read_unlock();
+	return false;
+}
+
+#else /* !CONFIG_LRU_GEN */
+
+static void *lru_gen_eviction(struct page *page)
+{
+	return NULL;
+}
+
+static bool lru_gen_refault(struct page *page, void *shadow)
+{
+	return false;
+}
+
+#endif /* CONFIG_LRU_GEN */
+
+/**
+ * workingset_age_nonresident - age non-resident entries as LRU ages
+ * @lruvec: the lruvec that was aged
+ * @nr_pages: the number of pages to count
+ *
+ * As in-memory pages are aged, non-resident pages need to be aged as
+ * well, in order for the refault distances later on to be comparable
+ * to the in-memory dimensions. This function allows reclaim and LRU
+ * operations to drive the non-resident aging along in parallel.
+ */
+void workingset_age_nonresident(struct lruvec *lruvec, unsigned long nr_pages)
+{
+	atomic_long_add(nr_pages, &lruvec->inactive_age);
+}
+
 /**
  * workingset_eviction - note the eviction of a page from memory
  * @mapping: address space the page was backing
@@ -215,24 +316,33 @@ void *workingset_eviction(struct address_space *mapping, struct page *page)
 	VM_BUG_ON_PAGE(page_count(page), page);
 	VM_BUG_ON_PAGE(!PageLocked(page), page);
 
+	if (lru_gen_enabled())
+		return lru_gen_eviction(page);
+
 	lruvec = mem_cgroup_lruvec(pgdat, memcg);
-	eviction = atomic_long_inc_return(&lruvec->inactive_age);
+	workingset_age_nonresident(lruvec, hpage_nr_pages(page));
+	eviction = atomic_long_read(&lruvec->inactive_age);
 	return pack_shadow(memcgid, pgdat, eviction);
 }
 
 /**
  * workingset_refault - evaluate the refault of a previously evicted page
+ * @page: the freshly allocated replacement page
  * @shadow: shadow entry of the evicted page
  *
  * Calculates and evaluates the refault distance of the previously
- * evicted page in the context of the node it was allocated in.
+ * evicted page in the context of the node it was allocated in. A
+ * refault that qualifies for activation is also charged as reclaim
+ * cost to the LRU type of @page, so that get_scan_count() can steer
+ * pressure away from the type that is thrashing.
  *
  * Returns %true if the page should be activated, %false otherwise.
  */
-bool workingset_refault(void *shadow)
+bool workingset_refault(struct page *page, void *shadow)
 {
+	bool file = page_is_file_cache(page);
 	unsigned long refault_distance;
-	unsigned long active_file;
+	unsigned long workingset_size;
 	struct mem_cgroup *memcg;
 	unsigned long eviction;
 	struct lruvec *lruvec;
@@ -240,6 +350,9 @@ bool workingset_refault(void *shadow)
 	struct pglist_data *pgdat;
 	int memcgid;
 
+	if (lru_gen_enabled())
+		return lru_gen_refault(page, shadow);
+
 	unpack_shadow(shadow, &memcgid, &pgdat, &eviction);
 
 	rcu_read_lock();
@@ -266,8 +379,6 @@ bool workingset_refault(void *shadow)
 	}
 	lruvec = mem_cgroup_lruvec(pgdat, memcg);
 	refault = atomic_long_read(&lruvec->inactive_age);
-	active_file = lruvec_lru_size(lruvec, LRU_ACTIVE_FILE, MAX_NR_ZONES);
-	rcu_read_unlock();
 
 	/*
 	 * The unsigned subtraction here gives an accurate distance
@@ -289,11 +400,44 @@ bool workingset_refault(void *shadow)
 
 	inc_node_state(pgdat, WORKINGSET_REFAULT);
 
-	if (refault_distance <= active_file) {
-		inc_node_state(pgdat, WORKINGSET_ACTIVATE);
-		return true;
+	/*
+	 * Compare the distance to the existing workingset size. We
+	 * don't activate pages that couldn't stay resident even if
+	 * all the memory was available to the workingset. Whether
+	 * workingset competition needs to consider anon or not
+	 * depends on having swap.
+	 */
+	workingset_size = lruvec_lru_size(lruvec, LRU_ACTIVE_FILE, MAX_NR_ZONES);
+	if (!file) {
+		workingset_size += lruvec_lru_size(lruvec, LRU_INACTIVE_FILE,
+						   MAX_NR_ZONES);
 	}
-	return false;
+	if (get_nr_swap_pages() > 0) {
+		workingset_size += lruvec_lru_size(lruvec, LRU_ACTIVE_ANON,
+						   MAX_NR_ZONES);
+		if (file) {
+			workingset_size += lruvec_lru_size(lruvec,
+						LRU_INACTIVE_ANON, MAX_NR_ZONES);
+		}
+	}
+	if (refault_distance > workingset_size) {
+		rcu_read_unlock();
+		return false;
+	}
+
+	/*
+	 * The page is going to be activated: age the LRU it was
+	 * evicted from, and charge the refault to its type as
+	 * reclaim cost.
+	 */
+	workingset_age_nonresident(lruvec, hpage_nr_pages(page));
+	spin_lock_irq(&pgdat->lru_lock);
+	lru_note_cost(lruvec, file, hpage_nr_pages(page));
+	spin_unlock_irq(&pgdat->lru_lock);
+	rcu_read_unlock();
+
+	inc_node_state(pgdat, WORKINGSET_ACTIVATE);
+	return true;
 }
 
 /**
@@ -317,7 +461,7 @@ void workingset_activation(struct page *page)
 	if (!mem_cgroup_disabled() && !memcg)
 		goto out;
 	lruvec = mem_cgroup_lruvec(page_pgdat(page), memcg);
-	atomic_long_inc(&lruvec->inactive_age);
+	workingset_age_nonresident(lruvec, hpage_nr_pages(page));
 out:
 	rcu_read_unlock();
 }
@@ -348,12 +492,22 @@ static unsigned long count_shadow_nodes(struct shrinker *shrinker,
 	shadow_nodes = list_lru_shrink_count(&workingset_shadow_nodes, sc);
 	local_irq_enable();
 
+	/*
+	 * With swap, anon pages leave shadow entries in the swap
+	 * cache as well, so they count towards the budget.
+	 */
 	if (sc->memcg) {
 		pages = mem_cgroup_node_nr_lru_pages(sc->memcg, sc->nid,
-						     LRU_ALL_FILE);
+				total_swap_pages ? LRU_ALL : LRU_ALL_FILE);
 	} else {
-		pages = node_page_state(NODE_DATA(sc->nid), NR_ACTIVE_FILE) +
-			node_page_state(NODE_DATA(sc->nid), NR_INACTIVE_FILE);
+		pg_data_t *pgdat = NODE_DATA(sc->nid);
+
+		pages = node_page_state(pgdat, NR_ACTIVE_FILE) +
+			node_page_state(pgdat, NR_INACTIVE_FILE);
+		if (total_swap_pages) {
+			pages += node_page_state(pgdat, NR_ACTIVE_ANON) +
+				 node_page_state(pgdat, NR_INACTIVE_ANON);
+		}
 	}
 
 	/*
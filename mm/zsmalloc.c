@@ -53,6 +53,8 @@
 #include <linux/mount.h>
 #include <linux/migrate.h>
 #include <linux/pagemap.h>
+#include <linux/workqueue.h>
+#include <linux/moduleparam.h>
 
 #define ZSPAGE_MAGIC	0x58
 
@@ -113,6 +115,12 @@
  */
 #define OBJ_ALLOCATED_TAG 1
 #define OBJ_TAG_BITS 1
+/*
+ * Set next to OBJ_ALLOCATED_TAG when the object was freed while its
+ * zspage was being reclaimed (see zs_reclaim_page). The object and its
+ * handle stay valid until the reclaimer releases them.
+ */
+#define OBJ_DEFERRED_TAG 2
 #define OBJ_INDEX_BITS	(BITS_PER_LONG - _PFN_BITS - OBJ_TAG_BITS)
 #define OBJ_INDEX_MASK	((_AC(1, UL) << OBJ_INDEX_BITS) - 1)
 
@@ -189,6 +197,23 @@ static int zs_size_classes;
  */
 static const int fullness_threshold_frac = 4;
 
+/*
+ * Background compaction is kicked from zs_free() once the share of
+ * allocated but unused objects in a size class reaches
+ * compact_frag_threshold percent (0 disables it). The worker may use
+ * at most compact_cpu_budget percent of one CPU over time; after a
+ * pass that took T, the next one is deferred by T * (100 - b) / b.
+ */
+static unsigned int compact_frag_threshold = 20;
+module_param(compact_frag_threshold, uint, 0644);
+MODULE_PARM_DESC(compact_frag_threshold,
+		 "Per-class wasted object percentage that triggers background compaction (0 = off)");
+
+static unsigned int compact_cpu_budget = 5;
+module_param(compact_cpu_budget, uint, 0644);
+MODULE_PARM_DESC(compact_cpu_budget,
+		 "Percentage of one CPU background compaction may use (1-100)");
+
 struct size_class {
 	spinlock_t lock;
 	struct list_head fullness_list[NR_ZS_FULLNESS];
@@ -259,6 +284,19 @@ struct zs_pool {
 	 * and unregister_shrinker() will not Oops.
 	 */
 	bool shrinker_enabled;
+
+#ifdef CONFIG_ZPOOL
+	/* zspages in allocation order, only kept for evictable zpools */
+	struct list_head lru;
+	spinlock_t lru_lock;
+	const struct zpool_ops *zpool_ops;
+	struct zpool *zpool;
+#endif
+
+	/* Background compaction, see compact_frag_threshold */
+	struct delayed_work compact_work;
+	/* jiffies before which compact_work must not run again */
+	unsigned long compact_next;
 #ifdef CONFIG_ZSMALLOC_STAT
 	struct dentry *stat_dentry;
 #endif
@@ -283,11 +321,15 @@ struct zspage {
 		unsigned int class:CLASS_BITS + 1;
 		unsigned int isolated:ISOLATED_BITS;
 		unsigned int magic:MAGIC_VAL_BITS;
+		unsigned int under_reclaim:1;
 	};
 	unsigned int inuse;
 	unsigned int freeobj;
 	struct page *first_page;
 	struct list_head list; /* fullness list */
+#ifdef CONFIG_ZPOOL
+	struct list_head lru; /* pool->lru, protected by class->lock too */
+#endif
 #ifdef CONFIG_COMPACTION
 	rwlock_t lock;
 #endif
@@ -385,16 +427,25 @@ static void record_obj(unsigned long handle, unsigned long obj)
 
 #ifdef CONFIG_ZPOOL
 
+static int zs_reclaim_page(struct zs_pool *pool, unsigned int retries);
+
 static void *zs_zpool_create(const char *name, gfp_t gfp,
 			     const struct zpool_ops *zpool_ops,
 			     struct zpool *zpool)
 {
+	struct zs_pool *pool;
+
 	/*
 	 * Ignore global gfp flags: zs_malloc() may be invoked from
 	 * different contexts and its caller must provide a valid
 	 * gfp mask.
 	 */
-	return zs_create_pool(name);
+	pool = zs_create_pool(name);
+	if (pool && zpool_ops && zpool_ops->evict) {
+		pool->zpool_ops = zpool_ops;
+		pool->zpool = zpool;
+	}
+	return pool;
 }
 
 static void zs_zpool_destroy(void *pool)
@@ -416,7 +467,20 @@ static void zs_zpool_free(void *pool, unsigned long handle)
 static int zs_zpool_shrink(void *pool, unsigned int pages,
 			unsigned int *reclaimed)
 {
-	return -EINVAL;
+	unsigned int total = 0;
+	int ret = -EINVAL;
+
+	while (total < pages) {
+		ret = zs_reclaim_page(pool, 8);
+		if (ret < 0)
+			break;
+		total++;
+	}
+
+	if (reclaimed)
+		*reclaimed = total;
+
+	return ret;
 }
 
 static void *zs_zpool_map(void *pool, unsigned long handle,
@@ -667,6 +731,65 @@ static const struct file_operations zs_stat_size_ops = {
 	.release        = single_release,
 };
 
+/*
+ * Number of zspages in each class whose usage (inuse / objs_per_zspage)
+ * falls in 0-9%, 10-19%, ... 90-99% and 100%. The four fullness groups
+ * are too coarse to tell how much compaction could gain.
+ */
+#define ZS_USAGE_BUCKETS	11
+
+static int zs_stats_fullness_show(struct seq_file *s, void *v)
+{
+	int i, fg, b;
+	struct zs_pool *pool = s->private;
+	struct size_class *class;
+	struct zspage *zspage;
+	unsigned long hist[ZS_USAGE_BUCKETS];
+
+	seq_printf(s, " %5s %5s", "class", "size");
+	for (b = 0; b < ZS_USAGE_BUCKETS - 1; b++)
+		seq_printf(s, " %6d%%", b * 10);
+	seq_printf(s, " %6d%%\n", 100);
+
+	for (i = 0; i < zs_size_classes; i++) {
+		class = pool->size_class[i];
+
+		if (class->index != i)
+			continue;
+
+		memset(hist, 0, sizeof(hist));
+		spin_lock(&class->lock);
+		for (fg = ZS_EMPTY; fg < NR_ZS_FULLNESS; fg++) {
+			list_for_each_entry(zspage, &class->fullness_list[fg],
+					    list) {
+				b = get_zspage_inuse(zspage) * 10 /
+					class->objs_per_zspage;
+				hist[b]++;
+			}
+		}
+		spin_unlock(&class->lock);
+
+		seq_printf(s, " %5u %5u", i, class->size);
+		for (b = 0; b < ZS_USAGE_BUCKETS; b++)
+			seq_printf(s, " %7lu", hist[b]);
+		seq_puts(s, "\n");
+	}
+
+	return 0;
+}
+
+static int zs_stats_fullness_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, zs_stats_fullness_show, inode->i_private);
+}
+
+static const struct file_operations zs_stat_fullness_ops = {
+	.open           = zs_stats_fullness_open,
+	.read           = seq_read,
+	.llseek         = seq_lseek,
+	.release        = single_release,
+};
+
 static void zs_pool_stat_create(struct zs_pool *pool, const char *name)
 {
 	struct dentry *entry;
@@ -690,7 +813,14 @@ static void zs_pool_stat_create(struct zs_pool *pool, const char *name)
 				name, "classes");
 		debugfs_remove_recursive(pool->stat_dentry);
 		pool->stat_dentry = NULL;
+		return;
 	}
+
+	entry = debugfs_create_file("fullness", S_IFREG | S_IRUGO,
+			pool->stat_dentry, pool, &zs_stat_fullness_ops);
+	if (!entry)
+		pr_warn("%s: debugfs file entry <%s> creation failed\n",
+				name, "fullness");
 }
 
 static void zs_pool_stat_destroy(struct zs_pool *pool)
@@ -979,6 +1109,34 @@ int trylock_zspage(struct zspage *zspage)
 	return 0;
 }
 
+#ifdef CONFIG_ZPOOL
+/* Caller should hold class->lock */
+static void zs_lru_move_head(struct zs_pool *pool, struct zspage *zspage)
+{
+	if (!pool->zpool_ops)
+		return;
+
+	spin_lock(&pool->lru_lock);
+	list_move(&zspage->lru, &pool->lru);
+	spin_unlock(&pool->lru_lock);
+}
+
+/* Caller should hold class->lock */
+static void zs_lru_del(struct zs_pool *pool, struct zspage *zspage)
+{
+	if (list_empty(&zspage->lru))
+		return;
+
+	spin_lock(&pool->lru_lock);
+	list_del_init(&zspage->lru);
+	spin_unlock(&pool->lru_lock);
+}
+#else
+static inline void zs_lru_move_head(struct zs_pool *pool,
+				struct zspage *zspage) {}
+static inline void zs_lru_del(struct zs_pool *pool, struct zspage *zspage) {}
+#endif
+
 static void __free_zspage(struct zs_pool *pool, struct size_class *class,
 				struct zspage *zspage)
 {
@@ -993,6 +1151,8 @@ static void __free_zspage(struct zs_pool *pool, struct size_class *class,
 	VM_BUG_ON(get_zspage_inuse(zspage));
 	VM_BUG_ON(fg != ZS_EMPTY);
 
+	zs_lru_del(pool, zspage);
+
 	next = page = get_first_page(zspage);
 	do {
 		VM_BUG_ON_PAGE(!PageLocked(page), page);
@@ -1123,6 +1283,9 @@ static struct zspage *alloc_zspage(struct zs_pool *pool,
 	memset(zspage, 0, sizeof(struct zspage));
 	zspage->magic = ZSPAGE_MAGIC;
 	migrate_lock_init(zspage);
+#ifdef CONFIG_ZPOOL
+	INIT_LIST_HEAD(&zspage->lru);
+#endif
 
 	for (i = 0; i < class->pages_per_zspage; i++) {
 		struct page *page;
@@ -1373,6 +1536,24 @@ unsigned long zs_get_total_pages(struct zs_pool *pool)
 }
 EXPORT_SYMBOL_GPL(zs_get_total_pages);
 
+/**
+ * zs_lookup_class_index - get index of the size class for a given size.
+ * @pool: pool the object would be allocated from
+ * @size: object size
+ *
+ * Sizes which map to the same index share a size class, so an object
+ * only takes less memory when its new size maps to a smaller index.
+ */
+unsigned int zs_lookup_class_index(struct zs_pool *pool, unsigned int size)
+{
+	struct size_class *class;
+
+	class = pool->size_class[get_size_class_index(size)];
+
+	return class->index;
+}
+EXPORT_SYMBOL_GPL(zs_lookup_class_index);
+
 /**
  * zs_map_object - get address of allocated object from handle.
  * @pool: pool from which the object was allocated
@@ -1561,6 +1742,7 @@ unsigned long zs_malloc(struct zs_pool *pool, size_t size, gfp_t gfp)
 		/* Now move the zspage to another fullness group, if required */
 		fix_fullness_group(class, zspage);
 		record_obj(handle, obj);
+		zs_lru_move_head(pool, zspage);
 		spin_unlock(&class->lock);
 
 		return handle;
@@ -1580,6 +1762,7 @@ unsigned long zs_malloc(struct zs_pool *pool, size_t size, gfp_t gfp)
 	insert_zspage(class, zspage, newfg);
 	set_zspage_mapping(zspage, class->index, newfg);
 	record_obj(handle, obj);
+	zs_lru_move_head(pool, zspage);
 	atomic_long_add(class->pages_per_zspage,
 				&pool->pages_allocated);
 	zs_stat_inc(class, OBJ_ALLOCATED, class->objs_per_zspage);
@@ -1617,6 +1800,35 @@ static void obj_free(struct size_class *class, unsigned long obj)
 	zs_stat_dec(class, OBJ_USED, 1);
 }
 
+/*
+ * Mark the object at @obj as freed without releasing it, see
+ * OBJ_DEFERRED_TAG. Caller should hold class->lock.
+ */
+static void obj_defer_free(struct size_class *class, unsigned long obj)
+{
+	struct page *f_page;
+	unsigned long f_offset;
+	unsigned int f_objidx;
+	unsigned long *head;
+	void *vaddr;
+
+	obj_to_location(obj, &f_page, &f_objidx);
+
+	if (unlikely(PageHugeObject(f_page))) {
+		f_page->index |= OBJ_DEFERRED_TAG;
+		return;
+	}
+
+	f_offset = (class->size * f_objidx) & ~PAGE_MASK;
+	vaddr = kmap_atomic(f_page);
+	head = (unsigned long *)(vaddr + f_offset);
+	*head |= OBJ_DEFERRED_TAG;
+	kunmap_atomic(vaddr);
+}
+
+static bool zs_class_fragmented(struct size_class *class);
+static void zs_schedule_compaction(struct zs_pool *pool);
+
 void zs_free(struct zs_pool *pool, unsigned long handle)
 {
 	struct zspage *zspage;
@@ -1627,6 +1839,7 @@ void zs_free(struct zs_pool *pool, unsigned long handle)
 	struct size_class *class;
 	enum fullness_group fullness;
 	bool isolated;
+	bool fragmented;
 
 	if (unlikely(!handle))
 		return;
@@ -1642,6 +1855,15 @@ void zs_free(struct zs_pool *pool, unsigned long handle)
 	class = pool->size_class[class_idx];
 
 	spin_lock(&class->lock);
+	if (unlikely(zspage->under_reclaim)) {
+		/* zs_reclaim_page() frees the object and the handle */
+		obj_defer_free(class, obj);
+		migrate_read_unlock(zspage);
+		spin_unlock(&class->lock);
+		unpin_tag(handle);
+		return;
+	}
+
 	obj_free(class, obj);
 	fullness = fix_fullness_group(class, zspage);
 	if (fullness != ZS_EMPTY) {
@@ -1655,10 +1877,13 @@ void zs_free(struct zs_pool *pool, unsigned long handle)
 	if (likely(!isolated))
 		free_zspage(pool, class, zspage);
 out:
-
+	fragmented = zs_class_fragmented(class);
 	spin_unlock(&class->lock);
 	unpin_tag(handle);
 	cache_free_handle(pool, handle);
+
+	if (fragmented)
+		zs_schedule_compaction(pool);
 }
 EXPORT_SYMBOL_GPL(zs_free);
 
@@ -2331,6 +2556,245 @@ unsigned long zs_compact(struct zs_pool *pool)
 }
 EXPORT_SYMBOL_GPL(zs_compact);
 
+#ifdef CONFIG_ZPOOL
+/*
+ * Take the least recently allocated-from zspage off the LRU and the
+ * fullness lists and mark it under reclaim. Returns with class->lock of
+ * the zspage held, or NULL if nothing can be reclaimed.
+ */
+static struct zspage *zs_lru_isolate(struct zs_pool *pool,
+				     struct size_class **pclass)
+{
+	struct size_class *class;
+	struct zspage *zspage;
+	enum fullness_group fg;
+	unsigned int class_idx;
+
+	spin_lock(&pool->lru_lock);
+	list_for_each_entry_reverse(zspage, &pool->lru, lru) {
+		get_zspage_mapping(zspage, &class_idx, &fg);
+		class = pool->size_class[class_idx];
+
+		/* lru_lock nests inside class->lock elsewhere */
+		if (!spin_trylock(&class->lock))
+			continue;
+
+		/*
+		 * Skip zspages waiting for deferred free and ones isolated
+		 * by compaction or page migration.
+		 */
+		if (!get_zspage_inuse(zspage) || list_empty(&zspage->list) ||
+		    is_zspage_isolated(zspage)) {
+			spin_unlock(&class->lock);
+			continue;
+		}
+
+		get_zspage_mapping(zspage, &class_idx, &fg);
+		remove_zspage(class, zspage, fg);
+		list_del_init(&zspage->lru);
+		zspage->under_reclaim = 1;
+		spin_unlock(&pool->lru_lock);
+
+		*pclass = class;
+		return zspage;
+	}
+	spin_unlock(&pool->lru_lock);
+
+	return NULL;
+}
+
+/*
+ * Return the handle of the first live object at or after <*page,
+ * *obj_idx> in a zspage under reclaim, advancing both, or 0 once the
+ * zspage has been walked. Caller should hold class->lock.
+ */
+static unsigned long find_evictable_obj(struct size_class *class,
+					struct page **page, int *obj_idx)
+{
+	unsigned long head;
+	int offset;
+	void *addr;
+
+	while (*page) {
+		addr = kmap_atomic(*page);
+		offset = get_first_obj_offset(*page) + class->size * *obj_idx;
+
+		while (offset < PAGE_SIZE) {
+			head = obj_to_head(*page, addr + offset);
+			if ((head & OBJ_ALLOCATED_TAG) &&
+			    !(head & OBJ_DEFERRED_TAG)) {
+				kunmap_atomic(addr);
+				return head & ~OBJ_ALLOCATED_TAG;
+			}
+			offset += class->size;
+			(*obj_idx)++;
+		}
+
+		kunmap_atomic(addr);
+		*page = get_next_page(*page);
+		*obj_idx = 0;
+	}
+
+	return 0;
+}
+
+/* Release objects zs_free()d while their zspage was under reclaim */
+static void free_deferred_objs(struct zs_pool *pool,
+			       struct size_class *class, struct zspage *zspage)
+{
+	struct page *page = get_first_page(zspage);
+	unsigned long head, handle;
+	int offset;
+	void *addr;
+
+	do {
+		addr = kmap_atomic(page);
+		offset = get_first_obj_offset(page);
+
+		while (offset < PAGE_SIZE) {
+			head = obj_to_head(page, addr + offset);
+			if ((head & OBJ_ALLOCATED_TAG) &&
+			    (head & OBJ_DEFERRED_TAG)) {
+				handle = head & ~(OBJ_ALLOCATED_TAG |
+						  OBJ_DEFERRED_TAG);
+				if (unlikely(PageHugeObject(page)))
+					page->index &= ~OBJ_DEFERRED_TAG;
+				/* obj_free() maps the page itself */
+				kunmap_atomic(addr);
+				obj_free(class, handle_to_obj(handle));
+				cache_free_handle(pool, handle);
+				addr = kmap_atomic(page);
+			}
+			offset += class->size;
+		}
+
+		kunmap_atomic(addr);
+	} while ((page = get_next_page(page)) != NULL);
+}
+
+/*
+ * Write back every object of the least recently used zspage through the
+ * zpool evict callback and free the zspage. Objects the callback frees
+ * are only marked (OBJ_DEFERRED_TAG) so their handles stay valid until
+ * the whole zspage has been walked. Returns 0 if a zspage was freed.
+ */
+static int zs_reclaim_page(struct zs_pool *pool, unsigned int retries)
+{
+	struct size_class *class;
+	struct zspage *zspage;
+	struct page *page;
+	unsigned long handle;
+	int obj_idx, ret = -EINVAL;
+	unsigned int i;
+
+	if (!pool->zpool_ops)
+		return -EINVAL;
+
+	for (i = 0; i < retries; i++) {
+		zspage = zs_lru_isolate(pool, &class);
+		if (!zspage)
+			return -EINVAL;
+
+		page = get_first_page(zspage);
+		obj_idx = 0;
+		while ((handle = find_evictable_obj(class, &page, &obj_idx))) {
+			spin_unlock(&class->lock);
+			ret = pool->zpool_ops->evict(pool->zpool, handle);
+			spin_lock(&class->lock);
+			if (ret)
+				break;
+			obj_idx++;
+		}
+
+		free_deferred_objs(pool, class, zspage);
+		zspage->under_reclaim = 0;
+		if (putback_zspage(class, zspage) == ZS_EMPTY) {
+			free_zspage(pool, class, zspage);
+			spin_unlock(&class->lock);
+			return 0;
+		}
+
+		/* Some objects could not be written back, try it later */
+		zs_lru_move_head(pool, zspage);
+		spin_unlock(&class->lock);
+		cond_resched();
+	}
+
+	return -EAGAIN;
+}
+#endif /* CONFIG_ZPOOL */
+
+/*
+ * Caller should hold class->lock. Returns true if at least one zspage
+ * could be freed and the wasted objects exceed compact_frag_threshold
+ * percent of the allocated ones.
+ */
+static bool zs_class_fragmented(struct size_class *class)
+{
+	unsigned int threshold = READ_ONCE(compact_frag_threshold);
+	unsigned long obj_allocated, obj_used;
+
+	if (!threshold || !zs_can_compact(class))
+		return false;
+
+	obj_allocated = zs_stat_get(class, OBJ_ALLOCATED);
+	obj_used = zs_stat_get(class, OBJ_USED);
+
+	return (obj_allocated - obj_used) * 100 >= obj_allocated * threshold;
+}
+
+static void zs_schedule_compaction(struct zs_pool *pool)
+{
+	unsigned long next = READ_ONCE(pool->compact_next);
+	unsigned long delay = 0;
+
+	if (delayed_work_pending(&pool->compact_work))
+		return;
+
+	if (time_before(jiffies, next))
+		delay = next - jiffies;
+
+	queue_delayed_work(system_unbound_wq, &pool->compact_work, delay);
+}
+
+static void zs_compact_work_fn(struct work_struct *work)
+{
+	struct zs_pool *pool = container_of(to_delayed_work(work),
+					struct zs_pool, compact_work);
+	unsigned int budget = clamp_val(READ_ONCE(compact_cpu_budget), 1, 100);
+	struct size_class *class;
+	bool fragmented;
+	u64 start, spent;
+	int i;
+
+	/* Kicked while the previous pass was still running */
+	if (time_before(jiffies, pool->compact_next)) {
+		queue_delayed_work(system_unbound_wq, &pool->compact_work,
+				   pool->compact_next - jiffies);
+		return;
+	}
+
+	start = local_clock();
+	for (i = zs_size_classes - 1; i >= 0; i--) {
+		class = pool->size_class[i];
+		if (!class)
+			continue;
+		if (class->index != i)
+			continue;
+
+		spin_lock(&class->lock);
+		fragmented = zs_class_fragmented(class);
+		spin_unlock(&class->lock);
+
+		if (fragmented)
+			__zs_compact(pool, class);
+	}
+	spent = local_clock() - start;
+
+	WRITE_ONCE(pool->compact_next, jiffies +
+		   nsecs_to_jiffies(div_u64(spent * (100 - budget), budget)));
+}
+
 void zs_pool_stats(struct zs_pool *pool, struct zs_pool_stats *stats)
 {
 	memcpy(stats, &pool->stats, sizeof(struct zs_pool_stats));
@@ -2416,6 +2880,11 @@ struct zs_pool *zs_create_pool(const char *name)
 		return NULL;
 
 	init_deferred_free(pool);
+	INIT_DELAYED_WORK(&pool->compact_work, zs_compact_work_fn);
+#ifdef CONFIG_ZPOOL
+	INIT_LIST_HEAD(&pool->lru);
+	spin_lock_init(&pool->lru_lock);
+#endif
 	pool->size_class = kcalloc(zs_size_classes, sizeof(struct size_class *),
 			GFP_KERNEL);
 	if (!pool->size_class) {
@@ -2505,6 +2974,7 @@ void zs_destroy_pool(struct zs_pool *pool)
 	int i;
 
 	zs_unregister_shrinker(pool);
+	cancel_delayed_work_sync(&pool->compact_work);
 	zs_unregister_migration(pool);
 	zs_pool_stat_destroy(pool);
 
@@ -0,0 +1,181 @@
+/*
+ * Victim selection over the oom_score_adj buckets of the Android low
+ * memory killer.
+ *
+ * A zombie keeps its bucket until it is reaped but has no mm left, so it
+ * is never eligible. With a zombie alone at oom_score_adj 1000:
+ *
+ *  1. and only adj 1000 allowed to be killed, a scan must come back
+ *     empty instead of looping over that bucket;
+ *  2. and a live task at adj 999 allowed to be killed as well, the scan
+ *     must go past the zombie bucket and kill that task.
+ *
+ * The scan is triggered through drop_caches, with minfree raised so that
+ * the killer always considers memory low. Other tasks of the system at
+ * adj 999 or 1000 can be killed too, so only run this on a test device.
+ *
+ * Needs root and CONFIG_ANDROID_LOW_MEMORY_KILLER.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define LMK_PARAMS	"/sys/module/lowmemorykiller/parameters/"
+#define TIMEOUT		10
+
+static char saved_adj[256], saved_minfree[256];
+
+static int read_file(const char *path, char *buf, size_t size)
+{
+	ssize_t len;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	len = read(fd, buf, size - 1);
+	close(fd);
+	if (len < 0)
+		return -1;
+	buf[len] = '\0';
+	return 0;
+}
+
+static int write_file(const char *path, const char *val)
+{
+	ssize_t len = strlen(val);
+	int fd;
+
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return -1;
+	if (write(fd, val, len) != len) {
+		close(fd);
+		return -1;
+	}
+	return close(fd);
+}
+
+static void restore_params(void)
+{
+	write_file(LMK_PARAMS "adj", saved_adj);
+	write_file(LMK_PARAMS "minfree", saved_minfree);
+}
+
+static pid_t spawn(const char *adj, int zombie)
+{
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		exit(1);
+	}
+	if (pid)
+		return pid;
+
+	if (write_file("/proc/self/oom_score_adj", adj))
+		_exit(2);
+	if (zombie)
+		_exit(0);
+
+	/* Give the killer something to free */
+	memset(mmap(NULL, 16 << 20, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0), 1,
+	       16 << 20);
+	for (;;)
+		pause();
+}
+
+/*
+ * Run a shrinker pass from a child so that a scan that never returns
+ * is reported rather than hanging the test.
+ */
+static int shrink(void)
+{
+	int status, i;
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0)
+		return -1;
+	if (!pid)
+		_exit(write_file("/proc/sys/vm/drop_caches", "2") ? 1 : 0);
+
+	for (i = 0; i < TIMEOUT * 10; i++) {
+		if (waitpid(pid, &status, WNOHANG) == pid)
+			return WIFEXITED(status) && !WEXITSTATUS(status) ? 0 : -1;
+		usleep(100000);
+	}
+	fprintf(stderr, "drop_caches did not return in %d s\n", TIMEOUT);
+	return -1;
+}
+
+static int killed(pid_t pid)
+{
+	int status, i;
+
+	for (i = 0; i < TIMEOUT * 10; i++) {
+		if (waitpid(pid, &status, WNOHANG) == pid)
+			return WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL;
+		usleep(100000);
+	}
+	return 0;
+}
+
+int main(void)
+{
+	siginfo_t info;
+	pid_t zombie, victim;
+	int ret = 1;
+
+	if (read_file(LMK_PARAMS "adj", saved_adj, sizeof(saved_adj)) ||
+	    read_file(LMK_PARAMS "minfree", saved_minfree,
+		      sizeof(saved_minfree))) {
+		printf("lowmemorykiller not available, skipping\n");
+		return 0;
+	}
+
+	zombie = spawn("1000", 1);
+	if (waitid(P_PID, zombie, &info, WEXITED | WNOWAIT)) {
+		perror("waitid");
+		return 1;
+	}
+
+	if (write_file(LMK_PARAMS "adj", "1000") ||
+	    write_file(LMK_PARAMS "minfree", "2147483647")) {
+		perror("lowmemorykiller parameters");
+		goto out;
+	}
+
+	if (shrink()) {
+		printf("[FAIL]\tscan with only an ineligible task in the top bucket\n");
+		goto out;
+	}
+	printf("[PASS]\tscan with only an ineligible task in the top bucket\n");
+
+	victim = spawn("999", 0);
+	/* Let it set its oom_score_adj and fault its memory in */
+	sleep(1);
+	if (write_file(LMK_PARAMS "adj", "999") || shrink() ||
+	    !killed(victim)) {
+		kill(victim, SIGKILL);
+		waitpid(victim, NULL, 0);
+		printf("[FAIL]\tscan past an ineligible top bucket\n");
+		goto out;
+	}
+	printf("[PASS]\tscan past an ineligible top bucket\n");
+	ret = 0;
+out:
+	restore_params();
+	waitpid(zombie, NULL, 0);
+	return ret;
+}
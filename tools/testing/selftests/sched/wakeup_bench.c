@@ -0,0 +1,165 @@
+/*
+ * Wakeup path microbenchmark.
+ *
+ * Pairs of unpinned threads ping-pong a byte over two pipes, so that every
+ * round trip is two blocking wakeups going through select_task_rq(). With
+ * energy aware scheduling, that is where the energy of the candidate CPUs
+ * gets estimated, and the cost of that estimation shows up directly in the
+ * round trip time.
+ *
+ * With -e, the run is repeated with the ENERGY_MODEL scheduler feature set
+ * and cleared, to compare the energy model based estimation against the
+ * sched_group walk. This needs debugfs mounted on /sys/kernel/debug and
+ * CONFIG_SCHED_DEBUG.
+ *
+ * usage: wakeup_bench [-p pairs] [-d seconds] [-e]
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+#include <pthread.h>
+#include <time.h>
+
+#define SCHED_FEATURES	"/sys/kernel/debug/sched_features"
+
+static unsigned int duration = 5;
+static volatile int stop;
+
+struct pair {
+	pthread_t ping, pong;
+	int to_pong[2];
+	int to_ping[2];
+	unsigned long loops;
+};
+
+static void *ping_fn(void *arg)
+{
+	struct pair *p = arg;
+	char c = 0;
+
+	while (!stop) {
+		if (write(p->to_pong[1], &c, 1) != 1)
+			err(2, "write");
+		if (read(p->to_ping[0], &c, 1) != 1)
+			err(2, "read");
+		p->loops++;
+	}
+	/* Let the other side go */
+	close(p->to_pong[1]);
+	return NULL;
+}
+
+static void *pong_fn(void *arg)
+{
+	struct pair *p = arg;
+	char c;
+
+	while (read(p->to_pong[0], &c, 1) == 1)
+		if (write(p->to_ping[1], &c, 1) != 1)
+			err(2, "write");
+	return NULL;
+}
+
+static int set_feature(const char *feat)
+{
+	FILE *f;
+	int ret;
+
+	f = fopen(SCHED_FEATURES, "w");
+	if (!f)
+		return -1;
+	ret = fputs(feat, f) < 0 ? -1 : 0;
+	if (fclose(f))
+		ret = -1;
+	return ret;
+}
+
+static void run(int nr_pairs, const char *label)
+{
+	struct timespec start, end;
+	unsigned long total = 0;
+	struct pair *pairs;
+	double ns;
+	int i;
+
+	pairs = calloc(nr_pairs, sizeof(*pairs));
+	if (!pairs)
+		err(2, "calloc");
+
+	stop = 0;
+	for (i = 0; i < nr_pairs; i++) {
+		if (pipe(pairs[i].to_pong) || pipe(pairs[i].to_ping))
+			err(2, "pipe");
+		if (pthread_create(&pairs[i].pong, NULL, pong_fn, &pairs[i]) ||
+		    pthread_create(&pairs[i].ping, NULL, ping_fn, &pairs[i]))
+			errx(2, "pthread_create");
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	sleep(duration);
+	stop = 1;
+
+	for (i = 0; i < nr_pairs; i++) {
+		pthread_join(pairs[i].ping, NULL);
+		pthread_join(pairs[i].pong, NULL);
+		close(pairs[i].to_pong[0]);
+		close(pairs[i].to_ping[0]);
+		close(pairs[i].to_ping[1]);
+		total += pairs[i].loops;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+
+	printf("%-18s wakeups/s: %10.0f  round trip: %8.2f us\n", label,
+	       2 * total / (ns / 1e9),
+	       total ? ns * nr_pairs / total / 1000 : 0);
+
+	free(pairs);
+}
+
+int main(int argc, char **argv)
+{
+	int nr_pairs = 1, compare = 0, opt;
+
+	while ((opt = getopt(argc, argv, "p:d:eh")) != -1) {
+		switch (opt) {
+		case 'p':
+			nr_pairs = atoi(optarg);
+			break;
+		case 'd':
+			duration = atoi(optarg);
+			break;
+		case 'e':
+			compare = 1;
+			break;
+		default:
+			errx(1, "usage: %s [-p pairs] [-d seconds] [-e]",
+			     argv[0]);
+		}
+	}
+	if (nr_pairs < 1 || !duration)
+		errx(1, "invalid arguments");
+
+	printf("pairs %d, %u s\n", nr_pairs, duration);
+
+	if (!compare) {
+		run(nr_pairs, "wakeup");
+		return 0;
+	}
+
+	if (set_feature("ENERGY_MODEL"))
+		err(1, "cannot set ENERGY_MODEL in " SCHED_FEATURES);
+	run(nr_pairs, "ENERGY_MODEL");
+
+	if (set_feature("NO_ENERGY_MODEL"))
+		err(1, "cannot set NO_ENERGY_MODEL in " SCHED_FEATURES);
+	run(nr_pairs, "NO_ENERGY_MODEL");
+
+	set_feature("ENERGY_MODEL");
+	return 0;
+}
@@ -0,0 +1,180 @@
+/*
+ * Multi-threaded anonymous page fault benchmark.
+ *
+ * Every worker thread repeatedly write-faults its own anonymous region
+ * and zaps it again with MADV_DONTNEED, which keeps the page tables in
+ * place. Meanwhile an optional churn thread keeps mapping and unmapping
+ * an unrelated area, taking the mmap_sem for write on every iteration.
+ * Without speculative page faults the workers serialize behind it.
+ *
+ * Reports the aggregate fault rate, and the speculative_pgfault and
+ * speculative_pgfault_abort deltas from /proc/vmstat when the kernel
+ * has CONFIG_SPECULATIVE_PAGE_FAULT.
+ *
+ * usage: spf_bench [-t threads] [-s MiB per thread] [-d seconds] [-n]
+ *	-n	do not run the mmap/munmap churn thread
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#ifndef MADV_NOHUGEPAGE
+#define MADV_NOHUGEPAGE	15
+#endif
+
+static size_t region_size = 64UL << 20;
+static unsigned int duration = 5;
+static volatile int stop;
+static long page_size;
+
+struct worker {
+	pthread_t thread;
+	unsigned long faults;
+};
+
+static int read_vmstat(const char *name, unsigned long *val)
+{
+	char key[64];
+	unsigned long v;
+	int found = 0;
+	FILE *f;
+
+	f = fopen("/proc/vmstat", "r");
+	if (!f)
+		return 0;
+	while (fscanf(f, "%63s %lu", key, &v) == 2) {
+		if (!strcmp(key, name)) {
+			*val = v;
+			found = 1;
+			break;
+		}
+	}
+	fclose(f);
+	return found;
+}
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	char *p;
+	size_t off;
+
+	p = mmap(NULL, region_size, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		err(2, "mmap");
+
+	/* Huge pmds take the regular fault path, measure pte faults only */
+	madvise(p, region_size, MADV_NOHUGEPAGE);
+
+	while (!stop) {
+		for (off = 0; off < region_size && !stop; off += page_size) {
+			p[off] = 1;
+			w->faults++;
+		}
+		if (madvise(p, region_size, MADV_DONTNEED))
+			err(2, "MADV_DONTNEED");
+	}
+
+	munmap(p, region_size);
+	return NULL;
+}
+
+static void *churn_fn(void *arg)
+{
+	unsigned long *loops = arg;
+	void *p;
+
+	while (!stop) {
+		p = mmap(NULL, page_size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			err(2, "mmap churn");
+		munmap(p, page_size);
+		(*loops)++;
+	}
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long spf_start = 0, spf_end = 0, abort_start = 0, abort_end = 0;
+	unsigned long total = 0, churn_loops = 0;
+	int nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	int churn = 1, have_spf, opt, i;
+	struct worker *workers;
+	pthread_t churn_thread;
+
+	page_size = sysconf(_SC_PAGESIZE);
+
+	while ((opt = getopt(argc, argv, "t:s:d:nh")) != -1) {
+		switch (opt) {
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 's':
+			region_size = (size_t)atol(optarg) << 20;
+			break;
+		case 'd':
+			duration = atoi(optarg);
+			break;
+		case 'n':
+			churn = 0;
+			break;
+		default:
+			errx(1, "usage: %s [-t threads] [-s MiB] [-d seconds] [-n]",
+			     argv[0]);
+		}
+	}
+	if (nr_threads < 1 || !region_size || !duration)
+		errx(1, "invalid arguments");
+
+	workers = calloc(nr_threads, sizeof(*workers));
+	if (!workers)
+		err(2, "calloc");
+
+	have_spf = read_vmstat("speculative_pgfault", &spf_start) &&
+		   read_vmstat("speculative_pgfault_abort", &abort_start);
+
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_create(&workers[i].thread, NULL, worker_fn,
+				   &workers[i]))
+			errx(2, "pthread_create");
+	if (churn && pthread_create(&churn_thread, NULL, churn_fn,
+				    &churn_loops))
+		errx(2, "pthread_create");
+
+	sleep(duration);
+	stop = 1;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		total += workers[i].faults;
+	}
+	if (churn)
+		pthread_join(churn_thread, NULL);
+
+	printf("threads %d, %zu MiB each, %u s%s\n", nr_threads,
+	       region_size >> 20, duration, churn ? ", mmap churn" : "");
+	printf("faults/s:        %lu\n", total / duration);
+	if (churn)
+		printf("churn loops/s:   %lu\n", churn_loops / duration);
+
+	if (have_spf) {
+		read_vmstat("speculative_pgfault", &spf_end);
+		read_vmstat("speculative_pgfault_abort", &abort_end);
+		printf("speculative:     %lu\n", spf_end - spf_start);
+		printf("aborted:         %lu\n", abort_end - abort_start);
+	} else {
+		printf("speculative page faults not available\n");
+	}
+
+	free(workers);
+	return 0;
+}
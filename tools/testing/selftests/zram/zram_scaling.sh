@@ -0,0 +1,105 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# zram compression scaling benchmark.
+#
+# Hot-adds a zram device and measures write throughput with 1..N parallel
+# writers, N being the number of online CPUs (or $MAX_JOBS). Each writer
+# owns a disjoint region of the device, so the numbers reflect how well
+# the per-CPU compression streams and per-slot locks scale rather than
+# contention on the same table entries.
+#
+# Uses fio when it is installed, falls back to parallel dd otherwise.
+# Run as root:
+#
+#	./zram_scaling.sh [disksize_mb] [comp_algorithm]
+
+DISKSIZE_MB=${1:-1024}
+ALGO=${2:-lzo}
+MAX_JOBS=${MAX_JOBS:-$(getconf _NPROCESSORS_ONLN)}
+CONTROL=/sys/class/zram-control
+
+# Kselftest framework requirement - SKIP code is 4.
+ksft_skip=4
+
+if [ "$(id -u)" -ne 0 ]; then
+	echo "zram_scaling: must be run as root [SKIP]"
+	exit $ksft_skip
+fi
+
+if [ ! -d "$CONTROL" ]; then
+	modprobe zram num_devices=0 > /dev/null 2>&1
+	if [ ! -d "$CONTROL" ]; then
+		echo "zram_scaling: zram module not available [SKIP]"
+		exit $ksft_skip
+	fi
+fi
+
+dev_id=$(cat $CONTROL/hot_add)
+dev=/dev/zram$dev_id
+sysfs=/sys/block/zram$dev_id
+
+cleanup()
+{
+	echo 1 > $sysfs/reset
+	echo $dev_id > $CONTROL/hot_remove
+}
+trap cleanup EXIT
+
+echo $ALGO > $sysfs/comp_algorithm || exit 1
+echo ${DISKSIZE_MB}M > $sysfs/disksize || exit 1
+
+run_fio()
+{
+	local jobs=$1
+	local size=$((DISKSIZE_MB / jobs))
+
+	fio --name=zram --filename=$dev --rw=write --bs=4k --direct=1 \
+	    --ioengine=psync --numjobs=$jobs --size=${size}M \
+	    --offset_increment=${size}M --buffer_compress_percentage=50 \
+	    --refill_buffers --group_reporting --minimal | \
+		awk -F';' '{ printf "%d\n", $48 / 1024 }'
+}
+
+run_dd()
+{
+	local jobs=$1
+	local count=$((DISKSIZE_MB * 256 / jobs))
+	local start end i
+
+	start=$(date +%s%N)
+	for i in $(seq 0 $((jobs - 1))); do
+		dd if=/dev/urandom bs=4k count=$count 2>/dev/null | \
+			base64 | \
+			dd of=$dev bs=4k count=$count seek=$((i * count)) \
+			   oflag=direct iflag=fullblock 2>/dev/null &
+	done
+	wait
+	end=$(date +%s%N)
+
+	echo $((DISKSIZE_MB * 1000000000 / (end - start)))
+}
+
+if command -v fio > /dev/null 2>&1; then
+	runner=run_fio
+else
+	runner=run_dd
+	echo "fio not found, falling back to dd (includes base64 cost)"
+fi
+
+printf "%-6s %12s\n" "jobs" "write MB/s"
+jobs=1
+while [ $jobs -le $MAX_JOBS ]; do
+	# Start every run from an empty device.
+	echo 1 > $sysfs/reset
+	echo $ALGO > $sysfs/comp_algorithm
+	echo ${DISKSIZE_MB}M > $sysfs/disksize
+
+	printf "%-6d %12s\n" $jobs "$($runner $jobs)"
+	jobs=$((jobs * 2))
+	if [ $jobs -gt $MAX_JOBS ] && [ $((jobs / 2)) -lt $MAX_JOBS ]; then
+		jobs=$MAX_JOBS
+	fi
+done
+
+exit 0